@@ -0,0 +1,15892 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__) || defined(__SSE4_2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define CROW_PARSER_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Delimiter searches for the SIMD parser backend and the JSON string index. Each one takes the widest instructions the
+// compiler is allowed to use (-mavx2, -msse4.2, SSE2 on x86-64) and finishes byte by byte.
+namespace crow
+{
+    namespace detail
+    {
+        inline unsigned count_trailing_zeros(uint32_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, x);
+            return index;
+#else
+            return __builtin_ctz(x);
+#endif
+        }
+
+        inline unsigned count_trailing_zeros(uint64_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, x);
+            return index;
+#else
+            return __builtin_ctzll(x);
+#endif
+        }
+
+        // RFC 7230 tchar; the same set as http_parser's `tokens' without the space it lets through
+        inline bool is_token_char(char c)
+        {
+            static const uint32_t bits[8] = {
+                0x00000000, 0x03ff6cfa, 0xc7fffffe, 0x57ffffff,
+                0x00000000, 0x00000000, 0x00000000, 0x00000000,
+            };
+            unsigned char u = static_cast<unsigned char>(c);
+            return (bits[u >> 5] >> (u & 31)) & 1;
+        }
+
+        // The first CR or LF in [p, end), end if there is none
+        inline const char* find_crlf(const char* p, const char* end)
+        {
+#if defined(__AVX2__)
+            const __m256i cr = _mm256_set1_epi8('\r');
+            const __m256i lf = _mm256_set1_epi8('\n');
+            for(; end - p >= 32; p += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+#ifdef CROW_PARSER_SSE2
+            const __m128i cr16 = _mm_set1_epi8('\r');
+            const __m128i lf16 = _mm_set1_epi8('\n');
+            for(; end - p >= 16; p += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr16), _mm_cmpeq_epi8(v, lf16)));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (*p == '\r' || *p == '\n')
+                    return p;
+            }
+            return end;
+        }
+
+        // The first byte of [p, end) that is not printable ASCII (0x21-0x7e), end if there is none.
+        // A request target ends at the first space, and anything else below 0x21 or above 0x7e
+        // is left to http_parser.
+        inline const char* find_non_printable(const char* p, const char* end)
+        {
+#if defined(__AVX2__)
+            // bytes above 0x7f are negative as signed chars, and so fail the first comparison
+            const __m256i low = _mm256_set1_epi8(0x20);
+            const __m256i high = _mm256_set1_epi8(0x7f);
+            for(; end - p >= 32; p += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+                uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+#ifdef CROW_PARSER_SSE2
+            const __m128i low16 = _mm_set1_epi8(0x20);
+            const __m128i high16 = _mm_set1_epi8(0x7f);
+            for(; end - p >= 16; p += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, low16), _mm_cmpgt_epi8(high16, v));
+                uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(ok)) & 0xffff;
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (static_cast<unsigned char>(*p) <= 0x20 || static_cast<unsigned char>(*p) >= 0x7f)
+                    return p;
+            }
+            return end;
+        }
+
+        // The first byte of [p, end) that cannot be part of a header name (normally the colon),
+        // end if there is none
+        inline const char* find_non_token(const char* p, const char* end)
+        {
+#if defined(__SSE4_2__)
+            // eight ranges covering every non-token byte; the last one also takes in `|' and `~',
+            // which are checked one by one
+            static const char ranges[16] = {
+                '\x00', ' ', '"', '"', '(', ')', ',', ',',
+                '/', '/', ':', '@', '[', ']', '{', '\xff',
+            };
+            const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+            while(end - p >= 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                int index = _mm_cmpestri(r, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+                if (index == 16)
+                {
+                    p += 16;
+                    continue;
+                }
+                p += index;
+                if (!is_token_char(*p))
+                    return p;
+                p ++;
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (!is_token_char(*p))
+                    return p;
+            }
+            return end;
+        }
+
+#ifdef CROW_PARSER_SSE2
+        // Bit masks of the quotes, backslashes and NULs among the 64 bytes at p
+        inline void classify_json_block(const char* p, uint64_t& quotes, uint64_t& backslashes, uint64_t& zeros)
+        {
+#if defined(__AVX2__)
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            auto mask = [&](const __m256i& c)
+            {
+                return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c))) |
+                    static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c)))) << 32;
+            };
+#else
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i zero = _mm_setzero_si128();
+            __m128i v[4];
+            for(int i = 0; i < 4; i ++)
+                v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            auto mask = [&](const __m128i& c)
+            {
+                uint64_t ret = 0;
+                for(int i = 0; i < 4; i ++)
+                    ret |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], c)))) << (16 * i);
+                return ret;
+            };
+#endif
+            quotes = mask(quote);
+            backslashes = mask(backslash);
+            zeros = mask(zero);
+        }
+#endif
+    }
+}
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace crow
+{
+    namespace detail
+    {
+        // Memory for the asio operations of one connection. A connection has at most a read
+        // and a write in flight, so two blocks that live as long as the connection serve every
+        // operation after the first; anything that does not fit goes to operator new.
+        class handler_arena
+        {
+        public:
+            handler_arena() = default;
+            handler_arena(const handler_arena&) = delete;
+            handler_arena& operator = (const handler_arena&) = delete;
+
+            void* allocate(std::size_t size)
+            {
+                for(auto& b : blocks_)
+                {
+                    if (!b.in_use && size <= sizeof(b.storage))
+                    {
+                        b.in_use = true;
+                        return &b.storage;
+                    }
+                }
+                return ::operator new(size);
+            }
+
+            void deallocate(void* p)
+            {
+                for(auto& b : blocks_)
+                {
+                    if (p == &b.storage)
+                    {
+                        b.in_use = false;
+                        return;
+                    }
+                }
+                ::operator delete(p);
+            }
+
+        private:
+            struct block
+            {
+                typename std::aligned_storage<512>::type storage;
+                bool in_use{};
+            };
+            block blocks_[2];
+        };
+
+        template <typename T>
+        struct handler_arena_allocator
+        {
+            using value_type = T;
+
+            explicit handler_arena_allocator(handler_arena& arena) noexcept
+                : arena(&arena)
+            {
+            }
+
+            template <typename U>
+            handler_arena_allocator(const handler_arena_allocator<U>& other) noexcept
+                : arena(other.arena)
+            {
+            }
+
+            T* allocate(std::size_t n)
+            {
+                return static_cast<T*>(arena->allocate(sizeof(T) * n));
+            }
+
+            void deallocate(T* p, std::size_t)
+            {
+                arena->deallocate(p);
+            }
+
+            template <typename U>
+            bool operator == (const handler_arena_allocator<U>& other) const noexcept
+            {
+                return arena == other.arena;
+            }
+
+            template <typename U>
+            bool operator != (const handler_arena_allocator<U>& other) const noexcept
+            {
+                return arena != other.arena;
+            }
+
+            handler_arena* arena;
+        };
+
+        // A completion handler whose operation is allocated from `arena'; asio finds the
+        // allocator through the nested allocator_type.
+        template <typename Handler>
+        struct arena_handler
+        {
+            using allocator_type = handler_arena_allocator<Handler>;
+
+            allocator_type get_allocator() const noexcept
+            {
+                return allocator_type(*arena);
+            }
+
+            template <typename ... Args>
+            void operator()(Args&& ... args)
+            {
+                handler(std::forward<Args>(args)...);
+            }
+
+            handler_arena* arena;
+            Handler handler;
+        };
+
+        template <typename Handler>
+        arena_handler<typename std::decay<Handler>::type> make_arena_handler(handler_arena& arena, Handler&& handler)
+        {
+            return {&arena, std::forward<Handler>(handler)};
+        }
+    }
+}
+
+
+
+#pragma once
+// settings for crow
+// TODO - replace with runtime config. libucl?
+
+/* #ifdef - enables debug mode */
+//#define CROW_ENABLE_DEBUG
+
+/* #ifdef - enables logging */
+#define CROW_ENABLE_LOGGING
+
+/* #ifdef - enables ssl */
+//#define CROW_ENABLE_SSL
+
+/* #ifdef - parses request heads with SIMD instructions (see parser.h) */
+//#define CROW_ENABLE_SIMD_PARSER
+
+/* #define - specifies log level */
+/*
+    Debug       = 0
+    Info        = 1
+    Warning     = 2
+    Error       = 3
+    Critical    = 4
+
+    default to INFO
+*/
+#ifndef CROW_LOG_LEVEL
+#define CROW_LOG_LEVEL 1
+#endif
+
+
+// compiler flags
+#if __cplusplus >= 201402L
+#define CROW_CAN_USE_CPP14
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CROW_CAN_USE_COROUTINES
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#if _MSC_VER < 1900
+#define CROW_MSVC_WORKAROUND
+#define constexpr const
+#define noexcept throw()
+#endif
+#endif
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <cstring>
+#include <functional>
+#include <string>
+
+
+
+
+namespace crow
+{
+    namespace black_magic
+    {
+#ifndef CROW_MSVC_WORKAROUND
+        struct OutOfRange
+        {
+            OutOfRange(unsigned /*pos*/, unsigned /*length*/) {}
+        };
+        constexpr unsigned requires_in_range( unsigned i, unsigned len )
+        {
+            return i >= len ? throw OutOfRange(i, len) : i;
+        }
+
+        class const_str
+        {
+            const char * const begin_;
+            unsigned size_;
+
+            public:
+            template< unsigned N >
+                constexpr const_str( const char(&arr)[N] ) : begin_(arr), size_(N - 1) {
+                    static_assert( N >= 1, "not a string literal");
+                }
+            constexpr char operator[]( unsigned i ) const { 
+                return requires_in_range(i, size_), begin_[i]; 
+            }
+
+            constexpr operator const char *() const { 
+                return begin_; 
+            }
+
+            constexpr const char* begin() const { return begin_; }
+            constexpr const char* end() const { return begin_ + size_; }
+
+            constexpr unsigned size() const { 
+                return size_; 
+            }
+        };
+
+        constexpr unsigned find_closing_tag(const_str s, unsigned p)
+        {
+            return s[p] == '>' ? p : find_closing_tag(s, p+1);
+        }
+
+        constexpr bool is_valid(const_str s, unsigned i = 0, int f = 0)
+        {
+            return 
+                i == s.size()
+                    ? f == 0 :
+                f < 0 || f >= 2
+                    ? false :
+                s[i] == '<'
+                    ? is_valid(s, i+1, f+1) :
+                s[i] == '>'
+                    ? is_valid(s, i+1, f-1) :
+                is_valid(s, i+1, f);
+        }
+
+        constexpr bool is_equ_p(const char* a, const char* b, unsigned n)
+        {
+            return
+                *a == 0 && *b == 0 && n == 0 
+                    ? true :
+                (*a == 0 || *b == 0)
+                    ? false :
+                n == 0
+                    ? true :
+                *a != *b
+                    ? false :
+                is_equ_p(a+1, b+1, n-1);
+        }
+
+        constexpr bool is_equ_n(const_str a, unsigned ai, const_str b, unsigned bi, unsigned n)
+        {
+            return 
+                ai + n > a.size() || bi + n > b.size() 
+                    ? false :
+                n == 0 
+                    ? true : 
+                a[ai] != b[bi] 
+                    ? false : 
+                is_equ_n(a,ai+1,b,bi+1,n-1);
+        }
+
+        constexpr bool is_int(const_str s, unsigned i)
+        {
+            return is_equ_n(s, i, "<int>", 0, 5);
+        }
+
+        constexpr bool is_uint(const_str s, unsigned i)
+        {
+            return is_equ_n(s, i, "<uint>", 0, 6);
+        }
+
+        constexpr bool is_float(const_str s, unsigned i)
+        {
+            return is_equ_n(s, i, "<float>", 0, 7) ||
+                is_equ_n(s, i, "<double>", 0, 8);
+        }
+
+        constexpr bool is_str(const_str s, unsigned i)
+        {
+            return is_equ_n(s, i, "<str>", 0, 5) ||
+                is_equ_n(s, i, "<string>", 0, 8);
+        }
+
+        constexpr bool is_path(const_str s, unsigned i)
+        {
+            return is_equ_n(s, i, "<path>", 0, 6);
+        }
+#endif
+        template <typename T> 
+        struct parameter_tag
+        {
+            static const int value = 0;
+        };
+#define CROW_INTERNAL_PARAMETER_TAG(t, i) \
+template <> \
+struct parameter_tag<t> \
+{ \
+    static const int value = i; \
+}
+        CROW_INTERNAL_PARAMETER_TAG(int, 1);
+        CROW_INTERNAL_PARAMETER_TAG(char, 1);
+        CROW_INTERNAL_PARAMETER_TAG(short, 1);
+        CROW_INTERNAL_PARAMETER_TAG(long, 1);
+        CROW_INTERNAL_PARAMETER_TAG(long long, 1);
+        CROW_INTERNAL_PARAMETER_TAG(unsigned int, 2);
+        CROW_INTERNAL_PARAMETER_TAG(unsigned char, 2);
+        CROW_INTERNAL_PARAMETER_TAG(unsigned short, 2);
+        CROW_INTERNAL_PARAMETER_TAG(unsigned long, 2);
+        CROW_INTERNAL_PARAMETER_TAG(unsigned long long, 2);
+        CROW_INTERNAL_PARAMETER_TAG(double, 3);
+        CROW_INTERNAL_PARAMETER_TAG(std::string, 4);
+#undef CROW_INTERNAL_PARAMETER_TAG
+        template <typename ... Args>
+        struct compute_parameter_tag_from_args_list;
+
+        template <>
+        struct compute_parameter_tag_from_args_list<>
+        {
+            static const int value = 0;
+        };
+
+        template <typename Arg, typename ... Args>
+        struct compute_parameter_tag_from_args_list<Arg, Args...>
+        {
+            static const int sub_value = 
+                compute_parameter_tag_from_args_list<Args...>::value;
+            static const int value = 
+                parameter_tag<typename std::decay<Arg>::type>::value
+                ? sub_value* 6 + parameter_tag<typename std::decay<Arg>::type>::value
+                : sub_value;
+        };
+
+        static inline bool is_parameter_tag_compatible(uint64_t a, uint64_t b)
+        {
+            if (a == 0)
+                return b == 0;
+            if (b == 0)
+                return a == 0;
+            int sa = a%6;
+            int sb = a%6;
+            if (sa == 5) sa = 4;
+            if (sb == 5) sb = 4;
+            if (sa != sb)
+                return false;
+            return is_parameter_tag_compatible(a/6, b/6);
+        }
+
+        static inline unsigned find_closing_tag_runtime(const char* s, unsigned p)
+        {
+            return
+                s[p] == 0
+                ? throw std::runtime_error("unmatched tag <") :
+                s[p] == '>'
+                ? p : find_closing_tag_runtime(s, p + 1);
+        }
+        
+        static inline uint64_t get_parameter_tag_runtime(const char* s, unsigned p = 0)
+        {
+            return
+                s[p] == 0
+                    ?  0 :
+                s[p] == '<' ? (
+                    std::strncmp(s+p, "<int>", 5) == 0
+                        ? get_parameter_tag_runtime(s, find_closing_tag_runtime(s, p)) * 6 + 1 :
+                    std::strncmp(s+p, "<uint>", 6) == 0
+                        ? get_parameter_tag_runtime(s, find_closing_tag_runtime(s, p)) * 6 + 2 :
+                    (std::strncmp(s+p, "<float>", 7) == 0 ||
+                    std::strncmp(s+p, "<double>", 8) == 0)
+                        ? get_parameter_tag_runtime(s, find_closing_tag_runtime(s, p)) * 6 + 3 :
+                    (std::strncmp(s+p, "<str>", 5) == 0 ||
+                    std::strncmp(s+p, "<string>", 8) == 0)
+                        ? get_parameter_tag_runtime(s, find_closing_tag_runtime(s, p)) * 6 + 4 :
+                    std::strncmp(s+p, "<path>", 6) == 0
+                        ? get_parameter_tag_runtime(s, find_closing_tag_runtime(s, p)) * 6 + 5 :
+                    throw std::runtime_error("invalid parameter type")
+                    ) :
+                get_parameter_tag_runtime(s, p+1);
+        }
+#ifndef CROW_MSVC_WORKAROUND
+        constexpr uint64_t get_parameter_tag(const_str s, unsigned p = 0)
+        {
+            return
+                p == s.size() 
+                    ?  0 :
+                s[p] == '<' ? ( 
+                    is_int(s, p)
+                        ? get_parameter_tag(s, find_closing_tag(s, p)) * 6 + 1 :
+                    is_uint(s, p)
+                        ? get_parameter_tag(s, find_closing_tag(s, p)) * 6 + 2 :
+                    is_float(s, p)
+                        ? get_parameter_tag(s, find_closing_tag(s, p)) * 6 + 3 :
+                    is_str(s, p)
+                        ? get_parameter_tag(s, find_closing_tag(s, p)) * 6 + 4 :
+                    is_path(s, p)
+                        ? get_parameter_tag(s, find_closing_tag(s, p)) * 6 + 5 :
+                    throw std::runtime_error("invalid parameter type")
+                    ) : 
+                get_parameter_tag(s, p+1);
+        }
+#endif
+
+        template <typename ... T>
+        struct S
+        {
+            template <typename U>
+            using push = S<U, T...>;
+            template <typename U>
+            using push_back = S<T..., U>;
+            template <template<typename ... Args> class U>
+            using rebind = U<T...>;
+        };
+template <typename F, typename Set>
+        struct CallHelper;
+        template <typename F, typename ...Args>
+        struct CallHelper<F, S<Args...>>
+        {
+            template <typename F1, typename ...Args1, typename = 
+                decltype(std::declval<F1>()(std::declval<Args1>()...))
+                >
+            static char __test(int);
+
+            template <typename ...>
+            static int __test(...);
+
+            static constexpr bool value = sizeof(__test<F, Args...>(0)) == sizeof(char);
+        };
+
+
+        template <int N>
+        struct single_tag_to_type
+        {
+        };
+
+        template <>
+        struct single_tag_to_type<1>
+        {
+            using type = int64_t;
+        };
+
+        template <>
+        struct single_tag_to_type<2>
+        {
+            using type = uint64_t;
+        };
+
+        template <>
+        struct single_tag_to_type<3>
+        {
+            using type = double;
+        };
+
+        template <>
+        struct single_tag_to_type<4>
+        {
+            using type = std::string;
+        };
+
+        template <>
+        struct single_tag_to_type<5>
+        {
+            using type = std::string;
+        };
+
+
+        template <uint64_t Tag> 
+        struct arguments
+        {
+            using subarguments = typename arguments<Tag/6>::type;
+            using type = 
+                typename subarguments::template push<typename single_tag_to_type<Tag%6>::type>;
+        };
+
+        template <> 
+        struct arguments<0>
+        {
+            using type = S<>;
+        };
+
+        template <typename ... T>
+        struct last_element_type
+        {
+            using type = typename std::tuple_element<sizeof...(T)-1, std::tuple<T...>>::type;
+        };
+
+
+        template <>
+        struct last_element_type<>
+        {
+        };
+
+
+        // from http://stackoverflow.com/questions/13072359/c11-compile-time-array-with-logarithmic-evaluation-depth
+        template<class T> using Invoke = typename T::type;
+
+        template<unsigned...> struct seq{ using type = seq; };
+
+        template<class S1, class S2> struct concat;
+
+        template<unsigned... I1, unsigned... I2>
+        struct concat<seq<I1...>, seq<I2...>>
+          : seq<I1..., (sizeof...(I1)+I2)...>{};
+
+        template<class S1, class S2>
+        using Concat = Invoke<concat<S1, S2>>;
+
+        template<unsigned N> struct gen_seq;
+        template<unsigned N> using GenSeq = Invoke<gen_seq<N>>;
+
+        template<unsigned N>
+        struct gen_seq : Concat<GenSeq<N/2>, GenSeq<N - N/2>>{};
+
+        template<> struct gen_seq<0> : seq<>{};
+        template<> struct gen_seq<1> : seq<0>{};
+
+        template <typename Seq, typename Tuple> 
+        struct pop_back_helper;
+
+        template <unsigned ... N, typename Tuple>
+        struct pop_back_helper<seq<N...>, Tuple>
+        {
+            template <template <typename ... Args> class U>
+            using rebind = U<typename std::tuple_element<N, Tuple>::type...>;
+        };
+
+        template <typename ... T>
+        struct pop_back //: public pop_back_helper<typename gen_seq<sizeof...(T)-1>::type, std::tuple<T...>>
+        {
+            template <template <typename ... Args> class U>
+            using rebind = typename pop_back_helper<typename gen_seq<sizeof...(T)-1>::type, std::tuple<T...>>::template rebind<U>;
+        };
+
+        template <>
+        struct pop_back<>
+        {
+            template <template <typename ... Args> class U>
+            using rebind = U<>;
+        };
+
+        // from http://stackoverflow.com/questions/2118541/check-if-c0x-parameter-pack-contains-a-type
+        template < typename Tp, typename... List >
+        struct contains : std::true_type {};
+
+        template < typename Tp, typename Head, typename... Rest >
+        struct contains<Tp, Head, Rest...>
+        : std::conditional< std::is_same<Tp, Head>::value,
+            std::true_type,
+            contains<Tp, Rest...>
+        >::type {};
+
+        template < typename Tp >
+        struct contains<Tp> : std::false_type {};
+
+        template <typename T>
+        struct empty_context
+        {
+        };
+
+        template <typename T>
+        struct promote
+        {
+            using type = T;
+        };
+
+#define CROW_INTERNAL_PROMOTE_TYPE(t1, t2) \
+        template<> \
+        struct promote<t1> \
+        {  \
+            using type = t2; \
+        }
+
+        CROW_INTERNAL_PROMOTE_TYPE(char, int64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(short, int64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(int, int64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(long, int64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(long long, int64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(unsigned char, uint64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(unsigned short, uint64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(unsigned int, uint64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(unsigned long, uint64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(unsigned long long, uint64_t);
+        CROW_INTERNAL_PROMOTE_TYPE(float, double);
+#undef CROW_INTERNAL_PROMOTE_TYPE
+
+        template <typename T>
+        using promote_t = typename promote<T>::type;
+
+    } // namespace black_magic
+
+    namespace detail
+    {
+
+        template <class T, std::size_t N, class... Args>
+        struct get_index_of_element_from_tuple_by_type_impl
+        {
+            static constexpr auto value = N;
+        };
+
+        template <class T, std::size_t N, class... Args>
+        struct get_index_of_element_from_tuple_by_type_impl<T, N, T, Args...>
+        {
+            static constexpr auto value = N;
+        };
+
+        template <class T, std::size_t N, class U, class... Args>
+        struct get_index_of_element_from_tuple_by_type_impl<T, N, U, Args...>
+        {
+            static constexpr auto value = get_index_of_element_from_tuple_by_type_impl<T, N + 1, Args...>::value;
+        };
+
+    } // namespace detail
+
+    namespace utility
+    {
+        template <class T, class... Args>
+        T& get_element_by_type(std::tuple<Args...>& t)
+        {
+            return std::get<detail::get_index_of_element_from_tuple_by_type_impl<T, 0, Args...>::value>(t);
+        }
+
+        template<typename T> 
+        struct function_traits;  
+
+#ifndef CROW_MSVC_WORKAROUND
+        template<typename T> 
+        struct function_traits : public function_traits<decltype(&T::operator())>
+        {
+            using parent_t = function_traits<decltype(&T::operator())>;
+            static const size_t arity = parent_t::arity;
+            using result_type = typename parent_t::result_type;
+            template <size_t i>
+            using arg = typename parent_t::template arg<i>;
+        
+        };  
+#endif
+
+        template<typename ClassType, typename R, typename ...Args> 
+        struct function_traits<R(ClassType::*)(Args...) const>
+        {
+            static const size_t arity = sizeof...(Args);
+
+            typedef R result_type;
+
+            template <size_t i>
+            using arg = typename std::tuple_element<i, std::tuple<Args...>>::type;
+        };
+
+        template<typename ClassType, typename R, typename ...Args> 
+        struct function_traits<R(ClassType::*)(Args...)>
+        {
+            static const size_t arity = sizeof...(Args);
+
+            typedef R result_type;
+
+            template <size_t i>
+            using arg = typename std::tuple_element<i, std::tuple<Args...>>::type;
+        };
+
+        template<typename R, typename ...Args> 
+        struct function_traits<std::function<R(Args...)>>
+        {
+            static const size_t arity = sizeof...(Args);
+
+            typedef R result_type;
+
+            template <size_t i>
+            using arg = typename std::tuple_element<i, std::tuple<Args...>>::type;
+        };
+
+        inline static std::string base64encode(const char* data, size_t size, const char* key = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/")
+        {
+            std::string ret;
+            ret.resize((size+2) / 3 * 4);
+            auto it = ret.begin();
+            while(size >= 3)
+            {
+                *it++ = key[(((unsigned char)*data)&0xFC)>>2];
+                unsigned char h = (((unsigned char)*data++) & 0x03) << 4;
+                *it++ = key[h|((((unsigned char)*data)&0xF0)>>4)];
+                h = (((unsigned char)*data++) & 0x0F) << 2;
+                *it++ = key[h|((((unsigned char)*data)&0xC0)>>6)];
+                *it++ = key[((unsigned char)*data++)&0x3F];
+
+                size -= 3;
+            }
+            if (size == 1)
+            {
+                *it++ = key[(((unsigned char)*data)&0xFC)>>2];
+                unsigned char h = (((unsigned char)*data++) & 0x03) << 4;
+                *it++ = key[h];
+                *it++ = '=';
+                *it++ = '=';
+            }
+            else if (size == 2)
+            {
+                *it++ = key[(((unsigned char)*data)&0xFC)>>2];
+                unsigned char h = (((unsigned char)*data++) & 0x03) << 4;
+                *it++ = key[h|((((unsigned char)*data)&0xF0)>>4)];
+                h = (((unsigned char)*data++) & 0x0F) << 2;
+                *it++ = key[h];
+                *it++ = '=';
+            }
+            return ret;
+        }
+
+        inline static std::string base64encode_urlsafe(const char* data, size_t size)
+        {
+            return base64encode(data, size, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_");
+        }
+
+        // accepts both the standard and the url safe alphabet; padding is optional
+        inline static std::string base64decode(const std::string& data)
+        {
+            std::string ret;
+            ret.reserve(data.size() / 4 * 3 + 2);
+            unsigned int acc = 0;
+            int bits = 0;
+            for(auto c : data)
+            {
+                int v;
+                if (c >= 'A' && c <= 'Z') v = c - 'A';
+                else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') v = c - '0' + 52;
+                else if (c == '+' || c == '-') v = 62;
+                else if (c == '/' || c == '_') v = 63;
+                else if (c == '=') break;
+                else throw std::runtime_error("invalid base64 character");
+                acc = (acc << 6) | static_cast<unsigned int>(v);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    ret.push_back(static_cast<char>((acc >> bits) & 0xFF));
+                }
+            }
+            return ret;
+        }
+
+
+    } // namespace utility
+}
+
+
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+
+
+
+
+namespace crow
+{
+    enum class LogLevel
+    {
+        Debug = 0,
+        Info,
+        Warning,
+        Error,
+        Critical,
+    };
+
+    class ILogHandler {
+        public:
+            virtual void log(const std::string &message, LogLevel level) = 0;
+    };
+
+    class CerrLogHandler : public ILogHandler {
+        public:
+            void log(const std::string &message, LogLevel /*level*/) override {
+                std::cerr << message;
+            }
+    };
+
+    class logger {
+
+        private:
+            //
+            static std::string timestamp()
+            {
+                char date[32];
+                time_t t = time(0);
+
+                tm my_tm;
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+                localtime_s(&my_tm, &t);
+#else
+                localtime_r(&t, &my_tm);
+#endif
+
+                size_t sz = strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &my_tm);
+                return std::string(date, date+sz);
+            }
+
+        public:
+
+
+            logger(const std::string &prefix, LogLevel level) : level_(level) {
+    #ifdef CROW_ENABLE_LOGGING
+                    stringstream_ << "(" << timestamp() << ") [" << prefix << "] ";
+    #endif
+
+            }
+            ~logger() {
+    #ifdef CROW_ENABLE_LOGGING
+                if(level_ >= get_current_log_level()) {
+                    auto handler = get_handler_ref();
+                    if (handler) {
+                        stringstream_ << std::endl;
+                        handler->log(stringstream_.str(), level_);
+                    }
+                }
+    #endif
+            }
+
+            //
+            template <typename T>
+            logger& operator<<(T const &value) {
+
+    #ifdef CROW_ENABLE_LOGGING
+                if(level_ >= get_current_log_level()) {
+                    stringstream_ << value;
+                }
+    #endif
+                return *this;
+            }
+
+            //
+            static void setLogLevel(LogLevel level) {
+                get_log_level_ref() = level;
+            }
+
+            static void setHandler(ILogHandler* handler) {
+                get_handler_ref() = handler;
+            }
+
+            static LogLevel get_current_log_level() {
+                return get_log_level_ref();
+            }
+
+        private:
+            //
+            static LogLevel& get_log_level_ref()
+            {
+                static LogLevel current_level = (LogLevel)CROW_LOG_LEVEL;
+                return current_level;
+            }
+            static ILogHandler*& get_handler_ref()
+            {
+                static CerrLogHandler default_handler;
+                static ILogHandler* current_handler = &default_handler;
+                return current_handler;
+            }
+
+            //
+            std::ostringstream stringstream_;
+            LogLevel level_;
+    };
+}
+
+#define CROW_LOG_CRITICAL   \
+        if (crow::logger::get_current_log_level() <= crow::LogLevel::Critical) \
+            crow::logger("CRITICAL", crow::LogLevel::Critical)
+#define CROW_LOG_ERROR      \
+        if (crow::logger::get_current_log_level() <= crow::LogLevel::Error) \
+            crow::logger("ERROR   ", crow::LogLevel::Error)
+#define CROW_LOG_WARNING    \
+        if (crow::logger::get_current_log_level() <= crow::LogLevel::Warning) \
+            crow::logger("WARNING ", crow::LogLevel::Warning)
+#define CROW_LOG_INFO       \
+        if (crow::logger::get_current_log_level() <= crow::LogLevel::Info) \
+            crow::logger("INFO    ", crow::LogLevel::Info)
+#define CROW_LOG_DEBUG      \
+        if (crow::logger::get_current_log_level() <= crow::LogLevel::Debug) \
+            crow::logger("DEBUG   ", crow::LogLevel::Debug)
+
+
+
+
+#pragma once
+#include <boost/asio.hpp>
+#ifdef CROW_ENABLE_SSL
+#include <boost/asio/ssl.hpp>
+#endif
+
+
+namespace crow
+{
+    using namespace boost;
+    using tcp = asio::ip::tcp;
+
+    struct SocketAdaptor
+    {
+        using context = void;
+        SocketAdaptor(boost::asio::io_service& io_service, context*)
+            : socket_(io_service)
+        {
+        }
+
+        boost::asio::io_service& get_io_service()
+        {
+            return socket_.get_io_service();
+        }
+
+        tcp::socket& raw_socket()
+        {
+            return socket_;
+        }
+
+        tcp::socket& socket()
+        {
+            return socket_;
+        }
+
+        tcp::endpoint remote_endpoint()
+        {
+            return socket_.remote_endpoint();
+        }
+
+        bool is_open()
+        {
+            return socket_.is_open();
+        }
+
+        void close()
+        {
+            boost::system::error_code ec;
+            socket_.close(ec);
+        }
+
+        template <typename F> 
+        void start(F f)
+        {
+            f(boost::system::error_code());
+        }
+
+        // completes when the socket becomes readable, without consuming any data
+        template <typename F>
+        void wait_readable(F f)
+        {
+            socket_.async_read_some(boost::asio::null_buffers(), f);
+        }
+
+        tcp::socket socket_;
+    };
+
+#ifdef CROW_ENABLE_SSL
+    struct SSLAdaptor
+    {
+        using context = boost::asio::ssl::context;
+        using ssl_socket_t = boost::asio::ssl::stream<tcp::socket>;
+        SSLAdaptor(boost::asio::io_service& io_service, context* ctx)
+            : ssl_socket_(new ssl_socket_t(io_service, *ctx))
+        {
+        }
+
+        boost::asio::ssl::stream<tcp::socket>& socket()
+        {
+            return *ssl_socket_;
+        }
+
+        tcp::socket::lowest_layer_type&
+        raw_socket()
+        {
+            return ssl_socket_->lowest_layer();
+        }
+
+        tcp::endpoint remote_endpoint()
+        {
+            return raw_socket().remote_endpoint();
+        }
+
+        bool is_open()
+        {
+            return raw_socket().is_open();
+        }
+
+        void close()
+        {
+            boost::system::error_code ec;
+            raw_socket().close(ec);
+        }
+
+        boost::asio::io_service& get_io_service()
+        {
+            return raw_socket().get_io_service();
+        }
+
+        template <typename F> 
+        void start(F f)
+        {
+            ssl_socket_->async_handshake(boost::asio::ssl::stream_base::server,
+                    [f](const boost::system::error_code& ec) {
+                        f(ec);
+                    });
+        }
+
+        template <typename F>
+        void wait_readable(F f)
+        {
+            ssl_socket_->next_layer().async_read_some(boost::asio::null_buffers(), f);
+        }
+
+        std::unique_ptr<boost::asio::ssl::stream<tcp::socket>> ssl_socket_;
+    };
+#endif
+}
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+// Shortest round-trip formatting of doubles, with Grisu2 (Florian Loitsch, "Printing
+// Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010). The digits always
+// read back to the same double, and are the shortest that do in all but rare cases, where
+// there is one digit too many.
+namespace crow
+{
+    namespace detail
+    {
+        namespace dtoa
+        {
+            // f * 2^e
+            struct diyfp
+            {
+                uint64_t f;
+                int e;
+            };
+
+            inline diyfp sub(diyfp x, diyfp y)
+            {
+                return {x.f - y.f, x.e};
+            }
+
+            // The upper 64 bits of the product, rounded
+            inline diyfp mul(diyfp x, diyfp y)
+            {
+                uint64_t x_lo = x.f & 0xFFFFFFFFu, x_hi = x.f >> 32;
+                uint64_t y_lo = y.f & 0xFFFFFFFFu, y_hi = y.f >> 32;
+                uint64_t p0 = x_lo * y_lo;
+                uint64_t p1 = x_lo * y_hi;
+                uint64_t p2 = x_hi * y_lo;
+                uint64_t p3 = x_hi * y_hi;
+                uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu) + (uint64_t(1) << 31);
+                return {p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64};
+            }
+
+            inline diyfp normalize(diyfp x)
+            {
+                while((x.f >> 63) == 0)
+                {
+                    x.f <<= 1;
+                    x.e --;
+                }
+                return x;
+            }
+
+            // v and the midpoints to its neighbours, m- and m+, all with m+'s exponent
+            struct boundaries
+            {
+                diyfp w;
+                diyfp minus;
+                diyfp plus;
+            };
+
+            // v must be finite and positive
+            inline boundaries compute_boundaries(double v)
+            {
+                const uint64_t hidden_bit = uint64_t(1) << 52;
+                const int bias = 1023 + 52;
+                uint64_t bits;
+                memcpy(&bits, &v, sizeof(bits));
+                uint64_t F = bits & (hidden_bit - 1);
+                int E = static_cast<int>(bits >> 52);
+
+                diyfp x = E == 0 ? diyfp{F, 1 - bias} : diyfp{F + hidden_bit, E - bias};
+                // at a power of two the lower neighbour is half as far
+                bool lower_closer = F == 0 && E > 1;
+                diyfp plus = normalize({2 * x.f + 1, x.e - 1});
+                diyfp minus = lower_closer ? diyfp{4 * x.f - 1, x.e - 2} : diyfp{2 * x.f - 1, x.e - 1};
+                minus.f <<= minus.e - plus.e;
+                minus.e = plus.e;
+                return {normalize(x), minus, plus};
+            }
+
+            struct cached_power
+            {
+                uint64_t f;
+                int e;
+                int k;
+            };
+
+            // A power of ten c = f * 2^e = 10^k with -60 <= e + 64 + `e' <= -32, so that
+            // scaling by it leaves the integer part of the result in 32 bits
+            inline cached_power get_cached_power(int e)
+            {
+                // 10^k for k = -300, -292, ..., 324
+                static const cached_power powers[] = {
+                    {0xAB70FE17C79AC6CA, -1060, -300},
+                    {0xFF77B1FCBEBCDC4F, -1034, -292},
+                    {0xBE5691EF416BD60C, -1007, -284},
+                    {0x8DD01FAD907FFC3C, -980, -276},
+                    {0xD3515C2831559A83, -954, -268},
+                    {0x9D71AC8FADA6C9B5, -927, -260},
+                    {0xEA9C227723EE8BCB, -901, -252},
+                    {0xAECC49914078536D, -874, -244},
+                    {0x823C12795DB6CE57, -847, -236},
+                    {0xC21094364DFB5637, -821, -228},
+                    {0x9096EA6F3848984F, -794, -220},
+                    {0xD77485CB25823AC7, -768, -212},
+                    {0xA086CFCD97BF97F4, -741, -204},
+                    {0xEF340A98172AACE5, -715, -196},
+                    {0xB23867FB2A35B28E, -688, -188},
+                    {0x84C8D4DFD2C63F3B, -661, -180},
+                    {0xC5DD44271AD3CDBA, -635, -172},
+                    {0x936B9FCEBB25C996, -608, -164},
+                    {0xDBAC6C247D62A584, -582, -156},
+                    {0xA3AB66580D5FDAF6, -555, -148},
+                    {0xF3E2F893DEC3F126, -529, -140},
+                    {0xB5B5ADA8AAFF80B8, -502, -132},
+                    {0x87625F056C7C4A8B, -475, -124},
+                    {0xC9BCFF6034C13053, -449, -116},
+                    {0x964E858C91BA2655, -422, -108},
+                    {0xDFF9772470297EBD, -396, -100},
+                    {0xA6DFBD9FB8E5B88F, -369, -92},
+                    {0xF8A95FCF88747D94, -343, -84},
+                    {0xB94470938FA89BCF, -316, -76},
+                    {0x8A08F0F8BF0F156B, -289, -68},
+                    {0xCDB02555653131B6, -263, -60},
+                    {0x993FE2C6D07B7FAC, -236, -52},
+                    {0xE45C10C42A2B3B06, -210, -44},
+                    {0xAA242499697392D3, -183, -36},
+                    {0xFD87B5F28300CA0E, -157, -28},
+                    {0xBCE5086492111AEB, -130, -20},
+                    {0x8CBCCC096F5088CC, -103, -12},
+                    {0xD1B71758E219652C, -77, -4},
+                    {0x9C40000000000000, -50, 4},
+                    {0xE8D4A51000000000, -24, 12},
+                    {0xAD78EBC5AC620000, 3, 20},
+                    {0x813F3978F8940984, 30, 28},
+                    {0xC097CE7BC90715B3, 56, 36},
+                    {0x8F7E32CE7BEA5C70, 83, 44},
+                    {0xD5D238A4ABE98068, 109, 52},
+                    {0x9F4F2726179A2245, 136, 60},
+                    {0xED63A231D4C4FB27, 162, 68},
+                    {0xB0DE65388CC8ADA8, 189, 76},
+                    {0x83C7088E1AAB65DB, 216, 84},
+                    {0xC45D1DF942711D9A, 242, 92},
+                    {0x924D692CA61BE758, 269, 100},
+                    {0xDA01EE641A708DEA, 295, 108},
+                    {0xA26DA3999AEF774A, 322, 116},
+                    {0xF209787BB47D6B85, 348, 124},
+                    {0xB454E4A179DD1877, 375, 132},
+                    {0x865B86925B9BC5C2, 402, 140},
+                    {0xC83553C5C8965D3D, 428, 148},
+                    {0x952AB45CFA97A0B3, 455, 156},
+                    {0xDE469FBD99A05FE3, 481, 164},
+                    {0xA59BC234DB398C25, 508, 172},
+                    {0xF6C69A72A3989F5C, 534, 180},
+                    {0xB7DCBF5354E9BECE, 561, 188},
+                    {0x88FCF317F22241E2, 588, 196},
+                    {0xCC20CE9BD35C78A5, 614, 204},
+                    {0x98165AF37B2153DF, 641, 212},
+                    {0xE2A0B5DC971F303A, 667, 220},
+                    {0xA8D9D1535CE3B396, 694, 228},
+                    {0xFB9B7CD9A4A7443C, 720, 236},
+                    {0xBB764C4CA7A44410, 747, 244},
+                    {0x8BAB8EEFB6409C1A, 774, 252},
+                    {0xD01FEF10A657842C, 800, 260},
+                    {0x9B10A4E5E9913129, 827, 268},
+                    {0xE7109BFBA19C0C9D, 853, 276},
+                    {0xAC2820D9623BF429, 880, 284},
+                    {0x80444B5E7AA7CF85, 907, 292},
+                    {0xBF21E44003ACDD2D, 933, 300},
+                    {0x8E679C2F5E44FF8F, 960, 308},
+                    {0xD433179D9C8CB841, 986, 316},
+                    {0x9E19DB92B4E31BA9, 1013, 324},
+                };
+                const int alpha = -60;
+                int f = alpha - e - 1;
+                // ceil(f * log10(2))
+                int k = (f * 78913) / (1 << 18) + (f > 0);
+                return powers[(300 + k + 7) / 8];
+            }
+
+            // The number of decimal digits of n, and the largest power of ten below it
+            inline int find_largest_pow10(uint32_t n, uint32_t& pow10)
+            {
+                static const uint32_t powers[] = {
+                    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+                };
+                int digits = 10;
+                while(digits > 1 && n < powers[digits - 1])
+                    digits --;
+                pow10 = powers[digits - 1];
+                return digits;
+            }
+
+            // Moves the last digit towards w while that stays inside the interval
+            inline void round(char* buffer, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+            {
+                while(rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+                {
+                    buffer[length - 1] --;
+                    rest += ten_k;
+                }
+            }
+
+            // Writes the digits of w, as few as keep the value between M- and M+
+            inline void digit_gen(char* buffer, int& length, int& decimal_exponent, diyfp M_minus, diyfp w, diyfp M_plus)
+            {
+                uint64_t delta = sub(M_plus, M_minus).f;
+                uint64_t dist = sub(M_plus, w).f;
+                diyfp one{uint64_t(1) << -M_plus.e, M_plus.e};
+
+                uint32_t p1 = static_cast<uint32_t>(M_plus.f >> -one.e);
+                uint64_t p2 = M_plus.f & (one.f - 1);
+
+                uint32_t pow10;
+                int n = find_largest_pow10(p1, pow10);
+                while(n > 0)
+                {
+                    uint32_t d = p1 / pow10;
+                    p1 %= pow10;
+                    buffer[length++] = static_cast<char>('0' + d);
+                    n --;
+                    uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+                    if (rest <= delta)
+                    {
+                        decimal_exponent += n;
+                        round(buffer, length, dist, delta, rest, uint64_t(pow10) << -one.e);
+                        return;
+                    }
+                    pow10 /= 10;
+                }
+
+                int m = 0;
+                while(1)
+                {
+                    p2 *= 10;
+                    buffer[length++] = static_cast<char>('0' + (p2 >> -one.e));
+                    p2 &= one.f - 1;
+                    m ++;
+                    delta *= 10;
+                    dist *= 10;
+                    if (p2 <= delta)
+                        break;
+                }
+                decimal_exponent -= m;
+                round(buffer, length, dist, delta, p2, one.f);
+            }
+
+            // The shortest digits of a finite positive v, which is digits * 10^decimal_exponent;
+            // buffer needs room for 17
+            inline void grisu2(char* buffer, int& length, int& decimal_exponent, double v)
+            {
+                boundaries b = compute_boundaries(v);
+                cached_power cached = get_cached_power(b.plus.e);
+                diyfp c{cached.f, cached.e};
+                diyfp w = mul(b.w, c);
+                diyfp w_minus = mul(b.minus, c);
+                diyfp w_plus = mul(b.plus, c);
+                // the products may be off by one either way, so the interval is narrowed to
+                // what is certainly inside
+                diyfp M_minus{w_minus.f + 1, w_minus.e};
+                diyfp M_plus{w_plus.f - 1, w_plus.e};
+                length = 0;
+                decimal_exponent = -cached.k;
+                digit_gen(buffer, length, decimal_exponent, M_minus, w, M_plus);
+            }
+
+            // Writes `exponent' as e+N or e-N
+            inline char* write_exponent(char* out, int exponent)
+            {
+                *out++ = 'e';
+                *out++ = exponent < 0 ? '-' : '+';
+                if (exponent < 0)
+                    exponent = -exponent;
+                if (exponent >= 100)
+                {
+                    *out++ = static_cast<char>('0' + exponent / 100);
+                    exponent %= 100;
+                    *out++ = static_cast<char>('0' + exponent / 10);
+                }
+                else if (exponent >= 10)
+                    *out++ = static_cast<char>('0' + exponent / 10);
+                *out++ = static_cast<char>('0' + exponent % 10);
+                return out;
+            }
+        }
+
+        // Writes v the way JavaScript would: plain decimals from 1e-6 up to 1e21 and
+        // d.ddde+N outside that, the shortest digits that read back to v. Non-finite values,
+        // which JSON has no way to write, come out as printf would. Needs 32 bytes at out and
+        // returns the end.
+        inline char* format_double(double v, char* out)
+        {
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            if (bits >> 63)
+            {
+                *out++ = '-';
+                bits &= ~(uint64_t(1) << 63);
+                memcpy(&v, &bits, sizeof(bits));
+            }
+            if ((bits >> 52) == 0x7FF)
+            {
+                const char* text = bits & ((uint64_t(1) << 52) - 1) ? "nan" : "inf";
+                memcpy(out, text, 3);
+                return out + 3;
+            }
+            if (bits == 0)
+            {
+                *out++ = '0';
+                return out;
+            }
+
+            char digits[17];
+            int k, exponent;
+            dtoa::grisu2(digits, k, exponent, v);
+            // the value is 0.digits * 10^n
+            int n = k + exponent;
+            if (k <= n && n <= 21)
+            {
+                memcpy(out, digits, k);
+                memset(out + k, '0', n - k);
+                return out + n;
+            }
+            if (0 < n && n <= 21)
+            {
+                memcpy(out, digits, n);
+                out[n] = '.';
+                memcpy(out + n + 1, digits + n, k - n);
+                return out + k + 1;
+            }
+            if (-6 < n && n <= 0)
+            {
+                out[0] = '0';
+                out[1] = '.';
+                memset(out + 2, '0', -n);
+                memcpy(out + 2 - n, digits, k);
+                return out + 2 - n + k;
+            }
+            *out++ = digits[0];
+            if (k > 1)
+            {
+                *out++ = '.';
+                memcpy(out, digits + 1, k - 1);
+                out += k - 1;
+            }
+            return dtoa::write_exponent(out, n - 1);
+        }
+
+        // Writes the decimal digits of v, two at a time, and returns the end; needs 20 bytes
+        inline char* format_integer(uint64_t v, char* out)
+        {
+            static const char pairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+            char buffer[20];
+            char* p = buffer + sizeof(buffer);
+            while(v >= 100)
+            {
+                unsigned i = static_cast<unsigned>(v % 100) * 2;
+                v /= 100;
+                *--p = pairs[i + 1];
+                *--p = pairs[i];
+            }
+            if (v >= 10)
+            {
+                unsigned i = static_cast<unsigned>(v) * 2;
+                *--p = pairs[i + 1];
+                *--p = pairs[i];
+            }
+            else
+                *--p = static_cast<char>('0' + v);
+            size_t length = buffer + sizeof(buffer) - p;
+            memcpy(out, p, length);
+            return out + length;
+        }
+
+        inline char* format_integer(int64_t v, char* out)
+        {
+            uint64_t magnitude = static_cast<uint64_t>(v);
+            if (v < 0)
+            {
+                *out++ = '-';
+                magnitude = 0 - magnitude;
+            }
+            return format_integer(magnitude, out);
+        }
+    }
+}
+
+
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <thread>
+
+
+
+
+namespace crow
+{
+    namespace detail 
+    {
+        // fast timer queue for fixed tick value.
+        class dumb_timer_queue
+        {
+        public:
+            using key = std::pair<dumb_timer_queue*, int>;
+
+            void cancel(key& k)
+            {
+                auto self = k.first;
+                k.first = nullptr;
+                if (!self)
+                    return;
+
+                unsigned int index = (unsigned int)(k.second - self->step_);
+                if (index < self->dq_.size())
+                    self->dq_[index].second = nullptr;
+            }
+
+            key add(std::function<void()> f)
+            {
+                dq_.emplace_back(std::chrono::steady_clock::now(), std::move(f));
+                int ret = static_cast<int>(step_+dq_.size()-1);
+
+                CROW_LOG_DEBUG << "timer add inside: " << this << ' ' << ret ;
+                return {this, ret};
+            }
+
+            void process()
+            {
+                if (!io_service_)
+                    return;
+
+                auto now = std::chrono::steady_clock::now();
+                while(!dq_.empty())
+                {
+                    auto& x = dq_.front();
+                    if (now - x.first < std::chrono::seconds(tick))
+                        break;
+                    if (x.second)
+                    {
+                        CROW_LOG_DEBUG << "timer call: " << this << ' ' << step_;
+                        // we know that timer handlers are very simple currenty; call here
+                        x.second();
+                    }
+                    dq_.pop_front();
+                    step_++;
+                }
+            }
+
+            void set_io_service(boost::asio::io_service& io_service)
+            {
+                io_service_ = &io_service;
+            }
+
+            dumb_timer_queue() noexcept
+            {
+            }
+
+        private:
+
+            int tick{5};
+            boost::asio::io_service* io_service_{};
+            std::deque<std::pair<decltype(std::chrono::steady_clock::now()), std::function<void()>>> dq_;
+            int step_{};
+        };
+    }
+}
+
+
+
+/* merged revision: 5b951d74bd66ec9d38448e0a85b1cf8b85d97db3 */
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef CROW_http_parser_h
+#define CROW_http_parser_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Also update SONAME in the Makefile whenever you change these. */
+#define CROW_HTTP_PARSER_VERSION_MAJOR 2
+#define CROW_HTTP_PARSER_VERSION_MINOR 3
+#define CROW_HTTP_PARSER_VERSION_PATCH 0
+
+#include <sys/types.h>
+#if defined(_WIN32) && !defined(__MINGW32__) && (!defined(_MSC_VER) || _MSC_VER<1600)
+#include <BaseTsd.h>
+#include <stddef.h>
+typedef __int8 int8_t;
+typedef unsigned __int8 uint8_t;
+typedef __int16 int16_t;
+typedef unsigned __int16 uint16_t;
+typedef __int32 int32_t;
+typedef unsigned __int32 uint32_t;
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
+#else
+#include <stdint.h>
+#endif
+
+/* Compile with -DHTTP_PARSER_STRICT=0 to make less checks, but run
+ * faster
+ */
+#ifndef CROW_HTTP_PARSER_STRICT
+# define CROW_HTTP_PARSER_STRICT 1
+#endif
+
+/* Maximium header size allowed. If the macro is not defined
+ * before including this header then the default is used. To
+ * change the maximum header size, define the macro in the build
+ * environment (e.g. -DHTTP_MAX_HEADER_SIZE=<value>). To remove
+ * the effective limit on the size of the header, define the macro
+ * to a very large number (e.g. -DHTTP_MAX_HEADER_SIZE=0x7fffffff)
+ */
+#ifndef CROW_HTTP_MAX_HEADER_SIZE
+# define CROW_HTTP_MAX_HEADER_SIZE (80*1024)
+#endif
+
+typedef struct http_parser http_parser;
+typedef struct http_parser_settings http_parser_settings;
+
+
+/* Callbacks should return non-zero to indicate an error. The parser will
+ * then halt execution.
+ *
+ * The one exception is on_headers_complete. In a HTTP_RESPONSE parser
+ * returning '1' from on_headers_complete will tell the parser that it
+ * should not expect a body. This is used when receiving a response to a
+ * HEAD request which may contain 'Content-Length' or 'Transfer-Encoding:
+ * chunked' headers that indicate the presence of a body.
+ *
+ * http_data_cb does not return data chunks. It will be call arbitrarally
+ * many times for each string. E.G. you might get 10 callbacks for "on_url"
+ * each providing just a few characters more data.
+ */
+typedef int (*http_data_cb) (http_parser*, const char *at, size_t length);
+typedef int (*http_cb) (http_parser*);
+
+
+/* Request Methods */
+#define CROW_HTTP_METHOD_MAP(CROW_XX)         \
+  CROW_XX(0,  DELETE,      DELETE)       \
+  CROW_XX(1,  GET,         GET)          \
+  CROW_XX(2,  HEAD,        HEAD)         \
+  CROW_XX(3,  POST,        POST)         \
+  CROW_XX(4,  PUT,         PUT)          \
+  /* pathological */                \
+  CROW_XX(5,  CONNECT,     CONNECT)      \
+  CROW_XX(6,  OPTIONS,     OPTIONS)      \
+  CROW_XX(7,  TRACE,       TRACE)        \
+  /* RFC-5789 */                    \
+  CROW_XX(8, PATCH,       PATCH)        \
+  CROW_XX(9, PURGE,       PURGE)        \
+  /* webdav */                      \
+  CROW_XX(10,  COPY,        COPY)         \
+  CROW_XX(11,  LOCK,        LOCK)         \
+  CROW_XX(12, MKCOL,       MKCOL)        \
+  CROW_XX(13, MOVE,        MOVE)         \
+  CROW_XX(14, PROPFIND,    PROPFIND)     \
+  CROW_XX(15, PROPPATCH,   PROPPATCH)    \
+  CROW_XX(16, SEARCH,      SEARCH)       \
+  CROW_XX(17, UNLOCK,      UNLOCK)       \
+  /* subversion */                  \
+  CROW_XX(18, REPORT,      REPORT)       \
+  CROW_XX(19, MKACTIVITY,  MKACTIVITY)   \
+  CROW_XX(20, CHECKOUT,    CHECKOUT)     \
+  CROW_XX(21, MERGE,       MERGE)        \
+  /* upnp */                        \
+  CROW_XX(22, MSEARCH,     M-SEARCH)     \
+  CROW_XX(23, NOTIFY,      NOTIFY)       \
+  CROW_XX(24, SUBSCRIBE,   SUBSCRIBE)    \
+  CROW_XX(25, UNSUBSCRIBE, UNSUBSCRIBE)  \
+  /* CalDAV */                      \
+  CROW_XX(26, MKCALENDAR,  MKCALENDAR)   \
+
+enum http_method
+  {
+#define CROW_XX(num, name, string) HTTP_##name = num,
+  CROW_HTTP_METHOD_MAP(CROW_XX)
+#undef CROW_XX
+  };
+
+
+enum http_parser_type { HTTP_REQUEST, HTTP_RESPONSE, HTTP_BOTH };
+
+
+/* Flag values for http_parser.flags field */
+enum flags
+  { F_CHUNKED               = 1 << 0
+  , F_CONNECTION_KEEP_ALIVE = 1 << 1
+  , F_CONNECTION_CLOSE      = 1 << 2
+  , F_TRAILING              = 1 << 3
+  , F_UPGRADE               = 1 << 4
+  , F_SKIPBODY              = 1 << 5
+  };
+
+
+/* Map for errno-related constants
+ * 
+ * The provided argument should be a macro that takes 2 arguments.
+ */
+#define CROW_HTTP_ERRNO_MAP(CROW_XX)                                           \
+  /* No error */                                                     \
+  CROW_XX(OK, "success")                                                  \
+                                                                     \
+  /* Callback-related errors */                                      \
+  CROW_XX(CB_message_begin, "the on_message_begin callback failed")       \
+  CROW_XX(CB_url, "the on_url callback failed")                           \
+  CROW_XX(CB_header_field, "the on_header_field callback failed")         \
+  CROW_XX(CB_header_value, "the on_header_value callback failed")         \
+  CROW_XX(CB_headers_complete, "the on_headers_complete callback failed") \
+  CROW_XX(CB_body, "the on_body callback failed")                         \
+  CROW_XX(CB_message_complete, "the on_message_complete callback failed") \
+  CROW_XX(CB_status, "the on_status callback failed")                     \
+                                                                     \
+  /* Parsing-related errors */                                       \
+  CROW_XX(INVALID_EOF_STATE, "stream ended at an unexpected time")        \
+  CROW_XX(HEADER_OVERFLOW,                                                \
+     "too many header bytes seen; overflow detected")                \
+  CROW_XX(CLOSED_CONNECTION,                                              \
+     "data received after completed connection: close message")      \
+  CROW_XX(INVALID_VERSION, "invalid HTTP version")                        \
+  CROW_XX(INVALID_STATUS, "invalid HTTP status code")                     \
+  CROW_XX(INVALID_METHOD, "invalid HTTP method")                          \
+  CROW_XX(INVALID_URL, "invalid URL")                                     \
+  CROW_XX(INVALID_HOST, "invalid host")                                   \
+  CROW_XX(INVALID_PORT, "invalid port")                                   \
+  CROW_XX(INVALID_PATH, "invalid path")                                   \
+  CROW_XX(INVALID_QUERY_STRING, "invalid query string")                   \
+  CROW_XX(INVALID_FRAGMENT, "invalid fragment")                           \
+  CROW_XX(LF_EXPECTED, "CROW_LF character expected")                           \
+  CROW_XX(INVALID_HEADER_TOKEN, "invalid character in header")            \
+  CROW_XX(INVALID_CONTENT_LENGTH,                                         \
+     "invalid character in content-length header")                   \
+  CROW_XX(INVALID_CHUNK_SIZE,                                             \
+     "invalid character in chunk size header")                       \
+  CROW_XX(INVALID_CONSTANT, "invalid constant string")                    \
+  CROW_XX(INVALID_INTERNAL_STATE, "encountered unexpected internal state")\
+  CROW_XX(STRICT, "strict mode assertion failed")                         \
+  CROW_XX(PAUSED, "parser is paused")                                     \
+  CROW_XX(UNKNOWN, "an unknown error occurred")
+
+
+/* Define HPE_* values for each errno value above */
+#define CROW_HTTP_ERRNO_GEN(n, s) HPE_##n,
+enum http_errno {
+  CROW_HTTP_ERRNO_MAP(CROW_HTTP_ERRNO_GEN)
+};
+#undef CROW_HTTP_ERRNO_GEN
+
+
+/* Get an http_errno value from an http_parser */
+#define CROW_HTTP_PARSER_ERRNO(p)            ((enum http_errno) (p)->http_errno)
+
+
+struct http_parser {
+  /** PRIVATE **/
+  unsigned int type : 2;         /* enum http_parser_type */
+  unsigned int flags : 6;        /* F_* values from 'flags' enum; semi-public */
+  unsigned int state : 8;        /* enum state from http_parser.c */
+  unsigned int header_state : 8; /* enum header_state from http_parser.c */
+  unsigned int index : 8;        /* index into current matcher */
+
+  uint32_t nread;          /* # bytes read in various scenarios */
+  uint64_t content_length; /* # bytes in body (0 if no Content-Length header) */
+
+  /** READ-ONLY **/
+  unsigned short http_major;
+  unsigned short http_minor;
+  unsigned int status_code : 16; /* responses only */
+  unsigned int method : 8;       /* requests only */
+  unsigned int http_errno : 7;
+
+  /* 1 = Upgrade header was present and the parser has exited because of that.
+   * 0 = No upgrade header present.
+   * Should be checked when http_parser_execute() returns in addition to
+   * error checking.
+   */
+  unsigned int upgrade : 1;
+
+  /** PUBLIC **/
+  void *data; /* A pointer to get hook to the "connection" or "socket" object */
+};
+
+
+struct http_parser_settings {
+  http_cb      on_message_begin;
+  http_data_cb on_url;
+  http_data_cb on_status;
+  http_data_cb on_header_field;
+  http_data_cb on_header_value;
+  http_cb      on_headers_complete;
+  http_data_cb on_body;
+  http_cb      on_message_complete;
+};
+
+
+enum http_parser_url_fields
+  { UF_SCHEMA           = 0
+  , UF_HOST             = 1
+  , UF_PORT             = 2
+  , UF_PATH             = 3
+  , UF_QUERY            = 4
+  , UF_FRAGMENT         = 5
+  , UF_USERINFO         = 6
+  , UF_MAX              = 7
+  };
+
+
+/* Result structure for http_parser_parse_url().
+ *
+ * Callers should index into field_data[] with UF_* values iff field_set
+ * has the relevant (1 << UF_*) bit set. As a courtesy to clients (and
+ * because we probably have padding left over), we convert any port to
+ * a uint16_t.
+ */
+struct http_parser_url {
+  uint16_t field_set;           /* Bitmask of (1 << UF_*) values */
+  uint16_t port;                /* Converted UF_PORT string */
+
+  struct {
+    uint16_t off;               /* Offset into buffer in which field starts */
+    uint16_t len;               /* Length of run in buffer */
+  } field_data[UF_MAX];
+};
+
+
+/* Returns the library version. Bits 16-23 contain the major version number,
+ * bits 8-15 the minor version number and bits 0-7 the patch level.
+ * Usage example:
+ *
+ *   unsigned long version = http_parser_version();
+ *   unsigned major = (version >> 16) & 255;
+ *   unsigned minor = (version >> 8) & 255;
+ *   unsigned patch = version & 255;
+ *   printf("http_parser v%u.%u.%u\n", major, minor, version);
+ */
+unsigned long http_parser_version(void);
+
+void http_parser_init(http_parser *parser, enum http_parser_type type);
+
+
+size_t http_parser_execute(http_parser *parser,
+                           const http_parser_settings *settings,
+                           const char *data,
+                           size_t len);
+
+
+/* If http_should_keep_alive() in the on_headers_complete or
+ * on_message_complete callback returns 0, then this should be
+ * the last message on the connection.
+ * If you are the server, respond with the "Connection: close" header.
+ * If you are the client, close the connection.
+ */
+int http_should_keep_alive(const http_parser *parser);
+
+/* Returns a string version of the HTTP method. */
+const char *http_method_str(enum http_method m);
+
+/* Return a string name of the given error */
+const char *http_errno_name(enum http_errno err);
+
+/* Return a string description of the given error */
+const char *http_errno_description(enum http_errno err);
+
+/* Parse a URL; return nonzero on failure */
+int http_parser_parse_url(const char *buf, size_t buflen,
+                          int is_connect,
+                          struct http_parser_url *u);
+
+/* Pause or un-pause the parser; a nonzero value pauses */
+void http_parser_pause(http_parser *parser, int paused);
+
+/* Checks if this is the final chunk of the body. */
+int http_body_is_final(const http_parser *parser);
+
+/*#include "http_parser.h"*/
+/* Based on src/http/ngx_http_parse.c from NGINX copyright Igor Sysoev
+ *
+ * Additional changes are licensed under the same terms as NGINX and
+ * copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <assert.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef CROW_ULLONG_MAX
+# define CROW_ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
+#endif
+
+#ifndef CROW_MIN
+# define CROW_MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef CROW_ARRAY_SIZE
+# define CROW_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#ifndef CROW_BIT_AT
+# define CROW_BIT_AT(a, i)                                                \
+  (!!((unsigned int) (a)[(unsigned int) (i) >> 3] &                  \
+   (1 << ((unsigned int) (i) & 7))))
+#endif
+
+#ifndef CROW_ELEM_AT
+# define CROW_ELEM_AT(a, i, v) ((unsigned int) (i) < CROW_ARRAY_SIZE(a) ? (a)[(i)] : (v))
+#endif
+
+#define CROW_SET_ERRNO(e)                                                 \
+do {                                                                 \
+  parser->http_errno = (e);                                          \
+} while(0)
+
+
+/* Run the notify callback FOR, returning ER if it fails */
+#define CROW_CALLBACK_NOTIFY_(FOR, ER)                                    \
+do {                                                                 \
+  assert(CROW_HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
+                                                                     \
+  if (settings->on_##FOR) {                                          \
+    if (0 != settings->on_##FOR(parser)) {                           \
+      CROW_SET_ERRNO(HPE_CB_##FOR);                                       \
+    }                                                                \
+                                                                     \
+    /* We either errored above or got paused; get out */             \
+    if (CROW_HTTP_PARSER_ERRNO(parser) != HPE_OK) {                       \
+      return (ER);                                                   \
+    }                                                                \
+  }                                                                  \
+} while (0)
+
+/* Run the notify callback FOR and consume the current byte */
+#define CROW_CALLBACK_NOTIFY(FOR)            CROW_CALLBACK_NOTIFY_(FOR, p - data + 1)
+
+/* Run the notify callback FOR and don't consume the current byte */
+#define CROW_CALLBACK_NOTIFY_NOADVANCE(FOR)  CROW_CALLBACK_NOTIFY_(FOR, p - data)
+
+/* Run data callback FOR with LEN bytes, returning ER if it fails */
+#define CROW_CALLBACK_DATA_(FOR, LEN, ER)                                 \
+do {                                                                 \
+  assert(CROW_HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
+                                                                     \
+  if (FOR##_mark) {                                                  \
+    if (settings->on_##FOR) {                                        \
+      if (0 != settings->on_##FOR(parser, FOR##_mark, (LEN))) {      \
+        CROW_SET_ERRNO(HPE_CB_##FOR);                                     \
+      }                                                              \
+                                                                     \
+      /* We either errored above or got paused; get out */           \
+      if (CROW_HTTP_PARSER_ERRNO(parser) != HPE_OK) {                     \
+        return (ER);                                                 \
+      }                                                              \
+    }                                                                \
+    FOR##_mark = NULL;                                               \
+  }                                                                  \
+} while (0)
+  
+/* Run the data callback FOR and consume the current byte */
+#define CROW_CALLBACK_DATA(FOR)                                           \
+    CROW_CALLBACK_DATA_(FOR, p - FOR##_mark, p - data + 1)
+
+/* Run the data callback FOR and don't consume the current byte */
+#define CROW_CALLBACK_DATA_NOADVANCE(FOR)                                 \
+    CROW_CALLBACK_DATA_(FOR, p - FOR##_mark, p - data)
+
+/* Set the mark FOR; non-destructive if mark is already set */
+#define CROW_MARK(FOR)                                                    \
+do {                                                                 \
+  if (!FOR##_mark) {                                                 \
+    FOR##_mark = p;                                                  \
+  }                                                                  \
+} while (0)
+
+
+#define CROW_PROXY_CONNECTION "proxy-connection"
+#define CROW_CONNECTION "connection"
+#define CROW_CONTENT_LENGTH "content-length"
+#define CROW_TRANSFER_ENCODING "transfer-encoding"
+#define CROW_UPGRADE "upgrade"
+#define CROW_CHUNKED "chunked"
+#define CROW_KEEP_ALIVE "keep-alive"
+#define CROW_CLOSE "close"
+
+
+
+
+enum state
+  { s_dead = 1 /* important that this is > 0 */
+
+  , s_start_req_or_res
+  , s_res_or_resp_H
+  , s_start_res
+  , s_res_H
+  , s_res_HT
+  , s_res_HTT
+  , s_res_HTTP
+  , s_res_first_http_major
+  , s_res_http_major
+  , s_res_first_http_minor
+  , s_res_http_minor
+  , s_res_first_status_code
+  , s_res_status_code
+  , s_res_status_start
+  , s_res_status
+  , s_res_line_almost_done
+
+  , s_start_req
+
+  , s_req_method
+  , s_req_spaces_before_url
+  , s_req_schema
+  , s_req_schema_slash
+  , s_req_schema_slash_slash
+  , s_req_server_start
+  , s_req_server
+  , s_req_server_with_at
+  , s_req_path
+  , s_req_query_string_start
+  , s_req_query_string
+  , s_req_fragment_start
+  , s_req_fragment
+  , s_req_http_start
+  , s_req_http_H
+  , s_req_http_HT
+  , s_req_http_HTT
+  , s_req_http_HTTP
+  , s_req_first_http_major
+  , s_req_http_major
+  , s_req_first_http_minor
+  , s_req_http_minor
+  , s_req_line_almost_done
+
+  , s_header_field_start
+  , s_header_field
+  , s_header_value_discard_ws
+  , s_header_value_discard_ws_almost_done
+  , s_header_value_discard_lws
+  , s_header_value_start
+  , s_header_value
+  , s_header_value_lws
+
+  , s_header_almost_done
+
+  , s_chunk_size_start
+  , s_chunk_size
+  , s_chunk_parameters
+  , s_chunk_size_almost_done
+
+  , s_headers_almost_done
+  , s_headers_done
+
+  /* Important: 's_headers_done' must be the last 'header' state. All
+   * states beyond this must be 'body' states. It is used for overflow
+   * checking. See the CROW_PARSING_HEADER() macro.
+   */
+
+  , s_chunk_data
+  , s_chunk_data_almost_done
+  , s_chunk_data_done
+
+  , s_body_identity
+  , s_body_identity_eof
+
+  , s_message_done
+  };
+
+
+#define CROW_PARSING_HEADER(state) (state <= s_headers_done)
+
+
+enum header_states
+  { h_general = 0
+  , h_C
+  , h_CO
+  , h_CON
+
+  , h_matching_connection
+  , h_matching_proxy_connection
+  , h_matching_content_length
+  , h_matching_transfer_encoding
+  , h_matching_upgrade
+
+  , h_connection
+  , h_content_length
+  , h_transfer_encoding
+  , h_upgrade
+
+  , h_matching_transfer_encoding_chunked
+  , h_matching_connection_keep_alive
+  , h_matching_connection_close
+
+  , h_transfer_encoding_chunked
+  , h_connection_keep_alive
+  , h_connection_close
+  };
+
+enum http_host_state
+  {
+    s_http_host_dead = 1
+  , s_http_userinfo_start
+  , s_http_userinfo
+  , s_http_host_start
+  , s_http_host_v6_start
+  , s_http_host
+  , s_http_host_v6
+  , s_http_host_v6_end
+  , s_http_host_port_start
+  , s_http_host_port
+};
+
+/* Macros for character classes; depends on strict-mode  */
+#define CROW_CR                  '\r'
+#define CROW_LF                  '\n'
+#define CROW_LOWER(c)            (unsigned char)(c | 0x20)
+#define CROW_IS_ALPHA(c)         (CROW_LOWER(c) >= 'a' && CROW_LOWER(c) <= 'z')
+#define CROW_IS_NUM(c)           ((c) >= '0' && (c) <= '9')
+#define CROW_IS_ALPHANUM(c)      (CROW_IS_ALPHA(c) || CROW_IS_NUM(c))
+#define CROW_IS_HEX(c)           (CROW_IS_NUM(c) || (CROW_LOWER(c) >= 'a' && CROW_LOWER(c) <= 'f'))
+#define CROW_IS_MARK(c)          ((c) == '-' || (c) == '_' || (c) == '.' || \
+  (c) == '!' || (c) == '~' || (c) == '*' || (c) == '\'' || (c) == '(' || \
+  (c) == ')')
+#define CROW_IS_USERINFO_CHAR(c) (CROW_IS_ALPHANUM(c) || CROW_IS_MARK(c) || (c) == '%' || \
+  (c) == ';' || (c) == ':' || (c) == '&' || (c) == '=' || (c) == '+' || \
+  (c) == '$' || (c) == ',')
+
+#if CROW_HTTP_PARSER_STRICT
+#define CROW_TOKEN(c)            (tokens[(unsigned char)c])
+#define CROW_IS_URL_CHAR(c)      (CROW_BIT_AT(normal_url_char, (unsigned char)c))
+#define CROW_IS_HOST_CHAR(c)     (CROW_IS_ALPHANUM(c) || (c) == '.' || (c) == '-')
+#else
+#define CROW_TOKEN(c)            ((c == ' ') ? ' ' : tokens[(unsigned char)c])
+#define CROW_IS_URL_CHAR(c)                                                         \
+  (CROW_BIT_AT(normal_url_char, (unsigned char)c) || ((c) & 0x80))
+#define CROW_IS_HOST_CHAR(c)                                                        \
+  (CROW_IS_ALPHANUM(c) || (c) == '.' || (c) == '-' || (c) == '_')
+#endif
+
+
+#define CROW_start_state (parser->type == HTTP_REQUEST ? s_start_req : s_start_res)
+
+
+#if CROW_HTTP_PARSER_STRICT
+# define CROW_STRICT_CHECK(cond)                                          \
+do {                                                                 \
+  if (cond) {                                                        \
+    CROW_SET_ERRNO(HPE_STRICT);                                           \
+    goto error;                                                      \
+  }                                                                  \
+} while (0)
+# define CROW_NEW_MESSAGE() (http_should_keep_alive(parser) ? CROW_start_state : s_dead)
+#else
+# define CROW_STRICT_CHECK(cond)
+# define CROW_NEW_MESSAGE() CROW_start_state
+#endif
+
+
+
+int http_message_needs_eof(const http_parser *parser);
+
+/* Our URL parser.
+ *
+ * This is designed to be shared by http_parser_execute() for URL validation,
+ * hence it has a state transition + byte-for-byte interface. In addition, it
+ * is meant to be embedded in http_parser_parse_url(), which does the dirty
+ * work of turning state transitions URL components for its API.
+ *
+ * This function should only be invoked with non-space characters. It is
+ * assumed that the caller cares about (and can detect) the transition between
+ * URL and non-URL states by looking for these.
+ */
+inline enum state
+parse_url_char(enum state s, const char ch)
+{
+#if CROW_HTTP_PARSER_STRICT
+# define CROW_T(v) 0
+#else
+# define CROW_T(v) v
+#endif
+
+
+static const uint8_t normal_url_char[32] = {
+/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
+        0    | CROW_T(2)   |   0    |   0    | CROW_T(16)  |   0    |   0    |   0,
+/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
+        0    |   2    |   4    |   0    |   16   |   32   |   64   |  128,
+/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0,
+/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  80  P    81  Q    82  R    83  S    84  CROW_T    85  U    86  V    87  W  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0, };
+
+#undef CROW_T
+
+  if (ch == ' ' || ch == '\r' || ch == '\n') {
+    return s_dead;
+  }
+
+#if CROW_HTTP_PARSER_STRICT
+  if (ch == '\t' || ch == '\f') {
+    return s_dead;
+  }
+#endif
+
+  switch (s) {
+    case s_req_spaces_before_url:
+      /* Proxied requests are followed by scheme of an absolute URI (alpha).
+       * All methods except CONNECT are followed by '/' or '*'.
+       */
+
+      if (ch == '/' || ch == '*') {
+        return s_req_path;
+      }
+
+      if (CROW_IS_ALPHA(ch)) {
+        return s_req_schema;
+      }
+
+      break;
+
+    case s_req_schema:
+      if (CROW_IS_ALPHA(ch)) {
+        return s;
+      }
+
+      if (ch == ':') {
+        return s_req_schema_slash;
+      }
+
+      break;
+
+    case s_req_schema_slash:
+      if (ch == '/') {
+        return s_req_schema_slash_slash;
+      }
+
+      break;
+
+    case s_req_schema_slash_slash:
+      if (ch == '/') {
+        return s_req_server_start;
+      }
+
+      break;
+
+    case s_req_server_with_at:
+      if (ch == '@') {
+        return s_dead;
+      }
+
+    /* FALLTHROUGH */
+    case s_req_server_start:
+    case s_req_server:
+      if (ch == '/') {
+        return s_req_path;
+      }
+
+      if (ch == '?') {
+        return s_req_query_string_start;
+      }
+
+      if (ch == '@') {
+        return s_req_server_with_at;
+      }
+
+      if (CROW_IS_USERINFO_CHAR(ch) || ch == '[' || ch == ']') {
+        return s_req_server;
+      }
+
+      break;
+
+    case s_req_path:
+      if (CROW_IS_URL_CHAR(ch)) {
+        return s;
+      }
+
+      switch (ch) {
+        case '?':
+          return s_req_query_string_start;
+
+        case '#':
+          return s_req_fragment_start;
+      }
+
+      break;
+
+    case s_req_query_string_start:
+    case s_req_query_string:
+      if (CROW_IS_URL_CHAR(ch)) {
+        return s_req_query_string;
+      }
+
+      switch (ch) {
+        case '?':
+          /* allow extra '?' in query string */
+          return s_req_query_string;
+
+        case '#':
+          return s_req_fragment_start;
+      }
+
+      break;
+
+    case s_req_fragment_start:
+      if (CROW_IS_URL_CHAR(ch)) {
+        return s_req_fragment;
+      }
+
+      switch (ch) {
+        case '?':
+          return s_req_fragment;
+
+        case '#':
+          return s;
+      }
+
+      break;
+
+    case s_req_fragment:
+      if (CROW_IS_URL_CHAR(ch)) {
+        return s;
+      }
+
+      switch (ch) {
+        case '?':
+        case '#':
+          return s;
+      }
+
+      break;
+
+    default:
+      break;
+  }
+
+  /* We should never fall out of the switch above unless there's an error */
+  return s_dead;
+}
+
+inline size_t http_parser_execute (http_parser *parser,
+                            const http_parser_settings *settings,
+                            const char *data,
+                            size_t len)
+{
+static const char *method_strings[] =
+  {
+#define CROW_XX(num, name, string) #string,
+  CROW_HTTP_METHOD_MAP(CROW_XX)
+#undef CROW_XX
+  };
+
+/* Tokens as defined by rfc 2616. Also lowercases them.
+ *        token       = 1*<any CHAR except CTLs or separators>
+ *     separators     = "(" | ")" | "<" | ">" | "@"
+ *                    | "," | ";" | ":" | "\" | <">
+ *                    | "/" | "[" | "]" | "?" | "="
+ *                    | "{" | "}" | SP | HT
+ */
+static const char tokens[256] = {
+/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
+        0,      '!',      0,      '#',     '$',     '%',     '&',    '\'',
+/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
+        0,       0,      '*',     '+',      0,      '-',     '.',      0,
+/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
+       '0',     '1',     '2',     '3',     '4',     '5',     '6',     '7',
+/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
+       '8',     '9',      0,       0,       0,       0,       0,       0,
+/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
+        0,      'a',     'b',     'c',     'd',     'e',     'f',     'g',
+/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
+       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
+/*  80  P    81  Q    82  R    83  S    84  T    85  U    86  V    87  W  */
+       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
+/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
+       'x',     'y',     'z',      0,       0,       0,      '^',     '_',
+/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
+       '`',     'a',     'b',     'c',     'd',     'e',     'f',     'g',
+/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
+       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
+/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
+       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
+/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
+       'x',     'y',     'z',      0,      '|',      0,      '~',       0 };
+
+
+static const int8_t unhex[256] =
+  {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  , 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1
+  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  };
+
+
+
+  char c, ch;
+  int8_t unhex_val;
+  const char *p = data;
+  const char *header_field_mark = 0;
+  const char *header_value_mark = 0;
+  const char *url_mark = 0;
+  const char *body_mark = 0;
+  const char *status_mark = 0;
+
+  /* We're in an error state. Don't bother doing anything. */
+  if (CROW_HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+    return 0;
+  }
+
+  if (len == 0) {
+    switch (parser->state) {
+      case s_body_identity_eof:
+        /* Use of CROW_CALLBACK_NOTIFY() here would erroneously return 1 byte read if
+         * we got paused.
+         */
+        CROW_CALLBACK_NOTIFY_NOADVANCE(message_complete);
+        return 0;
+
+      case s_dead:
+      case s_start_req_or_res:
+      case s_start_res:
+      case s_start_req:
+        return 0;
+
+      default:
+        CROW_SET_ERRNO(HPE_INVALID_EOF_STATE);
+        return 1;
+    }
+  }
+
+
+  if (parser->state == s_header_field)
+    header_field_mark = data;
+  if (parser->state == s_header_value)
+    header_value_mark = data;
+  switch (parser->state) {
+  case s_req_path:
+  case s_req_schema:
+  case s_req_schema_slash:
+  case s_req_schema_slash_slash:
+  case s_req_server_start:
+  case s_req_server:
+  case s_req_server_with_at:
+  case s_req_query_string_start:
+  case s_req_query_string:
+  case s_req_fragment_start:
+  case s_req_fragment:
+    url_mark = data;
+    break;
+  case s_res_status:
+    status_mark = data;
+    break;
+  }
+
+  for (p=data; p != data + len; p++) {
+    ch = *p;
+
+    if (CROW_PARSING_HEADER(parser->state)) {
+      ++parser->nread;
+      /* Don't allow the total size of the HTTP headers (including the status
+       * line) to exceed CROW_HTTP_MAX_HEADER_SIZE.  This check is here to protect
+       * embedders against denial-of-service attacks where the attacker feeds
+       * us a never-ending header that the embedder keeps buffering.
+       *
+       * This check is arguably the responsibility of embedders but we're doing
+       * it on the embedder's behalf because most won't bother and this way we
+       * make the web a little safer.  CROW_HTTP_MAX_HEADER_SIZE is still far bigger
+       * than any reasonable request or response so this should never affect
+       * day-to-day operation.
+       */
+      if (parser->nread > (CROW_HTTP_MAX_HEADER_SIZE)) {
+        CROW_SET_ERRNO(HPE_HEADER_OVERFLOW);
+        goto error;
+      }
+    }
+
+    reexecute_byte:
+    switch (parser->state) {
+
+      case s_dead:
+        /* this state is used after a 'Connection: close' message
+         * the parser will error out if it reads another message
+         */
+        if (ch == CROW_CR || ch == CROW_LF)
+          break;
+
+        CROW_SET_ERRNO(HPE_CLOSED_CONNECTION);
+        goto error;
+
+      case s_start_req_or_res:
+      {
+        if (ch == CROW_CR || ch == CROW_LF)
+          break;
+        parser->flags = 0;
+        parser->content_length = CROW_ULLONG_MAX;
+
+        if (ch == 'H') {
+          parser->state = s_res_or_resp_H;
+
+          CROW_CALLBACK_NOTIFY(message_begin);
+        } else {
+          parser->type = HTTP_REQUEST;
+          parser->state = s_start_req;
+          goto reexecute_byte;
+        }
+
+        break;
+      }
+
+      case s_res_or_resp_H:
+        if (ch == 'T') {
+          parser->type = HTTP_RESPONSE;
+          parser->state = s_res_HT;
+        } else {
+          if (ch != 'E') {
+            CROW_SET_ERRNO(HPE_INVALID_CONSTANT);
+            goto error;
+          }
+
+          parser->type = HTTP_REQUEST;
+          parser->method = HTTP_HEAD;
+          parser->index = 2;
+          parser->state = s_req_method;
+        }
+        break;
+
+      case s_start_res:
+      {
+        parser->flags = 0;
+        parser->content_length = CROW_ULLONG_MAX;
+
+        switch (ch) {
+          case 'H':
+            parser->state = s_res_H;
+            break;
+
+          case CROW_CR:
+          case CROW_LF:
+            break;
+
+          default:
+            CROW_SET_ERRNO(HPE_INVALID_CONSTANT);
+            goto error;
+        }
+
+        CROW_CALLBACK_NOTIFY(message_begin);
+        break;
+      }
+
+      case s_res_H:
+        CROW_STRICT_CHECK(ch != 'T');
+        parser->state = s_res_HT;
+        break;
+
+      case s_res_HT:
+        CROW_STRICT_CHECK(ch != 'T');
+        parser->state = s_res_HTT;
+        break;
+
+      case s_res_HTT:
+        CROW_STRICT_CHECK(ch != 'P');
+        parser->state = s_res_HTTP;
+        break;
+
+      case s_res_HTTP:
+        CROW_STRICT_CHECK(ch != '/');
+        parser->state = s_res_first_http_major;
+        break;
+
+      case s_res_first_http_major:
+        if (ch < '0' || ch > '9') {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major = ch - '0';
+        parser->state = s_res_http_major;
+        break;
+
+      /* major HTTP version or dot */
+      case s_res_http_major:
+      {
+        if (ch == '.') {
+          parser->state = s_res_first_http_minor;
+          break;
+        }
+
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major *= 10;
+        parser->http_major += ch - '0';
+
+        if (parser->http_major > 999) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* first digit of minor HTTP version */
+      case s_res_first_http_minor:
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor = ch - '0';
+        parser->state = s_res_http_minor;
+        break;
+
+      /* minor HTTP version or end of request line */
+      case s_res_http_minor:
+      {
+        if (ch == ' ') {
+          parser->state = s_res_first_status_code;
+          break;
+        }
+
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor *= 10;
+        parser->http_minor += ch - '0';
+
+        if (parser->http_minor > 999) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      case s_res_first_status_code:
+      {
+        if (!CROW_IS_NUM(ch)) {
+          if (ch == ' ') {
+            break;
+          }
+
+          CROW_SET_ERRNO(HPE_INVALID_STATUS);
+          goto error;
+        }
+        parser->status_code = ch - '0';
+        parser->state = s_res_status_code;
+        break;
+      }
+
+      case s_res_status_code:
+      {
+        if (!CROW_IS_NUM(ch)) {
+          switch (ch) {
+            case ' ':
+              parser->state = s_res_status_start;
+              break;
+            case CROW_CR:
+              parser->state = s_res_line_almost_done;
+              break;
+            case CROW_LF:
+              parser->state = s_header_field_start;
+              break;
+            default:
+              CROW_SET_ERRNO(HPE_INVALID_STATUS);
+              goto error;
+          }
+          break;
+        }
+
+        parser->status_code *= 10;
+        parser->status_code += ch - '0';
+
+        if (parser->status_code > 999) {
+          CROW_SET_ERRNO(HPE_INVALID_STATUS);
+          goto error;
+        }
+
+        break;
+      }
+
+      case s_res_status_start:
+      {
+        if (ch == CROW_CR) {
+          parser->state = s_res_line_almost_done;
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_field_start;
+          break;
+        }
+
+        CROW_MARK(status);
+        parser->state = s_res_status;
+        parser->index = 0;
+        break;
+      }
+
+      case s_res_status:
+        if (ch == CROW_CR) {
+          parser->state = s_res_line_almost_done;
+          CROW_CALLBACK_DATA(status);
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_field_start;
+          CROW_CALLBACK_DATA(status);
+          break;
+        }
+
+        break;
+
+      case s_res_line_almost_done:
+        CROW_STRICT_CHECK(ch != CROW_LF);
+        parser->state = s_header_field_start;
+        break;
+
+      case s_start_req:
+      {
+        if (ch == CROW_CR || ch == CROW_LF)
+          break;
+        parser->flags = 0;
+        parser->content_length = CROW_ULLONG_MAX;
+
+        if (!CROW_IS_ALPHA(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        parser->method = (enum http_method) 0;
+        parser->index = 1;
+        switch (ch) {
+          case 'C': parser->method = HTTP_CONNECT; /* or COPY, CHECKOUT */ break;
+          case 'D': parser->method = HTTP_DELETE; break;
+          case 'G': parser->method = HTTP_GET; break;
+          case 'H': parser->method = HTTP_HEAD; break;
+          case 'L': parser->method = HTTP_LOCK; break;
+          case 'M': parser->method = HTTP_MKCOL; /* or MOVE, MKACTIVITY, MERGE, M-SEARCH, MKCALENDAR */ break;
+          case 'N': parser->method = HTTP_NOTIFY; break;
+          case 'O': parser->method = HTTP_OPTIONS; break;
+          case 'P': parser->method = HTTP_POST;
+            /* or PROPFIND|PROPPATCH|PUT|PATCH|PURGE */
+            break;
+          case 'R': parser->method = HTTP_REPORT; break;
+          case 'S': parser->method = HTTP_SUBSCRIBE; /* or SEARCH */ break;
+          case 'T': parser->method = HTTP_TRACE; break;
+          case 'U': parser->method = HTTP_UNLOCK; /* or UNSUBSCRIBE */ break;
+          default:
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+        }
+        parser->state = s_req_method;
+
+        CROW_CALLBACK_NOTIFY(message_begin);
+
+        break;
+      }
+
+      case s_req_method:
+      {
+        const char *matcher;
+        if (ch == '\0') {
+          CROW_SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        matcher = method_strings[parser->method];
+        if (ch == ' ' && matcher[parser->index] == '\0') {
+          parser->state = s_req_spaces_before_url;
+        } else if (ch == matcher[parser->index]) {
+          ; /* nada */
+        } else if (parser->method == HTTP_CONNECT) {
+          if (parser->index == 1 && ch == 'H') {
+            parser->method = HTTP_CHECKOUT;
+          } else if (parser->index == 2  && ch == 'P') {
+            parser->method = HTTP_COPY;
+          } else {
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->method == HTTP_MKCOL) {
+          if (parser->index == 1 && ch == 'O') {
+            parser->method = HTTP_MOVE;
+          } else if (parser->index == 1 && ch == 'E') {
+            parser->method = HTTP_MERGE;
+          } else if (parser->index == 1 && ch == '-') {
+            parser->method = HTTP_MSEARCH;
+          } else if (parser->index == 2 && ch == 'A') {
+            parser->method = HTTP_MKACTIVITY;
+          } else if (parser->index == 3 && ch == 'A') {
+            parser->method = HTTP_MKCALENDAR;
+          } else {
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->method == HTTP_SUBSCRIBE) {
+          if (parser->index == 1 && ch == 'E') {
+            parser->method = HTTP_SEARCH;
+          } else {
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 1 && parser->method == HTTP_POST) {
+          if (ch == 'R') {
+            parser->method = HTTP_PROPFIND; /* or HTTP_PROPPATCH */
+          } else if (ch == 'U') {
+            parser->method = HTTP_PUT; /* or HTTP_PURGE */
+          } else if (ch == 'A') {
+            parser->method = HTTP_PATCH;
+          } else {
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 2) {
+          if (parser->method == HTTP_PUT) {
+            if (ch == 'R') {
+              parser->method = HTTP_PURGE;
+            } else {
+              CROW_SET_ERRNO(HPE_INVALID_METHOD);
+              goto error;
+            }
+          } else if (parser->method == HTTP_UNLOCK) {
+            if (ch == 'S') {
+              parser->method = HTTP_UNSUBSCRIBE;
+            } else {
+              CROW_SET_ERRNO(HPE_INVALID_METHOD);
+              goto error;
+            }
+          } else {
+            CROW_SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 4 && parser->method == HTTP_PROPFIND && ch == 'P') {
+          parser->method = HTTP_PROPPATCH;
+        } else {
+          CROW_SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        ++parser->index;
+        break;
+      }
+
+      case s_req_spaces_before_url:
+      {
+        if (ch == ' ') break;
+
+        CROW_MARK(url);
+        if (parser->method == HTTP_CONNECT) {
+          parser->state = s_req_server_start;
+        }
+
+        parser->state = parse_url_char((enum state)parser->state, ch);
+        if (parser->state == s_dead) {
+          CROW_SET_ERRNO(HPE_INVALID_URL);
+          goto error;
+        }
+
+        break;
+      }
+
+      case s_req_schema:
+      case s_req_schema_slash:
+      case s_req_schema_slash_slash:
+      case s_req_server_start:
+      {
+        switch (ch) {
+          /* No whitespace allowed here */
+          case ' ':
+          case CROW_CR:
+          case CROW_LF:
+            CROW_SET_ERRNO(HPE_INVALID_URL);
+            goto error;
+          default:
+            parser->state = parse_url_char((enum state)parser->state, ch);
+            if (parser->state == s_dead) {
+              CROW_SET_ERRNO(HPE_INVALID_URL);
+              goto error;
+            }
+        }
+
+        break;
+      }
+
+      case s_req_server:
+      case s_req_server_with_at:
+      case s_req_path:
+      case s_req_query_string_start:
+      case s_req_query_string:
+      case s_req_fragment_start:
+      case s_req_fragment:
+      {
+        switch (ch) {
+          case ' ':
+            parser->state = s_req_http_start;
+            CROW_CALLBACK_DATA(url);
+            break;
+          case CROW_CR:
+          case CROW_LF:
+            parser->http_major = 0;
+            parser->http_minor = 9;
+            parser->state = (ch == CROW_CR) ?
+              s_req_line_almost_done :
+              s_header_field_start;
+            CROW_CALLBACK_DATA(url);
+            break;
+          default:
+            parser->state = parse_url_char((enum state)parser->state, ch);
+            if (parser->state == s_dead) {
+              CROW_SET_ERRNO(HPE_INVALID_URL);
+              goto error;
+            }
+        }
+        break;
+      }
+
+      case s_req_http_start:
+        switch (ch) {
+          case 'H':
+            parser->state = s_req_http_H;
+            break;
+          case ' ':
+            break;
+          default:
+            CROW_SET_ERRNO(HPE_INVALID_CONSTANT);
+            goto error;
+        }
+        break;
+
+      case s_req_http_H:
+        CROW_STRICT_CHECK(ch != 'T');
+        parser->state = s_req_http_HT;
+        break;
+
+      case s_req_http_HT:
+        CROW_STRICT_CHECK(ch != 'T');
+        parser->state = s_req_http_HTT;
+        break;
+
+      case s_req_http_HTT:
+        CROW_STRICT_CHECK(ch != 'P');
+        parser->state = s_req_http_HTTP;
+        break;
+
+      case s_req_http_HTTP:
+        CROW_STRICT_CHECK(ch != '/');
+        parser->state = s_req_first_http_major;
+        break;
+
+      /* first digit of major HTTP version */
+      case s_req_first_http_major:
+        if (ch < '1' || ch > '9') {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major = ch - '0';
+        parser->state = s_req_http_major;
+        break;
+
+      /* major HTTP version or dot */
+      case s_req_http_major:
+      {
+        if (ch == '.') {
+          parser->state = s_req_first_http_minor;
+          break;
+        }
+
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major *= 10;
+        parser->http_major += ch - '0';
+
+        if (parser->http_major > 999) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* first digit of minor HTTP version */
+      case s_req_first_http_minor:
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor = ch - '0';
+        parser->state = s_req_http_minor;
+        break;
+
+      /* minor HTTP version or end of request line */
+      case s_req_http_minor:
+      {
+        if (ch == CROW_CR) {
+          parser->state = s_req_line_almost_done;
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_field_start;
+          break;
+        }
+
+        /* XXX allow spaces after digit? */
+
+        if (!CROW_IS_NUM(ch)) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor *= 10;
+        parser->http_minor += ch - '0';
+
+        if (parser->http_minor > 999) {
+          CROW_SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* end of request line */
+      case s_req_line_almost_done:
+      {
+        if (ch != CROW_LF) {
+          CROW_SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
+
+        parser->state = s_header_field_start;
+        break;
+      }
+
+      case s_header_field_start:
+      {
+        if (ch == CROW_CR) {
+          parser->state = s_headers_almost_done;
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          /* they might be just sending \n instead of \r\n so this would be
+           * the second \n to denote the end of headers*/
+          parser->state = s_headers_almost_done;
+          goto reexecute_byte;
+        }
+
+        c = CROW_TOKEN(ch);
+
+        if (!c) {
+          CROW_SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+          goto error;
+        }
+
+        CROW_MARK(header_field);
+
+        parser->index = 0;
+        parser->state = s_header_field;
+
+        switch (c) {
+          case 'c':
+            parser->header_state = h_C;
+            break;
+
+          case 'p':
+            parser->header_state = h_matching_proxy_connection;
+            break;
+
+          case 't':
+            parser->header_state = h_matching_transfer_encoding;
+            break;
+
+          case 'u':
+            parser->header_state = h_matching_upgrade;
+            break;
+
+          default:
+            parser->header_state = h_general;
+            break;
+        }
+        break;
+      }
+
+      case s_header_field:
+      {
+        c = CROW_TOKEN(ch);
+
+        if (c) {
+          switch (parser->header_state) {
+            case h_general:
+              break;
+
+            case h_C:
+              parser->index++;
+              parser->header_state = (c == 'o' ? h_CO : h_general);
+              break;
+
+            case h_CO:
+              parser->index++;
+              parser->header_state = (c == 'n' ? h_CON : h_general);
+              break;
+
+            case h_CON:
+              parser->index++;
+              switch (c) {
+                case 'n':
+                  parser->header_state = h_matching_connection;
+                  break;
+                case 't':
+                  parser->header_state = h_matching_content_length;
+                  break;
+                default:
+                  parser->header_state = h_general;
+                  break;
+              }
+              break;
+
+            /* connection */
+
+            case h_matching_connection:
+              parser->index++;
+              if (parser->index > sizeof(CROW_CONNECTION)-1
+                  || c != CROW_CONNECTION[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CROW_CONNECTION)-2) {
+                parser->header_state = h_connection;
+              }
+              break;
+
+            /* proxy-connection */
+
+            case h_matching_proxy_connection:
+              parser->index++;
+              if (parser->index > sizeof(CROW_PROXY_CONNECTION)-1
+                  || c != CROW_PROXY_CONNECTION[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CROW_PROXY_CONNECTION)-2) {
+                parser->header_state = h_connection;
+              }
+              break;
+
+            /* content-length */
+
+            case h_matching_content_length:
+              parser->index++;
+              if (parser->index > sizeof(CROW_CONTENT_LENGTH)-1
+                  || c != CROW_CONTENT_LENGTH[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CROW_CONTENT_LENGTH)-2) {
+                parser->header_state = h_content_length;
+              }
+              break;
+
+            /* transfer-encoding */
+
+            case h_matching_transfer_encoding:
+              parser->index++;
+              if (parser->index > sizeof(CROW_TRANSFER_ENCODING)-1
+                  || c != CROW_TRANSFER_ENCODING[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CROW_TRANSFER_ENCODING)-2) {
+                parser->header_state = h_transfer_encoding;
+              }
+              break;
+
+            /* upgrade */
+
+            case h_matching_upgrade:
+              parser->index++;
+              if (parser->index > sizeof(CROW_UPGRADE)-1
+                  || c != CROW_UPGRADE[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CROW_UPGRADE)-2) {
+                parser->header_state = h_upgrade;
+              }
+              break;
+
+            case h_connection:
+            case h_content_length:
+            case h_transfer_encoding:
+            case h_upgrade:
+              if (ch != ' ') parser->header_state = h_general;
+              break;
+
+            default:
+              assert(0 && "Unknown header_state");
+              break;
+          }
+          break;
+        }
+
+        if (ch == ':') {
+          parser->state = s_header_value_discard_ws;
+          CROW_CALLBACK_DATA(header_field);
+          break;
+        }
+
+        if (ch == CROW_CR) {
+          parser->state = s_header_almost_done;
+          CROW_CALLBACK_DATA(header_field);
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_field_start;
+          CROW_CALLBACK_DATA(header_field);
+          break;
+        }
+
+        CROW_SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+        goto error;
+      }
+
+      case s_header_value_discard_ws:
+        if (ch == ' ' || ch == '\t') break;
+
+        if (ch == CROW_CR) {
+          parser->state = s_header_value_discard_ws_almost_done;
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_value_discard_lws;
+          break;
+        }
+
+        /* FALLTHROUGH */
+
+      case s_header_value_start:
+      {
+        CROW_MARK(header_value);
+
+        parser->state = s_header_value;
+        parser->index = 0;
+
+        c = CROW_LOWER(ch);
+
+        switch (parser->header_state) {
+          case h_upgrade:
+            parser->flags |= F_UPGRADE;
+            parser->header_state = h_general;
+            break;
+
+          case h_transfer_encoding:
+            /* looking for 'Transfer-Encoding: chunked' */
+            if ('c' == c) {
+              parser->header_state = h_matching_transfer_encoding_chunked;
+            } else {
+              parser->header_state = h_general;
+            }
+            break;
+
+          case h_content_length:
+            if (!CROW_IS_NUM(ch)) {
+              CROW_SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
+            }
+
+            parser->content_length = ch - '0';
+            break;
+
+          case h_connection:
+            /* looking for 'Connection: keep-alive' */
+            if (c == 'k') {
+              parser->header_state = h_matching_connection_keep_alive;
+            /* looking for 'Connection: close' */
+            } else if (c == 'c') {
+              parser->header_state = h_matching_connection_close;
+            } else {
+              parser->header_state = h_general;
+            }
+            break;
+
+          default:
+            parser->header_state = h_general;
+            break;
+        }
+        break;
+      }
+
+      case s_header_value:
+      {
+
+        if (ch == CROW_CR) {
+          parser->state = s_header_almost_done;
+          CROW_CALLBACK_DATA(header_value);
+          break;
+        }
+
+        if (ch == CROW_LF) {
+          parser->state = s_header_almost_done;
+          CROW_CALLBACK_DATA_NOADVANCE(header_value);
+          goto reexecute_byte;
+        }
+
+        c = CROW_LOWER(ch);
+
+        switch (parser->header_state) {
+          case h_general:
+            break;
+
+          case h_connection:
+          case h_transfer_encoding:
+            assert(0 && "Shouldn't get here.");
+            break;
+
+          case h_content_length:
+          {
+            uint64_t t;
+
+            if (ch == ' ') break;
+
+            if (!CROW_IS_NUM(ch)) {
+              CROW_SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
+            }
+
+            t = parser->content_length;
+            t *= 10;
+            t += ch - '0';
+
+            /* Overflow? Test against a conservative limit for simplicity. */
+            if ((CROW_ULLONG_MAX - 10) / 10 < parser->content_length) {
+              CROW_SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
+            }
+
+            parser->content_length = t;
+            break;
+          }
+
+          /* Transfer-Encoding: chunked */
+          case h_matching_transfer_encoding_chunked:
+            parser->index++;
+            if (parser->index > sizeof(CROW_CHUNKED)-1
+                || c != CROW_CHUNKED[parser->index]) {
+              parser->header_state = h_general;
+            } else if (parser->index == sizeof(CROW_CHUNKED)-2) {
+              parser->header_state = h_transfer_encoding_chunked;
+            }
+            break;
+
+          /* looking for 'Connection: keep-alive' */
+          case h_matching_connection_keep_alive:
+            parser->index++;
+            if (parser->index > sizeof(CROW_KEEP_ALIVE)-1
+                || c != CROW_KEEP_ALIVE[parser->index]) {
+              parser->header_state = h_general;
+            } else if (parser->index == sizeof(CROW_KEEP_ALIVE)-2) {
+              parser->header_state = h_connection_keep_alive;
+            }
+            break;
+
+          /* looking for 'Connection: close' */
+          case h_matching_connection_close:
+            parser->index++;
+            if (parser->index > sizeof(CROW_CLOSE)-1 || c != CROW_CLOSE[parser->index]) {
+              parser->header_state = h_general;
+            } else if (parser->index == sizeof(CROW_CLOSE)-2) {
+              parser->header_state = h_connection_close;
+            }
+            break;
+
+          case h_transfer_encoding_chunked:
+          case h_connection_keep_alive:
+          case h_connection_close:
+            if (ch != ' ') parser->header_state = h_general;
+            break;
+
+          default:
+            parser->state = s_header_value;
+            parser->header_state = h_general;
+            break;
+        }
+        break;
+      }
+
+      case s_header_almost_done:
+      {
+        CROW_STRICT_CHECK(ch != CROW_LF);
+
+        parser->state = s_header_value_lws;
+        break;
+      }
+
+      case s_header_value_lws:
+      {
+        if (ch == ' ' || ch == '\t') {
+          parser->state = s_header_value_start;
+          goto reexecute_byte;
+        }
+
+        /* finished the header */
+        switch (parser->header_state) {
+          case h_connection_keep_alive:
+            parser->flags |= F_CONNECTION_KEEP_ALIVE;
+            break;
+          case h_connection_close:
+            parser->flags |= F_CONNECTION_CLOSE;
+            break;
+          case h_transfer_encoding_chunked:
+            parser->flags |= F_CHUNKED;
+            break;
+          default:
+            break;
+        }
+
+        parser->state = s_header_field_start;
+        goto reexecute_byte;
+      }
+
+      case s_header_value_discard_ws_almost_done:
+      {
+        CROW_STRICT_CHECK(ch != CROW_LF);
+        parser->state = s_header_value_discard_lws;
+        break;
+      }
+
+      case s_header_value_discard_lws:
+      {
+        if (ch == ' ' || ch == '\t') {
+          parser->state = s_header_value_discard_ws;
+          break;
+        } else {
+          /* header value was empty */
+          CROW_MARK(header_value);
+          parser->state = s_header_field_start;
+          CROW_CALLBACK_DATA_NOADVANCE(header_value);
+          goto reexecute_byte;
+        }
+      }
+
+      case s_headers_almost_done:
+      {
+        CROW_STRICT_CHECK(ch != CROW_LF);
+
+        if (parser->flags & F_TRAILING) {
+          /* End of a chunked request */
+          parser->state = CROW_NEW_MESSAGE();
+          CROW_CALLBACK_NOTIFY(message_complete);
+          break;
+        }
+
+        parser->state = s_headers_done;
+
+        /* Set this here so that on_headers_complete() callbacks can see it */
+        parser->upgrade =
+          (parser->flags & F_UPGRADE || parser->method == HTTP_CONNECT);
+
+        /* Here we call the headers_complete callback. This is somewhat
+         * different than other callbacks because if the user returns 1, we
+         * will interpret that as saying that this message has no body. This
+         * is needed for the annoying case of recieving a response to a HEAD
+         * request.
+         *
+         * We'd like to use CROW_CALLBACK_NOTIFY_NOADVANCE() here but we cannot, so
+         * we have to simulate it by handling a change in errno below.
+         */
+        if (settings->on_headers_complete) {
+          switch (settings->on_headers_complete(parser)) {
+            case 0:
+              break;
+
+            case 1:
+              parser->flags |= F_SKIPBODY;
+              break;
+
+            default:
+              CROW_SET_ERRNO(HPE_CB_headers_complete);
+              return p - data; /* Error */
+          }
+        }
+
+        if (CROW_HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+          return p - data;
+        }
+
+        goto reexecute_byte;
+      }
+
+      case s_headers_done:
+      {
+        CROW_STRICT_CHECK(ch != CROW_LF);
+
+        parser->nread = 0;
+
+        /* Exit, the rest of the connect is in a different protocol. */
+        if (parser->upgrade) {
+          parser->state = CROW_NEW_MESSAGE();
+          CROW_CALLBACK_NOTIFY(message_complete);
+          return (p - data) + 1;
+        }
+
+        if (parser->flags & F_SKIPBODY) {
+          parser->state = CROW_NEW_MESSAGE();
+          CROW_CALLBACK_NOTIFY(message_complete);
+        } else if (parser->flags & F_CHUNKED) {
+          /* chunked encoding - ignore Content-Length header */
+          parser->state = s_chunk_size_start;
+        } else {
+          if (parser->content_length == 0) {
+            /* Content-Length header given but zero: Content-Length: 0\r\n */
+            parser->state = CROW_NEW_MESSAGE();
+            CROW_CALLBACK_NOTIFY(message_complete);
+          } else if (parser->content_length != CROW_ULLONG_MAX) {
+            /* Content-Length header given and non-zero */
+            parser->state = s_body_identity;
+          } else {
+            if (parser->type == HTTP_REQUEST ||
+                !http_message_needs_eof(parser)) {
+              /* Assume content-length 0 - read the next */
+              parser->state = CROW_NEW_MESSAGE();
+              CROW_CALLBACK_NOTIFY(message_complete);
+            } else {
+              /* Read body until EOF */
+              parser->state = s_body_identity_eof;
+            }
+          }
+        }
+
+        break;
+      }
+
+      case s_body_identity:
+      {
+        uint64_t to_read = CROW_MIN(parser->content_length,
+                               (uint64_t) ((data + len) - p));
+
+        assert(parser->content_length != 0
+            && parser->content_length != CROW_ULLONG_MAX);
+
+        /* The difference between advancing content_length and p is because
+         * the latter will automaticaly advance on the next loop iteration.
+         * Further, if content_length ends up at 0, we want to see the last
+         * byte again for our message complete callback.
+         */
+        CROW_MARK(body);
+        parser->content_length -= to_read;
+        p += to_read - 1;
+
+        if (parser->content_length == 0) {
+          parser->state = s_message_done;
+
+          /* Mimic CROW_CALLBACK_DATA_NOADVANCE() but with one extra byte.
+           *
+           * The alternative to doing this is to wait for the next byte to
+           * trigger the data callback, just as in every other case. The
+           * problem with this is that this makes it difficult for the test
+           * harness to distinguish between complete-on-EOF and
+           * complete-on-length. It's not clear that this distinction is
+           * important for applications, but let's keep it for now.
+           */
+          CROW_CALLBACK_DATA_(body, p - body_mark + 1, p - data);
+          goto reexecute_byte;
+        }
+
+        break;
+      }
+
+      /* read until EOF */
+      case s_body_identity_eof:
+        CROW_MARK(body);
+        p = data + len - 1;
+
+        break;
+
+      case s_message_done:
+        parser->state = CROW_NEW_MESSAGE();
+        CROW_CALLBACK_NOTIFY(message_complete);
+        break;
+
+      case s_chunk_size_start:
+      {
+        assert(parser->nread == 1);
+        assert(parser->flags & F_CHUNKED);
+
+        unhex_val = unhex[(unsigned char)ch];
+        if (unhex_val == -1) {
+          CROW_SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
+          goto error;
+        }
+
+        parser->content_length = unhex_val;
+        parser->state = s_chunk_size;
+        break;
+      }
+
+      case s_chunk_size:
+      {
+        uint64_t t;
+
+        assert(parser->flags & F_CHUNKED);
+
+        if (ch == CROW_CR) {
+          parser->state = s_chunk_size_almost_done;
+          break;
+        }
+
+        unhex_val = unhex[(unsigned char)ch];
+
+        if (unhex_val == -1) {
+          if (ch == ';' || ch == ' ') {
+            parser->state = s_chunk_parameters;
+            break;
+          }
+
+          CROW_SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
+          goto error;
+        }
+
+        t = parser->content_length;
+        t *= 16;
+        t += unhex_val;
+
+        /* Overflow? Test against a conservative limit for simplicity. */
+        if ((CROW_ULLONG_MAX - 16) / 16 < parser->content_length) {
+          CROW_SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+          goto error;
+        }
+
+        parser->content_length = t;
+        break;
+      }
+
+      case s_chunk_parameters:
+      {
+        assert(parser->flags & F_CHUNKED);
+        /* just ignore this shit. TODO check for overflow */
+        if (ch == CROW_CR) {
+          parser->state = s_chunk_size_almost_done;
+          break;
+        }
+        break;
+      }
+
+      case s_chunk_size_almost_done:
+      {
+        assert(parser->flags & F_CHUNKED);
+        CROW_STRICT_CHECK(ch != CROW_LF);
+
+        parser->nread = 0;
+
+        if (parser->content_length == 0) {
+          parser->flags |= F_TRAILING;
+          parser->state = s_header_field_start;
+        } else {
+          parser->state = s_chunk_data;
+        }
+        break;
+      }
+
+      case s_chunk_data:
+      {
+        uint64_t to_read = CROW_MIN(parser->content_length,
+                               (uint64_t) ((data + len) - p));
+
+        assert(parser->flags & F_CHUNKED);
+        assert(parser->content_length != 0
+            && parser->content_length != CROW_ULLONG_MAX);
+
+        /* See the explanation in s_body_identity for why the content
+         * length and data pointers are managed this way.
+         */
+        CROW_MARK(body);
+        parser->content_length -= to_read;
+        p += to_read - 1;
+
+        if (parser->content_length == 0) {
+          parser->state = s_chunk_data_almost_done;
+        }
+
+        break;
+      }
+
+      case s_chunk_data_almost_done:
+        assert(parser->flags & F_CHUNKED);
+        assert(parser->content_length == 0);
+        CROW_STRICT_CHECK(ch != CROW_CR);
+        parser->state = s_chunk_data_done;
+        CROW_CALLBACK_DATA(body);
+        break;
+
+      case s_chunk_data_done:
+        assert(parser->flags & F_CHUNKED);
+        CROW_STRICT_CHECK(ch != CROW_LF);
+        parser->nread = 0;
+        parser->state = s_chunk_size_start;
+        break;
+
+      default:
+        assert(0 && "unhandled state");
+        CROW_SET_ERRNO(HPE_INVALID_INTERNAL_STATE);
+        goto error;
+    }
+  }
+
+  /* Run callbacks for any marks that we have leftover after we ran our of
+   * bytes. There should be at most one of these set, so it's OK to invoke
+   * them in series (unset marks will not result in callbacks).
+   *
+   * We use the NOADVANCE() variety of callbacks here because 'p' has already
+   * overflowed 'data' and this allows us to correct for the off-by-one that
+   * we'd otherwise have (since CROW_CALLBACK_DATA() is meant to be run with a 'p'
+   * value that's in-bounds).
+   */
+
+  assert(((header_field_mark ? 1 : 0) +
+          (header_value_mark ? 1 : 0) +
+          (url_mark ? 1 : 0)  +
+          (body_mark ? 1 : 0) +
+          (status_mark ? 1 : 0)) <= 1);
+
+  CROW_CALLBACK_DATA_NOADVANCE(header_field);
+  CROW_CALLBACK_DATA_NOADVANCE(header_value);
+  CROW_CALLBACK_DATA_NOADVANCE(url);
+  CROW_CALLBACK_DATA_NOADVANCE(body);
+  CROW_CALLBACK_DATA_NOADVANCE(status);
+
+  return len;
+
+error:
+  if (CROW_HTTP_PARSER_ERRNO(parser) == HPE_OK) {
+    CROW_SET_ERRNO(HPE_UNKNOWN);
+  }
+
+  return (p - data);
+}
+
+
+/* Does the parser need to see an EOF to find the end of the message? */
+inline int
+http_message_needs_eof (const http_parser *parser)
+{
+  if (parser->type == HTTP_REQUEST) {
+    return 0;
+  }
+
+  /* See RFC 2616 section 4.4 */
+  if (parser->status_code / 100 == 1 || /* 1xx e.g. Continue */
+      parser->status_code == 204 ||     /* No Content */
+      parser->status_code == 304 ||     /* Not Modified */
+      parser->flags & F_SKIPBODY) {     /* response to a HEAD request */
+    return 0;
+  }
+
+  if ((parser->flags & F_CHUNKED) || parser->content_length != CROW_ULLONG_MAX) {
+    return 0;
+  }
+
+  return 1;
+}
+
+
+inline int
+http_should_keep_alive (const http_parser *parser)
+{
+  if (parser->http_major > 0 && parser->http_minor > 0) {
+    /* HTTP/1.1 */
+    if (parser->flags & F_CONNECTION_CLOSE) {
+      return 0;
+    }
+  } else {
+    /* HTTP/1.0 or earlier */
+    if (!(parser->flags & F_CONNECTION_KEEP_ALIVE)) {
+      return 0;
+    }
+  }
+
+  return !http_message_needs_eof(parser);
+}
+
+
+inline const char *
+http_method_str (enum http_method m)
+{
+static const char *method_strings[] =
+  {
+#define CROW_XX(num, name, string) #string,
+  CROW_HTTP_METHOD_MAP(CROW_XX)
+#undef CROW_XX
+  };
+  return CROW_ELEM_AT(method_strings, m, "<unknown>");
+}
+
+
+inline void
+http_parser_init (http_parser *parser, enum http_parser_type t)
+{
+  void *data = parser->data; /* preserve application data */
+  memset(parser, 0, sizeof(*parser));
+  parser->data = data;
+  parser->type = t;
+  parser->state = (t == HTTP_REQUEST ? s_start_req : (t == HTTP_RESPONSE ? s_start_res : s_start_req_or_res));
+  parser->http_errno = HPE_OK;
+}
+
+inline const char *
+http_errno_name(enum http_errno err) {
+/* Map errno values to strings for human-readable output */
+#define CROW_HTTP_STRERROR_GEN(n, s) { "HPE_" #n, s },
+static struct {
+  const char *name;
+  const char *description;
+} http_strerror_tab[] = {
+  CROW_HTTP_ERRNO_MAP(CROW_HTTP_STRERROR_GEN)
+};
+#undef CROW_HTTP_STRERROR_GEN
+  assert(err < (sizeof(http_strerror_tab)/sizeof(http_strerror_tab[0])));
+  return http_strerror_tab[err].name;
+}
+
+inline const char *
+http_errno_description(enum http_errno err) {
+/* Map errno values to strings for human-readable output */
+#define CROW_HTTP_STRERROR_GEN(n, s) { "HPE_" #n, s },
+static struct {
+  const char *name;
+  const char *description;
+} http_strerror_tab[] = {
+  CROW_HTTP_ERRNO_MAP(CROW_HTTP_STRERROR_GEN)
+};
+#undef CROW_HTTP_STRERROR_GEN
+  assert(err < (sizeof(http_strerror_tab)/sizeof(http_strerror_tab[0])));
+  return http_strerror_tab[err].description;
+}
+
+inline static enum http_host_state
+http_parse_host_char(enum http_host_state s, const char ch) {
+  switch(s) {
+    case s_http_userinfo:
+    case s_http_userinfo_start:
+      if (ch == '@') {
+        return s_http_host_start;
+      }
+
+      if (CROW_IS_USERINFO_CHAR(ch)) {
+        return s_http_userinfo;
+      }
+      break;
+
+    case s_http_host_start:
+      if (ch == '[') {
+        return s_http_host_v6_start;
+      }
+
+      if (CROW_IS_HOST_CHAR(ch)) {
+        return s_http_host;
+      }
+
+      break;
+
+    case s_http_host:
+      if (CROW_IS_HOST_CHAR(ch)) {
+        return s_http_host;
+      }
+
+    /* FALLTHROUGH */
+    case s_http_host_v6_end:
+      if (ch == ':') {
+        return s_http_host_port_start;
+      }
+
+      break;
+
+    case s_http_host_v6:
+      if (ch == ']') {
+        return s_http_host_v6_end;
+      }
+
+    /* FALLTHROUGH */
+    case s_http_host_v6_start:
+      if (CROW_IS_HEX(ch) || ch == ':' || ch == '.') {
+        return s_http_host_v6;
+      }
+
+      break;
+
+    case s_http_host_port:
+    case s_http_host_port_start:
+      if (CROW_IS_NUM(ch)) {
+        return s_http_host_port;
+      }
+
+      break;
+
+    default:
+      break;
+  }
+  return s_http_host_dead;
+}
+
+inline int
+http_parse_host(const char * buf, struct http_parser_url *u, int found_at) {
+  enum http_host_state s;
+
+  const char *p;
+  size_t buflen = u->field_data[UF_HOST].off + u->field_data[UF_HOST].len;
+
+  u->field_data[UF_HOST].len = 0;
+
+  s = found_at ? s_http_userinfo_start : s_http_host_start;
+
+  for (p = buf + u->field_data[UF_HOST].off; p < buf + buflen; p++) {
+    enum http_host_state new_s = http_parse_host_char(s, *p);
+
+    if (new_s == s_http_host_dead) {
+      return 1;
+    }
+
+    switch(new_s) {
+      case s_http_host:
+        if (s != s_http_host) {
+          u->field_data[UF_HOST].off = static_cast<uint16_t>(p - buf);
+        }
+        u->field_data[UF_HOST].len++;
+        break;
+
+      case s_http_host_v6:
+        if (s != s_http_host_v6) {
+          u->field_data[UF_HOST].off = static_cast<uint16_t>(p - buf);
+        }
+        u->field_data[UF_HOST].len++;
+        break;
+
+      case s_http_host_port:
+        if (s != s_http_host_port) {
+          u->field_data[UF_PORT].off = static_cast<uint16_t>(p - buf);
+          u->field_data[UF_PORT].len = 0;
+          u->field_set |= (1 << UF_PORT);
+        }
+        u->field_data[UF_PORT].len++;
+        break;
+
+      case s_http_userinfo:
+        if (s != s_http_userinfo) {
+          u->field_data[UF_USERINFO].off = static_cast<uint16_t>(p - buf);
+          u->field_data[UF_USERINFO].len = 0;
+          u->field_set |= (1 << UF_USERINFO);
+        }
+        u->field_data[UF_USERINFO].len++;
+        break;
+
+      default:
+        break;
+    }
+    s = new_s;
+  }
+
+  /* Make sure we don't end somewhere unexpected */
+  switch (s) {
+    case s_http_host_start:
+    case s_http_host_v6_start:
+    case s_http_host_v6:
+    case s_http_host_port_start:
+    case s_http_userinfo:
+    case s_http_userinfo_start:
+      return 1;
+    default:
+      break;
+  }
+
+  return 0;
+}
+
+inline int
+http_parser_parse_url(const char *buf, size_t buflen, int is_connect,
+                      struct http_parser_url *u)
+{
+  enum state s;
+  const char *p;
+  enum http_parser_url_fields uf, old_uf;
+  int found_at = 0;
+
+  u->port = u->field_set = 0;
+  s = is_connect ? s_req_server_start : s_req_spaces_before_url;
+  old_uf = UF_MAX;
+
+  for (p = buf; p < buf + buflen; p++) {
+    s = parse_url_char(s, *p);
+
+    /* Figure out the next field that we're operating on */
+    switch (s) {
+      case s_dead:
+        return 1;
+
+      /* Skip delimeters */
+      case s_req_schema_slash:
+      case s_req_schema_slash_slash:
+      case s_req_server_start:
+      case s_req_query_string_start:
+      case s_req_fragment_start:
+        continue;
+
+      case s_req_schema:
+        uf = UF_SCHEMA;
+        break;
+
+      case s_req_server_with_at:
+        found_at = 1;
+
+      /* FALLTROUGH */
+      case s_req_server:
+        uf = UF_HOST;
+        break;
+
+      case s_req_path:
+        uf = UF_PATH;
+        break;
+
+      case s_req_query_string:
+        uf = UF_QUERY;
+        break;
+
+      case s_req_fragment:
+        uf = UF_FRAGMENT;
+        break;
+
+      default:
+        assert(!"Unexpected state");
+        return 1;
+    }
+
+    /* Nothing's changed; soldier on */
+    if (uf == old_uf) {
+      u->field_data[uf].len++;
+      continue;
+    }
+
+    u->field_data[uf].off = static_cast<uint16_t>(p - buf);
+    u->field_data[uf].len = 1;
+
+    u->field_set |= (1 << uf);
+    old_uf = uf;
+  }
+
+  /* host must be present if there is a schema */
+  /* parsing http:///toto will fail */
+  if ((u->field_set & ((1 << UF_SCHEMA) | (1 << UF_HOST))) != 0) {
+    if (http_parse_host(buf, u, found_at) != 0) {
+      return 1;
+    }
+  }
+
+  /* CONNECT requests can only contain "hostname:port" */
+  if (is_connect && u->field_set != ((1 << UF_HOST)|(1 << UF_PORT))) {
+    return 1;
+  }
+
+  if (u->field_set & (1 << UF_PORT)) {
+    /* Don't bother with endp; we've already validated the string */
+    unsigned long v = strtoul(buf + u->field_data[UF_PORT].off, NULL, 10);
+
+    /* Ports have a max value of 2^16 */
+    if (v > 0xffff) {
+      return 1;
+    }
+
+    u->port = (uint16_t) v;
+  }
+
+  return 0;
+}
+
+inline void
+http_parser_pause(http_parser *parser, int paused) {
+  /* Users should only be pausing/unpausing a parser that is not in an error
+   * state. In non-debug builds, there's not much that we can do about this
+   * other than ignore it.
+   */
+  if (CROW_HTTP_PARSER_ERRNO(parser) == HPE_OK ||
+      CROW_HTTP_PARSER_ERRNO(parser) == HPE_PAUSED) {
+    CROW_SET_ERRNO((paused) ? HPE_PAUSED : HPE_OK);
+  } else {
+    assert(0 && "Attempting to pause parser in error state");
+  }
+}
+
+inline int
+http_body_is_final(const struct http_parser *parser) {
+    return parser->state == s_message_done;
+}
+
+inline unsigned long
+http_parser_version(void) {
+  return CROW_HTTP_PARSER_VERSION_MAJOR * 0x10000 |
+         CROW_HTTP_PARSER_VERSION_MINOR * 0x00100 |
+         CROW_HTTP_PARSER_VERSION_PATCH * 0x00001;
+}
+
+#undef CROW_HTTP_METHOD_MAP
+#undef CROW_HTTP_ERRNO_MAP
+#undef CROW_SET_ERRNO
+#undef CROW_CALLBACK_NOTIFY_
+#undef CROW_CALLBACK_NOTIFY
+#undef CROW_CALLBACK_NOTIFY_NOADVANCE
+#undef CROW_CALLBACK_DATA_
+#undef CROW_CALLBACK_DATA
+#undef CROW_CALLBACK_DATA_NOADVANCE
+#undef CROW_MARK
+#undef CROW_PROXY_CONNECTION
+#undef CROW_CONNECTION
+#undef CROW_CONTENT_LENGTH
+#undef CROW_TRANSFER_ENCODING
+#undef CROW_UPGRADE
+#undef CROW_CHUNKED
+#undef CROW_KEEP_ALIVE
+#undef CROW_CLOSE
+#undef CROW_PARSING_HEADER
+#undef CROW_CR
+#undef CROW_LF
+#undef CROW_LOWER
+#undef CROW_IS_ALPHA
+#undef CROW_IS_NUM
+#undef CROW_IS_ALPHANUM
+#undef CROW_IS_HEX
+#undef CROW_IS_MARK
+#undef CROW_IS_USERINFO_CHAR
+#undef CROW_TOKEN
+#undef CROW_IS_URL_CHAR
+#undef CROW_IS_HOST_CHAR
+#undef CROW_start_state
+#undef CROW_STRICT_CHECK
+#undef CROW_NEW_MESSAGE
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+
+
+/* 
+ *
+ * TinySHA1 - a header only implementation of the SHA1 algorithm in C++. Based
+ * on the implementation in boost::uuid::details.
+ * 
+ * SHA1 Wikipedia Page: http://en.wikipedia.org/wiki/SHA-1
+ * 
+ * Copyright (c) 2012-22 SAURAV MOHAPATRA <mohaps@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef _TINY_SHA1_HPP_
+#define _TINY_SHA1_HPP_
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+namespace sha1
+{
+	class SHA1
+	{
+	public:
+		typedef uint32_t digest32_t[5];
+		typedef uint8_t digest8_t[20];
+		inline static uint32_t LeftRotate(uint32_t value, size_t count) {
+			return (value << count) ^ (value >> (32-count));
+		}
+		SHA1(){ reset(); }
+		virtual ~SHA1() {}
+		SHA1(const SHA1& s) { *this = s; }
+		const SHA1& operator = (const SHA1& s) {
+			memcpy(m_digest, s.m_digest, 5 * sizeof(uint32_t));
+			memcpy(m_block, s.m_block, 64);
+			m_blockByteIndex = s.m_blockByteIndex;
+			m_byteCount = s.m_byteCount;
+			return *this;
+		}
+		SHA1& reset() {
+			m_digest[0] = 0x67452301;
+			m_digest[1] = 0xEFCDAB89;
+			m_digest[2] = 0x98BADCFE;
+			m_digest[3] = 0x10325476;
+			m_digest[4] = 0xC3D2E1F0;
+			m_blockByteIndex = 0;
+			m_byteCount = 0;
+			return *this;
+		}
+		SHA1& processByte(uint8_t octet) {
+			this->m_block[this->m_blockByteIndex++] = octet;
+			++this->m_byteCount;
+			if(m_blockByteIndex == 64) {
+				this->m_blockByteIndex = 0;
+				processBlock();
+			}
+			return *this;
+		}
+		SHA1& processBlock(const void* const start, const void* const end) {
+			const uint8_t* begin = static_cast<const uint8_t*>(start);
+			const uint8_t* finish = static_cast<const uint8_t*>(end);
+			while(begin != finish) {
+				processByte(*begin);
+				begin++;
+			}
+			return *this;
+		}
+		SHA1& processBytes(const void* const data, size_t len) {
+			const uint8_t* block = static_cast<const uint8_t*>(data);
+			processBlock(block, block + len);
+			return *this;
+		}
+		const uint32_t* getDigest(digest32_t digest) {
+			size_t bitCount = this->m_byteCount * 8;
+			processByte(0x80);
+			if (this->m_blockByteIndex > 56) {
+				while (m_blockByteIndex != 0) {
+					processByte(0);
+				}
+				while (m_blockByteIndex < 56) {
+					processByte(0);
+				}
+			} else {
+				while (m_blockByteIndex < 56) {
+					processByte(0);
+				}
+			}
+			processByte(0);
+			processByte(0);
+			processByte(0);
+			processByte(0);
+			processByte( static_cast<unsigned char>((bitCount>>24) & 0xFF));
+			processByte( static_cast<unsigned char>((bitCount>>16) & 0xFF));
+			processByte( static_cast<unsigned char>((bitCount>>8 ) & 0xFF));
+			processByte( static_cast<unsigned char>((bitCount)     & 0xFF));
+	
+			memcpy(digest, m_digest, 5 * sizeof(uint32_t));
+			return digest;
+		}
+		const uint8_t* getDigestBytes(digest8_t digest) {
+			digest32_t d32;
+			getDigest(d32);
+			size_t di = 0;
+			digest[di++] = ((d32[0] >> 24) & 0xFF);
+			digest[di++] = ((d32[0] >> 16) & 0xFF);
+			digest[di++] = ((d32[0] >> 8) & 0xFF);
+			digest[di++] = ((d32[0]) & 0xFF);
+			
+			digest[di++] = ((d32[1] >> 24) & 0xFF);
+			digest[di++] = ((d32[1] >> 16) & 0xFF);
+			digest[di++] = ((d32[1] >> 8) & 0xFF);
+			digest[di++] = ((d32[1]) & 0xFF);
+			
+			digest[di++] = ((d32[2] >> 24) & 0xFF);
+			digest[di++] = ((d32[2] >> 16) & 0xFF);
+			digest[di++] = ((d32[2] >> 8) & 0xFF);
+			digest[di++] = ((d32[2]) & 0xFF);
+			
+			digest[di++] = ((d32[3] >> 24) & 0xFF);
+			digest[di++] = ((d32[3] >> 16) & 0xFF);
+			digest[di++] = ((d32[3] >> 8) & 0xFF);
+			digest[di++] = ((d32[3]) & 0xFF);
+			
+			digest[di++] = ((d32[4] >> 24) & 0xFF);
+			digest[di++] = ((d32[4] >> 16) & 0xFF);
+			digest[di++] = ((d32[4] >> 8) & 0xFF);
+			digest[di++] = ((d32[4]) & 0xFF);
+			return digest;
+		}
+	
+	protected:
+		void processBlock() {
+			uint32_t w[80];
+			for (size_t i = 0; i < 16; i++) {
+				w[i]  = (m_block[i*4 + 0] << 24);
+				w[i] |= (m_block[i*4 + 1] << 16);
+				w[i] |= (m_block[i*4 + 2] << 8);
+				w[i] |= (m_block[i*4 + 3]);
+			}
+			for (size_t i = 16; i < 80; i++) {
+				w[i] = LeftRotate((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]), 1);
+			}
+	
+			uint32_t a = m_digest[0];
+			uint32_t b = m_digest[1];
+			uint32_t c = m_digest[2];
+			uint32_t d = m_digest[3];
+			uint32_t e = m_digest[4];
+	
+			for (std::size_t i=0; i<80; ++i) {
+				uint32_t f = 0;
+				uint32_t k = 0;
+	
+				if (i<20) {
+					f = (b & c) | (~b & d);
+					k = 0x5A827999;
+				} else if (i<40) {
+					f = b ^ c ^ d;
+					k = 0x6ED9EBA1;
+				} else if (i<60) {
+					f = (b & c) | (b & d) | (c & d);
+					k = 0x8F1BBCDC;
+				} else {
+					f = b ^ c ^ d;
+					k = 0xCA62C1D6;
+				}
+				uint32_t temp = LeftRotate(a, 5) + f + e + k + w[i];
+				e = d;
+				d = c;
+				c = LeftRotate(b, 30);
+				b = a;
+				a = temp;
+			}
+	
+			m_digest[0] += a;
+			m_digest[1] += b;
+			m_digest[2] += c;
+			m_digest[3] += d;
+			m_digest[4] += e;
+		}
+	private:
+		digest32_t m_digest;
+		uint8_t m_block[64];
+		size_t m_blockByteIndex;
+		size_t m_byteCount;
+	};
+}
+#endif
+
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+
+
+
+namespace crow
+{
+    enum class HTTPMethod
+    {
+#ifndef DELETE
+        DELETE = 0,
+        GET,
+        HEAD,
+        POST,
+        PUT,
+        CONNECT,
+        OPTIONS,
+        TRACE,
+        PATCH,
+        PURGE,
+#endif
+
+        Delete = 0,
+        Get,
+        Head,
+        Post,
+        Put,
+        Connect,
+        Options,
+        Trace,
+        Patch,
+        Purge,
+
+
+        InternalMethodCount,
+        // should not add an item below this line: used for array count
+    };
+
+    inline std::string method_name(HTTPMethod method)
+    {
+        switch(method)
+        {
+            case HTTPMethod::Delete:
+                return "DELETE";
+            case HTTPMethod::Get:
+                return "GET";
+            case HTTPMethod::Head:
+                return "HEAD";
+            case HTTPMethod::Post:
+                return "POST";
+            case HTTPMethod::Put:
+                return "PUT";
+            case HTTPMethod::Connect:
+                return "CONNECT";
+            case HTTPMethod::Options:
+                return "OPTIONS";
+            case HTTPMethod::Trace:
+                return "TRACE";
+            case HTTPMethod::Patch:
+                return "PATCH";
+            case HTTPMethod::Purge:
+                return "PURGE";
+            default:
+                return "invalid";
+        }
+        return "invalid";
+    }
+
+    enum class ParamType
+    {
+        INT,
+        UINT,
+        DOUBLE,
+        STRING,
+        PATH,
+
+        MAX
+    };
+
+    // Parameters matched by the router. They are kept as views into the request url, which
+    // outlives the handler call, and converted to the handler's argument types only when it is
+    // invoked, so matching a route never allocates.
+    struct routing_params
+    {
+        static const unsigned capacity = 16;
+
+        struct param
+        {
+            const char* data;
+            uint32_t size;
+            ParamType type;
+        };
+
+        // <path> parameters are read back as strings, in the same sequence as <string> ones
+        void push(ParamType type, const char* data, size_t size)
+        {
+            if (count_ == capacity)
+                throw std::runtime_error("too many route parameters");
+            params_[count_++] = param{data, static_cast<uint32_t>(size), type == ParamType::PATH ? ParamType::STRING : type};
+        }
+
+        void pop()
+        {
+            count_ --;
+        }
+
+        unsigned size() const
+        {
+            return count_;
+        }
+
+        void debug_print() const
+        {
+            std::cerr << "routing_params" << std::endl;
+            for(unsigned i = 0; i < count_; i ++)
+                std::cerr << (int)params_[i].type << ':' << std::string(params_[i].data, params_[i].size) << ", ";
+            std::cerr << std::endl;
+        }
+
+        template <typename T>
+        T get(unsigned) const;
+
+    private:
+        // `index'th parameter of the given type
+        const param& nth(ParamType type, unsigned index) const
+        {
+            for(unsigned i = 0; i < count_; i ++)
+            {
+                if (params_[i].type == type && index-- == 0)
+                    return params_[i];
+            }
+            throw std::out_of_range("routing_params: no such parameter");
+        }
+
+        // strto* need a terminated string; numbers too long for the stack buffer are rare enough to allocate
+        template <typename F>
+        static auto convert(const param& p, F f) -> decltype(f(""))
+        {
+            char buf[64];
+            if (p.size < sizeof(buf))
+            {
+                std::memcpy(buf, p.data, p.size);
+                buf[p.size] = 0;
+                return f(buf);
+            }
+            std::string copy(p.data, p.size);
+            return f(copy.c_str());
+        }
+
+        std::array<param, capacity> params_{};
+        unsigned count_{};
+    };
+
+    template<>
+    inline int64_t routing_params::get<int64_t>(unsigned index) const
+    {
+        return convert(nth(ParamType::INT, index), [](const char* s){ return static_cast<int64_t>(std::strtoll(s, nullptr, 10)); });
+    }
+
+    template<>
+    inline uint64_t routing_params::get<uint64_t>(unsigned index) const
+    {
+        return convert(nth(ParamType::UINT, index), [](const char* s){ return static_cast<uint64_t>(std::strtoull(s, nullptr, 10)); });
+    }
+
+    template<>
+    inline double routing_params::get<double>(unsigned index) const
+    {
+        return convert(nth(ParamType::DOUBLE, index), [](const char* s){ return std::strtod(s, nullptr); });
+    }
+
+    template<>
+    inline std::string routing_params::get<std::string>(unsigned index) const
+    {
+        const param& p = nth(ParamType::STRING, index);
+        return std::string(p.data, p.size);
+    }
+}
+
+#ifndef CROW_MSVC_WORKAROUND
+constexpr crow::HTTPMethod operator "" _method(const char* str, size_t /*len*/)
+{
+    return
+        crow::black_magic::is_equ_p(str, "GET", 3) ? crow::HTTPMethod::Get :
+        crow::black_magic::is_equ_p(str, "DELETE", 6) ? crow::HTTPMethod::Delete :
+        crow::black_magic::is_equ_p(str, "HEAD", 4) ? crow::HTTPMethod::Head :
+        crow::black_magic::is_equ_p(str, "POST", 4) ? crow::HTTPMethod::Post :
+        crow::black_magic::is_equ_p(str, "PUT", 3) ? crow::HTTPMethod::Put :
+        crow::black_magic::is_equ_p(str, "OPTIONS", 7) ? crow::HTTPMethod::Options :
+        crow::black_magic::is_equ_p(str, "CONNECT", 7) ? crow::HTTPMethod::Connect :
+        crow::black_magic::is_equ_p(str, "TRACE", 5) ? crow::HTTPMethod::Trace :
+        crow::black_magic::is_equ_p(str, "PATCH", 5) ? crow::HTTPMethod::Patch :
+        crow::black_magic::is_equ_p(str, "PURGE", 5) ? crow::HTTPMethod::Purge :
+        throw std::runtime_error("invalid http method");
+}
+#endif
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <boost/utility/string_ref.hpp>
+
+namespace crow
+{
+    namespace detail
+    {
+        // Header names are ASCII; folding case by hand avoids going through std::locale.
+        inline bool iequals_ascii(const char* a, const char* b, size_t size)
+        {
+            for(size_t i = 0; i < size; i ++)
+            {
+                char x = a[i], y = b[i];
+                if (x != y && ((x | 0x20) != (y | 0x20) || (unsigned char)((x | 0x20) - 'a') > 'z' - 'a'))
+                    return false;
+            }
+            return true;
+        }
+
+        inline char to_lower_ascii(char c)
+        {
+            return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+        }
+
+        inline void assign_string(std::string& s, boost::string_ref v)
+        {
+            s.assign(v.data(), v.size());
+        }
+
+        // only a std::string rvalue is moved; everything else is copied into the existing buffer
+        template <typename T>
+        typename std::enable_if<std::is_same<T, std::string>::value>::type assign_string(std::string& s, T&& v)
+        {
+            s = std::move(v);
+        }
+    }
+
+    // Headers the server itself reads. ci_map remembers where the first of each is, so
+    // finding one is an array read instead of a search.
+    enum class known_header : uint8_t
+    {
+        connection,
+        host,
+        expect,
+        upgrade,
+        content_length,
+        server,
+        date,
+        cookie,
+        http2_settings,
+        none
+    };
+
+    namespace detail
+    {
+        constexpr size_t known_header_count = static_cast<size_t>(known_header::none);
+
+        inline known_header classify_header(boost::string_ref name)
+        {
+            auto is = [&](const char* s){ return iequals_ascii(name.data(), s, name.size()); };
+            switch(name.size())
+            {
+                case 4:
+                    if (is("host")) return known_header::host;
+                    if (is("date")) return known_header::date;
+                    break;
+                case 6:
+                    if (is("expect")) return known_header::expect;
+                    if (is("server")) return known_header::server;
+                    if (is("cookie")) return known_header::cookie;
+                    break;
+                case 7:
+                    if (is("upgrade")) return known_header::upgrade;
+                    break;
+                case 10:
+                    if (is("connection")) return known_header::connection;
+                    break;
+                case 14:
+                    if (is("content-length")) return known_header::content_length;
+                    if (is("http2-settings")) return known_header::http2_settings;
+                    break;
+            }
+            return known_header::none;
+        }
+    }
+
+    struct ci_hash
+    {
+        size_t operator()(boost::string_ref key) const
+        {
+            // FNV-1a over the lower case bytes
+            size_t seed = 2166136261u;
+            for(auto c : key)
+            {
+                seed ^= (unsigned char)detail::to_lower_ascii(c);
+                seed *= 16777619u;
+            }
+            return seed;
+        }
+    };
+
+    struct ci_key_eq
+    {
+        bool operator()(boost::string_ref l, boost::string_ref r) const
+        {
+            return l.size() == r.size() && detail::iequals_ascii(l.data(), r.data(), l.size());
+        }
+    };
+
+    // Case-insensitive multimap for headers. Entries live in one array, inline up to
+    // `inline_capacity', in insertion order with equal keys kept next to each other, and are
+    // found by a linear search; a request only carries a dozen or two of them. The
+    // known_header ones are found directly.
+    // clear() keeps both the array and the strings in it, so a connection refilling the
+    // same map for every request stops allocating once it has seen its largest one.
+    class ci_map
+    {
+    public:
+        using key_type = std::string;
+        using mapped_type = std::string;
+        using value_type = std::pair<std::string, std::string>;
+        using size_type = size_t;
+        using iterator = value_type*;
+        using const_iterator = const value_type*;
+
+        static constexpr size_t inline_capacity = 16;
+
+        ci_map()
+        {
+        }
+
+        ci_map(std::initializer_list<value_type> init)
+        {
+            for(auto& kv : init)
+                emplace(kv.first, kv.second);
+        }
+
+        ci_map(const ci_map& other)
+        {
+            for(auto& kv : other)
+                emplace_back(kv.first, kv.second);
+        }
+
+        ci_map(ci_map&& other)
+        {
+            steal(other);
+        }
+
+        ci_map& operator = (const ci_map& other)
+        {
+            if (this != &other)
+            {
+                clear();
+                for(auto& kv : other)
+                    emplace_back(kv.first, kv.second);
+            }
+            return *this;
+        }
+
+        ci_map& operator = (ci_map&& other)
+        {
+            if (this != &other)
+            {
+                release();
+                steal(other);
+            }
+            return *this;
+        }
+
+        ~ci_map()
+        {
+            release();
+        }
+
+        iterator begin() { return data_; }
+        iterator end() { return data_ + size_; }
+        const_iterator begin() const { return data_; }
+        const_iterator end() const { return data_ + size_; }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        void clear()
+        {
+            size_ = 0;
+            std::fill(std::begin(known_), std::end(known_), 0);
+        }
+
+        // Adds an entry after any others with the same key
+        template <typename Key, typename Value>
+        iterator emplace(Key&& key, Value&& value)
+        {
+            emplace_back(std::forward<Key>(key), std::forward<Value>(value));
+            size_t last = size_ - 1;
+            const std::string& k = data_[last].first;
+            for(size_t i = last; i -- > 0; )
+            {
+                if (key_equal(data_[i].first, k))
+                {
+                    std::rotate(data_ + i + 1, data_ + last, data_ + size_);
+                    for(auto& pos : known_)
+                    {
+                        if (pos > i + 1)
+                            pos ++;
+                    }
+                    return data_ + i + 1;
+                }
+            }
+            return data_ + last;
+        }
+
+        iterator insert(const value_type& kv)
+        {
+            return emplace(kv.first, kv.second);
+        }
+
+        iterator find(boost::string_ref key)
+        {
+            for(size_t i = 0; i < size_; i ++)
+            {
+                if (key_equal(data_[i].first, key))
+                    return data_ + i;
+            }
+            return end();
+        }
+
+        const_iterator find(boost::string_ref key) const
+        {
+            return const_cast<ci_map*>(this)->find(key);
+        }
+
+        iterator find(known_header key)
+        {
+            size_t pos = known_[static_cast<size_t>(key)];
+            return pos ? data_ + pos - 1 : end();
+        }
+
+        const_iterator find(known_header key) const
+        {
+            return const_cast<ci_map*>(this)->find(key);
+        }
+
+        std::pair<iterator, iterator> equal_range(boost::string_ref key)
+        {
+            return group(find(key));
+        }
+
+        std::pair<iterator, iterator> equal_range(known_header key)
+        {
+            return group(find(key));
+        }
+
+        std::pair<const_iterator, const_iterator> equal_range(boost::string_ref key) const
+        {
+            auto r = const_cast<ci_map*>(this)->equal_range(key);
+            return {r.first, r.second};
+        }
+
+        std::pair<const_iterator, const_iterator> equal_range(known_header key) const
+        {
+            auto r = const_cast<ci_map*>(this)->equal_range(key);
+            return {r.first, r.second};
+        }
+
+        size_t count(boost::string_ref key) const
+        {
+            auto r = equal_range(key);
+            return r.second - r.first;
+        }
+
+        size_t count(known_header key) const
+        {
+            auto r = equal_range(key);
+            return r.second - r.first;
+        }
+
+        size_t erase(boost::string_ref key)
+        {
+            auto r = equal_range(key);
+            size_t n = r.second - r.first;
+            // the erased strings go past the end, where clear() keeps them too
+            std::rotate(r.first, r.second, end());
+            size_ -= n;
+            reindex();
+            return n;
+        }
+
+        iterator erase(const_iterator pos)
+        {
+            iterator it = data_ + (pos - data_);
+            std::rotate(it, it + 1, end());
+            size_ --;
+            reindex();
+            return it;
+        }
+
+    private:
+        static bool key_equal(boost::string_ref l, boost::string_ref r)
+        {
+            return ci_key_eq()(l, r);
+        }
+
+        // The entries sharing first's key, which are next to each other
+        std::pair<iterator, iterator> group(iterator first)
+        {
+            iterator last = first;
+            while(last != end() && key_equal(last->first, first->first))
+                ++ last;
+            return {first, last};
+        }
+
+        template <typename Key, typename Value>
+        void emplace_back(Key&& key, Value&& value)
+        {
+            if (size_ == constructed_)
+            {
+                if (constructed_ == capacity_)
+                    grow();
+                new (data_ + constructed_) value_type();
+                constructed_ ++;
+            }
+            value_type& kv = data_[size_];
+            detail::assign_string(kv.first, std::forward<Key>(key));
+            detail::assign_string(kv.second, std::forward<Value>(value));
+            size_ ++;
+            note_known(size_ - 1);
+        }
+
+        // Records entry i if it is the first of a known header
+        void note_known(size_t i)
+        {
+            known_header h = detail::classify_header(data_[i].first);
+            if (h != known_header::none && !known_[static_cast<size_t>(h)])
+                known_[static_cast<size_t>(h)] = i + 1;
+        }
+
+        void reindex()
+        {
+            std::fill(std::begin(known_), std::end(known_), 0);
+            for(size_t i = 0; i < size_; i ++)
+                note_known(i);
+        }
+
+        void grow()
+        {
+            size_t capacity = capacity_ * 2;
+            value_type* data = static_cast<value_type*>(std::malloc(capacity * sizeof(value_type)));
+            if (!data)
+                throw std::bad_alloc();
+            for(size_t i = 0; i < constructed_; i ++)
+            {
+                new (data + i) value_type(std::move(data_[i]));
+                data_[i].~value_type();
+            }
+            if (data_ != inline_data())
+                std::free(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+
+        void release()
+        {
+            for(size_t i = 0; i < constructed_; i ++)
+                data_[i].~value_type();
+            if (data_ != inline_data())
+                std::free(data_);
+            data_ = inline_data();
+            size_ = constructed_ = 0;
+            capacity_ = inline_capacity;
+            std::fill(std::begin(known_), std::end(known_), 0);
+        }
+
+        // Takes over other's entries, leaving it empty; expects *this to be released
+        void steal(ci_map& other)
+        {
+            std::copy(std::begin(other.known_), std::end(other.known_), std::begin(known_));
+            if (other.data_ != other.inline_data())
+            {
+                data_ = other.data_;
+                capacity_ = other.capacity_;
+                size_ = other.size_;
+                constructed_ = other.constructed_;
+                other.data_ = other.inline_data();
+                other.size_ = other.constructed_ = 0;
+                other.capacity_ = inline_capacity;
+                other.clear();
+                return;
+            }
+            for(size_t i = 0; i < other.size_; i ++)
+                new (data_ + i) value_type(std::move(other.data_[i]));
+            size_ = constructed_ = other.size_;
+            other.clear();
+        }
+
+        value_type* inline_data()
+        {
+            return reinterpret_cast<value_type*>(&inline_);
+        }
+
+        typename std::aligned_storage<sizeof(value_type) * inline_capacity, alignof(value_type)>::type inline_;
+        value_type* data_{inline_data()};
+        size_t size_{};
+        size_t constructed_{};
+        size_t capacity_{inline_capacity};
+        // 1 + the index of the first entry of each known_header, 0 if there is none
+        uint32_t known_[detail::known_header_count]{};
+    };
+}
+
+
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <boost/optional.hpp>
+
+namespace crow
+{
+// ----------------------------------------------------------------------------
+// qs_parse (modified)
+// https://github.com/bartgrantham/qs_parse
+// ----------------------------------------------------------------------------
+/*  Similar to strncmp, but handles URL-encoding for either string  */
+int qs_strncmp(const char * s, const char * qs, size_t n);
+
+
+/*  Finds the beginning of each key/value pair and stores a pointer in qs_kv.
+ *  Also decodes the value portion of the k/v pair *in-place*.  In a future
+ *  enhancement it will also have a compile-time option of sorting qs_kv
+ *  alphabetically by key.  */
+int qs_parse(char * qs, char * qs_kv[], int qs_kv_size);
+
+
+/*  Used by qs_parse to decode the value portion of a k/v pair  */
+int qs_decode(char * qs);
+
+
+/*  Looks up the value according to the key on a pre-processed query string
+ *  A future enhancement will be a compile-time option to look up the key
+ *  in a pre-sorted qs_kv array via a binary search.  */
+//char * qs_k2v(const char * key, char * qs_kv[], int qs_kv_size);
+ char * qs_k2v(const char * key, char * const * qs_kv, int qs_kv_size, int nth);
+
+
+/*  Non-destructive lookup of value, based on key.  User provides the
+ *  destinaton string and length.  */
+char * qs_scanvalue(const char * key, const char * qs, char * val, size_t val_len);
+
+// TODO: implement sorting of the qs_kv array; for now ensure it's not compiled
+#undef _qsSORTING
+
+// isxdigit _is_ available in <ctype.h>, but let's avoid another header instead
+#define CROW_QS_ISHEX(x)    ((((x)>='0'&&(x)<='9') || ((x)>='A'&&(x)<='F') || ((x)>='a'&&(x)<='f')) ? 1 : 0)
+#define CROW_QS_HEX2DEC(x)  (((x)>='0'&&(x)<='9') ? (x)-48 : ((x)>='A'&&(x)<='F') ? (x)-55 : ((x)>='a'&&(x)<='f') ? (x)-87 : 0)
+#define CROW_QS_ISQSCHR(x) ((((x)=='=')||((x)=='#')||((x)=='&')||((x)=='\0')) ? 0 : 1)
+
+inline int qs_strncmp(const char * s, const char * qs, size_t n)
+{
+    int i=0;
+    unsigned char u1, u2, unyb, lnyb;
+
+    while(n-- > 0)
+    {
+        u1 = (unsigned char) *s++;
+        u2 = (unsigned char) *qs++;
+
+        if ( ! CROW_QS_ISQSCHR(u1) ) {  u1 = '\0';  }
+        if ( ! CROW_QS_ISQSCHR(u2) ) {  u2 = '\0';  }
+
+        if ( u1 == '+' ) {  u1 = ' ';  }
+        if ( u1 == '%' ) // easier/safer than scanf
+        {
+            unyb = (unsigned char) *s++;
+            lnyb = (unsigned char) *s++;
+            if ( CROW_QS_ISHEX(unyb) && CROW_QS_ISHEX(lnyb) )
+                u1 = (CROW_QS_HEX2DEC(unyb) * 16) + CROW_QS_HEX2DEC(lnyb);
+            else
+                u1 = '\0';
+        }
+
+        if ( u2 == '+' ) {  u2 = ' ';  }
+        if ( u2 == '%' ) // easier/safer than scanf
+        {
+            unyb = (unsigned char) *qs++;
+            lnyb = (unsigned char) *qs++;
+            if ( CROW_QS_ISHEX(unyb) && CROW_QS_ISHEX(lnyb) )
+                u2 = (CROW_QS_HEX2DEC(unyb) * 16) + CROW_QS_HEX2DEC(lnyb);
+            else
+                u2 = '\0';
+        }
+
+        if ( u1 != u2 )
+            return u1 - u2;
+        if ( u1 == '\0' )
+            return 0;
+        i++;
+    }
+    if ( CROW_QS_ISQSCHR(*qs) )
+        return -1;
+    else
+        return 0;
+}
+
+
+inline int qs_parse(char * qs, char * qs_kv[], int qs_kv_size)
+{
+    int i, j;
+    char * substr_ptr;
+
+    for(i=0; i<qs_kv_size; i++)  qs_kv[i] = NULL;
+
+    // find the beginning of the k/v substrings or the fragment
+    substr_ptr = qs + strcspn(qs, "?#");
+    if (substr_ptr[0] != '\0')
+        substr_ptr++;
+    else
+        return 0; // no query or fragment
+
+    i=0;
+    while(i<qs_kv_size)
+    {
+        qs_kv[i] = substr_ptr;
+        j = static_cast<int>(strcspn(substr_ptr, "&"));
+        if ( substr_ptr[j] == '\0' ) {  break;  }
+        substr_ptr += j + 1;
+        i++;
+    }
+    i++;  // x &'s -> means x iterations of this loop -> means *x+1* k/v pairs
+
+    // we only decode the values in place, the keys could have '='s in them
+    // which will hose our ability to distinguish keys from values later
+    for(j=0; j<i; j++)
+    {
+        substr_ptr = qs_kv[j] + strcspn(qs_kv[j], "=&#");
+        if ( substr_ptr[0] == '&' || substr_ptr[0] == '\0')  // blank value: skip decoding
+            substr_ptr[0] = '\0';
+        else
+            qs_decode(++substr_ptr);
+    }
+
+#ifdef _qsSORTING
+// TODO: qsort qs_kv, using qs_strncmp() for the comparison
+#endif
+
+    return i;
+}
+
+
+inline int qs_decode(char * qs)
+{
+    int i=0, j=0;
+
+    while( CROW_QS_ISQSCHR(qs[j]) )
+    {
+        if ( qs[j] == '+' ) {  qs[i] = ' ';  }
+        else if ( qs[j] == '%' ) // easier/safer than scanf
+        {
+            if ( ! CROW_QS_ISHEX(qs[j+1]) || ! CROW_QS_ISHEX(qs[j+2]) )
+            {
+                qs[i] = '\0';
+                return i;
+            }
+            qs[i] = (CROW_QS_HEX2DEC(qs[j+1]) * 16) + CROW_QS_HEX2DEC(qs[j+2]);
+            j+=2;
+        }
+        else
+        {
+            qs[i] = qs[j];
+        }
+        i++;  j++;
+    }
+    qs[i] = '\0';
+
+    return i;
+}
+
+
+inline char * qs_k2v(const char * key, char * const * qs_kv, int qs_kv_size, int nth = 0)
+{
+    int i;
+    size_t key_len, skip;
+
+    key_len = strlen(key);
+
+#ifdef _qsSORTING
+// TODO: binary search for key in the sorted qs_kv
+#else  // _qsSORTING
+    for(i=0; i<qs_kv_size; i++)
+    {
+        // we rely on the unambiguous '=' to find the value in our k/v pair
+        if ( qs_strncmp(key, qs_kv[i], key_len) == 0 )
+        {
+            skip = strcspn(qs_kv[i], "=");
+            if ( qs_kv[i][skip] == '=' )
+                skip++;
+            // return (zero-char value) ? ptr to trailing '\0' : ptr to value
+            if(nth == 0)
+                return qs_kv[i] + skip;
+            else 
+                --nth;
+        }
+    }
+#endif  // _qsSORTING
+
+    return NULL;
+}
+
+inline boost::optional<std::pair<std::string, std::string>> qs_dict_name2kv(const char * dict_name, char * const * qs_kv, int qs_kv_size, int nth = 0)
+{
+    int i;
+    size_t name_len, skip_to_eq, skip_to_brace_open, skip_to_brace_close;
+
+    name_len = strlen(dict_name);
+
+#ifdef _qsSORTING
+// TODO: binary search for key in the sorted qs_kv
+#else  // _qsSORTING
+    for(i=0; i<qs_kv_size; i++)
+    {
+        if ( strncmp(dict_name, qs_kv[i], name_len) == 0 )
+        {
+            skip_to_eq = strcspn(qs_kv[i], "=");
+            if ( qs_kv[i][skip_to_eq] == '=' )
+                skip_to_eq++;
+            skip_to_brace_open = strcspn(qs_kv[i], "[");
+            if ( qs_kv[i][skip_to_brace_open] == '[' )
+                skip_to_brace_open++;
+            skip_to_brace_close = strcspn(qs_kv[i], "]");
+
+            if ( skip_to_brace_open <= skip_to_brace_close &&
+                 skip_to_brace_open > 0 &&
+                 skip_to_brace_close > 0 &&
+                 nth == 0 )
+            {
+                auto key = std::string(qs_kv[i] + skip_to_brace_open, skip_to_brace_close - skip_to_brace_open);
+                auto value = std::string(qs_kv[i] + skip_to_eq);
+                return boost::make_optional(std::make_pair(key, value));
+            }
+            else
+            {
+                --nth;
+            }
+        }
+    }
+#endif  // _qsSORTING
+
+    return boost::none;
+}
+
+
+inline char * qs_scanvalue(const char * key, const char * qs, char * val, size_t val_len)
+{
+    const char * tmp;
+
+    // find the beginning of the k/v substrings
+    if ( (tmp = strchr(qs, '?')) != NULL )
+        qs = tmp + 1;
+
+    const auto key_len = strlen(key);
+    while(qs[0] != '#' && qs[0] != '\0')
+    {
+        if ( qs_strncmp(key, qs, key_len) == 0 )
+            break;
+        qs += strcspn(qs, "&") + 1;
+    }
+
+    if ( qs[0] == '\0' ) return NULL;
+
+    qs += strcspn(qs, "=&#");
+    if ( qs[0] == '=' )
+    {
+        qs++;
+        const auto i = strcspn(qs, "&=#");
+#ifdef _MSC_VER
+        strncpy_s(val, val_len, qs, (val_len - 1)<(i + 1) ? (val_len - 1) : (i + 1));
+#else
+        strncpy(val, qs, (val_len - 1)<(i + 1) ? (val_len - 1) : (i + 1));
+#endif
+		qs_decode(val);
+    }
+    else
+    {
+        if ( val_len > 0 )
+            val[0] = '\0';
+    }
+
+    return val;
+}
+}
+// ----------------------------------------------------------------------------
+
+
+namespace crow 
+{
+    // The query part of a url. It is decoded in place and indexed on first lookup: each pair
+    // becomes offsets into the owned copy of the query, and keys are hashed into an open
+    // addressing table, so a lookup costs one hash of the name whatever the number of pairs.
+    class query_string
+    {
+    public:
+        static const int MAX_KEY_VALUE_PAIRS_COUNT = 256;
+
+        query_string()
+        {
+
+        }
+
+        query_string(const query_string& qs) = default;
+        query_string& operator = (const query_string& qs) = default;
+
+        query_string(query_string&& qs)
+            : url_(std::move(qs.url_)), entries_(std::move(qs.entries_)), slots_(std::move(qs.slots_)), parsed_(qs.parsed_)
+        {
+            qs.clear();
+        }
+
+        query_string& operator = (query_string&& qs)
+        {
+            url_ = std::move(qs.url_);
+            entries_ = std::move(qs.entries_);
+            slots_ = std::move(qs.slots_);
+            parsed_ = qs.parsed_;
+            qs.clear();
+            return *this;
+        }
+
+        // the url is only split into key/value pairs on first lookup
+        query_string(std::string url)
+            : url_(std::move(url))
+        {
+        }
+
+        // Replaces the url, keeping the storage for reuse
+        void assign(const char* url, size_t size)
+        {
+            url_.assign(url, size);
+            entries_.clear();
+            slots_.clear();
+            parsed_ = false;
+        }
+
+        void clear() 
+        {
+            entries_.clear();
+            slots_.clear();
+            url_.clear();
+            parsed_ = false;
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const query_string& qs)
+        {
+            qs.parse();
+            os << "[ ";
+            for(size_t i = 0; i < qs.entries_.size(); ++i) {
+                if (i)
+                    os << ", ";
+                auto& e = qs.entries_[i];
+                os.write(qs.url_.data() + e.key, e.key_size);
+                if (e.has_value)
+                    os << '=' << qs.url_.data() + e.value;
+            }
+            os << " ]";
+            return os;
+
+        }
+
+        // The decoded value for `name', nullptr if there is none; "" for a key without a value.
+        char* get (const std::string& name) const
+        {
+            parse();
+            const entry* e = find(name.data(), name.size(), "");
+            return e ? value(*e) : nullptr;
+        }
+
+        std::vector<char*> get_list (const std::string& name) const
+        {
+            parse();
+            std::vector<char*> ret;
+            for(const entry* e = find(name.data(), name.size(), "[]"); e; e = next(*e))
+                ret.push_back(value(*e));
+            return ret;
+        }
+
+        std::unordered_map<std::string, std::string> get_dict (const std::string& name) const
+        {
+            parse();
+            std::unordered_map<std::string, std::string> ret;
+
+            for(auto& e : entries_)
+            {
+                const char* key = url_.data() + e.key;
+                if (e.key_size < name.size() || name.compare(0, name.size(), key, name.size()) != 0)
+                    continue;
+                // `name[sub]=value' -> sub, `name=value' -> ""
+                const char* open = std::find(key, key + e.key_size, '[');
+                const char* close = std::find(key, key + e.key_size, ']');
+                if (open != key + e.key_size)
+                    open ++;
+                if (open <= close)
+                    ret.insert({std::string(open, close), value(e)});
+            }
+            return ret;
+        }
+
+        // Typed lookups; `fallback' is returned when the key is missing or its value does not
+        // parse completely. Values are converted in place, without allocating.
+        int64_t get_int (const std::string& name, int64_t fallback = 0) const
+        {
+            const char* v = get(name);
+            if (!v || !*v)
+                return fallback;
+            char* end;
+            errno = 0;
+            long long n = strtoll(v, &end, 10);
+            if (*end || errno == ERANGE)
+                return fallback;
+            return n;
+        }
+
+        double get_double (const std::string& name, double fallback = 0) const
+        {
+            const char* v = get(name);
+            if (!v || !*v)
+                return fallback;
+            char* end;
+            errno = 0;
+            double d = strtod(v, &end);
+            if (*end || errno == ERANGE)
+                return fallback;
+            return d;
+        }
+
+        // true/1/yes/on or a key without a value are true; false/0/no/off are false
+        bool get_bool (const std::string& name, bool fallback = false) const
+        {
+            const char* v = get(name);
+            if (!v)
+                return fallback;
+            static const char* const truthy[] = {"", "1", "true", "yes", "on"};
+            static const char* const falsy[] = {"0", "false", "no", "off"};
+            for(auto t : truthy)
+                if (strcasecmp_ascii(v, t))
+                    return true;
+            for(auto f : falsy)
+                if (strcasecmp_ascii(v, f))
+                    return false;
+            return fallback;
+        }
+
+    private:
+        struct entry
+        {
+            uint32_t key;
+            uint32_t key_size;
+            // the value is nul terminated
+            uint32_t value;
+            uint32_t hash;
+            // 1 + index of the next pair with the same key, 0 for the last one
+            uint32_t next;
+            bool has_value;
+        };
+
+        static bool strcasecmp_ascii(const char* a, const char* b)
+        {
+            auto lower = [](char c){ return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 'a' - 'A') : c; };
+            for(; *a && *b; a ++, b ++)
+            {
+                if (lower(*a) != lower(*b))
+                    return false;
+            }
+            return *a == *b;
+        }
+
+        static uint32_t hash_key(const char* data, size_t size, uint32_t h = 2166136261u)
+        {
+            // FNV-1a
+            for(size_t i = 0; i < size; i ++)
+            {
+                h ^= static_cast<unsigned char>(data[i]);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        // Decodes `+' and `%xx' escapes of s[0, size) in place, stopping at a `#' or a bad
+        // escape, and returns the decoded length.
+        static size_t decode(char* s, size_t size)
+        {
+            size_t i = 0, j = 0;
+            for(; j < size && s[j] != '#'; i ++, j ++)
+            {
+                if (s[j] == '+')
+                    s[i] = ' ';
+                else if (s[j] == '%')
+                {
+                    if (j + 2 >= size || !CROW_QS_ISHEX(s[j+1]) || !CROW_QS_ISHEX(s[j+2]))
+                        break;
+                    s[i] = static_cast<char>(CROW_QS_HEX2DEC(s[j+1]) * 16 + CROW_QS_HEX2DEC(s[j+2]));
+                    j += 2;
+                }
+                else
+                    s[i] = s[j];
+            }
+            return i;
+        }
+
+        char* value(const entry& e) const
+        {
+            return &url_[e.value];
+        }
+
+        const entry* next(const entry& e) const
+        {
+            return e.next ? &entries_[e.next - 1] : nullptr;
+        }
+
+        // First pair whose decoded key is `name' followed by `suffix'. Names are decoded like
+        // keys; short ones are decoded on the stack.
+        const entry* find(const char* name, size_t size, const char* suffix) const
+        {
+            if (slots_.empty())
+                return nullptr;
+
+            size_t suffix_size = strlen(suffix);
+            char buf[128];
+            std::string heap;
+            char* key = buf;
+            if (size + suffix_size > sizeof(buf))
+            {
+                heap.resize(size + suffix_size);
+                key = &heap[0];
+            }
+            memcpy(key, name, size);
+            size = decode(key, size);
+            memcpy(key + size, suffix, suffix_size);
+            size += suffix_size;
+
+            uint32_t h = hash_key(key, size);
+            size_t mask = slots_.size() - 1;
+            for(size_t slot = h & mask; slots_[slot]; slot = (slot + 1) & mask)
+            {
+                const entry& e = entries_[slots_[slot] - 1];
+                if (e.hash == h && e.key_size == size && memcmp(url_.data() + e.key, key, size) == 0)
+                    return &e;
+            }
+            return nullptr;
+        }
+
+        // decodes the pairs in place, so this must run at most once per url_
+        void parse() const
+        {
+            if (parsed_)
+                return;
+            parsed_ = true;
+
+            size_t pos = url_.find_first_of("?#");
+            if (pos == std::string::npos)
+                return;
+            pos ++;
+
+            char* s = &url_[0];
+            size_t n = url_.size();
+            entries_.reserve(std::min<size_t>(std::count(url_.begin() + pos, url_.end(), '&') + 1, MAX_KEY_VALUE_PAIRS_COUNT));
+            while (entries_.size() < (size_t)MAX_KEY_VALUE_PAIRS_COUNT)
+            {
+                size_t end = url_.find('&', pos);
+                if (end == std::string::npos)
+                    end = n;
+                size_t key_end = pos;
+                while (key_end < end && s[key_end] != '=' && s[key_end] != '#')
+                    key_end ++;
+
+                entry e{};
+                e.key = static_cast<uint32_t>(pos);
+                e.key_size = static_cast<uint32_t>(decode(s + pos, key_end - pos));
+                e.hash = hash_key(s + pos, e.key_size);
+                e.has_value = key_end < end && s[key_end] == '=';
+                if (e.has_value)
+                {
+                    e.value = static_cast<uint32_t>(key_end + 1);
+                    size_t value_size = decode(s + e.value, end - e.value);
+                    if (e.value + value_size < n)
+                        s[e.value + value_size] = '\0';
+                }
+                else
+                {
+                    e.value = static_cast<uint32_t>(key_end);
+                    if (key_end < n)
+                        s[key_end] = '\0';
+                }
+                entries_.push_back(e);
+
+                if (end == n)
+                    break;
+                pos = end + 1;
+            }
+
+            size_t size = 2;
+            while (size < entries_.size() * 2)
+                size *= 2;
+            slots_.assign(size, 0);
+            for(uint32_t i = 0; i < entries_.size(); i ++)
+            {
+                entry& e = entries_[i];
+                size_t slot = e.hash & (size - 1);
+                for(; slots_[slot]; slot = (slot + 1) & (size - 1))
+                {
+                    entry* first = &entries_[slots_[slot] - 1];
+                    if (first->hash == e.hash && first->key_size == e.key_size &&
+                        memcmp(s + first->key, s + e.key, e.key_size) == 0)
+                    {
+                        while (first->next)
+                            first = &entries_[first->next - 1];
+                        first->next = i + 1;
+                        break;
+                    }
+                }
+                if (!slots_[slot])
+                    slots_[slot] = i + 1;
+            }
+        }
+
+        mutable std::string url_;
+        mutable std::vector<entry> entries_;
+        // 1 + index of the first pair with a given key, 0 for an empty slot
+        mutable std::vector<uint32_t> slots_;
+        mutable bool parsed_{};
+    };
+
+} // end namespace
+
+
+
+#pragma once
+
+#include <boost/asio.hpp>
+
+
+
+
+
+
+
+
+namespace crow
+{
+    template <typename T, typename Key>
+    inline const std::string& get_header_value(const T& headers, const Key& key)
+    {
+        auto it = headers.find(key);
+        if (it != headers.end())
+        {
+            return it->second;
+        }
+        static std::string empty;
+        return empty;
+    }
+
+	struct DetachHelper;
+
+    template <typename Adaptor, typename Handler, typename ... Middlewares>
+    class Connection;
+
+    struct request
+    {
+        template <typename Adaptor, typename Handler, typename ... Middlewares>
+        friend class crow::Connection;
+
+        HTTPMethod method;
+        std::string raw_url;
+        std::string url;
+        query_string url_params;
+        ci_map headers;
+        std::string body;
+
+        void* middleware_context{};
+        boost::asio::io_service* io_service{};
+
+        request()
+            : method(HTTPMethod::Get)
+        {
+        }
+
+        request(HTTPMethod method, std::string raw_url, std::string url, query_string url_params, ci_map headers, std::string body)
+            : method(method), raw_url(std::move(raw_url)), url(std::move(url)), url_params(std::move(url_params)), headers(std::move(headers)), body(std::move(body))
+        {
+        }
+
+        void add_header(std::string key, std::string value)
+        {
+            headers.emplace(std::move(key), std::move(value));
+        }
+
+        const std::string& get_header_value(const std::string& key) const
+        {
+            return crow::get_header_value(headers, key);
+        }
+
+        const std::string& get_header_value(known_header key) const
+        {
+            return crow::get_header_value(headers, key);
+        }
+
+        // resolved from the socket on first use; most handlers never ask for it
+        const std::string& remoteIpAddress() const
+        {
+            if (remote_ip_address_.empty() && remote_ip_address_helper_)
+                remote_ip_address_ = remote_ip_address_helper_();
+            return remote_ip_address_;
+        }
+
+        template<typename CompletionHandler>
+        void post(CompletionHandler handler)
+        {
+            io_service->post(handler);
+        }
+
+        template<typename CompletionHandler>
+        void dispatch(CompletionHandler handler)
+        {
+            io_service->dispatch(handler);
+        }
+
+        private:
+            mutable std::string remote_ip_address_;
+            std::function<std::string()> remote_ip_address_helper_;
+    };
+}
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+
+
+
+
+
+
+
+
+
+
+namespace crow
+{
+    // HTTP/2 (RFC 7540) framing and HPACK (RFC 7541) header compression.
+    //
+    // Nothing in here touches a socket: a session is fed the bytes read from the peer and leaves
+    // the bytes to be sent in output(), so Connection decides when they are written.
+    namespace http2
+    {
+        static const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static const size_t client_preface_size = sizeof(client_preface) - 1;
+        static const size_t frame_header_size = 9;
+
+        enum class frame_type : uint8_t
+        {
+            data = 0,
+            headers,
+            priority,
+            rst_stream,
+            settings,
+            push_promise,
+            ping,
+            goaway,
+            window_update,
+            continuation,
+        };
+
+        namespace flags
+        {
+            enum : uint8_t
+            {
+                end_stream = 0x1,
+                ack = 0x1,
+                end_headers = 0x4,
+                padded = 0x8,
+                priority = 0x20,
+            };
+        }
+
+        enum class error_code : uint32_t
+        {
+            no_error = 0,
+            protocol_error,
+            internal_error,
+            flow_control_error,
+            settings_timeout,
+            stream_closed,
+            frame_size_error,
+            refused_stream,
+            cancel,
+            compression_error,
+            connect_error,
+            enhance_your_calm,
+            inadequate_security,
+            http_1_1_required,
+        };
+
+        enum class settings_id : uint16_t
+        {
+            header_table_size = 1,
+            enable_push,
+            max_concurrent_streams,
+            initial_window_size,
+            max_frame_size,
+            max_header_list_size,
+        };
+
+        struct frame_header
+        {
+            uint32_t length;
+            frame_type type;
+            uint8_t flags;
+            uint32_t stream_id;
+        };
+
+        inline uint32_t read_uint32(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+        }
+
+        inline void append_uint32(std::string& out, uint32_t v)
+        {
+            out.push_back(static_cast<char>(v >> 24));
+            out.push_back(static_cast<char>(v >> 16));
+            out.push_back(static_cast<char>(v >> 8));
+            out.push_back(static_cast<char>(v));
+        }
+
+        inline frame_header parse_frame_header(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            frame_header h;
+            h.length = (uint32_t(u[0]) << 16) | (uint32_t(u[1]) << 8) | uint32_t(u[2]);
+            h.type = static_cast<frame_type>(u[3]);
+            h.flags = u[4];
+            h.stream_id = read_uint32(p + 5) & 0x7FFFFFFF;
+            return h;
+        }
+
+        inline void append_frame_header(std::string& out, uint32_t length, frame_type type, uint8_t flags, uint32_t stream_id)
+        {
+            out.push_back(static_cast<char>(length >> 16));
+            out.push_back(static_cast<char>(length >> 8));
+            out.push_back(static_cast<char>(length));
+            out.push_back(static_cast<char>(type));
+            out.push_back(static_cast<char>(flags));
+            append_uint32(out, stream_id & 0x7FFFFFFF);
+        }
+
+        inline void append_setting(std::string& out, settings_id id, uint32_t value)
+        {
+            out.push_back(static_cast<char>(static_cast<uint16_t>(id) >> 8));
+            out.push_back(static_cast<char>(static_cast<uint16_t>(id)));
+            append_uint32(out, value);
+        }
+
+        namespace hpack
+        {
+            using header_list = std::vector<std::pair<std::string, std::string>>;
+
+            // 5.1 integer representation; `first' holds the bits above the prefix
+            inline void encode_integer(std::string& out, uint8_t first, int prefix_bits, uint64_t value)
+            {
+                const uint64_t max_prefix = (1u << prefix_bits) - 1;
+                if (value < max_prefix)
+                {
+                    out.push_back(static_cast<char>(first | value));
+                    return;
+                }
+                out.push_back(static_cast<char>(first | max_prefix));
+                value -= max_prefix;
+                while (value >= 128)
+                {
+                    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                    value >>= 7;
+                }
+                out.push_back(static_cast<char>(value));
+            }
+
+            inline uint64_t decode_integer(const char*& p, const char* end, int prefix_bits)
+            {
+                if (p == end)
+                    throw std::runtime_error("hpack: truncated integer");
+                const uint64_t max_prefix = (1u << prefix_bits) - 1;
+                uint64_t value = static_cast<unsigned char>(*p++) & max_prefix;
+                if (value < max_prefix)
+                    return value;
+                for(int shift = 0; ; shift += 7)
+                {
+                    if (p == end)
+                        throw std::runtime_error("hpack: truncated integer");
+                    if (shift > 28)
+                        throw std::runtime_error("hpack: integer overflow");
+                    unsigned char b = static_cast<unsigned char>(*p++);
+                    value += uint64_t(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                        return value;
+                }
+            }
+
+            struct huffman_code
+            {
+                uint32_t code;
+                uint8_t bits;
+            };
+
+            // Appendix B; symbol 256 is EOS
+            inline const huffman_code* huffman_table()
+            {
+                static const huffman_code table[257] = {
+                    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+                    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+                    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+                    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+                    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+                    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+                    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+                    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+                    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+                    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+                    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+                    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+                    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+                    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+                    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+                    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+                    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+                    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+                    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+                    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+                    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+                    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+                    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+                    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+                    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+                    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+                    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+                    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+                    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+                    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+                    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+                    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+                    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+                    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+                    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+                    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+                    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+                    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+                    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+                    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+                    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+                    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+                    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+                    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+                    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+                    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+                    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+                    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+                    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+                    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+                    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+                    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+                    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+                    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+                    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+                    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+                    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+                    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+                    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+                    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+                    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+                    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+                    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+                    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+                    {0x3fffffff, 30}
+                };
+                return table;
+            }
+
+            struct huffman_node
+            {
+                int16_t next[2];
+                int16_t symbol;
+            };
+
+            inline const std::vector<huffman_node>& huffman_tree()
+            {
+                static const std::vector<huffman_node> tree = []{
+                    std::vector<huffman_node> nodes(1, huffman_node{{-1, -1}, -1});
+                    for(int symbol = 0; symbol < 257; symbol ++)
+                    {
+                        const huffman_code& c = huffman_table()[symbol];
+                        size_t current = 0;
+                        for(int i = c.bits - 1; i >= 0; i --)
+                        {
+                            int bit = (c.code >> i) & 1;
+                            if (nodes[current].next[bit] < 0)
+                            {
+                                nodes[current].next[bit] = static_cast<int16_t>(nodes.size());
+                                nodes.push_back(huffman_node{{-1, -1}, -1});
+                            }
+                            current = static_cast<size_t>(nodes[current].next[bit]);
+                        }
+                        nodes[current].symbol = static_cast<int16_t>(symbol);
+                    }
+                    return nodes;
+                }();
+                return tree;
+            }
+
+            inline size_t huffman_encoded_size(const std::string& s)
+            {
+                uint64_t bits = 0;
+                for(auto c : s)
+                    bits += huffman_table()[static_cast<unsigned char>(c)].bits;
+                return static_cast<size_t>((bits + 7) / 8);
+            }
+
+            inline void huffman_encode(std::string& out, const std::string& s)
+            {
+                uint64_t acc = 0;
+                int bits = 0;
+                for(auto c : s)
+                {
+                    const huffman_code& code = huffman_table()[static_cast<unsigned char>(c)];
+                    acc = (acc << code.bits) | code.code;
+                    bits += code.bits;
+                    while (bits >= 8)
+                    {
+                        bits -= 8;
+                        out.push_back(static_cast<char>(acc >> bits));
+                    }
+                    acc &= (uint64_t(1) << bits) - 1;
+                }
+                // pad with the most significant bits of EOS
+                if (bits)
+                    out.push_back(static_cast<char>((acc << (8 - bits)) | (0xFF >> bits)));
+            }
+
+            inline std::string huffman_decode(const char* p, size_t size)
+            {
+                const auto& tree = huffman_tree();
+                std::string ret;
+                ret.reserve(size * 8 / 5);
+                size_t current = 0;
+                int depth = 0;
+                bool all_ones = true;
+                for(size_t i = 0; i < size; i ++)
+                {
+                    unsigned char b = static_cast<unsigned char>(p[i]);
+                    for(int shift = 7; shift >= 0; shift --)
+                    {
+                        int bit = (b >> shift) & 1;
+                        current = static_cast<size_t>(tree[current].next[bit]);
+                        depth ++;
+                        all_ones = all_ones && bit;
+                        int symbol = tree[current].symbol;
+                        if (symbol >= 0)
+                        {
+                            if (symbol == 256)
+                                throw std::runtime_error("hpack: EOS in huffman string");
+                            ret.push_back(static_cast<char>(symbol));
+                            current = 0;
+                            depth = 0;
+                            all_ones = true;
+                        }
+                    }
+                }
+                if (depth > 7 || !all_ones)
+                    throw std::runtime_error("hpack: invalid huffman padding");
+                return ret;
+            }
+
+            // 5.2 string literal, huffman coded when that is shorter
+            inline void encode_string(std::string& out, const std::string& s)
+            {
+                size_t huffman_size = huffman_encoded_size(s);
+                if (huffman_size < s.size())
+                {
+                    encode_integer(out, 0x80, 7, huffman_size);
+                    huffman_encode(out, s);
+                }
+                else
+                {
+                    encode_integer(out, 0, 7, s.size());
+                    out += s;
+                }
+            }
+
+            inline std::string decode_string(const char*& p, const char* end)
+            {
+                if (p == end)
+                    throw std::runtime_error("hpack: truncated string");
+                bool huffman = (*p & 0x80) != 0;
+                uint64_t length = decode_integer(p, end, 7);
+                if (length > static_cast<uint64_t>(end - p))
+                    throw std::runtime_error("hpack: truncated string");
+                const char* begin = p;
+                p += length;
+                if (huffman)
+                    return huffman_decode(begin, static_cast<size_t>(length));
+                return std::string(begin, static_cast<size_t>(length));
+            }
+
+            struct static_entry
+            {
+                const char* name;
+                const char* value;
+            };
+
+            static const size_t static_table_size = 61;
+
+            // Appendix A; index 1 is the first entry
+            inline const static_entry* static_table()
+            {
+                static const static_entry table[static_table_size] = {
+                    {":authority", ""},
+                    {":method", "GET"},
+                    {":method", "POST"},
+                    {":path", "/"},
+                    {":path", "/index.html"},
+                    {":scheme", "http"},
+                    {":scheme", "https"},
+                    {":status", "200"},
+                    {":status", "204"},
+                    {":status", "206"},
+                    {":status", "304"},
+                    {":status", "400"},
+                    {":status", "404"},
+                    {":status", "500"},
+                    {"accept-charset", ""},
+                    {"accept-encoding", "gzip, deflate"},
+                    {"accept-language", ""},
+                    {"accept-ranges", ""},
+                    {"accept", ""},
+                    {"access-control-allow-origin", ""},
+                    {"age", ""},
+                    {"allow", ""},
+                    {"authorization", ""},
+                    {"cache-control", ""},
+                    {"content-disposition", ""},
+                    {"content-encoding", ""},
+                    {"content-language", ""},
+                    {"content-length", ""},
+                    {"content-location", ""},
+                    {"content-range", ""},
+                    {"content-type", ""},
+                    {"cookie", ""},
+                    {"date", ""},
+                    {"etag", ""},
+                    {"expect", ""},
+                    {"expires", ""},
+                    {"from", ""},
+                    {"host", ""},
+                    {"if-match", ""},
+                    {"if-modified-since", ""},
+                    {"if-none-match", ""},
+                    {"if-range", ""},
+                    {"if-unmodified-since", ""},
+                    {"last-modified", ""},
+                    {"link", ""},
+                    {"location", ""},
+                    {"max-forwards", ""},
+                    {"proxy-authenticate", ""},
+                    {"proxy-authorization", ""},
+                    {"range", ""},
+                    {"referer", ""},
+                    {"refresh", ""},
+                    {"retry-after", ""},
+                    {"server", ""},
+                    {"set-cookie", ""},
+                    {"strict-transport-security", ""},
+                    {"transfer-encoding", ""},
+                    {"user-agent", ""},
+                    {"vary", ""},
+                    {"via", ""},
+                    {"www-authenticate", ""},
+                };
+                return table;
+            }
+
+            // 2.3.2 dynamic table; index 1 is the most recently inserted entry
+            class header_table
+            {
+            public:
+                static const size_t entry_overhead = 32;
+
+                explicit header_table(size_t max_size = 4096)
+                    : max_size_(max_size)
+                {
+                }
+
+                size_t size() const { return size_; }
+                size_t max_size() const { return max_size_; }
+                size_t count() const { return entries_.size(); }
+
+                const std::pair<std::string, std::string>& get(size_t index) const
+                {
+                    return entries_[index - 1];
+                }
+
+                void set_max_size(size_t max_size)
+                {
+                    max_size_ = max_size;
+                    evict(0);
+                }
+
+                void insert(std::string name, std::string value)
+                {
+                    size_t entry_size = name.size() + value.size() + entry_overhead;
+                    if (entry_size > max_size_)
+                    {
+                        // an entry larger than the table empties it (4.4)
+                        entries_.clear();
+                        size_ = 0;
+                        return;
+                    }
+                    evict(entry_size);
+                    entries_.emplace_front(std::move(name), std::move(value));
+                    size_ += entry_size;
+                }
+
+            private:
+                void evict(size_t room)
+                {
+                    while (!entries_.empty() && size_ + room > max_size_)
+                    {
+                        auto& e = entries_.back();
+                        size_ -= e.first.size() + e.second.size() + entry_overhead;
+                        entries_.pop_back();
+                    }
+                }
+
+                std::deque<std::pair<std::string, std::string>> entries_;
+                size_t size_{};
+                size_t max_size_;
+            };
+
+            class decoder
+            {
+            public:
+                // `max_table_size' is the SETTINGS_HEADER_TABLE_SIZE we advertised
+                explicit decoder(size_t max_table_size = 4096)
+                    : table_(max_table_size), max_table_size_(max_table_size)
+                {
+                }
+
+                const header_table& table() const { return table_; }
+
+                // Appends the fields of one header block to `headers'. Throws std::runtime_error
+                // on malformed input, which is a connection error (COMPRESSION_ERROR).
+                void decode(const char* p, size_t size, header_list& headers)
+                {
+                    const char* end = p + size;
+                    bool fields_seen = false;
+                    while (p != end)
+                    {
+                        unsigned char b = static_cast<unsigned char>(*p);
+                        if (b & 0x80)
+                        {
+                            // 6.1 indexed header field
+                            uint64_t index = decode_integer(p, end, 7);
+                            if (index == 0)
+                                throw std::runtime_error("hpack: index 0");
+                            auto e = lookup(index);
+                            headers.emplace_back(e.first, e.second);
+                            fields_seen = true;
+                        }
+                        else if ((b & 0xE0) == 0x20)
+                        {
+                            // 6.3 dynamic table size update, only at the start of a block
+                            if (fields_seen)
+                                throw std::runtime_error("hpack: misplaced table size update");
+                            uint64_t new_size = decode_integer(p, end, 5);
+                            if (new_size > max_table_size_)
+                                throw std::runtime_error("hpack: table size update too large");
+                            table_.set_max_size(static_cast<size_t>(new_size));
+                        }
+                        else
+                        {
+                            // 6.2 literal: with incremental indexing (01), without indexing (0000)
+                            // or never indexed (0001)
+                            bool index_it = (b & 0xC0) == 0x40;
+                            uint64_t name_index = decode_integer(p, end, index_it ? 6 : 4);
+                            std::string name = name_index ? lookup(name_index).first : decode_string(p, end);
+                            std::string value = decode_string(p, end);
+                            if (index_it)
+                                table_.insert(name, value);
+                            headers.emplace_back(std::move(name), std::move(value));
+                            fields_seen = true;
+                        }
+                    }
+                }
+
+            private:
+                std::pair<std::string, std::string> lookup(uint64_t index) const
+                {
+                    if (index <= static_table_size)
+                    {
+                        auto& e = static_table()[index - 1];
+                        return {e.name, e.value};
+                    }
+                    index -= static_table_size;
+                    if (index > table_.count())
+                        throw std::runtime_error("hpack: index out of range");
+                    return table_.get(static_cast<size_t>(index));
+                }
+
+                header_table table_;
+                size_t max_table_size_;
+            };
+
+            class encoder
+            {
+            public:
+                // the peer's SETTINGS_HEADER_TABLE_SIZE; announced at the start of the next block
+                void set_max_table_size(size_t size)
+                {
+                    if (size == table_.max_size() && !pending_size_update_)
+                        return;
+                    table_.set_max_size(size);
+                    pending_size_update_ = true;
+                }
+
+                const header_table& table() const { return table_; }
+
+                // Field names must already be lower case.
+                void encode(const header_list& headers, std::string& out)
+                {
+                    if (pending_size_update_)
+                    {
+                        encode_integer(out, 0x20, 5, table_.max_size());
+                        pending_size_update_ = false;
+                    }
+
+                    for(auto& kv : headers)
+                    {
+                        size_t name_index = 0;
+                        size_t index = find(kv.first, kv.second, name_index);
+                        if (index)
+                        {
+                            encode_integer(out, 0x80, 7, index);
+                            continue;
+                        }
+
+                        if (is_sensitive(kv.first))
+                            encode_integer(out, 0x10, 4, name_index);
+                        else if (!worth_indexing(kv.first, kv.second))
+                            encode_integer(out, 0x00, 4, name_index);
+                        else
+                        {
+                            encode_integer(out, 0x40, 6, name_index);
+                            table_.insert(kv.first, kv.second);
+                        }
+                        if (!name_index)
+                            encode_string(out, kv.first);
+                        encode_string(out, kv.second);
+                    }
+                }
+
+            private:
+                // Returns the index of an exact match, or 0 and sets `name_index' to an entry with
+                // the same name (0 if there is none).
+                size_t find(const std::string& name, const std::string& value, size_t& name_index) const
+                {
+                    for(size_t i = 0; i < static_table_size; i ++)
+                    {
+                        auto& e = static_table()[i];
+                        if (name == e.name)
+                        {
+                            if (value == e.value)
+                                return i + 1;
+                            if (!name_index)
+                                name_index = i + 1;
+                        }
+                    }
+                    for(size_t i = 1; i <= table_.count(); i ++)
+                    {
+                        auto& e = table_.get(i);
+                        if (e.first == name)
+                        {
+                            if (e.second == value)
+                                return static_table_size + i;
+                            if (!name_index)
+                                name_index = static_table_size + i;
+                        }
+                    }
+                    return 0;
+                }
+
+                static bool is_sensitive(const std::string& name)
+                {
+                    return name == "set-cookie" || name == "authorization" || name == "cookie";
+                }
+
+                // values that differ from one response to the next would only churn the table
+                bool worth_indexing(const std::string& name, const std::string& value) const
+                {
+                    if (name == "content-length" || name == "etag" || name == "location" || name == ":path" || name == "last-modified")
+                        return false;
+                    return name.size() + value.size() + header_table::entry_overhead <= table_.max_size() / 4;
+                }
+
+                header_table table_;
+                bool pending_size_update_{};
+            };
+        }
+
+        // Server side of one HTTP/2 connection.
+        //
+        // Handler must provide
+        //      void handle_stream(uint32_t stream_id, request&& req);  // a complete request arrived
+        //      void handle_stream_reset(uint32_t stream_id);           // the client cancelled it
+        // and answers each request, possibly later, with submit_response(). Both callbacks may be
+        // made from inside feed().
+        template <typename Handler>
+        class session
+        {
+        public:
+            static const uint32_t default_window_size = 65535;
+            static const uint32_t default_max_frame_size = 16384;
+            static const uint32_t max_concurrent_streams = 128;
+            // bounds the memory a client can pin with CONTINUATION frames
+            static const size_t max_header_block_size = 256 * 1024;
+
+            explicit session(Handler* handler)
+                : handler_(handler)
+            {
+            }
+
+            // Queues the server connection preface; the client's one is expected first in feed().
+            void start()
+            {
+                std::string payload;
+                append_setting(payload, settings_id::max_concurrent_streams, max_concurrent_streams);
+                append_frame_header(output_, static_cast<uint32_t>(payload.size()), frame_type::settings, 0, 0);
+                output_ += payload;
+            }
+
+            // h2c upgrade (3.2): `http2_settings' is the HTTP2-Settings header of the upgrade request.
+            // Opens stream 1, half closed from the client's side, for the handler to answer the
+            // upgrade request on. Returns false if the settings are malformed.
+            bool upgrade(const std::string& http2_settings)
+            {
+                std::string payload;
+                try
+                {
+                    payload = utility::base64decode(http2_settings);
+                }
+                catch(std::exception&)
+                {
+                    return false;
+                }
+                if (payload.size() % 6 || apply_settings(payload.data(), payload.size()) != error_code::no_error)
+                    return false;
+
+                last_stream_id_ = 1;
+                stream& s = open_stream(1);
+                s.remote_closed = true;
+                s.dispatched = true;
+                return true;
+            }
+
+            // Returns false once the connection has failed; output() then ends with a GOAWAY and
+            // the socket should be closed after writing it.
+            bool feed(const char* data, size_t size)
+            {
+                if (goaway_sent_)
+                    return false;
+                input_.append(data, size);
+
+                size_t pos = 0;
+                if (!preface_received_)
+                {
+                    size_t n = std::min(input_.size(), client_preface_size);
+                    if (input_.compare(0, n, client_preface, n) != 0)
+                        return connection_error(error_code::protocol_error);
+                    if (n < client_preface_size)
+                        return true;
+                    preface_received_ = true;
+                    pos = client_preface_size;
+                }
+
+                while (input_.size() - pos >= frame_header_size)
+                {
+                    frame_header h = parse_frame_header(input_.data() + pos);
+                    if (h.length > default_max_frame_size)
+                        return connection_error(error_code::frame_size_error);
+                    if (input_.size() - pos - frame_header_size < h.length)
+                        break;
+                    if (!process_frame(h, input_.data() + pos + frame_header_size))
+                    {
+                        input_.clear();
+                        return false;
+                    }
+                    pos += frame_header_size + h.length;
+                }
+                input_.erase(0, pos);
+                return true;
+            }
+
+            // Sends the response for `stream_id'; the body goes out as the peer's flow control
+            // windows allow. Does nothing if the stream was reset meanwhile.
+            void submit_response(uint32_t stream_id, int status, const hpack::header_list& headers, std::string body)
+            {
+                auto it = streams_.find(stream_id);
+                if (it == streams_.end() || it->second.response_submitted || goaway_sent_)
+                    return;
+                stream& s = it->second;
+                s.response_submitted = true;
+
+                hpack::header_list fields;
+                fields.reserve(headers.size() + 1);
+                fields.emplace_back(":status", std::to_string(status));
+                for(auto& kv : headers)
+                {
+                    std::string name = boost::algorithm::to_lower_copy(kv.first);
+                    // connection specific fields are not allowed in HTTP/2 (8.1.2.2)
+                    if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade")
+                        continue;
+                    fields.emplace_back(std::move(name), kv.second);
+                }
+
+                std::string block;
+                encoder_.encode(fields, block);
+                write_header_block(stream_id, block, body.empty());
+
+                if (body.empty())
+                {
+                    s.local_closed = true;
+                    close_stream_if_done(it);
+                    return;
+                }
+                s.pending_body = std::move(body);
+                flush_pending_data();
+            }
+
+            std::string& output()
+            {
+                return output_;
+            }
+
+            // no more frames will be processed: a GOAWAY was sent, or the client sent one and
+            // everything it asked for has been answered
+            bool is_finished() const
+            {
+                return goaway_sent_ || (goaway_received_ && streams_.empty());
+            }
+
+            size_t stream_count() const
+            {
+                return streams_.size();
+            }
+
+        private:
+            struct stream
+            {
+                request req;
+                std::string method;
+                int64_t send_window{};
+                int64_t recv_window{default_window_size};
+                bool remote_closed{};
+                bool local_closed{};
+                bool dispatched{};
+                bool response_submitted{};
+                std::string pending_body;
+                size_t pending_offset{};
+            };
+
+            stream& open_stream(uint32_t stream_id)
+            {
+                stream& s = streams_[stream_id];
+                s.send_window = peer_initial_window_;
+                return s;
+            }
+
+            bool connection_error(error_code code)
+            {
+                CROW_LOG_DEBUG << "http2 connection error " << static_cast<uint32_t>(code);
+                if (!goaway_sent_)
+                {
+                    append_frame_header(output_, 8, frame_type::goaway, 0, 0);
+                    append_uint32(output_, last_stream_id_);
+                    append_uint32(output_, static_cast<uint32_t>(code));
+                    goaway_sent_ = true;
+                }
+                return false;
+            }
+
+            void reset_stream(uint32_t stream_id, error_code code)
+            {
+                append_frame_header(output_, 4, frame_type::rst_stream, 0, stream_id);
+                append_uint32(output_, static_cast<uint32_t>(code));
+                auto it = streams_.find(stream_id);
+                if (it != streams_.end())
+                {
+                    bool dispatched = it->second.dispatched;
+                    streams_.erase(it);
+                    if (dispatched)
+                        handler_->handle_stream_reset(stream_id);
+                }
+            }
+
+            void window_update(uint32_t stream_id, uint32_t increment)
+            {
+                append_frame_header(output_, 4, frame_type::window_update, 0, stream_id);
+                append_uint32(output_, increment);
+            }
+
+            void close_stream_if_done(typename std::map<uint32_t, stream>::iterator it)
+            {
+                stream& s = it->second;
+                if (!s.local_closed)
+                    return;
+                if (!s.remote_closed)
+                {
+                    // answered before the request body was complete; the rest is not needed (8.1)
+                    append_frame_header(output_, 4, frame_type::rst_stream, 0, it->first);
+                    append_uint32(output_, static_cast<uint32_t>(error_code::no_error));
+                }
+                streams_.erase(it);
+            }
+
+            void write_header_block(uint32_t stream_id, const std::string& block, bool end_stream)
+            {
+                size_t offset = 0;
+                bool first = true;
+                do
+                {
+                    size_t n = std::min<size_t>(block.size() - offset, peer_max_frame_size_);
+                    bool last = offset + n == block.size();
+                    uint8_t f = last ? flags::end_headers : 0;
+                    if (first && end_stream)
+                        f |= flags::end_stream;
+                    append_frame_header(output_, static_cast<uint32_t>(n), first ? frame_type::headers : frame_type::continuation, f, stream_id);
+                    output_.append(block, offset, n);
+                    offset += n;
+                    first = false;
+                } while (offset < block.size());
+            }
+
+            void flush_pending_data()
+            {
+                for(auto it = streams_.begin(); it != streams_.end() && conn_send_window_ > 0; )
+                {
+                    stream& s = it->second;
+                    if (!s.response_submitted || s.local_closed)
+                    {
+                        ++it;
+                        continue;
+                    }
+                    while (s.pending_offset < s.pending_body.size() && conn_send_window_ > 0 && s.send_window > 0)
+                    {
+                        size_t remaining = s.pending_body.size() - s.pending_offset;
+                        size_t n = std::min<size_t>(remaining, peer_max_frame_size_);
+                        n = std::min<size_t>(n, static_cast<size_t>(std::min(conn_send_window_, s.send_window)));
+                        bool last = n == remaining;
+                        append_frame_header(output_, static_cast<uint32_t>(n), frame_type::data, last ? flags::end_stream : 0, it->first);
+                        output_.append(s.pending_body, s.pending_offset, n);
+                        s.pending_offset += n;
+                        conn_send_window_ -= static_cast<int64_t>(n);
+                        s.send_window -= static_cast<int64_t>(n);
+                        if (last)
+                            s.local_closed = true;
+                    }
+                    if (s.local_closed)
+                    {
+                        auto next = std::next(it);
+                        close_stream_if_done(it);
+                        it = next;
+                    }
+                    else
+                        ++it;
+                }
+            }
+
+            error_code apply_settings(const char* p, size_t size)
+            {
+                for(size_t i = 0; i + 6 <= size; i += 6)
+                {
+                    auto id = static_cast<settings_id>((static_cast<unsigned char>(p[i]) << 8) | static_cast<unsigned char>(p[i+1]));
+                    uint32_t value = read_uint32(p + i + 2);
+                    switch(id)
+                    {
+                        case settings_id::header_table_size:
+                            encoder_.set_max_table_size(std::min<uint32_t>(value, 4096));
+                            break;
+                        case settings_id::enable_push:
+                            if (value > 1)
+                                return error_code::protocol_error;
+                            break;
+                        case settings_id::initial_window_size:
+                            {
+                                if (value > 0x7FFFFFFF)
+                                    return error_code::flow_control_error;
+                                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                                for(auto& kv : streams_)
+                                    kv.second.send_window += delta;
+                                peer_initial_window_ = value;
+                            }
+                            break;
+                        case settings_id::max_frame_size:
+                            if (value < default_max_frame_size || value > 0xFFFFFF)
+                                return error_code::protocol_error;
+                            peer_max_frame_size_ = value;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                return error_code::no_error;
+            }
+
+            // strips padding and priority fields from DATA and HEADERS payloads
+            bool strip_payload(const frame_header& h, const char*& payload, size_t& length)
+            {
+                length = h.length;
+                size_t pad = 0;
+                if (h.flags & flags::padded)
+                {
+                    if (length < 1)
+                        return false;
+                    pad = static_cast<unsigned char>(*payload);
+                    payload ++;
+                    length --;
+                }
+                if (h.type == frame_type::headers && (h.flags & flags::priority))
+                {
+                    if (length < 5)
+                        return false;
+                    payload += 5;
+                    length -= 5;
+                }
+                if (pad > length)
+                    return false;
+                length -= pad;
+                return true;
+            }
+
+            bool process_frame(const frame_header& h, const char* payload)
+            {
+                if (continuation_stream_ && h.type != frame_type::continuation)
+                    return connection_error(error_code::protocol_error);
+                if (!settings_received_ && h.type != frame_type::settings)
+                    return connection_error(error_code::protocol_error);
+
+                switch(h.type)
+                {
+                    case frame_type::data:
+                        return on_data(h, payload);
+                    case frame_type::headers:
+                        return on_headers(h, payload);
+                    case frame_type::continuation:
+                        if (h.stream_id != continuation_stream_)
+                            return connection_error(error_code::protocol_error);
+                        header_block_.append(payload, h.length);
+                        if (header_block_.size() > max_header_block_size)
+                            return connection_error(error_code::enhance_your_calm);
+                        if (h.flags & flags::end_headers)
+                        {
+                            continuation_stream_ = 0;
+                            return on_header_block();
+                        }
+                        return true;
+                    case frame_type::priority:
+                        if (h.stream_id == 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 5)
+                            return connection_error(error_code::frame_size_error);
+                        return true;
+                    case frame_type::rst_stream:
+                        if (h.stream_id == 0 || h.stream_id > last_stream_id_)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 4)
+                            return connection_error(error_code::frame_size_error);
+                        {
+                            auto it = streams_.find(h.stream_id);
+                            if (it != streams_.end())
+                            {
+                                bool dispatched = it->second.dispatched;
+                                streams_.erase(it);
+                                if (dispatched)
+                                    handler_->handle_stream_reset(h.stream_id);
+                            }
+                        }
+                        return true;
+                    case frame_type::settings:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.flags & flags::ack)
+                        {
+                            if (h.length != 0)
+                                return connection_error(error_code::frame_size_error);
+                            return true;
+                        }
+                        if (h.length % 6)
+                            return connection_error(error_code::frame_size_error);
+                        {
+                            error_code ec = apply_settings(payload, h.length);
+                            if (ec != error_code::no_error)
+                                return connection_error(ec);
+                        }
+                        settings_received_ = true;
+                        append_frame_header(output_, 0, frame_type::settings, flags::ack, 0);
+                        flush_pending_data();
+                        return true;
+                    case frame_type::push_promise:
+                        // clients never push
+                        return connection_error(error_code::protocol_error);
+                    case frame_type::ping:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 8)
+                            return connection_error(error_code::frame_size_error);
+                        if (!(h.flags & flags::ack))
+                        {
+                            append_frame_header(output_, 8, frame_type::ping, flags::ack, 0);
+                            output_.append(payload, 8);
+                        }
+                        return true;
+                    case frame_type::goaway:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        goaway_received_ = true;
+                        return true;
+                    case frame_type::window_update:
+                        return on_window_update(h, payload);
+                    default:
+                        // unknown frame types are ignored (4.1)
+                        return true;
+                }
+            }
+
+            bool on_data(const frame_header& h, const char* payload)
+            {
+                if (h.stream_id == 0)
+                    return connection_error(error_code::protocol_error);
+
+                // the whole frame, padding included, counts against flow control; hand it back at once
+                conn_recv_window_ -= h.length;
+                if (conn_recv_window_ < 0)
+                    return connection_error(error_code::flow_control_error);
+                if (h.length)
+                {
+                    window_update(0, h.length);
+                    conn_recv_window_ += h.length;
+                }
+
+                const char* data = payload;
+                size_t length;
+                if (!strip_payload(h, data, length))
+                    return connection_error(error_code::protocol_error);
+
+                auto it = streams_.find(h.stream_id);
+                if (it == streams_.end() || it->second.remote_closed)
+                {
+                    if (h.stream_id > last_stream_id_)
+                        return connection_error(error_code::protocol_error);
+                    reset_stream(h.stream_id, error_code::stream_closed);
+                    return true;
+                }
+
+                stream& s = it->second;
+                s.recv_window -= h.length;
+                if (s.recv_window < 0)
+                {
+                    reset_stream(h.stream_id, error_code::flow_control_error);
+                    return true;
+                }
+                s.req.body.append(data, length);
+
+                if (h.flags & flags::end_stream)
+                {
+                    s.remote_closed = true;
+                    dispatch(h.stream_id, s);
+                }
+                else if (h.length)
+                {
+                    window_update(h.stream_id, h.length);
+                    s.recv_window += h.length;
+                }
+                return true;
+            }
+
+            bool on_headers(const frame_header& h, const char* payload)
+            {
+                if (h.stream_id == 0 || h.stream_id % 2 == 0)
+                    return connection_error(error_code::protocol_error);
+
+                const char* fragment = payload;
+                size_t length;
+                if (!strip_payload(h, fragment, length))
+                    return connection_error(error_code::protocol_error);
+
+                auto it = streams_.find(h.stream_id);
+                if (it != streams_.end())
+                {
+                    // trailers
+                    if (it->second.remote_closed)
+                        return connection_error(error_code::stream_closed);
+                    if (!(h.flags & flags::end_stream))
+                        return connection_error(error_code::protocol_error);
+                }
+                else if (h.stream_id <= last_stream_id_)
+                    return connection_error(error_code::stream_closed);
+
+                header_stream_ = h.stream_id;
+                header_end_stream_ = (h.flags & flags::end_stream) != 0;
+                header_block_.assign(fragment, length);
+                if (h.flags & flags::end_headers)
+                    return on_header_block();
+                continuation_stream_ = h.stream_id;
+                return true;
+            }
+
+            bool on_header_block()
+            {
+                hpack::header_list fields;
+                try
+                {
+                    // decoded even for refused streams; the table state is shared by all of them
+                    decoder_.decode(header_block_.data(), header_block_.size(), fields);
+                }
+                catch(std::exception& e)
+                {
+                    CROW_LOG_DEBUG << e.what();
+                    return connection_error(error_code::compression_error);
+                }
+                header_block_.clear();
+
+                uint32_t stream_id = header_stream_;
+                auto it = streams_.find(stream_id);
+                if (it != streams_.end())
+                {
+                    // trailer fields are not passed on
+                    it->second.remote_closed = true;
+                    dispatch(stream_id, it->second);
+                    return true;
+                }
+
+                last_stream_id_ = stream_id;
+                if (streams_.size() >= max_concurrent_streams || goaway_received_)
+                {
+                    reset_stream(stream_id, error_code::refused_stream);
+                    return true;
+                }
+
+                stream& s = open_stream(stream_id);
+                if (!build_request(fields, s))
+                {
+                    reset_stream(stream_id, error_code::protocol_error);
+                    return true;
+                }
+                if (header_end_stream_)
+                {
+                    s.remote_closed = true;
+                    dispatch(stream_id, s);
+                }
+                return true;
+            }
+
+            // 8.1.2 request pseudo-header fields; returns false for a malformed request
+            bool build_request(hpack::header_list& fields, stream& s)
+            {
+                request& req = s.req;
+                std::string authority;
+                bool regular_seen = false;
+                for(auto& kv : fields)
+                {
+                    auto& name = kv.first;
+                    if (!name.empty() && name[0] == ':')
+                    {
+                        if (regular_seen)
+                            return false;
+                        if (name == ":method")
+                            s.method = std::move(kv.second);
+                        else if (name == ":path")
+                            req.raw_url = std::move(kv.second);
+                        else if (name == ":authority")
+                            authority = std::move(kv.second);
+                        else if (name != ":scheme")
+                            return false;
+                        continue;
+                    }
+                    regular_seen = true;
+                    if (std::any_of(name.begin(), name.end(), [](char c){ return c >= 'A' && c <= 'Z'; }))
+                        return false;
+                    if (name == "connection")
+                        return false;
+                    if (name == "cookie" && req.headers.count(known_header::cookie))
+                    {
+                        // split cookie fields are joined again for HTTP/1 style consumers (8.1.2.5)
+                        auto& cookie = req.headers.find(known_header::cookie)->second;
+                        cookie += "; ";
+                        cookie += kv.second;
+                        continue;
+                    }
+                    req.headers.emplace(std::move(kv.first), std::move(kv.second));
+                }
+                if (s.method.empty() || req.raw_url.empty())
+                    return false;
+                if (!authority.empty() && !req.headers.count(known_header::host))
+                    req.headers.emplace("host", std::move(authority));
+
+                req.url = req.raw_url.substr(0, req.raw_url.find("?"));
+                auto query_pos = req.raw_url.find_first_of("?#");
+                if (query_pos != std::string::npos)
+                    req.url_params = query_string(req.raw_url.substr(query_pos));
+                return true;
+            }
+
+            void dispatch(uint32_t stream_id, stream& s)
+            {
+                for(int i = 0; i < static_cast<int>(HTTPMethod::InternalMethodCount); i ++)
+                {
+                    if (method_name(static_cast<HTTPMethod>(i)) == s.method)
+                    {
+                        s.req.method = static_cast<HTTPMethod>(i);
+                        s.dispatched = true;
+                        handler_->handle_stream(stream_id, std::move(s.req));
+                        return;
+                    }
+                }
+                submit_response(stream_id, 501, {}, {});
+            }
+
+            bool on_window_update(const frame_header& h, const char* payload)
+            {
+                if (h.length != 4)
+                    return connection_error(error_code::frame_size_error);
+                uint32_t increment = read_uint32(payload) & 0x7FFFFFFF;
+                if (h.stream_id == 0)
+                {
+                    if (increment == 0)
+                        return connection_error(error_code::protocol_error);
+                    conn_send_window_ += increment;
+                    if (conn_send_window_ > 0x7FFFFFFF)
+                        return connection_error(error_code::flow_control_error);
+                }
+                else
+                {
+                    auto it = streams_.find(h.stream_id);
+                    if (it == streams_.end())
+                    {
+                        if (h.stream_id > last_stream_id_)
+                            return connection_error(error_code::protocol_error);
+                        return true;
+                    }
+                    if (increment == 0)
+                    {
+                        reset_stream(h.stream_id, error_code::protocol_error);
+                        return true;
+                    }
+                    it->second.send_window += increment;
+                    if (it->second.send_window > 0x7FFFFFFF)
+                    {
+                        reset_stream(h.stream_id, error_code::flow_control_error);
+                        return true;
+                    }
+                }
+                flush_pending_data();
+                return true;
+            }
+
+            Handler* handler_;
+
+            std::string input_;
+            std::string output_;
+
+            hpack::decoder decoder_;
+            hpack::encoder encoder_;
+
+            std::map<uint32_t, stream> streams_;
+            uint32_t last_stream_id_{};
+
+            std::string header_block_;
+            uint32_t header_stream_{};
+            bool header_end_stream_{};
+            uint32_t continuation_stream_{};
+
+            int64_t conn_send_window_{default_window_size};
+            int64_t conn_recv_window_{default_window_size};
+            int64_t peer_initial_window_{default_window_size};
+            uint32_t peer_max_frame_size_{default_max_frame_size};
+
+            bool preface_received_{};
+            bool settings_received_{};
+            bool goaway_sent_{};
+            bool goaway_received_{};
+        };
+    }
+}
+
+
+
+#pragma once
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/array.hpp>
+
+
+
+
+
+
+
+namespace crow
+{
+    namespace websocket
+    {
+        enum class WebSocketReadState
+        {
+            MiniHeader,
+            Len16,
+            Len64,
+            Mask,
+            Payload,
+        };
+
+		struct connection
+		{
+            virtual void send_binary(const std::string& msg) = 0;
+            virtual void send_text(const std::string& msg) = 0;
+            virtual void close(const std::string& msg = "quit") = 0;
+            virtual ~connection(){}
+
+            void userdata(void* u) { userdata_ = u; }
+            void* userdata() { return userdata_; }
+
+        private:
+            void* userdata_;
+		};
+
+		template <typename Adaptor>
+        class Connection : public connection
+        {
+			public:
+				Connection(const crow::request& req, Adaptor&& adaptor, 
+						std::function<void(crow::websocket::connection&)> open_handler,
+						std::function<void(crow::websocket::connection&, const std::string&, bool)> message_handler,
+						std::function<void(crow::websocket::connection&, const std::string&)> close_handler,
+						std::function<void(crow::websocket::connection&)> error_handler,
+						std::function<bool(const crow::request&)> accept_handler)
+					: adaptor_(std::move(adaptor)), open_handler_(std::move(open_handler)), message_handler_(std::move(message_handler)), close_handler_(std::move(close_handler)), error_handler_(std::move(error_handler))
+					, accept_handler_(std::move(accept_handler))
+				{
+					if (!boost::iequals(req.get_header_value("upgrade"), "websocket"))
+					{
+						adaptor.close();
+						delete this;
+						return;
+					}
+
+					if (accept_handler_)
+					{
+						if (!accept_handler_(req))
+						{
+							adaptor.close();
+							delete this;
+							return;
+						}
+					}
+
+					// Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==
+					// Sec-WebSocket-Version: 13
+                    std::string magic = req.get_header_value("Sec-WebSocket-Key") +  "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+                    sha1::SHA1 s;
+                    s.processBytes(magic.data(), magic.size());
+                    uint8_t digest[20];
+                    s.getDigestBytes(digest);   
+                    start(crow::utility::base64encode((char*)digest, 20));
+				}
+
+                template<typename CompletionHandler>
+                void dispatch(CompletionHandler handler)
+                {
+                    adaptor_.get_io_service().dispatch(handler);
+                }
+
+                template<typename CompletionHandler>
+                void post(CompletionHandler handler)
+                {
+                    adaptor_.get_io_service().post(handler);
+                }
+
+                void send_pong(const std::string& msg)
+                {
+                    dispatch([this, msg]{
+                        char buf[3] = "\x8A\x00";
+                        buf[1] += static_cast<char>(msg.size());
+                        write_buffers_.emplace_back(buf, buf+2);
+                        write_buffers_.emplace_back(msg);
+                        do_write();
+                    });
+                }
+
+                void send_binary(const std::string& msg) override
+                {
+                    dispatch([this, msg]{
+                        auto header = build_header(2, msg.size());
+                        write_buffers_.emplace_back(std::move(header));
+                        write_buffers_.emplace_back(msg);
+                        do_write();
+                    });
+                }
+
+                void send_text(const std::string& msg) override
+                {
+                    dispatch([this, msg]{
+                        auto header = build_header(1, msg.size());
+                        write_buffers_.emplace_back(std::move(header));
+                        write_buffers_.emplace_back(msg);
+                        do_write();
+                    });
+                }
+
+                void close(const std::string& msg) override
+                {
+                    dispatch([this, msg]{
+                        has_sent_close_ = true;
+                        if (has_recv_close_ && !is_close_handler_called_)
+                        {
+                            is_close_handler_called_ = true;
+                            if (close_handler_)
+                                close_handler_(*this, msg);
+                        }
+                        auto header = build_header(0x8, msg.size());
+                        write_buffers_.emplace_back(std::move(header));
+                        write_buffers_.emplace_back(msg);
+                        do_write();
+                    });
+                }
+
+            protected:
+
+                std::string build_header(int opcode, size_t size)
+                {
+                    char buf[2+8] = "\x80\x00";
+                    buf[0] += opcode;
+                    if (size < 126)
+                    {
+                        buf[1] += static_cast<char>(size);
+                        return {buf, buf+2};
+                    }
+                    else if (size < 0x10000)
+                    {
+                        buf[1] += 126;
+                        *(uint16_t*)(buf+2) = htons((uint16_t)size);
+                        return {buf, buf+4};
+                    }
+                    else
+                    {
+                        buf[1] += 127;
+                        *reinterpret_cast<uint64_t*>(buf+2) = ((1==htonl(1)) ? static_cast<uint64_t>(size) : (static_cast<uint64_t>(htonl((size) & 0xFFFFFFFF)) << 32) | htonl(static_cast<uint64_t>(size) >> 32));
+                        return {buf, buf+10};
+                    }
+                }
+
+                void start(std::string&& hello)
+                {
+                    static std::string header = "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: ";
+                    static std::string crlf = "\r\n";
+                    write_buffers_.emplace_back(header);
+                    write_buffers_.emplace_back(std::move(hello));
+                    write_buffers_.emplace_back(crlf);
+                    write_buffers_.emplace_back(crlf);
+                    do_write();
+                    if (open_handler_)
+                        open_handler_(*this);
+                    do_read();
+                }
+
+                void do_read()
+                {
+                    is_reading = true;
+                    switch(state_)
+                    {
+                        case WebSocketReadState::MiniHeader:
+                            {
+                                //boost::asio::async_read(adaptor_.socket(), boost::asio::buffer(&mini_header_, 1), 
+                                adaptor_.socket().async_read_some(boost::asio::buffer(&mini_header_, 2), 
+                                    [this](const boost::system::error_code& ec, std::size_t 
+#ifdef CROW_ENABLE_DEBUG
+                                        bytes_transferred
+#endif
+                                        )
+
+                                    {
+                                        is_reading = false;
+                                        mini_header_ = ntohs(mini_header_);
+#ifdef CROW_ENABLE_DEBUG
+                                        
+                                        if (!ec && bytes_transferred != 2)
+                                        {
+                                            throw std::runtime_error("WebSocket:MiniHeader:async_read fail:asio bug?");
+                                        }
+#endif
+
+                                        if (!ec && ((mini_header_ & 0x80) == 0x80))
+                                        {
+                                            if ((mini_header_ & 0x7f) == 127)
+                                            {
+                                                state_ = WebSocketReadState::Len64;
+                                            }
+                                            else if ((mini_header_ & 0x7f) == 126)
+                                            {
+                                                state_ = WebSocketReadState::Len16;
+                                            }
+                                            else
+                                            {
+                                                remaining_length_ = mini_header_ & 0x7f;
+                                                state_ = WebSocketReadState::Mask;
+                                            }
+                                            do_read();
+                                        }
+                                        else
+                                        {
+                                            close_connection_ = true;
+                                            adaptor_.close();
+                                            if (error_handler_)
+                                                error_handler_(*this);
+                                            check_destroy();
+                                        }
+                                    });
+                            }
+                            break;
+                        case WebSocketReadState::Len16:
+                            {
+                                remaining_length_ = 0;
+                                remaining_length16_ = 0;
+                                boost::asio::async_read(adaptor_.socket(), boost::asio::buffer(&remaining_length16_, 2), 
+                                    [this](const boost::system::error_code& ec, std::size_t 
+#ifdef CROW_ENABLE_DEBUG
+                                        bytes_transferred
+#endif
+                                        ) 
+                                    {
+                                        is_reading = false;
+                                        remaining_length16_ = ntohs(remaining_length16_);
+                                        remaining_length_ = remaining_length16_;
+#ifdef CROW_ENABLE_DEBUG
+                                        if (!ec && bytes_transferred != 2)
+                                        {
+                                            throw std::runtime_error("WebSocket:Len16:async_read fail:asio bug?");
+                                        }
+#endif
+
+                                        if (!ec)
+                                        {
+                                            state_ = WebSocketReadState::Mask;
+                                            do_read();
+                                        }
+                                        else
+                                        {
+                                            close_connection_ = true;
+                                            adaptor_.close();
+                                            if (error_handler_)
+                                                error_handler_(*this);
+                                            check_destroy();
+                                        }
+                                    });
+                            }
+                            break;
+                        case WebSocketReadState::Len64:
+                            {
+                                boost::asio::async_read(adaptor_.socket(), boost::asio::buffer(&remaining_length_, 8), 
+                                    [this](const boost::system::error_code& ec, std::size_t 
+#ifdef CROW_ENABLE_DEBUG
+                                        bytes_transferred
+#endif
+                                        ) 
+                                    {
+                                        is_reading = false;
+                                        remaining_length_ = ((1==ntohl(1)) ? (remaining_length_) : ((uint64_t)ntohl((remaining_length_) & 0xFFFFFFFF) << 32) | ntohl((remaining_length_) >> 32));
+#ifdef CROW_ENABLE_DEBUG
+                                        if (!ec && bytes_transferred != 8)
+                                        {
+                                            throw std::runtime_error("WebSocket:Len16:async_read fail:asio bug?");
+                                        }
+#endif
+
+                                        if (!ec)
+                                        {
+                                            state_ = WebSocketReadState::Mask;
+                                            do_read();
+                                        }
+                                        else
+                                        {
+                                            close_connection_ = true;
+                                            adaptor_.close();
+                                            if (error_handler_)
+                                                error_handler_(*this);
+                                            check_destroy();
+                                        }
+                                    });
+                            }
+                            break;
+                        case WebSocketReadState::Mask:
+                                boost::asio::async_read(adaptor_.socket(), boost::asio::buffer((char*)&mask_, 4), 
+                                    [this](const boost::system::error_code& ec, std::size_t 
+#ifdef CROW_ENABLE_DEBUG 
+                                        bytes_transferred
+#endif
+                                    )
+                                    {
+                                        is_reading = false;
+#ifdef CROW_ENABLE_DEBUG
+                                        if (!ec && bytes_transferred != 4)
+                                        {
+                                            throw std::runtime_error("WebSocket:Mask:async_read fail:asio bug?");
+                                        }
+#endif
+
+                                        if (!ec)
+                                        {
+                                            state_ = WebSocketReadState::Payload;
+                                            do_read();
+                                        }
+                                        else
+                                        {
+                                            close_connection_ = true;
+                                            if (error_handler_)
+                                                error_handler_(*this);
+                                            adaptor_.close();
+                                        }
+                                    });
+                            break;
+                        case WebSocketReadState::Payload:
+                            {
+                                size_t to_read = buffer_.size();
+                                if (remaining_length_ < to_read)
+                                    to_read = remaining_length_;
+                                adaptor_.socket().async_read_some( boost::asio::buffer(buffer_, to_read), 
+                                    [this](const boost::system::error_code& ec, std::size_t bytes_transferred)
+                                    {
+                                        is_reading = false;
+
+                                        if (!ec)
+                                        {
+                                            fragment_.insert(fragment_.end(), buffer_.begin(), buffer_.begin() + bytes_transferred);
+                                            remaining_length_ -= bytes_transferred;
+                                            if (remaining_length_ == 0)
+                                            {
+                                                handle_fragment();
+                                                state_ = WebSocketReadState::MiniHeader;
+                                                do_read();
+                                            }
+                                        }
+                                        else
+                                        {
+                                            close_connection_ = true;
+                                            if (error_handler_)
+                                                error_handler_(*this);
+                                            adaptor_.close();
+                                        }
+                                    });
+                            }
+                            break;
+                    }
+                }
+
+                bool is_FIN()
+                {
+                    return (mini_header_ & 0x8000) > 0;
+                }
+
+                int opcode()
+                {
+                    return (mini_header_ & 0x0f00) >> 8;
+                }
+
+                void handle_fragment()
+                {
+                    for(decltype(fragment_.length()) i = 0; i < fragment_.length(); i ++)
+                    {
+                        fragment_[i] ^= ((char*)&mask_)[i%4];
+                    }
+                    switch(opcode())
+                    {
+                        case 0: // Continuation
+                            {
+                                message_ += fragment_;
+                                if (is_FIN())
+                                {
+                                    if (message_handler_)
+                                        message_handler_(*this, message_, is_binary_);
+                                    message_.clear();
+                                }
+                            }
+                            break;
+                        case 1: // Text
+                            {
+                                is_binary_ = false;
+                                message_ += fragment_;
+                                if (is_FIN())
+                                {
+                                    if (message_handler_)
+                                        message_handler_(*this, message_, is_binary_);
+                                    message_.clear();
+                                }
+                            }
+                            break;
+                        case 2: // Binary
+                            {
+                                is_binary_ = true;
+                                message_ += fragment_;
+                                if (is_FIN())
+                                {
+                                    if (message_handler_)
+                                        message_handler_(*this, message_, is_binary_);
+                                    message_.clear();
+                                }
+                            }
+                            break;
+                        case 0x8: // Close
+                            {
+                                has_recv_close_ = true;
+                                if (!has_sent_close_)
+                                {
+                                    close(fragment_);
+                                }
+                                else
+                                {
+                                    adaptor_.close();
+                                    close_connection_ = true;
+                                    if (!is_close_handler_called_)
+                                    {
+                                        if (close_handler_)
+                                            close_handler_(*this, fragment_);
+                                        is_close_handler_called_ = true;
+                                    }
+                                    check_destroy();
+                                }
+                            }
+                            break;
+                        case 0x9: // Ping
+                            {
+                                send_pong(fragment_);
+                            }
+                            break;
+                        case 0xA: // Pong
+                            {
+                                pong_received_ = true;
+                            }
+                            break;
+                    }
+
+                    fragment_.clear();
+                }
+
+                void do_write()
+                {
+                    if (sending_buffers_.empty())
+                    {
+                        sending_buffers_.swap(write_buffers_);
+                        std::vector<boost::asio::const_buffer> buffers;
+                        buffers.reserve(sending_buffers_.size());
+                        for(auto& s:sending_buffers_)
+                        {
+                            buffers.emplace_back(boost::asio::buffer(s));
+                        }
+                        boost::asio::async_write(adaptor_.socket(), buffers, 
+                            [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                            {
+                                sending_buffers_.clear();
+                                if (!ec && !close_connection_)
+                                {
+                                    if (!write_buffers_.empty())
+                                        do_write();
+                                    if (has_sent_close_)
+                                        close_connection_ = true;
+                                }
+                                else
+                                {
+                                    close_connection_ = true;
+                                    check_destroy();
+                                }
+                            });
+                    }
+                }
+
+                void check_destroy()
+                {
+                    //if (has_sent_close_ && has_recv_close_)
+                    if (!is_close_handler_called_)
+                        if (close_handler_)
+                            close_handler_(*this, "uncleanly");
+                    if (sending_buffers_.empty() && !is_reading)
+                        delete this;
+                }
+			private:
+				Adaptor adaptor_;
+
+                std::vector<std::string> sending_buffers_;
+                std::vector<std::string> write_buffers_;
+
+                boost::array<char, 4096> buffer_;
+                bool is_binary_;
+                std::string message_;
+                std::string fragment_;
+                WebSocketReadState state_{WebSocketReadState::MiniHeader};
+                uint16_t remaining_length16_{0};
+                uint64_t remaining_length_{0};
+                bool close_connection_{false};
+                bool is_reading{false};
+                uint32_t mask_;
+                uint16_t mini_header_;
+                bool has_sent_close_{false};
+                bool has_recv_close_{false};
+                bool error_occured_{false};
+                bool pong_received_{false};
+                bool is_close_handler_called_{false};
+
+				std::function<void(crow::websocket::connection&)> open_handler_;
+				std::function<void(crow::websocket::connection&, const std::string&, bool)> message_handler_;
+				std::function<void(crow::websocket::connection&, const std::string&)> close_handler_;
+				std::function<void(crow::websocket::connection&)> error_handler_;
+				std::function<bool(const crow::request&)> accept_handler_;
+        };
+    }
+}
+
+
+
+#pragma once
+
+//#define CROW_JSON_NO_ERROR_CHECK
+
+#include <string>
+#include <unordered_map>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/operators.hpp>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+
+
+
+
+
+
+
+
+#if defined(__GNUG__) || defined(__clang__)
+#define crow_json_likely(x) __builtin_expect(x, 1)
+#define crow_json_unlikely(x) __builtin_expect(x, 0)
+#else
+#define crow_json_likely(x) x
+#define crow_json_unlikely(x) x
+#endif
+
+
+namespace crow
+{
+    namespace mustache
+    {
+        class template_t;
+    }
+
+    namespace json
+    {
+        inline void escape(const char* str, size_t size, std::string& ret)
+        {
+            ret.reserve(ret.size() + size+size/4);
+            const char* end = str + size;
+            for(const char* p = str; p != end; ++p)
+            {
+                // copy the run of characters that need no escaping in one go
+                const char* run = p;
+                while(p != end && *p != '"' && *p != '\\' && !(0 <= *p && *p < 0x20))
+                    ++p;
+                ret.append(run, p);
+                if (p == end)
+                    break;
+                char c = *p;
+                switch(c)
+                {
+                    case '"': ret += "\\\""; break;
+                    case '\\': ret += "\\\\"; break;
+                    case '\n': ret += "\\n"; break;
+                    case '\b': ret += "\\b"; break;
+                    case '\f': ret += "\\f"; break;
+                    case '\r': ret += "\\r"; break;
+                    case '\t': ret += "\\t"; break;
+                    default:
+                        if (0 <= c && c < 0x20)
+                        {
+                            ret += "\\u00";
+                            auto to_hex = [](char c)
+                            {
+                                c = c&0xf;
+                                if (c < 10)
+                                    return '0' + c;
+                                return 'a'+c-10;
+                            };
+                            ret += to_hex(c/16);
+                            ret += to_hex(c%16);
+                        }
+                        else
+                            ret += c;
+                        break;
+                }
+            }
+        }
+        inline void escape(const std::string& str, std::string& ret)
+        {
+            escape(str.data(), str.size(), ret);
+        }
+        inline std::string escape(const std::string& str)
+        {
+            std::string ret;
+            escape(str, ret);
+            return ret;
+        }
+
+        enum class type : char
+        {
+            Null,
+            False,
+            True,
+            Number,
+            String,
+            List,
+            Object,
+        };
+
+        inline const char* get_type_str(type t) {
+            switch(t){
+                case type::Number: return "Number";
+                case type::False: return "False";
+                case type::True: return "True";
+                case type::List: return "List";
+                case type::String: return "String";
+                case type::Object: return "Object";
+                default: return "Unknown";
+            }
+        }
+
+        enum class num_type : char {
+            Signed_integer,
+            Unsigned_integer,
+            Floating_point,
+            Null
+        };
+
+        class rvalue;
+        rvalue load(const char* data, size_t size);
+        rvalue load(std::string&& str);
+
+        namespace detail 
+        {
+            // Decodes the escapes in [head, end) in place; returns the new end
+            inline char* unescape(char* head, char* end)
+            {
+                char* tail = head;
+                while(head != end)
+                {
+                    if (*head == '\\')
+                    {
+                        switch(*++head)
+                        {
+                            case '"':  *tail++ = '"'; break;
+                            case '\\': *tail++ = '\\'; break;
+                            case '/':  *tail++ = '/'; break;
+                            case 'b':  *tail++ = '\b'; break;
+                            case 'f':  *tail++ = '\f'; break;
+                            case 'n':  *tail++ = '\n'; break;
+                            case 'r':  *tail++ = '\r'; break;
+                            case 't':  *tail++ = '\t'; break;
+                            case 'u':
+                                {
+                                    auto from_hex = [](char c)
+                                    {
+                                        if (c >= 'a')
+                                            return c - 'a' + 10;
+                                        if (c >= 'A')
+                                            return c - 'A' + 10;
+                                        return c - '0';
+                                    };
+                                    unsigned int code = 
+                                        (from_hex(head[1])<<12) + 
+                                        (from_hex(head[2])<< 8) + 
+                                        (from_hex(head[3])<< 4) + 
+                                        from_hex(head[4]);
+                                    if (code >= 0x800)
+                                    {
+                                        *tail++ = 0xE0 | (code >> 12);
+                                        *tail++ = 0x80 | ((code >> 6) & 0x3F);
+                                        *tail++ = 0x80 | (code & 0x3F);
+                                    }
+                                    else if (code >= 0x80)
+                                    {
+                                        *tail++ = 0xC0 | (code >> 6);
+                                        *tail++ = 0x80 | (code & 0x3F);
+                                    }
+                                    else
+                                    {
+                                        *tail++ = code;
+                                    }
+                                    head += 4;
+                                }
+                                break;
+                        }
+                    }
+                    else
+                        *tail++ = *head;
+                    head++;
+                }
+                return tail;
+            }
+
+            inline num_type number_type(const char* start, const char* end)
+            {
+                const std::size_t len = end - start;
+                const bool has_minus = std::memchr(start, '-', len) != nullptr;
+                const bool has_e = std::memchr(start, 'e', len) != nullptr
+                                || std::memchr(start, 'E', len) != nullptr;
+                const bool has_dec_sep = std::memchr(start, '.', len) != nullptr;
+                if (has_dec_sep || has_e)
+                  return num_type::Floating_point;
+                else if (has_minus)
+                  return num_type::Signed_integer;
+                else
+                  return num_type::Unsigned_integer;
+            }
+
+            // A number's value, parsed once
+            union number
+            {
+                double d;
+                int64_t si;
+                uint64_t ui;
+            };
+
+            // Works out the type and value of a number skip_number has accepted, in one pass.
+            // Integers are accumulated directly. A float is exact through Clinger's fast path
+            // when its digits fit in 53 bits and its power of ten is one a double holds exactly,
+            // which covers nearly all the numbers found in practice. Anything else (integers out
+            // of range, long or extreme floats) returns false and is left to lexical_cast.
+            inline bool parse_number(const char* start, const char* end, num_type& nt, number& value)
+            {
+                static const double powers_of_ten[] = {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+                };
+                const char* p = start;
+                bool negative = *p == '-';
+                if (negative)
+                    p++;
+
+                uint64_t mantissa = 0;
+                int digits = 0;
+                int exponent = 0;
+                bool overflow = false;
+                for(; p != end && *p >= '0' && *p <= '9'; p++)
+                {
+                    if (digits < 19)
+                    {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits += mantissa != 0;
+                    }
+                    else
+                    {
+                        // 20 digits may still fit an unsigned integer
+                        unsigned d = *p - '0';
+                        if (!overflow && digits == 19 && mantissa <= (UINT64_MAX - d) / 10)
+                            mantissa = mantissa * 10 + d;
+                        else
+                            overflow = true;
+                        digits++;
+                        exponent++;
+                    }
+                }
+
+                if (p == end)
+                {
+                    if (overflow)
+                    {
+                        nt = negative ? num_type::Signed_integer : num_type::Unsigned_integer;
+                        return false;
+                    }
+                    if (negative)
+                    {
+                        nt = num_type::Signed_integer;
+                        if (mantissa > uint64_t(INT64_MAX) + 1)
+                            return false;
+                        value.si = mantissa == uint64_t(INT64_MAX) + 1 ? INT64_MIN : -static_cast<int64_t>(mantissa);
+                    }
+                    else
+                    {
+                        nt = num_type::Unsigned_integer;
+                        value.ui = mantissa;
+                    }
+                    return true;
+                }
+
+                nt = num_type::Floating_point;
+                if (digits > 19)
+                    return false;
+                if (*p == '.')
+                {
+                    for(p++; p != end && *p >= '0' && *p <= '9'; p++)
+                    {
+                        if (digits >= 19)
+                            return false;
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits += mantissa != 0;
+                        exponent--;
+                    }
+                }
+                if (p != end)
+                {
+                    // 'e' or 'E'
+                    p++;
+                    bool negative_exponent = *p == '-';
+                    if (*p == '-' || *p == '+')
+                        p++;
+                    int e = 0;
+                    for(; p != end; p++)
+                    {
+                        if (e > 10000)
+                            return false;
+                        e = e * 10 + (*p - '0');
+                    }
+                    exponent += negative_exponent ? -e : e;
+                }
+
+                if (mantissa > (uint64_t(1) << 53))
+                    return false;
+                double d = static_cast<double>(mantissa);
+                if (mantissa != 0)
+                {
+                    if (exponent < -22 || exponent > 22)
+                        return false;
+                    d = exponent < 0 ? d / powers_of_ten[-exponent] : d * powers_of_ten[exponent];
+                }
+                value.d = negative ? -d : d;
+                return true;
+            }
+
+            // Moves `data' past a number, false if it is malformed
+            inline bool skip_number(char*& data)
+            {
+                enum NumberParsingState
+                {
+                    Minus,
+                    AfterMinus,
+                    ZeroFirst,
+                    Digits,
+                    DigitsAfterPoints,
+                    E,
+                    DigitsAfterE,
+                    Invalid,
+                } state{Minus};
+                while(crow_json_likely(state != Invalid))
+                {
+                    switch(*data)
+                    {
+                        case '0':
+                            state = (NumberParsingState)"\2\2\7\3\4\6\6"[state];
+                            /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
+                            {
+                                state = NumberParsingState::ZeroFirst;
+                            }
+                            else if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterE || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                // ok; pass
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '1': case '2': case '3': 
+                        case '4': case '5': case '6': 
+                        case '7': case '8': case '9':
+                            state = (NumberParsingState)"\3\3\7\3\4\6\6"[state];
+                            while(*(data+1) >= '0' && *(data+1) <= '9') data++;
+                            /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
+                            {
+                                state = NumberParsingState::Digits;
+                            }
+                            else if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterE || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                // ok; pass
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '.':
+                            state = (NumberParsingState)"\7\7\4\4\7\7\7"[state];
+                            /*
+                            if (state == NumberParsingState::Digits || state == NumberParsingState::ZeroFirst)
+                            {
+                                state = NumberParsingState::DigitsAfterPoints;
+                            }
+                            else
+                                return false;
+                            */
+                            break;
+                        case '-':
+                            state = (NumberParsingState)"\1\7\7\7\7\6\7"[state];
+                            /*if (state == NumberParsingState::Minus)
+                            {
+                                state = NumberParsingState::AfterMinus;
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '+':
+                            state = (NumberParsingState)"\7\7\7\7\7\6\7"[state];
+                            /*if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case 'e': case 'E':
+                            state = (NumberParsingState)"\7\7\7\5\5\7\7"[state];
+                            /*if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                state = NumberParsingState::E;
+                            }
+                            else 
+                                return false;*/
+                            break;
+                        default:
+                            if (crow_json_likely(state == NumberParsingState::ZeroFirst || 
+                                    state == NumberParsingState::Digits || 
+                                    state == NumberParsingState::DigitsAfterPoints || 
+                                    state == NumberParsingState::DigitsAfterE))
+                                return true;
+                            else
+                                return false;
+                    }
+                    data++;
+                }
+
+                return false;
+            }
+
+            // Moves `data' from just after an opening quote to the closing one, checking escapes
+            inline bool skip_string(char*& data, bool& has_escaping)
+            {
+                has_escaping = false;
+                while(1)
+                {
+                    if (crow_json_likely(*data != '"' && *data != '\\' && *data != '\0'))
+                    {
+                        data ++;
+                    }
+                    else if (*data == '"')
+                    {
+                        return true;
+                    }
+                    else if (*data == '\\')
+                    {
+                        has_escaping = true;
+                        data++;
+                        switch(*data)
+                        {
+                            case 'u':
+                                {
+                                    auto check = [](char c)
+                                    {
+                                        return 
+                                            ('0' <= c && c <= '9') ||
+                                            ('a' <= c && c <= 'f') ||
+                                            ('A' <= c && c <= 'F');
+                                    };
+                                    if (!(check(*(data+1)) && 
+                                        check(*(data+2)) && 
+                                        check(*(data+3)) && 
+                                        check(*(data+4))))
+                                        return false;
+                                }
+                                data += 5;
+                                break;
+                            case '"':
+                            case '\\':
+                            case '/':
+                            case 'b':
+                            case 'f':
+                            case 'n':
+                            case 'r':
+                            case 't':
+                                data ++;
+                                break;
+                            default:
+                                return false;
+                        }
+                    }
+                    else
+                        return false;
+                }
+            }
+
+            // Where the strings of a document start and end, found 64 bytes at a time before
+            // parsing: the quotes that are not escaped, and the backslashes that start an escape.
+            // A string without escapes is then skipped in one step instead of byte by byte; one
+            // with escapes is still walked by skip_string, which checks them. The index stops at
+            // the first NUL like the parsers do, and is left empty for short documents or
+            // without SSE2.
+            class string_index
+            {
+            public:
+                string_index(char* data, size_t size)
+                    : data_(data)
+                {
+#ifdef CROW_PARSER_SSE2
+                    if (size >= 64 && size <= UINT32_MAX)
+                        build(size);
+#else
+                    (void)size;
+#endif
+                }
+
+                // skip_string, for `data' just after an opening quote
+                bool skip_string(char*& data, bool& has_escaping)
+                {
+                    uint32_t open = static_cast<uint32_t>(data - 1 - data_);
+                    while(next_ < positions_.size() && positions_[next_] < open)
+                        next_ ++;
+                    if (next_ + 1 < positions_.size() && positions_[next_] == open && data_[positions_[next_+1]] == '"')
+                    {
+                        data = data_ + positions_[next_+1];
+                        next_ += 2;
+                        has_escaping = false;
+                        return true;
+                    }
+                    return detail::skip_string(data, has_escaping);
+                }
+
+            private:
+#ifdef CROW_PARSER_SSE2
+                void build(size_t size)
+                {
+                    positions_.reserve(size / 8);
+                    // whether the first byte of the next block is escaped
+                    uint64_t carry = 0;
+                    for(size_t at = 0; at < size; at += 64)
+                    {
+                        uint64_t quotes, backslashes, zeros;
+                        if (size - at >= 64)
+                            crow::detail::classify_json_block(data_ + at, quotes, backslashes, zeros);
+                        else
+                        {
+                            // the zeros past the end stop the index
+                            char tail[64] = {};
+                            memcpy(tail, data_ + at, size - at);
+                            crow::detail::classify_json_block(tail, quotes, backslashes, zeros);
+                        }
+                        // backslashes are rare, so the escaped bytes are worked out one by one
+                        uint64_t escaped = carry;
+                        carry = 0;
+                        for(uint64_t m = backslashes; m; m &= m - 1)
+                        {
+                            uint64_t bit = m & (~m + 1);
+                            if (escaped & bit)
+                                continue;
+                            if (bit >> 63)
+                                carry = 1;
+                            else
+                                escaped |= bit << 1;
+                        }
+                        uint64_t found = (quotes | backslashes) & ~escaped;
+                        if (zeros)
+                            found &= (zeros & (~zeros + 1)) - 1;
+                        for(; found; found &= found - 1)
+                            positions_.push_back(static_cast<uint32_t>(at + crow::detail::count_trailing_zeros(found)));
+                        if (zeros)
+                            return;
+                    }
+                }
+#endif
+
+                char* data_;
+                std::vector<uint32_t> positions_;
+                size_t next_{};
+            };
+
+            struct r_string 
+                : boost::less_than_comparable<r_string>,
+                boost::less_than_comparable<r_string, std::string>,
+                boost::equality_comparable<r_string>,
+                boost::equality_comparable<r_string, std::string>
+            {
+                r_string() {};
+                r_string(char* s, char* e)
+                    : s_(s), e_(e)
+                {};
+                ~r_string()
+                {
+                    if (owned_ == 1)
+                        delete[] s_;
+                    else if (owned_ == 2)
+                        delete reinterpret_cast<std::string*>(s_);
+                }
+
+                r_string(const r_string& r)
+                {
+                    *this = r;
+                }
+
+                r_string(r_string&& r)
+                {
+                    *this = r;
+                }
+
+                r_string& operator = (r_string&& r)
+                {
+                    s_ = r.s_;
+                    e_ = r.e_;
+                    owned_ = r.owned_;
+                    if (r.owned_)
+                        r.owned_ = 0;
+                    return *this;
+                }
+
+                r_string& operator = (const r_string& r)
+                {
+                    s_ = r.s_;
+                    e_ = r.e_;
+                    owned_ = 0;
+                    return *this;
+                }
+
+                operator std::string () const
+                {
+                    return std::string(s_, e_);
+                }
+
+
+                const char* begin() const { return s_; }
+                const char* end() const { return e_; }
+                size_t size() const { return end() - begin(); }
+
+                using iterator = const char*;
+                using const_iterator = const char*;
+
+                char* s_;
+                mutable char* e_;
+                uint8_t owned_{0};
+                friend std::ostream& operator << (std::ostream& os, const r_string& s)
+                {
+                    os << (std::string)s;
+                    return os;
+                }
+            private:
+                void force(char* s, uint32_t length)
+                {
+                    s_ = s;
+                    e_ = s_ + length;
+                    owned_ = 1;
+                }
+                // owns a whole std::string, and so reads as empty
+                void force(std::string* s)
+                {
+                    s_ = e_ = reinterpret_cast<char*>(s);
+                    owned_ = 2;
+                }
+                friend rvalue crow::json::load(const char* data, size_t size);
+                friend rvalue crow::json::load(std::string&& str);
+            };
+
+            inline bool operator < (const r_string& l, const r_string& r)
+            {
+                return boost::lexicographical_compare(l,r);
+            }
+
+            inline bool operator < (const r_string& l, const std::string& r)
+            {
+                return boost::lexicographical_compare(l,r);
+            }
+
+            inline bool operator > (const r_string& l, const std::string& r)
+            {
+                return boost::lexicographical_compare(r,l);
+            }
+
+            inline bool operator == (const r_string& l, const r_string& r)
+            {
+                return boost::equals(l,r);
+            }
+
+            inline bool operator == (const r_string& l, const std::string& r)
+            {
+                return boost::equals(l,r);
+            }
+
+            // FNV-1a, for the key indexes of rvalue and wvalue objects
+            inline size_t hash_key(const char* s, size_t size)
+            {
+                size_t seed = 2166136261u;
+                for(size_t i = 0; i < size; i ++)
+                {
+                    seed ^= static_cast<unsigned char>(s[i]);
+                    seed *= 16777619u;
+                }
+                return seed;
+            }
+        }
+
+        class rvalue
+        {
+            // set when num_ holds the number's value
+            static const int parsed_bit = 2;
+            static const int error_bit = 4;
+            // Objects with more members than this get a hash index of their keys
+            static const uint32_t index_threshold = 16;
+        public:
+            rvalue() noexcept : option_{error_bit}
+            {}
+            rvalue(type t) noexcept
+                : lsize_{}, lremain_{}, t_{t}
+            {}
+            rvalue(type t, char* s, char* e)  noexcept
+                : start_{s},
+                end_{e},
+                t_{t}
+            {
+                determine_num_type();
+            }
+
+            rvalue(const rvalue& r)
+            : start_(r.start_),
+                end_(r.end_),
+                key_(r.key_),
+                t_(r.t_),
+                nt_(r.nt_),
+                num_(r.num_),
+                option_(r.option_)
+            {
+                copy_l(r);
+            }
+
+            rvalue(rvalue&& r) noexcept
+            {
+                *this = std::move(r);
+            }
+
+            rvalue& operator = (const rvalue& r)
+            {
+                start_ = r.start_;
+                end_ = r.end_;
+                key_ = r.key_;
+                t_ = r.t_;
+                nt_ = r.nt_;
+                num_ = r.num_;
+                option_ = r.option_;
+                copy_l(r);
+                return *this;
+            }
+            rvalue& operator = (rvalue&& r) noexcept
+            {
+                start_ = r.start_;
+                end_ = r.end_;
+                key_ = std::move(r.key_);
+                l_ = std::move(r.l_);
+                index_ = std::move(r.index_);
+                lsize_ = r.lsize_;
+                lremain_ = r.lremain_;
+                t_ = r.t_;
+                nt_ = r.nt_;
+                num_ = r.num_;
+                option_ = r.option_;
+                return *this;
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return (option_ & error_bit) == 0;
+            }
+
+            explicit operator int64_t() const
+            {
+                return i();
+            }
+
+            explicit operator uint64_t() const
+            {
+                return u();
+            }
+
+            explicit operator int() const
+            {
+                return (int)i();
+            }
+
+            type t() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (option_ & error_bit)
+                {
+                    throw std::runtime_error("invalid json object");
+                }
+#endif
+                return t_;
+            }
+
+            num_type nt() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (option_ & error_bit)
+                {
+                    throw std::runtime_error("invalid json object");
+                }
+#endif
+                return nt_;
+            }
+
+            int64_t i() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                switch (t()) {
+                    case type::Number:
+                    case type::String:
+                        break;
+                    default:
+                        const std::string msg = "expected number, got: "
+                            + std::string(get_type_str(t()));
+                        throw std::runtime_error(msg);
+                }
+#endif
+                if (option_ & parsed_bit)
+                {
+                    if (nt_ == num_type::Signed_integer)
+                        return num_.si;
+                    if (nt_ == num_type::Unsigned_integer && num_.ui <= INT64_MAX)
+                        return num_.ui;
+                }
+                return boost::lexical_cast<int64_t>(start_, end_-start_);
+            }
+
+            uint64_t u() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                switch (t()) {
+                    case type::Number:
+                    case type::String:
+                        break;
+                    default:
+                        throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
+                }
+#endif
+                if ((option_ & parsed_bit) && nt_ == num_type::Unsigned_integer)
+                    return num_.ui;
+                return boost::lexical_cast<uint64_t>(start_, end_-start_);
+            }
+
+            double d() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number)
+                    throw std::runtime_error("value is not number");
+#endif
+                if (option_ & parsed_bit)
+                {
+                    switch(nt_)
+                    {
+                        case num_type::Floating_point: return num_.d;
+                        case num_type::Signed_integer: return static_cast<double>(num_.si);
+                        case num_type::Unsigned_integer: return static_cast<double>(num_.ui);
+                        case num_type::Null: break;
+                    }
+                }
+                return boost::lexical_cast<double>(start_, end_-start_);
+            }
+
+            bool b() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::True && t() != type::False)
+                    throw std::runtime_error("value is not boolean");
+#endif
+                return t() == type::True;
+            }
+
+            void unescape() const
+            {
+                if (*(start_-1))
+                {
+                    end_ = detail::unescape(start_, end_);
+                    *end_ = 0;
+                    *(start_-1) = 0;
+                }
+            }
+
+            detail::r_string s() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::String)
+                    throw std::runtime_error("value is not string");
+#endif
+                unescape();
+                return detail::r_string{start_, end_};
+            }
+
+            bool has(const char* str) const
+            {
+                return has(std::string(str));
+            }
+
+            bool has(const std::string& str) const
+            {
+                return find(str) != nullptr;
+            }
+
+            int count(const std::string& str)
+            {
+                return has(str) ? 1 : 0;
+            }
+
+            rvalue* begin() const 
+            { 
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object && t() != type::List)
+                    throw std::runtime_error("value is not a container");
+#endif
+                return l_.get(); 
+            }
+            rvalue* end() const 
+            { 
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object && t() != type::List)
+                    throw std::runtime_error("value is not a container");
+#endif
+                return l_.get()+lsize_; 
+            }
+
+            const detail::r_string& key() const
+            {
+                return key_;
+            }
+
+            size_t size() const
+            {
+                if (t() == type::String)
+                    return s().size();
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object && t() != type::List)
+                    throw std::runtime_error("value is not a container");
+#endif
+                return lsize_;
+            }
+
+            const rvalue& operator[](int index) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::List)
+                    throw std::runtime_error("value is not a list");
+                if (index >= (int)lsize_ || index < 0)
+                    throw std::runtime_error("list out of bound");
+#endif
+                return l_[index];
+            }
+
+            const rvalue& operator[](size_t index) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::List)
+                    throw std::runtime_error("value is not a list");
+                if (index >= lsize_)
+                    throw std::runtime_error("list out of bound");
+#endif
+                return l_[index];
+            }
+
+            const rvalue& operator[](const char* str) const
+            {
+                return this->operator[](std::string(str));
+            }
+
+            const rvalue& operator[](const std::string& str) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object)
+                    throw std::runtime_error("value is not an object");
+#endif
+                if (auto v = find(str))
+                    return *v;
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                throw std::runtime_error("cannot find key");
+#else
+                static rvalue nullValue;
+                return nullValue;
+#endif
+            }
+
+            void set_error()
+            {
+                option_|=error_bit;
+            }
+
+            bool error() const
+            {
+                return (option_&error_bit)!=0;
+            }
+        private:
+            void copy_l(const rvalue& r)
+            {
+                if (r.t() != type::Object && r.t() != type::List)
+                    return;
+                lsize_ = r.lsize_;
+                lremain_ = 0;
+                l_.reset(new rvalue[lsize_]);
+                std::copy(r.begin(), r.end(), begin());
+                index_.reset();
+                if (r.index_)
+                {
+                    size_t capacity = index_capacity();
+                    index_.reset(new uint32_t[capacity]);
+                    std::copy(r.index_.get(), r.index_.get() + capacity, index_.get());
+                }
+            }
+
+            // A power of two at least twice the number of members
+            size_t index_capacity() const
+            {
+                size_t capacity = 32;
+                while(capacity < 2 * static_cast<size_t>(lsize_))
+                    capacity *= 2;
+                return capacity;
+            }
+
+            // Open addressing over the members: each slot holds 1 + a member's position, or 0.
+            // Built once while parsing, so lookups never write to a document, and the members
+            // keep their order.
+            void build_index()
+            {
+                size_t mask = index_capacity() - 1;
+                index_.reset(new uint32_t[mask + 1]());
+                for(uint32_t i = 0; i < lsize_; i ++)
+                {
+                    size_t slot = detail::hash_key(l_[i].key_.begin(), l_[i].key_.size()) & mask;
+                    while(index_[slot])
+                        slot = (slot + 1) & mask;
+                    index_[slot] = i + 1;
+                }
+            }
+
+            // The first member called `str', if any
+            const rvalue* find(const std::string& str) const
+            {
+                auto matches = [&](const rvalue& v)
+                {
+                    return v.key_.size() == str.size() && memcmp(v.key_.begin(), str.data(), str.size()) == 0;
+                };
+                if (index_)
+                {
+                    size_t mask = index_capacity() - 1;
+                    for(size_t slot = detail::hash_key(str.data(), str.size()) & mask; index_[slot]; slot = (slot + 1) & mask)
+                    {
+                        const rvalue& v = l_[index_[slot] - 1];
+                        if (matches(v))
+                            return &v;
+                    }
+                    return nullptr;
+                }
+                for(auto& v : *this)
+                {
+                    if (matches(v))
+                        return &v;
+                }
+                return nullptr;
+            }
+
+            void emplace_back(rvalue&& v)
+            {
+                if (!lremain_)
+                {
+                    int new_size = lsize_ + lsize_;
+                    if (new_size - lsize_ > 60000)
+                        new_size = lsize_ + 60000;
+                    if (new_size < 4)
+                        new_size = 4;
+                    rvalue* p = new rvalue[new_size];
+                    rvalue* p2 = p;
+                    for(auto& x : *this)
+                        *p2++ = std::move(x);
+                    l_.reset(p);
+                    lremain_ = new_size - lsize_;
+                }
+                l_[lsize_++] = std::move(v);
+                lremain_ --;
+            }
+
+            // determines num_type from the string, and the value along with it
+            void determine_num_type()
+            {
+                if (t_ != type::Number)
+                {
+                    nt_ = num_type::Null;
+                    return;
+                }
+
+                if (detail::parse_number(start_, end_, nt_, num_))
+                    option_ |= parsed_bit;
+            }
+
+            mutable char* start_ = nullptr;
+            mutable char* end_ = nullptr;
+            detail::r_string key_;
+            std::unique_ptr<rvalue[]> l_;
+            std::unique_ptr<uint32_t[]> index_;
+            uint32_t lsize_ = 0;
+            uint16_t lremain_ = 0;
+            type t_ = type::Null;
+            num_type nt_{num_type::Null};
+            detail::number num_{};
+            mutable uint8_t option_{0};
+
+            friend rvalue load_nocopy_internal(char* data, size_t size);
+            friend rvalue load(const char* data, size_t size);
+            friend rvalue load(std::string&& str);
+            friend std::ostream& operator <<(std::ostream& os, const rvalue& r)
+            {
+                switch(r.t_)
+                {
+
+                case type::Null: os << "null"; break;
+                case type::False: os << "false"; break;
+                case type::True: os << "true"; break;
+                case type::Number:
+                    {
+                        switch (r.nt())
+                        {
+                        case num_type::Floating_point: os << r.d(); break;
+                        case num_type::Signed_integer: os << r.i(); break;
+                        case num_type::Unsigned_integer: os << r.u(); break;
+                        case num_type::Null: throw std::runtime_error("Number with num_type Null");
+                        }
+                    }
+                    break;
+                case type::String: os << '"' << r.s() << '"'; break;
+                case type::List: 
+                    {
+                        os << '['; 
+                        bool first = true;
+                        for(auto& x : r)
+                        {
+                            if (!first)
+                                os << ',';
+                            first = false;
+                            os << x;
+                        }
+                        os << ']'; 
+                    }
+                    break;
+                case type::Object:
+                    {
+                        os << '{'; 
+                        bool first = true;
+                        for(auto& x : r)
+                        {
+                            if (!first)
+                                os << ',';
+                            os << '"' << escape(x.key_) << "\":";
+                            first = false;
+                            os << x;
+                        }
+                        os << '}'; 
+                    }
+                    break;
+                }
+                return os;
+            }
+        };
+        namespace detail {
+        }
+
+        inline bool operator == (const rvalue& l, const std::string& r)
+        {
+            return l.s() == r;
+        }
+
+        inline bool operator == (const std::string& l, const rvalue& r)
+        {
+            return l == r.s();
+        }
+
+        inline bool operator != (const rvalue& l, const std::string& r)
+        {
+            return l.s() != r;
+        }
+
+        inline bool operator != (const std::string& l, const rvalue& r)
+        {
+            return l != r.s();
+        }
+
+        inline bool operator == (const rvalue& l, double r)
+        {
+            return l.d() == r;
+        }
+
+        inline bool operator == (double l, const rvalue& r)
+        {
+            return l == r.d();
+        }
+
+        inline bool operator != (const rvalue& l, double r)
+        {
+            return l.d() != r;
+        }
+
+        inline bool operator != (double l, const rvalue& r)
+        {
+            return l != r.d();
+        }
+
+
+        inline rvalue load_nocopy_internal(char* data, size_t size)
+        {
+            //static const char* escaped = "\"\\/\b\f\n\r\t";
+            struct Parser
+            {
+                Parser(char* data, size_t size)
+                    : data(data), strings(data, size)
+                {
+                }
+
+                bool consume(char c)
+                {
+                    if (crow_json_unlikely(*data != c))
+                        return false;
+                    data++;
+                    return true;
+                }
+
+                void ws_skip()
+                {
+                    while(*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') ++data;
+                };
+
+                rvalue decode_string()
+                {
+                    if (crow_json_unlikely(!consume('"')))
+                        return {};
+                    char* start = data;
+                    bool has_escaping;
+                    if (crow_json_unlikely(!strings.skip_string(data, has_escaping)))
+                        return {};
+                    // unescaped now rather than on first access, so that reading a document
+                    // never writes to it
+                    char* end = has_escaping ? detail::unescape(start, data) : data;
+                    *end = 0;
+                    *(start-1) = 0;
+                    data++;
+                    return {type::String, start, end};
+                }
+
+                rvalue decode_list()
+                {
+                    rvalue ret(type::List);
+                    if (crow_json_unlikely(!consume('[')))
+                    {
+                        ret.set_error();
+                        return ret;
+                    }
+                    ws_skip();
+                    if (crow_json_unlikely(*data == ']'))
+                    {
+                        data++;
+                        return ret;
+                    }
+
+                    while(1)
+                    {
+                        auto v = decode_value();
+                        if (crow_json_unlikely(!v))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+                        ws_skip();
+                        ret.emplace_back(std::move(v));
+                        if (*data == ']')
+                        {
+                            data++;
+                            break;
+                        }
+                        if (crow_json_unlikely(!consume(',')))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+                        ws_skip();
+                    }
+                    return ret;
+                }
+
+                rvalue decode_number()
+                {
+                    char* start = data;
+                    if (crow_json_likely(detail::skip_number(data)))
+                        return {type::Number, start, data};
+                    return {};
+                }
+
+                rvalue decode_value()
+                {
+                    switch(*data)
+                    {
+                        case '[':
+                            return decode_list();
+                        case '{':
+                            return decode_object();
+                        case '"':
+                            return decode_string();
+                        case 't':
+                            if (//e-data >= 4 &&
+                                    data[1] == 'r' &&
+                                    data[2] == 'u' &&
+                                    data[3] == 'e')
+                            {
+                                data += 4;
+                                return {type::True};
+                            }
+                            else
+                                return {};
+                        case 'f':
+                            if (//e-data >= 5 &&
+                                    data[1] == 'a' &&
+                                    data[2] == 'l' &&
+                                    data[3] == 's' &&
+                                    data[4] == 'e')
+                            {
+                                data += 5;
+                                return {type::False};
+                            }
+                            else
+                                return {};
+                        case 'n':
+                            if (//e-data >= 4 &&
+                                    data[1] == 'u' &&
+                                    data[2] == 'l' &&
+                                    data[3] == 'l')
+                            {
+                                data += 4;
+                                return {type::Null};
+                            }
+                            else
+                                return {};
+                        //case '1': case '2': case '3': 
+                        //case '4': case '5': case '6': 
+                        //case '7': case '8': case '9':
+                        //case '0': case '-':
+                        default:
+                            return decode_number();
+                    }
+                    return {};
+                }
+
+                rvalue decode_object()
+                {
+                    rvalue ret(type::Object);
+                    if (crow_json_unlikely(!consume('{')))
+                    {
+                        ret.set_error();
+                        return ret;
+                    }
+
+                    ws_skip();
+
+                    if (crow_json_unlikely(*data == '}'))
+                    {
+                        data++;
+                        return ret;
+                    }
+
+                    while(1)
+                    {
+                        auto t = decode_string();
+                        if (crow_json_unlikely(!t))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+
+                        ws_skip();
+                        if (crow_json_unlikely(!consume(':')))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+
+                        // TODO caching key to speed up (flyweight?)
+                        auto key = t.s();
+
+                        ws_skip();
+                        auto v = decode_value();
+                        if (crow_json_unlikely(!v))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+                        ws_skip();
+
+                        v.key_ = std::move(key);
+                        ret.emplace_back(std::move(v));
+                        if (crow_json_unlikely(*data == '}'))
+                        {
+                            data++;
+                            if (ret.lsize_ > rvalue::index_threshold)
+                                ret.build_index();
+                            break;
+                        }
+                        if (crow_json_unlikely(!consume(',')))
+                        {
+                            ret.set_error();
+                            break;
+                        }
+                        ws_skip();
+                    }
+                    return ret;
+                }
+
+                rvalue parse()
+                {
+                    ws_skip();
+                    auto ret = decode_value(); // or decode object?
+                    ws_skip();
+                    if (ret && *data != '\0')
+                        ret.set_error();
+                    return ret;
+                }
+
+                char* data;
+                detail::string_index strings;
+            };
+            return Parser(data, size).parse();
+        }
+        inline rvalue load(const char* data, size_t size)
+        {
+            char* s = new char[size+1];
+            memcpy(s, data, size);
+            s[size] = 0;
+            auto ret = load_nocopy_internal(s, size);
+            if (ret)
+                ret.key_.force(s, static_cast<uint32_t>(size));
+            else
+                delete[] s;
+            return ret;
+        }
+
+        // Parses `str' where it is, without the copy the other overloads make; the returned
+        // value keeps the string alive and its contents are overwritten while parsing.
+        inline rvalue load(std::string&& str)
+        {
+            std::unique_ptr<std::string> owned(new std::string(std::move(str)));
+            auto ret = load_nocopy_internal(&(*owned)[0], owned->size());
+            if (ret)
+                ret.key_.force(owned.release());
+            return ret;
+        }
+
+        inline rvalue load(const char* data)
+        {
+            return load(data, strlen(data));
+        }
+
+        inline rvalue load(const std::string& str)
+        {
+            return load(str.data(), str.size());
+        }
+
+        class tape;
+        tape load_tape(const char* data, size_t size);
+        tape load_tape(std::string&& str);
+
+        // A document parsed into one flat array of 64-bit words, the way simdjson lays it out,
+        // instead of a tree of rvalues. Parsing allocates the text and the tape and nothing
+        // per value. Each value starts with a word carrying its type in the top byte:
+        //   null, true, false  that word alone
+        //   string, number     the offset of the text in the low bits, then its length
+        //   list, object       the index just past the value, then the number of elements;
+        //                      an object's elements are key strings, each followed by its value
+        // Strings are unescaped in place while parsing. Values refer to the tape, which has to
+        // outlive them and stay where it is.
+        class tape
+        {
+        public:
+            class value;
+            class iterator;
+
+            explicit operator bool() const noexcept
+            {
+                return !error_;
+            }
+
+            bool error() const
+            {
+                return error_;
+            }
+
+            value root() const;
+
+        private:
+            static const int tag_shift = 56;
+            static const uint64_t payload_mask = (uint64_t(1) << tag_shift) - 1;
+
+            char tag(size_t index) const
+            {
+                return static_cast<char>(words_[index] >> tag_shift);
+            }
+
+            uint64_t payload(size_t index) const
+            {
+                return words_[index] & payload_mask;
+            }
+
+            // The index of the value after the one at `index'
+            size_t next(size_t index) const
+            {
+                switch(tag(index))
+                {
+                    case '[': case '{': return payload(index);
+                    case '"': case 'u': case 'i': case 'd': return index + 2;
+                    default: return index + 1;
+                }
+            }
+
+            void push(char tag, uint64_t payload)
+            {
+                words_.push_back((uint64_t(static_cast<unsigned char>(tag)) << tag_shift) | payload);
+            }
+
+            static void ws_skip(char*& data)
+            {
+                while(*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') ++data;
+            }
+
+            bool parse()
+            {
+                char* data = &text_[0];
+                detail::string_index strings(data, text_.size());
+                ws_skip(data);
+                if (!parse_value(data, strings))
+                    return false;
+                ws_skip(data);
+                return *data == '\0';
+            }
+
+            bool parse_value(char*& data, detail::string_index& strings)
+            {
+                switch(*data)
+                {
+                    case '[':
+                        return parse_container(data, '[', ']', strings);
+                    case '{':
+                        return parse_container(data, '{', '}', strings);
+                    case '"':
+                        return parse_string(data, strings);
+                    case 't':
+                        if (data[1] == 'r' && data[2] == 'u' && data[3] == 'e')
+                        {
+                            data += 4;
+                            push('t', 0);
+                            return true;
+                        }
+                        return false;
+                    case 'f':
+                        if (data[1] == 'a' && data[2] == 'l' && data[3] == 's' && data[4] == 'e')
+                        {
+                            data += 5;
+                            push('f', 0);
+                            return true;
+                        }
+                        return false;
+                    case 'n':
+                        if (data[1] == 'u' && data[2] == 'l' && data[3] == 'l')
+                        {
+                            data += 4;
+                            push('n', 0);
+                            return true;
+                        }
+                        return false;
+                    default:
+                        {
+                            char* start = data;
+                            if (crow_json_unlikely(!detail::skip_number(data)))
+                                return false;
+                            static const char tags[] = {'i', 'u', 'd'};
+                            push(tags[static_cast<int>(detail::number_type(start, data))], start - &text_[0]);
+                            words_.push_back(data - start);
+                            return true;
+                        }
+                }
+            }
+
+            bool parse_string(char*& data, detail::string_index& strings)
+            {
+                char* start = ++data;
+                bool has_escaping;
+                if (crow_json_unlikely(!strings.skip_string(data, has_escaping)))
+                    return false;
+                char* end = has_escaping ? detail::unescape(start, data) : data;
+                push('"', start - &text_[0]);
+                words_.push_back(end - start);
+                data++;
+                return true;
+            }
+
+            bool parse_container(char*& data, char open, char close, detail::string_index& strings)
+            {
+                size_t at = words_.size();
+                push(open, 0);
+                words_.push_back(0);
+                data++;
+                ws_skip(data);
+                uint64_t count = 0;
+                if (*data == close)
+                    data++;
+                else
+                {
+                    while(1)
+                    {
+                        if (open == '{')
+                        {
+                            if (crow_json_unlikely(*data != '"' || !parse_string(data, strings)))
+                                return false;
+                            ws_skip(data);
+                            if (crow_json_unlikely(*data != ':'))
+                                return false;
+                            data++;
+                            ws_skip(data);
+                        }
+                        if (crow_json_unlikely(!parse_value(data, strings)))
+                            return false;
+                        count++;
+                        ws_skip(data);
+                        if (*data == close)
+                        {
+                            data++;
+                            break;
+                        }
+                        if (crow_json_unlikely(*data != ','))
+                            return false;
+                        data++;
+                        ws_skip(data);
+                    }
+                }
+                words_[at] |= words_.size();
+                words_[at + 1] = count;
+                return true;
+            }
+
+            std::string text_;
+            std::vector<uint64_t> words_;
+            bool error_{true};
+
+            friend tape load_tape(const char* data, size_t size);
+            friend tape load_tape(std::string&& str);
+        };
+
+        // A value on a tape, with the accessors of rvalue
+        class tape::value
+        {
+        public:
+            static const size_t npos = static_cast<size_t>(-1);
+
+            value() = default;
+            value(const tape* doc, size_t index, size_t key = npos)
+                : doc_(doc), index_(index), key_(key)
+            {
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return doc_ != nullptr;
+            }
+
+            bool error() const
+            {
+                return doc_ == nullptr;
+            }
+
+            type t() const
+            {
+                if (!doc_)
+                {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                    throw std::runtime_error("invalid json object");
+#else
+                    return type::Null;
+#endif
+                }
+                switch(doc_->tag(index_))
+                {
+                    case 't': return type::True;
+                    case 'f': return type::False;
+                    case '"': return type::String;
+                    case 'u': case 'i': case 'd': return type::Number;
+                    case '[': return type::List;
+                    case '{': return type::Object;
+                    default: return type::Null;
+                }
+            }
+
+            num_type nt() const
+            {
+                if (t() != type::Number)
+                    return num_type::Null;
+                switch(doc_->tag(index_))
+                {
+                    case 'i': return num_type::Signed_integer;
+                    case 'u': return num_type::Unsigned_integer;
+                    default: return num_type::Floating_point;
+                }
+            }
+
+            int64_t i() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number && t() != type::String)
+                    throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
+#endif
+                return boost::lexical_cast<int64_t>(text(), length());
+            }
+
+            uint64_t u() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number && t() != type::String)
+                    throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
+#endif
+                return boost::lexical_cast<uint64_t>(text(), length());
+            }
+
+            double d() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number)
+                    throw std::runtime_error("value is not number");
+#endif
+                return boost::lexical_cast<double>(text(), length());
+            }
+
+            bool b() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::True && t() != type::False)
+                    throw std::runtime_error("value is not boolean");
+#endif
+                return t() == type::True;
+            }
+
+            detail::r_string s() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::String)
+                    throw std::runtime_error("value is not string");
+#endif
+                return {text(), text() + length()};
+            }
+
+            detail::r_string key() const
+            {
+                if (key_ == npos)
+                    return {};
+                return value(doc_, key_).s();
+            }
+
+            size_t size() const
+            {
+                if (t() == type::String)
+                    return length();
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object && t() != type::List)
+                    throw std::runtime_error("value is not a container");
+#endif
+                return doc_->words_[index_ + 1];
+            }
+
+            iterator begin() const;
+            iterator end() const;
+
+            value operator[](size_t index) const;
+
+            value operator[](int index) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (index < 0)
+                    throw std::runtime_error("list out of bound");
+#endif
+                return (*this)[static_cast<size_t>(index)];
+            }
+
+            value operator[](const std::string& str) const;
+
+            value operator[](const char* str) const
+            {
+                return (*this)[std::string(str)];
+            }
+
+            bool has(const std::string& str) const;
+
+            bool has(const char* str) const
+            {
+                return has(std::string(str));
+            }
+
+            int count(const std::string& str) const
+            {
+                return has(str) ? 1 : 0;
+            }
+
+            friend std::ostream& operator << (std::ostream& os, const value& v);
+
+        private:
+            char* text() const
+            {
+                return const_cast<char*>(doc_->text_.data()) + doc_->payload(index_);
+            }
+
+            size_t length() const
+            {
+                return doc_->words_[index_ + 1];
+            }
+
+            // The member called `str', or npos
+            size_t find(const std::string& str) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object)
+                    throw std::runtime_error("value is not an object");
+#endif
+                if (t() != type::Object)
+                    return npos;
+                for(size_t i = index_ + 2; i != doc_->payload(index_); i = doc_->next(i + 2))
+                {
+                    if (value(doc_, i).s() == str)
+                        return i;
+                }
+                return npos;
+            }
+
+            const tape* doc_{};
+            size_t index_{};
+            // where the key of an object's member is
+            size_t key_{npos};
+
+            friend class iterator;
+        };
+
+        class tape::iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = tape::value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const tape::value*;
+            using reference = tape::value;
+
+            iterator(const tape* doc, size_t index, bool object)
+                : doc_(doc), index_(index), object_(object)
+            {
+                load();
+            }
+
+            tape::value operator*() const
+            {
+                return current_;
+            }
+
+            const tape::value* operator->() const
+            {
+                return &current_;
+            }
+
+            iterator& operator++()
+            {
+                index_ = doc_->next(current_.index_);
+                load();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            bool operator == (const iterator& other) const
+            {
+                return index_ == other.index_;
+            }
+
+            bool operator != (const iterator& other) const
+            {
+                return index_ != other.index_;
+            }
+
+        private:
+            void load()
+            {
+                if (object_)
+                    current_ = tape::value(doc_, index_ + 2, index_);
+                else
+                    current_ = tape::value(doc_, index_);
+            }
+
+            const tape* doc_;
+            size_t index_;
+            bool object_;
+            tape::value current_;
+        };
+
+        inline tape::value tape::root() const
+        {
+            if (error_)
+                return {};
+            return {this, 0};
+        }
+
+        inline tape::iterator tape::value::begin() const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::Object && t() != type::List)
+                throw std::runtime_error("value is not a container");
+#endif
+            return {doc_, index_ + 2, t() == type::Object};
+        }
+
+        inline tape::iterator tape::value::end() const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::Object && t() != type::List)
+                throw std::runtime_error("value is not a container");
+#endif
+            return {doc_, static_cast<size_t>(doc_->payload(index_)), t() == type::Object};
+        }
+
+        inline tape::value tape::value::operator[](size_t index) const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::List)
+                throw std::runtime_error("value is not a list");
+            if (index >= size())
+                throw std::runtime_error("list out of bound");
+#endif
+            size_t i = index_ + 2;
+            while(index--)
+                i = doc_->next(i);
+            return {doc_, i};
+        }
+
+        inline tape::value tape::value::operator[](const std::string& str) const
+        {
+            size_t key = find(str);
+            if (key != npos)
+                return {doc_, key + 2, key};
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            throw std::runtime_error("cannot find key");
+#else
+            return {};
+#endif
+        }
+
+        inline bool tape::value::has(const std::string& str) const
+        {
+            return find(str) != npos;
+        }
+
+        inline std::ostream& operator << (std::ostream& os, const tape::value& v)
+        {
+            switch(v.t())
+            {
+                case type::Null: os << "null"; break;
+                case type::False: os << "false"; break;
+                case type::True: os << "true"; break;
+                case type::Number: os.write(v.text(), v.length()); break;
+                case type::String: os << '"' << escape(v.s()) << '"'; break;
+                case type::List:
+                case type::Object:
+                    {
+                        bool object = v.t() == type::Object;
+                        os << (object ? '{' : '[');
+                        bool first = true;
+                        for(auto x : v)
+                        {
+                            if (!first)
+                                os << ',';
+                            first = false;
+                            if (object)
+                                os << '"' << escape(x.key()) << "\":";
+                            os << x;
+                        }
+                        os << (object ? '}' : ']');
+                    }
+                    break;
+            }
+            return os;
+        }
+
+        inline tape load_tape(const char* data, size_t size)
+        {
+            return load_tape(std::string(data, size));
+        }
+
+        inline tape load_tape(std::string&& str)
+        {
+            tape ret;
+            ret.text_ = std::move(str);
+            ret.error_ = !ret.parse();
+            if (ret.error_)
+                ret.words_.clear();
+            return ret;
+        }
+
+        inline tape load_tape(const char* data)
+        {
+            return load_tape(data, strlen(data));
+        }
+
+        inline tape load_tape(const std::string& str)
+        {
+            return load_tape(str.data(), str.size());
+        }
+
+        class wvalue
+        {
+            friend class crow::mustache::template_t;
+        public:
+            type t() const { return t_; }
+        private:
+            // Objects with more members than this get a hash index of their keys
+            static const size_t index_threshold = 32;
+
+            // An object's members, in the order they were added. A few are found by a linear
+            // search; past index_threshold an open-addressing index (1 + a member's position
+            // per slot, 0 for none) takes over.
+            struct object
+            {
+                static const size_t npos = static_cast<size_t>(-1);
+
+                std::vector<std::pair<std::string, wvalue>> members;
+                std::vector<uint32_t> index;
+
+                size_t find(const std::string& key) const
+                {
+                    if (index.empty())
+                    {
+                        for(size_t i = 0; i < members.size(); i ++)
+                        {
+                            if (members[i].first == key)
+                                return i;
+                        }
+                        return npos;
+                    }
+                    size_t mask = index.size() - 1;
+                    for(size_t slot = detail::hash_key(key.data(), key.size()) & mask; index[slot]; slot = (slot + 1) & mask)
+                    {
+                        if (members[index[slot] - 1].first == key)
+                            return index[slot] - 1;
+                    }
+                    return npos;
+                }
+
+                // Adds a member, which must not be there yet
+                wvalue& add(const std::string& key, wvalue&& value)
+                {
+                    if (members.empty())
+                        members.reserve(8);
+                    members.emplace_back(key, std::move(value));
+                    if (members.size() > index_threshold)
+                    {
+                        if (index.size() < 2 * members.size())
+                            reindex();
+                        else
+                            insert(members.size() - 1);
+                    }
+                    return members.back().second;
+                }
+
+                void reindex()
+                {
+                    size_t capacity = 32;
+                    while(capacity < 2 * members.size())
+                        capacity *= 2;
+                    index.assign(capacity, 0);
+                    for(size_t i = 0; i < members.size(); i ++)
+                        insert(i);
+                }
+
+                void insert(size_t i)
+                {
+                    const std::string& key = members[i].first;
+                    size_t mask = index.size() - 1;
+                    size_t slot = detail::hash_key(key.data(), key.size()) & mask;
+                    while(index[slot])
+                        slot = (slot + 1) & mask;
+                    index[slot] = static_cast<uint32_t>(i + 1);
+                }
+            };
+
+            type t_{type::Null};
+            num_type nt{num_type::Null};
+            // only the member for t_ is alive: num for a Number, s for a String, and the
+            // owned l or o for a List or an Object
+            union
+            {
+                detail::number num{};
+                std::string s;
+                std::vector<wvalue>* l;
+                object* o;
+            };
+        public:
+
+            wvalue() {}
+
+            wvalue(const rvalue& r)
+            {
+                switch(r.t())
+                {
+                    case type::Null:
+                    case type::False:
+                    case type::True:
+                        t_ = r.t();
+                        return;
+                    case type::Number:
+                        t_ = type::Number;
+                        nt = r.nt();
+                        if (nt == num_type::Floating_point)
+                          num.d = r.d();
+                        else if (nt == num_type::Signed_integer)
+                          num.si = r.i();
+                        else
+                          num.ui = r.u();
+                        return;
+                    case type::String:
+                        *this = std::string(r.s());
+                        return;
+                    case type::List:
+                        {
+                            auto& list = as_list();
+                            list.reserve(r.size());
+                            for(auto it = r.begin(); it != r.end(); ++it)
+                                list.emplace_back(*it);
+                        }
+                        return;
+                    case type::Object:
+                        {
+                            auto& obj = as_object();
+                            obj.members.reserve(r.size());
+                            for(auto it = r.begin(); it != r.end(); ++it)
+                            {
+                                std::string key = it->key();
+                                if (obj.find(key) == object::npos)
+                                    obj.add(key, wvalue(*it));
+                            }
+                        }
+                        return;
+                }
+            }
+
+            wvalue(wvalue&& r) noexcept
+            {
+                take(r);
+            }
+
+            wvalue& operator = (wvalue&& r) noexcept
+            {
+                if (this != &r)
+                {
+                    reset();
+                    take(r);
+                }
+                return *this;
+            }
+
+            ~wvalue()
+            {
+                reset();
+            }
+
+            void clear()
+            {
+                reset();
+            }
+
+            void reset()
+            {
+                switch(t_)
+                {
+                    case type::String:
+                        s.~basic_string();
+                        break;
+                    case type::List:
+                        delete l;
+                        break;
+                    case type::Object:
+                        delete o;
+                        break;
+                    default:
+                        break;
+                }
+                t_ = type::Null;
+                num.ui = 0;
+            }
+
+            wvalue& operator = (std::nullptr_t)
+            {
+                reset();
+                return *this;
+            }
+            wvalue& operator = (bool value)
+            {
+                reset();
+                if (value)
+                    t_ = type::True;
+                else
+                    t_ = type::False;
+                return *this;
+            }
+
+            wvalue& operator = (double value)
+            {
+                reset();
+                t_ = type::Number;
+                num.d = value;
+                nt = num_type::Floating_point;
+                return *this;
+            }
+
+            wvalue& operator = (unsigned short value)
+            {
+                reset();
+                t_ = type::Number;
+                num.ui = value;
+                nt = num_type::Unsigned_integer;
+                return *this;
+            }
+
+            wvalue& operator = (short value)
+            {
+                reset();
+                t_ = type::Number;
+                num.si = value;
+                nt = num_type::Signed_integer;
+                return *this;
+            }
+
+            wvalue& operator = (long long value)
+            {
+                reset();
+                t_ = type::Number;
+                num.si = value;
+                nt = num_type::Signed_integer;
+                return *this;
+            }
+
+            wvalue& operator = (long value)
+            {
+                reset();
+                t_ = type::Number;
+                num.si = value;
+                nt = num_type::Signed_integer;
+                return *this;
+            }
+
+            wvalue& operator = (int value)
+            {
+                reset();
+                t_ = type::Number;
+                num.si = value;
+                nt = num_type::Signed_integer;
+                return *this;
+            }
+
+            wvalue& operator = (unsigned long long value)
+            {
+                reset();
+                t_ = type::Number;
+                num.ui = value;
+                nt = num_type::Unsigned_integer;
+                return *this;
+            }
+
+            wvalue& operator = (unsigned long value)
+            {
+                reset();
+                t_ = type::Number;
+                num.ui = value;
+                nt = num_type::Unsigned_integer;
+                return *this;
+            }
+
+            wvalue& operator = (unsigned int value)
+            {
+                reset();
+                t_ = type::Number;
+                num.ui = value;
+                nt = num_type::Unsigned_integer;
+                return *this;
+            }
+
+            wvalue& operator=(const char* str)
+            {
+                as_string() = str;
+                return *this;
+            }
+
+            wvalue& operator=(const std::string& str)
+            {
+                as_string() = str;
+                return *this;
+            }
+
+            wvalue& operator=(std::string&& str)
+            {
+                as_string() = std::move(str);
+                return *this;
+            }
+
+            wvalue& operator=(std::vector<wvalue>&& v)
+            {
+                auto& list = as_list();
+                list.clear();
+                list.resize(v.size());
+                size_t idx = 0;
+                for(auto& x:v)
+                {
+                    list[idx++] = std::move(x);
+                }
+                return *this;
+            }
+
+            template <typename T>
+            wvalue& operator=(const std::vector<T>& v)
+            {
+                auto& list = as_list();
+                list.clear();
+                list.resize(v.size());
+                size_t idx = 0;
+                for(auto& x:v)
+                {
+                    list[idx++] = x;
+                }
+                return *this;
+            }
+
+            wvalue& operator[](unsigned index)
+            {
+                auto& list = as_list();
+                if (list.size() < index+1)
+                    list.resize(index+1);
+                return list[index];
+            }
+
+            int count(const std::string& str)
+            {
+                if (t_ != type::Object)
+                    return 0;
+                return o->find(str) != object::npos ? 1 : 0;
+            }
+
+            wvalue& operator[](const std::string& str)
+            {
+                auto& obj = as_object();
+                size_t i = obj.find(str);
+                if (i != object::npos)
+                    return obj.members[i].second;
+                return obj.add(str, wvalue());
+            }
+
+            std::vector<std::string> keys() const 
+            {
+                if (t_ != type::Object) 
+                    return {};
+                std::vector<std::string> result;
+                result.reserve(o->members.size());
+                for (auto& kv:o->members) 
+                {
+                    result.push_back(kv.first);
+                }
+                return result;
+            }
+
+            size_t estimate_length() const
+            {
+                switch(t_)
+                {
+                    case type::Null: return 4;
+                    case type::False: return 5;
+                    case type::True: return 4;
+                    case type::Number: return 30;
+                    case type::String: return 2+s.size()+s.size()/2;
+                    case type::List: 
+                        {
+                            size_t sum{};
+                            for(auto& x:*l)
+                            {
+                                sum += 1;
+                                sum += x.estimate_length();
+                            }
+                            return sum+2;
+                        }
+                    case type::Object:
+                        {
+                            size_t sum{};
+                            for(auto& kv:o->members)
+                            {
+                                sum += 2;
+                                sum += 2+kv.first.size()+kv.first.size()/2;
+                                sum += kv.second.estimate_length();
+                            }
+                            return sum+2;
+                        }
+                }
+                return 1;
+            }
+
+        private:
+            // Takes over r's value, leaving it null; expects *this to be null
+            void take(wvalue& r)
+            {
+                t_ = r.t_;
+                nt = r.nt;
+                switch(t_)
+                {
+                    case type::String:
+                        new (&s) std::string(std::move(r.s));
+                        r.reset();
+                        return;
+                    case type::List:
+                        l = r.l;
+                        break;
+                    case type::Object:
+                        o = r.o;
+                        break;
+                    default:
+                        num = r.num;
+                        break;
+                }
+                r.t_ = type::Null;
+                r.num.ui = 0;
+            }
+
+            // Turns this into a string, keeping the one there is
+            std::string& as_string()
+            {
+                if (t_ != type::String)
+                {
+                    reset();
+                    new (&s) std::string();
+                    t_ = type::String;
+                }
+                return s;
+            }
+
+            // Turns this into a list, keeping the one there is
+            std::vector<wvalue>& as_list()
+            {
+                if (t_ != type::List)
+                {
+                    reset();
+                    l = new std::vector<wvalue>();
+                    t_ = type::List;
+                }
+                return *l;
+            }
+
+            // Turns this into an object, keeping the one there is
+            object& as_object()
+            {
+                if (t_ != type::Object)
+                {
+                    reset();
+                    o = new object();
+                    t_ = type::Object;
+                }
+                return *o;
+            }
+
+            friend void dump_internal(const wvalue& v, std::string& out);
+            friend std::string dump(const wvalue& v);
+        };
+
+        inline void dump_string(const std::string& str, std::string& out)
+        {
+            out.push_back('"');
+            escape(str, out);
+            out.push_back('"');
+        }
+        inline void dump_internal(const wvalue& v, std::string& out)
+        {
+            switch(v.t_)
+            {
+                case type::Null: out += "null"; break;
+                case type::False: out += "false"; break;
+                case type::True: out += "true"; break;
+                case type::Number: 
+                    {
+                        char outbuf[32];
+                        char* end;
+                        if (v.nt == num_type::Floating_point)
+                            end = crow::detail::format_double(v.num.d, outbuf);
+                        else if (v.nt == num_type::Signed_integer)
+                            end = crow::detail::format_integer(v.num.si, outbuf);
+                        else
+                            end = crow::detail::format_integer(v.num.ui, outbuf);
+                        out.append(outbuf, end);
+                    }
+                    break;
+                case type::String: dump_string(v.s, out); break;
+                case type::List: 
+                     {
+                         out.push_back('[');
+                         if (v.l)
+                         {
+                             bool first = true;
+                             for(auto& x:*v.l)
+                             {
+                                 if (!first)
+                                 {
+                                     out.push_back(',');
+                                 }
+                                 first = false;
+                                 dump_internal(x, out);
+                             }
+                         }
+                         out.push_back(']');
+                     }
+                     break;
+                case type::Object:
+                     {
+                         out.push_back('{');
+                         if (v.o)
+                         {
+                             bool first = true;
+                             for(auto& kv:v.o->members)
+                             {
+                                 if (!first)
+                                 {
+                                     out.push_back(',');
+                                 }
+                                 first = false;
+                                 dump_string(kv.first, out);
+                                 out.push_back(':');
+                                 dump_internal(kv.second, out);
+                             }
+                         }
+                         out.push_back('}');
+                     }
+                     break;
+            }
+        }
+
+        inline std::string dump(const wvalue& v)
+        {
+            std::string ret;
+            ret.reserve(v.estimate_length());
+            dump_internal(v, ret);
+            return ret;
+        }
+
+        // Writes a document straight into `out' as it is produced, without building a wvalue
+        // first. Commas and colons are put in by the writer; the caller pairs up the begin and
+        // end calls and gives every object member a key() before its value:
+        //
+        //     json::writer w(res.body);
+        //     w.begin_object().key("items").begin_list();
+        //     for(auto& item : items)
+        //         w.value(item.id);
+        //     w.end_list().end_object();
+        class writer
+        {
+        public:
+            explicit writer(std::string& out) : out_(out) {}
+
+            writer& begin_object() { separate(); out_.push_back('{'); first_ = true; return *this; }
+            writer& end_object() { out_.push_back('}'); first_ = false; return *this; }
+            writer& begin_list() { separate(); out_.push_back('['); first_ = true; return *this; }
+            writer& end_list() { out_.push_back(']'); first_ = false; return *this; }
+
+            writer& key(const char* data, size_t size)
+            {
+                separate();
+                out_.push_back('"');
+                escape(data, size, out_);
+                out_ += "\":";
+                after_key_ = true;
+                return *this;
+            }
+            writer& key(const char* str) { return key(str, strlen(str)); }
+            writer& key(const std::string& str) { return key(str.data(), str.size()); }
+
+            writer& value(std::nullptr_t) { separate(); out_ += "null"; return *this; }
+            writer& value(bool b) { separate(); out_ += b ? "true" : "false"; return *this; }
+
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, writer&>::type value(T v)
+            {
+                return number(crow::detail::format_integer(static_cast<int64_t>(v), buf_));
+            }
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T, bool>::value, writer&>::type value(T v)
+            {
+                return number(crow::detail::format_integer(static_cast<uint64_t>(v), buf_));
+            }
+            writer& value(double v) { return number(crow::detail::format_double(v, buf_)); }
+
+            writer& value(const char* data, size_t size)
+            {
+                separate();
+                out_.push_back('"');
+                escape(data, size, out_);
+                out_.push_back('"');
+                return *this;
+            }
+            writer& value(const char* str) { return value(str, strlen(str)); }
+            writer& value(const std::string& str) { return value(str.data(), str.size()); }
+
+            // Splices in a prebuilt value
+            writer& value(const wvalue& v) { separate(); dump_internal(v, out_); return *this; }
+
+        private:
+            void separate()
+            {
+                if (after_key_)
+                    after_key_ = false;
+                else if (!first_)
+                    out_.push_back(',');
+                first_ = false;
+            }
+
+            writer& number(char* end)
+            {
+                separate();
+                out_.append(buf_, end);
+                return *this;
+            }
+
+            std::string& out_;
+            char buf_[32];
+            bool first_{true};
+            bool after_key_{};
+        };
+
+        // Parses a document handed over in pieces of any size, as a body arrives, and reports
+        // what it reads to `handler' instead of building an rvalue. The handler takes the same
+        // calls as json::writer, so a writer can be used to re-serialize what is read:
+        //
+        //     begin_object() end_object() begin_list() end_list() key(const std::string&)
+        //     value(std::nullptr_t) value(bool) value(int64_t) value(uint64_t) value(double)
+        //     value(const std::string&)
+        //
+        // Non-negative integers come as uint64_t, negative ones as int64_t and anything else,
+        // including integers too large for 64 bits, as double. The only state kept is the
+        // nesting stack and the token being read, bounded by max_depth and max_token, so memory
+        // does not grow with the document.
+        template <typename Handler>
+        class stream_parser
+        {
+        public:
+            explicit stream_parser(Handler* handler, size_t max_depth = 1024, size_t max_token = 1 << 20)
+                : handler_(handler), max_depth_(max_depth), max_token_(max_token)
+            {
+            }
+
+            // Returns false once the input is known to be invalid; nothing is reported after that
+            bool feed(const char* data, size_t size)
+            {
+                const char* p = data;
+                const char* end = data + size;
+                while(p != end)
+                {
+                    switch(state_)
+                    {
+                        case state::error:
+                            return false;
+                        case state::done:
+                            if (!is_space(*p))
+                                return fail();
+                            p++;
+                            break;
+                        case state::value:
+                        case state::value_or_end_list:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == ']' && state_ == state::value_or_end_list)
+                            {
+                                p++;
+                                close();
+                            }
+                            else if (!start_value(*p++))
+                                return fail();
+                            break;
+                        case state::key:
+                        case state::key_or_end_object:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == '}' && state_ == state::key_or_end_object)
+                            {
+                                p++;
+                                close();
+                            }
+                            else if (*p++ == '"')
+                            {
+                                token_.clear();
+                                string_is_key_ = true;
+                                state_ = state::string;
+                            }
+                            else
+                                return fail();
+                            break;
+                        case state::colon:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p++ == ':')
+                                state_ = state::value;
+                            else
+                                return fail();
+                            break;
+                        case state::comma_or_end:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == ',')
+                            {
+                                p++;
+                                state_ = stack_.back() == '{' ? state::key : state::value;
+                            }
+                            else if (*p == (stack_.back() == '{' ? '}' : ']'))
+                            {
+                                p++;
+                                close();
+                            }
+                            else
+                                return fail();
+                            break;
+                        case state::string:
+                            {
+                                const char* run = p;
+                                while(p != end && *p != '"' && *p != '\\')
+                                    p++;
+                                if (!append(run, p - run))
+                                    return fail();
+                                if (p == end)
+                                    break;
+                                if (*p++ == '"')
+                                    end_string();
+                                else
+                                    state_ = state::string_escape;
+                            }
+                            break;
+                        case state::string_escape:
+                            {
+                                char c;
+                                switch(*p++)
+                                {
+                                    case '"': c = '"'; break;
+                                    case '\\': c = '\\'; break;
+                                    case '/': c = '/'; break;
+                                    case 'b': c = '\b'; break;
+                                    case 'f': c = '\f'; break;
+                                    case 'n': c = '\n'; break;
+                                    case 'r': c = '\r'; break;
+                                    case 't': c = '\t'; break;
+                                    case 'u':
+                                        code_ = 0;
+                                        hex_digits_ = 0;
+                                        state_ = state::string_unicode;
+                                        continue;
+                                    default:
+                                        return fail();
+                                }
+                                if (!append(&c, 1))
+                                    return fail();
+                                state_ = state::string;
+                            }
+                            break;
+                        case state::string_unicode:
+                            {
+                                char c = *p++;
+                                unsigned digit;
+                                if (c >= '0' && c <= '9')
+                                    digit = c - '0';
+                                else if (c >= 'a' && c <= 'f')
+                                    digit = c - 'a' + 10;
+                                else if (c >= 'A' && c <= 'F')
+                                    digit = c - 'A' + 10;
+                                else
+                                    return fail();
+                                code_ = code_ * 16 + digit;
+                                if (++hex_digits_ == 4)
+                                {
+                                    if (!append_code_point())
+                                        return fail();
+                                    state_ = state::string;
+                                }
+                            }
+                            break;
+                        case state::number:
+                            {
+                                const char* run = p;
+                                while(p != end && is_number_char(*p))
+                                    p++;
+                                if (!append(run, p - run))
+                                    return fail();
+                                // the number goes on into the next piece, or ends at the end of input
+                                if (p != end && !end_number())
+                                    return fail();
+                            }
+                            break;
+                        case state::literal:
+                            if (*p++ != literal_[literal_pos_])
+                                return fail();
+                            if (literal_[++literal_pos_] == 0)
+                            {
+                                if (literal_[0] == 'n')
+                                    handler_->value(nullptr);
+                                else
+                                    handler_->value(literal_[0] == 't');
+                                value_done();
+                            }
+                            break;
+                    }
+                }
+                return state_ != state::error;
+            }
+
+            // Call at the end of input; true if it held exactly one complete value
+            bool finish()
+            {
+                if (state_ == state::number && !end_number())
+                    fail();
+                return state_ == state::done;
+            }
+
+            bool done() const
+            {
+                return state_ == state::done;
+            }
+
+            bool failed() const
+            {
+                return state_ == state::error;
+            }
+
+            // Gets ready for another document
+            void reset()
+            {
+                state_ = state::value;
+                stack_.clear();
+                token_.clear();
+            }
+
+        private:
+            enum class state : char
+            {
+                value,
+                value_or_end_list,
+                key,
+                key_or_end_object,
+                colon,
+                comma_or_end,
+                string,
+                string_escape,
+                string_unicode,
+                number,
+                literal,
+                done,
+                error,
+            };
+
+            static bool is_space(char c)
+            {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            }
+
+            static bool is_number_char(char c)
+            {
+                return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+            }
+
+            bool fail()
+            {
+                state_ = state::error;
+                return false;
+            }
+
+            bool append(const char* data, size_t size)
+            {
+                if (token_.size() + size > max_token_)
+                    return false;
+                token_.append(data, size);
+                return true;
+            }
+
+            // Same encoding as the \u escapes json::load reads
+            bool append_code_point()
+            {
+                char buf[3];
+                size_t size;
+                if (code_ >= 0x800)
+                {
+                    buf[0] = 0xE0 | (code_ >> 12);
+                    buf[1] = 0x80 | ((code_ >> 6) & 0x3F);
+                    buf[2] = 0x80 | (code_ & 0x3F);
+                    size = 3;
+                }
+                else if (code_ >= 0x80)
+                {
+                    buf[0] = 0xC0 | (code_ >> 6);
+                    buf[1] = 0x80 | (code_ & 0x3F);
+                    size = 2;
+                }
+                else
+                {
+                    buf[0] = code_;
+                    size = 1;
+                }
+                return append(buf, size);
+            }
+
+            bool start_value(char c)
+            {
+                switch(c)
+                {
+                    case '{':
+                    case '[':
+                        if (stack_.size() >= max_depth_)
+                            return false;
+                        stack_.push_back(c);
+                        if (c == '{')
+                        {
+                            handler_->begin_object();
+                            state_ = state::key_or_end_object;
+                        }
+                        else
+                        {
+                            handler_->begin_list();
+                            state_ = state::value_or_end_list;
+                        }
+                        return true;
+                    case '"':
+                        token_.clear();
+                        string_is_key_ = false;
+                        state_ = state::string;
+                        return true;
+                    case 't': literal_ = "true"; break;
+                    case 'f': literal_ = "false"; break;
+                    case 'n': literal_ = "null"; break;
+                    default:
+                        if (c != '-' && !(c >= '0' && c <= '9'))
+                            return false;
+                        token_.assign(1, c);
+                        state_ = state::number;
+                        return true;
+                }
+                literal_pos_ = 1;
+                state_ = state::literal;
+                return true;
+            }
+
+            void end_string()
+            {
+                if (string_is_key_)
+                {
+                    handler_->key(token_);
+                    state_ = state::colon;
+                }
+                else
+                {
+                    handler_->value(token_);
+                    value_done();
+                }
+            }
+
+            bool end_number()
+            {
+                const char* p = token_.data();
+                const char* end = p + token_.size();
+                if (!valid_number(p, end))
+                    return false;
+                num_type nt;
+                detail::number n;
+                if (detail::parse_number(p, end, nt, n))
+                {
+                    if (nt == num_type::Floating_point)
+                        handler_->value(n.d);
+                    else if (nt == num_type::Signed_integer)
+                        handler_->value(n.si);
+                    else
+                        handler_->value(n.ui);
+                }
+                else
+                {
+                    double d;
+                    if (!boost::conversion::try_lexical_convert(token_, d))
+                        return false;
+                    handler_->value(d);
+                }
+                value_done();
+                return true;
+            }
+
+            // The number grammar; the token is known to hold only number characters
+            static bool valid_number(const char* p, const char* end)
+            {
+                auto digits = [&]
+                {
+                    const char* start = p;
+                    while(p != end && *p >= '0' && *p <= '9')
+                        p++;
+                    return p != start;
+                };
+                if (*p == '-')
+                    p++;
+                if (p != end && *p == '0')
+                    p++;
+                else if (!digits())
+                    return false;
+                if (p != end && *p == '.')
+                {
+                    p++;
+                    if (!digits())
+                        return false;
+                }
+                if (p != end && (*p == 'e' || *p == 'E'))
+                {
+                    p++;
+                    if (p != end && (*p == '+' || *p == '-'))
+                        p++;
+                    if (!digits())
+                        return false;
+                }
+                return p == end;
+            }
+
+            void close()
+            {
+                if (stack_.back() == '{')
+                    handler_->end_object();
+                else
+                    handler_->end_list();
+                stack_.pop_back();
+                value_done();
+            }
+
+            void value_done()
+            {
+                state_ = stack_.empty() ? state::done : state::comma_or_end;
+            }
+
+            Handler* handler_;
+            size_t max_depth_;
+            size_t max_token_;
+            state state_{state::value};
+            std::vector<char> stack_;
+            std::string token_;
+            bool string_is_key_{};
+            const char* literal_{};
+            size_t literal_pos_{};
+            unsigned code_{};
+            int hex_digits_{};
+        };
+
+        //std::vector<boost::asio::const_buffer> dump_ref(wvalue& v)
+        //{
+        //}
+    }
+}
+
+#undef crow_json_likely
+#undef crow_json_unlikely
+
+
+
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <functional>
+
+
+namespace crow
+{
+    namespace mustache
+    {
+        using context = json::wvalue;
+
+        template_t load(const std::string& filename);
+
+        class invalid_template_exception : public std::exception
+        {
+            public:
+            invalid_template_exception(const std::string& msg)
+                : msg("crow::mustache error: " + msg)
+            {
+            }
+            virtual const char* what() const throw()
+            {
+                return msg.c_str();
+            }
+            std::string msg;
+        };
+
+        enum class ActionType
+        {
+            Ignore,
+            Tag,
+            UnescapeTag,
+            OpenBlock,
+            CloseBlock,
+            ElseBlock,
+            Partial,
+        };
+
+        struct Action
+        {
+            int start;
+            int end;
+            int pos;
+            ActionType t;
+            Action(ActionType t, int start, int end, int pos = 0) 
+                : start(start), end(end), pos(pos), t(t)
+            {}
+        };
+
+        class template_t 
+        {
+        public:
+            template_t(std::string body)
+                : body_(std::move(body))
+            {
+                // {{ {{# {{/ {{^ {{! {{> {{=
+                parse();
+            }
+
+        private:
+            std::string tag_name(const Action& action)
+            {
+                return body_.substr(action.start, action.end - action.start);
+            }
+            auto find_context(const std::string& name, const std::vector<context*>& stack)->std::pair<bool, context&>
+            {
+                if (name == ".")
+                {
+                    return {true, *stack.back()};
+                }
+                int dotPosition = name.find(".");
+                if (dotPosition == (int)name.npos)
+                {
+                    for(auto it = stack.rbegin(); it != stack.rend(); ++it)
+                    {
+                        if ((*it)->t() == json::type::Object)
+                        {
+                            if ((*it)->count(name))
+                                return {true, (**it)[name]};
+                        }
+                    }
+                }
+                else
+                {
+                    std::vector<int> dotPositions;
+                    dotPositions.push_back(-1);
+                    while(dotPosition != (int)name.npos)
+                    {
+                        dotPositions.push_back(dotPosition);
+                        dotPosition = name.find(".", dotPosition+1);
+                    }
+                    dotPositions.push_back(name.size());
+                    std::vector<std::string> names;
+                    names.reserve(dotPositions.size()-1);
+                    for(int i = 1; i < (int)dotPositions.size(); i ++)
+                        names.emplace_back(name.substr(dotPositions[i-1]+1, dotPositions[i]-dotPositions[i-1]-1));
+
+                    for(auto it = stack.rbegin(); it != stack.rend(); ++it)
+                    {
+                        context* view = *it;
+                        bool found = true;
+                        for(auto jt = names.begin(); jt != names.end(); ++jt)
+                        {
+                            if (view->t() == json::type::Object &&
+                                view->count(*jt))
+                            {
+                                view = &(*view)[*jt];
+                            }
+                            else
+                            {
+                                found = false;
+                                break;
+                            }
+                        }
+                        if (found)
+                            return {true, *view};
+                    }
+
+                }
+
+                static json::wvalue empty_str;
+                empty_str = "";
+                return {false, empty_str};
+            }
+
+            void escape(const std::string& in, std::string& out)
+            {
+                out.reserve(out.size() + in.size());
+                for(auto it = in.begin(); it != in.end(); ++it)
+                {
+                    switch(*it)
+                    {
+                        case '&': out += "&amp;"; break;
+                        case '<': out += "&lt;"; break;
+                        case '>': out += "&gt;"; break;
+                        case '"': out += "&quot;"; break;
+                        case '\'': out += "&#39;"; break;
+                        case '/': out += "&#x2F;"; break;
+                        default: out += *it; break;
+                    }
+                }
+            }
+
+            void render_internal(int actionBegin, int actionEnd, std::vector<context*>& stack, std::string& out, int indent)
+            {
+                int current = actionBegin;
+
+                if (indent)
+                    out.insert(out.size(), indent, ' ');
+
+                while(current < actionEnd)
+                {
+                    auto& fragment = fragments_[current];
+                    auto& action = actions_[current];
+                    render_fragment(fragment, indent, out);
+                    switch(action.t)
+                    {
+                        case ActionType::Ignore:
+                            // do nothing
+                            break;
+                        case ActionType::Partial:
+                            {
+                                std::string partial_name = tag_name(action);
+                                auto partial_templ = load(partial_name);
+                                int partial_indent = action.pos;
+                                partial_templ.render_internal(0, partial_templ.fragments_.size()-1, stack, out, partial_indent?indent+partial_indent:0);
+                            }
+                            break;
+                        case ActionType::UnescapeTag:
+                        case ActionType::Tag:
+                            {
+                                auto optional_ctx = find_context(tag_name(action), stack);
+                                auto& ctx = optional_ctx.second;
+                                switch(ctx.t())
+                                {
+                                    case json::type::Number:
+                                        out += json::dump(ctx);
+                                        break;
+                                    case json::type::String:
+                                        if (action.t == ActionType::Tag)
+                                            escape(ctx.s, out);
+                                        else
+                                            out += ctx.s;
+                                        break;
+                                    default:
+                                        throw std::runtime_error("not implemented tag type" + boost::lexical_cast<std::string>((int)ctx.t()));
+                                }
+                            }
+                            break;
+                        case ActionType::ElseBlock:
+                            {
+                                static context nullContext;
+                                auto optional_ctx = find_context(tag_name(action), stack);
+                                if (!optional_ctx.first)
+                                {
+                                    stack.emplace_back(&nullContext);
+                                    break;
+                                }
+
+                                auto& ctx = optional_ctx.second;
+                                switch(ctx.t())
+                                {
+                                    case json::type::List:
+                                        if (ctx.l && !ctx.l->empty())
+                                            current = action.pos;
+                                        else
+                                            stack.emplace_back(&nullContext);
+                                        break;
+                                    case json::type::False:
+                                    case json::type::Null:
+                                        stack.emplace_back(&nullContext);
+                                        break;
+                                    default:
+                                        current = action.pos;
+                                        break;
+                                }
+                                break;
+                            }
+                        case ActionType::OpenBlock:
+                            {
+                                auto optional_ctx = find_context(tag_name(action), stack);
+                                if (!optional_ctx.first)
+                                {
+                                    current = action.pos;
+                                    break;
+                                }
+
+                                auto& ctx = optional_ctx.second;
+                                switch(ctx.t())
+                                {
+                                    case json::type::List:
+                                        if (ctx.l)
+                                            for(auto it = ctx.l->begin(); it != ctx.l->end(); ++it)
+                                            {
+                                                stack.push_back(&*it);
+                                                render_internal(current+1, action.pos, stack, out, indent);
+                                                stack.pop_back();
+                                            }
+                                        current = action.pos;
+                                        break;
+                                    case json::type::Number:
+                                    case json::type::String:
+                                    case json::type::Object:
+                                    case json::type::True:
+                                        stack.push_back(&ctx);
+                                        break;
+                                    case json::type::False:
+                                    case json::type::Null:
+                                        current = action.pos;
+                                        break;
+                                    default:
+                                        throw std::runtime_error("{{#: not implemented context type: " + boost::lexical_cast<std::string>((int)ctx.t()));
+                                        break;
+                                }
+                                break;
+                            }
+                        case ActionType::CloseBlock:
+                            stack.pop_back();
+                            break;
+                        default:
+                            throw std::runtime_error("not implemented " + boost::lexical_cast<std::string>((int)action.t));
+                    }
+                    current++;
+                }
+                auto& fragment = fragments_[actionEnd];
+                render_fragment(fragment, indent, out);
+            }
+            void render_fragment(const std::pair<int, int> fragment, int indent, std::string& out)
+            {
+                if (indent)
+                {
+                    for(int i = fragment.first; i < fragment.second; i ++)
+                    {
+                        out += body_[i];
+                        if (body_[i] == '\n' && i+1 != (int)body_.size())
+                            out.insert(out.size(), indent, ' ');
+                    }
+                }
+                else
+                    out.insert(out.size(), body_, fragment.first, fragment.second-fragment.first);
+            }
+        public:
+            std::string render()
+            {
+                context empty_ctx;
+                std::vector<context*> stack;
+                stack.emplace_back(&empty_ctx);
+
+                std::string ret;
+                render_internal(0, fragments_.size()-1, stack, ret, 0);
+                return ret;
+            }
+            std::string render(context& ctx)
+            {
+                std::vector<context*> stack;
+                stack.emplace_back(&ctx);
+
+                std::string ret;
+                render_internal(0, fragments_.size()-1, stack, ret, 0);
+                return ret;
+            }
+
+        private:
+
+            void parse()
+            {
+                std::string tag_open = "{{";
+                std::string tag_close = "}}";
+
+                std::vector<int> blockPositions;
+                
+                size_t current = 0;
+                while(1)
+                {
+                    size_t idx = body_.find(tag_open, current);
+                    if (idx == body_.npos)
+                    {
+                        fragments_.emplace_back(current, body_.size());
+                        actions_.emplace_back(ActionType::Ignore, 0, 0);
+                        break;
+                    }
+                    fragments_.emplace_back(current, idx);
+
+                    idx += tag_open.size();
+                    size_t endIdx = body_.find(tag_close, idx);
+                    if (endIdx == idx)
+                    {
+                        throw invalid_template_exception("empty tag is not allowed");
+                    }
+                    if (endIdx == body_.npos)
+                    {
+                        // error, no matching tag
+                        throw invalid_template_exception("not matched opening tag");
+                    }
+                    current = endIdx + tag_close.size();
+                    switch(body_[idx])
+                    {
+                        case '#':
+                            idx++;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            blockPositions.emplace_back(actions_.size());
+                            actions_.emplace_back(ActionType::OpenBlock, idx, endIdx);
+                            break;
+                        case '/':
+                            idx++;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            {
+                                auto& matched = actions_[blockPositions.back()];
+                                if (body_.compare(idx, endIdx-idx, 
+                                        body_, matched.start, matched.end - matched.start) != 0)
+                                {
+                                    throw invalid_template_exception("not matched {{# {{/ pair: " + 
+                                        body_.substr(matched.start, matched.end - matched.start) + ", " + 
+                                        body_.substr(idx, endIdx-idx));
+                                }
+                                matched.pos = actions_.size();
+                            }
+                            actions_.emplace_back(ActionType::CloseBlock, idx, endIdx, blockPositions.back());
+                            blockPositions.pop_back();
+                            break;
+                        case '^':
+                            idx++;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            blockPositions.emplace_back(actions_.size());
+                            actions_.emplace_back(ActionType::ElseBlock, idx, endIdx);
+                            break;
+                        case '!':
+                            // do nothing action
+                            actions_.emplace_back(ActionType::Ignore, idx+1, endIdx);
+                            break;
+                        case '>': // partial
+                            idx++;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            actions_.emplace_back(ActionType::Partial, idx, endIdx);
+                            break;
+                        case '{':
+                            if (tag_open != "{{" || tag_close != "}}")
+                                throw invalid_template_exception("cannot use triple mustache when delimiter changed");
+
+                            idx ++;
+                            if (body_[endIdx+2] != '}')
+                            {
+                                throw invalid_template_exception("{{{: }}} not matched");
+                            }
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            actions_.emplace_back(ActionType::UnescapeTag, idx, endIdx);
+                            current++;
+                            break;
+                        case '&':
+                            idx ++;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            actions_.emplace_back(ActionType::UnescapeTag, idx, endIdx);
+                            break;
+                        case '=':
+                            // tag itself is no-op
+                            idx ++;
+                            actions_.emplace_back(ActionType::Ignore, idx, endIdx);
+                            endIdx --;
+                            if (body_[endIdx] != '=')
+                                throw invalid_template_exception("{{=: not matching = tag: "+body_.substr(idx, endIdx-idx));
+                            endIdx --;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx] == ' ') endIdx--;
+                            endIdx++;
+                            {
+                                bool succeeded = false;
+                                for(size_t i = idx; i < endIdx; i++)
+                                {
+                                    if (body_[i] == ' ')
+                                    {
+                                        tag_open = body_.substr(idx, i-idx);
+                                        while(body_[i] == ' ') i++;
+                                        tag_close = body_.substr(i, endIdx-i);
+                                        if (tag_open.empty())
+                                            throw invalid_template_exception("{{=: empty open tag");
+                                        if (tag_close.empty())
+                                            throw invalid_template_exception("{{=: empty close tag");
+
+                                        if (tag_close.find(" ") != tag_close.npos)
+                                            throw invalid_template_exception("{{=: invalid open/close tag: "+tag_open+" " + tag_close);
+                                        succeeded = true;
+                                        break;
+                                    }
+                                }
+                                if (!succeeded)
+                                    throw invalid_template_exception("{{=: cannot find space between new open/close tags");
+                            }
+                            break;
+                        default:
+                            // normal tag case;
+                            while(body_[idx] == ' ') idx++;
+                            while(body_[endIdx-1] == ' ') endIdx--;
+                            actions_.emplace_back(ActionType::Tag, idx, endIdx);
+                            break;
+                    }
+                }
+
+                // removing standalones
+                for(int i = actions_.size()-2; i >= 0; i --)
+                {
+                    if (actions_[i].t == ActionType::Tag || actions_[i].t == ActionType::UnescapeTag)
+                        continue;
+                    auto& fragment_before = fragments_[i];
+                    auto& fragment_after = fragments_[i+1];
+                    bool is_last_action = i == (int)actions_.size()-2;
+                    bool all_space_before = true;
+                    int j, k;
+                    for(j = fragment_before.second-1;j >= fragment_before.first;j--)
+                    {
+                        if (body_[j] != ' ')
+                        {
+                            all_space_before = false;
+                            break;
+                        }
+                    }
+                    if (all_space_before && i > 0)
+                        continue;
+                    if (!all_space_before && body_[j] != '\n')
+                        continue;
+                    bool all_space_after = true;
+                    for(k = fragment_after.first; k < (int)body_.size() && k < fragment_after.second; k ++)
+                    {
+                        if (body_[k] != ' ')
+                        {
+                            all_space_after = false;
+                            break;
+                        }
+                    }
+                    if (all_space_after && !is_last_action)
+                        continue;
+                    if (!all_space_after && 
+                            !(
+                                body_[k] == '\n' 
+                            || 
+                                (body_[k] == '\r' && 
+                                k + 1 < (int)body_.size() && 
+                                body_[k+1] == '\n')))
+                        continue;
+                    if (actions_[i].t == ActionType::Partial)
+                    {
+                        actions_[i].pos = fragment_before.second - j - 1;
+                    }
+                    fragment_before.second = j+1;
+                    if (!all_space_after)
+                    {
+                        if (body_[k] == '\n')
+                            k++;
+                        else 
+                            k += 2;
+                        fragment_after.first = k;
+                    }
+                }
+            }
+            
+            std::vector<std::pair<int,int>> fragments_;
+            std::vector<Action> actions_;
+            std::string body_;
+        };
+
+        inline template_t compile(const std::string& body)
+        {
+            return template_t(body);
+        }
+        namespace detail
+        {
+            inline std::string& get_template_base_directory_ref()
+            {
+                static std::string template_base_directory = "templates";
+                return template_base_directory;
+            }
+        }
+
+        inline std::string default_loader(const std::string& filename)
+        {
+            std::string path = detail::get_template_base_directory_ref();
+            if (!(path.back() == '/' || path.back() == '\\'))
+                path += '/';
+            path += filename;
+            std::ifstream inf(path);
+            if (!inf)
+                return {};
+            return {std::istreambuf_iterator<char>(inf), std::istreambuf_iterator<char>()};
+        }
+
+        namespace detail
+        {
+            inline std::function<std::string (std::string)>& get_loader_ref()
+            {
+                static std::function<std::string (std::string)> loader = default_loader;
+                return loader;
+            }
+        }
+
+        inline void set_base(const std::string& path)
+        {
+            auto& base = detail::get_template_base_directory_ref();
+            base = path;
+            if (base.back() != '\\' && 
+                base.back() != '/')
+            {
+                base += '/';
+            }
+        }
+
+        inline void set_loader(std::function<std::string(std::string)> loader)
+        {
+            detail::get_loader_ref() = std::move(loader);
+        }
+
+        inline std::string load_text(const std::string& filename)
+        {
+            return detail::get_loader_ref()(filename);
+        }
+
+        inline template_t load(const std::string& filename)
+        {
+            return compile(detail::get_loader_ref()(filename));
+        }
+    }
+}
+
+
+
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+
+
+
+
+
+
+namespace crow
+{
+    template <typename Adaptor, typename Handler, typename ... Middlewares>
+    class Connection;
+    struct response
+    {
+        template <typename Adaptor, typename Handler, typename ... Middlewares>
+        friend class crow::Connection;
+
+        int code{200};
+        std::string body;
+        std::vector<char> bytes;
+        json::wvalue json_value;
+
+        // `headers' stores HTTP headers.
+        ci_map headers;
+
+        void set_header(std::string key, std::string value)
+        {
+            headers.erase(key);
+            headers.emplace(std::move(key), std::move(value));
+        }
+        void add_header(std::string key, std::string value)
+        {
+            headers.emplace(std::move(key), std::move(value));
+        }
+
+        const std::string& get_header_value(const std::string& key)
+        {
+            return crow::get_header_value(headers, key);
+        }
+
+        const std::string& get_header_value(known_header key)
+        {
+            return crow::get_header_value(headers, key);
+        }
+
+
+        response() {}
+        explicit response(int code) : code(code) {}
+        response(int code, std::vector<char> &data) : code(code), bytes(std::move(data)) {}
+        response(std::vector<char> &data) : bytes(std::move(data)) {}
+        response(std::string body) : body(std::move(body)) {}
+        response(json::wvalue&& json_value) : json_value(std::move(json_value))
+        {
+            json_mode();
+        }
+        response(int code, std::string body) : code(code), body(std::move(body)) {}
+        response(const json::wvalue& json_value) : body(json::dump(json_value))
+        {
+            json_mode();
+        }
+        response(int code, const json::wvalue& json_value) : code(code), body(json::dump(json_value))
+        {
+            json_mode();
+        }
+
+        response(response&& r)
+        {
+            *this = std::move(r);
+        }
+
+        response& operator = (const response& r) = delete;
+
+        response& operator = (response&& r) noexcept
+        {
+            body = std::move(r.body);
+            bytes = std::move(r.bytes);
+            json_value = std::move(r.json_value);
+            code = r.code;
+            headers = std::move(r.headers);
+            completed_ = r.completed_;
+            return *this;
+        }
+
+        bool is_completed() const noexcept
+        {
+            return completed_;
+        }
+
+        void clear()
+        {
+            body.clear();
+            json_value.clear();
+            bytes.clear();
+            code = 200;
+            headers.clear();
+            completed_ = false;
+        }
+
+        void redirect(const std::string& location)
+        {
+            code = 301;
+            set_header("Location", location);
+        }
+
+        void write(const std::vector<char>& byte_part)
+        {
+            bytes.insert(std::end(bytes), std::begin(byte_part), std::end(byte_part));
+        }
+
+        void write(const std::string& body_part)
+        {
+            body += body_part;
+        }
+
+        void end()
+        {
+            if (!completed_)
+            {
+                completed_ = true;
+
+                if (complete_request_handler_)
+                {
+                    complete_request_handler_();
+                }
+            }
+        }
+
+        void end(const std::string& body_part)
+        {
+            body += body_part;
+            end();
+        }
+
+        // Starts a JSON body that is written in place, with no wvalue tree in between. The
+        // writer appends to `body', so it must not outlive the response.
+        json::writer write_json()
+        {
+            json_mode();
+            return json::writer(body);
+        }
+
+        bool is_alive()
+        {
+            return is_alive_helper_ && is_alive_helper_();
+        }
+
+        // `handler' is called on the connection's io_service if the client disconnects
+        // before end() is called; use it to abandon expensive work. The connection is
+        // already closed at that point, but end() must still be called.
+        void on_disconnect(std::function<void()> handler)
+        {
+            disconnect_handler_ = std::move(handler);
+        }
+
+        // Hands the response over to another thread. After this, the handler must not touch
+        // the response on the io_service thread; the returned helper completes it instead.
+        DetachHelper detach();
+
+        private:
+            boost::asio::io_service* io_service_{};
+            bool completed_{};
+            std::function<void()> complete_request_handler_;
+            std::function<bool()> is_alive_helper_;
+            std::function<void()> disconnect_handler_;
+
+            //In case of a JSON object, set the Content-Type header
+            void json_mode()
+            {
+                set_header("Content-Type", "application/json");
+            }
+    };
+
+    // Completes a detached response from any thread. Completion is posted to the io_service
+    // owning the connection, so the connection itself is only ever touched by that thread.
+    struct DetachHelper
+    {
+        DetachHelper(response& res, boost::asio::io_service* io_service)
+            : res_(&res), io_service_(io_service)
+        {
+        }
+
+        // Fill this in before calling end(); must not be touched afterwards.
+        response& res()
+        {
+            return *res_;
+        }
+
+        void end()
+        {
+            response* res = res_;
+            if (!io_service_)
+            {
+                res->end();
+                return;
+            }
+            io_service_->post([res]{ res->end(); });
+        }
+
+        // Replaces the response with `r' and completes it.
+        void end(response&& r)
+        {
+            response* res = res_;
+            if (!io_service_)
+            {
+                *res = std::move(r);
+                res->end();
+                return;
+            }
+            // handlers passed to post must be copyable, so the response travels on the heap
+            response* moved = new response(std::move(r));
+            io_service_->post([res, moved]{
+                *res = std::move(*moved);
+                delete moved;
+                res->end();
+            });
+        }
+
+    private:
+        response* res_;
+        boost::asio::io_service* io_service_;
+    };
+
+    inline DetachHelper response::detach()
+    {
+        return DetachHelper(*this, io_service_);
+    }
+}
+
+
+
+#pragma once
+
+
+
+
+#ifdef CROW_CAN_USE_COROUTINES
+#include <coroutine>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+
+
+
+
+
+namespace crow
+{
+    // Lazily started coroutine producing a T.
+    //
+    // A route handler may return task<response> instead of a response:
+    //
+    //      CROW_ROUTE(app, "/slow")([](const crow::request& req) -> crow::task<crow::response> {
+    //          co_await crow::sleep_for(*req.io_service, std::chrono::seconds(1));
+    //          co_return crow::response("done");
+    //      });
+    //
+    // The router starts it on the connection's io_service and completes the response when it
+    // finishes. Other tasks can be awaited with co_await; the awaitables below all resume on the
+    // io_service they were given, so a handler stays on its connection's thread throughout.
+    template <typename T = void>
+    class task;
+
+    inline void start_response_task(task<response>&& t, response& res);
+
+    namespace detail
+    {
+        template <typename Promise>
+        struct task_final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                auto& promise = h.promise();
+                if (promise.continuation_)
+                    return promise.continuation_;
+                if (promise.on_done_)
+                    promise.on_done_(h, promise.on_done_context_);
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        template <typename T, typename Derived>
+        struct task_promise_base
+        {
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            task_final_awaiter<Derived> final_suspend() noexcept { return {}; }
+
+            void unhandled_exception()
+            {
+                exception_ = std::current_exception();
+            }
+
+            std::coroutine_handle<> continuation_;
+            // called instead of resuming a continuation; responsible for destroying the frame
+            void (*on_done_)(std::coroutine_handle<Derived>, void*){};
+            void* on_done_context_{};
+            std::exception_ptr exception_;
+        };
+
+        template <typename T>
+        struct task_promise : task_promise_base<T, task_promise<T>>
+        {
+            task<T> get_return_object() noexcept;
+
+            template <typename U>
+            void return_value(U&& value)
+            {
+                value_.emplace(std::forward<U>(value));
+            }
+
+            T result()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+                return std::move(*value_);
+            }
+
+            std::optional<T> value_;
+        };
+
+        template <>
+        struct task_promise<void> : task_promise_base<void, task_promise<void>>
+        {
+            task<void> get_return_object() noexcept;
+
+            void return_void() noexcept {}
+
+            void result()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+            }
+        };
+    }
+
+    template <typename T>
+    class task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        explicit task(handle_type handle) noexcept
+            : handle_(handle)
+        {
+        }
+
+        task(task&& other) noexcept
+            : handle_(std::exchange(other.handle_, nullptr))
+        {
+        }
+
+        task& operator = (task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator = (const task&) = delete;
+
+        ~task()
+        {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                handle_type handle_;
+
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle_.promise().continuation_ = awaiting;
+                    return handle_;
+                }
+
+                T await_resume()
+                {
+                    return handle_.promise().result();
+                }
+            };
+            return awaiter{handle_};
+        }
+
+        auto operator co_await() & noexcept
+        {
+            return std::move(*this).operator co_await();
+        }
+
+    private:
+        friend void start_response_task(task<response>&& t, response& res);
+
+        handle_type handle_;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return task<T>{std::coroutine_handle<task_promise<T>>::from_promise(*this)};
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return task<void>{std::coroutine_handle<task_promise<void>>::from_promise(*this)};
+        }
+    }
+
+    // Runs a handler's task to completion and ends `res' with its result; an exception ends
+    // it with a 500, as it would for an ordinary handler.
+    inline void start_response_task(task<response>&& t, response& res)
+    {
+        auto handle = std::exchange(t.handle_, nullptr);
+        handle.promise().on_done_context_ = &res;
+        handle.promise().on_done_ = [](std::coroutine_handle<detail::task_promise<response>> h, void* context)
+        {
+            response& res = *static_cast<response*>(context);
+            try
+            {
+                res = h.promise().result();
+            }
+            catch(std::exception& e)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
+                res = response(500);
+            }
+            catch(...)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
+                res = response(500);
+            }
+            h.destroy();
+            res.end();
+        };
+        handle.resume();
+    }
+
+    namespace detail
+    {
+        // Awaits an asio-style asynchronous operation: `initiate' is given the completion
+        // handler, which resumes the coroutine on whatever io_service runs the operation.
+        template <typename Result, typename Initiate>
+        struct asio_awaiter
+        {
+            Initiate initiate_;
+            Result result_{};
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                initiate_(result_, h);
+            }
+
+            Result await_resume() noexcept
+            {
+                return std::move(result_);
+            }
+        };
+
+        template <typename Result, typename Initiate>
+        asio_awaiter<Result, Initiate> make_asio_awaiter(Initiate initiate)
+        {
+            return {std::move(initiate)};
+        }
+    }
+
+    struct io_result
+    {
+        boost::system::error_code ec;
+        std::size_t bytes_transferred{};
+    };
+
+    // Timer: resumes on `io_service' after `duration'.
+    template <typename Rep, typename Period>
+    auto sleep_for(boost::asio::io_service& io_service, std::chrono::duration<Rep, Period> duration)
+    {
+        struct awaiter
+        {
+            boost::asio::steady_timer timer_;
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                timer_.async_wait([h](const boost::system::error_code&) { h.resume(); });
+            }
+
+            void await_resume() noexcept {}
+        };
+        awaiter ret{boost::asio::steady_timer(io_service)};
+        ret.timer_.expires_after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+        return ret;
+    }
+
+    // Socket I/O on any asio stream; resumes on the stream's io_service.
+    template <typename AsyncStream, typename MutableBufferSequence>
+    auto async_read_some(AsyncStream& stream, const MutableBufferSequence& buffers)
+    {
+        return detail::make_asio_awaiter<io_result>([&stream, buffers](io_result& result, std::coroutine_handle<> h) {
+            stream.async_read_some(buffers, [&result, h](const boost::system::error_code& ec, std::size_t n) {
+                result = {ec, n};
+                h.resume();
+            });
+        });
+    }
+
+    template <typename AsyncStream, typename ConstBufferSequence>
+    auto async_write(AsyncStream& stream, const ConstBufferSequence& buffers)
+    {
+        return detail::make_asio_awaiter<io_result>([&stream, buffers](io_result& result, std::coroutine_handle<> h) {
+            boost::asio::async_write(stream, buffers, [&result, h](const boost::system::error_code& ec, std::size_t n) {
+                result = {ec, n};
+                h.resume();
+            });
+        });
+    }
+
+    template <typename Socket>
+    auto async_connect(Socket& socket, const typename Socket::endpoint_type& endpoint)
+    {
+        return detail::make_asio_awaiter<boost::system::error_code>([&socket, endpoint](boost::system::error_code& result, std::coroutine_handle<> h) {
+            socket.async_connect(endpoint, [&result, h](const boost::system::error_code& ec) {
+                result = ec;
+                h.resume();
+            });
+        });
+    }
+
+    // Executor pool: runs `f' on `pool' (an io_service run by worker threads) and resumes with
+    // its result on `home', normally the connection's *req.io_service.
+    template <typename F>
+    auto offload(boost::asio::io_service& pool, boost::asio::io_service& home, F f)
+    {
+        using result_t = decltype(f());
+        using stored_t = typename std::conditional<std::is_void<result_t>::value, bool, result_t>::type;
+
+        struct awaiter
+        {
+            boost::asio::io_service& pool_;
+            boost::asio::io_service& home_;
+            F f_;
+            std::optional<stored_t> result_;
+            std::exception_ptr exception_;
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                pool_.post([this, h] {
+                    try
+                    {
+                        if constexpr (std::is_void<result_t>::value)
+                        {
+                            f_();
+                            result_.emplace(true);
+                        }
+                        else
+                            result_.emplace(f_());
+                    }
+                    catch(...)
+                    {
+                        exception_ = std::current_exception();
+                    }
+                    home_.post([h] { h.resume(); });
+                });
+            }
+
+            result_t await_resume()
+            {
+                if (exception_)
+                    std::rethrow_exception(exception_);
+                if constexpr (!std::is_void<result_t>::value)
+                    return std::move(*result_);
+            }
+        };
+        return awaiter{pool, home, std::move(f), {}, {}};
+    }
+}
+#endif
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <tuple>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <boost/lexical_cast.hpp>
+#include <vector>
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+namespace crow
+{
+    class BaseRule
+    {
+    public:
+        BaseRule(std::string rule)
+            : rule_(std::move(rule))
+        {
+        }
+
+        virtual ~BaseRule()
+        {
+        }
+        
+        virtual void validate() = 0;
+        std::unique_ptr<BaseRule> upgrade()
+        {
+            if (rule_to_upgrade_)
+                return std::move(rule_to_upgrade_);
+            return {};
+        }
+
+        virtual void handle(const request&, response&, const routing_params&) = 0;
+        virtual void handle_upgrade(const request&, response& res, SocketAdaptor&&) 
+        {
+            res = response(404);
+            res.end();
+        }
+#ifdef CROW_ENABLE_SSL
+        virtual void handle_upgrade(const request&, response& res, SSLAdaptor&&) 
+        {
+            res = response(404);
+            res.end();
+        }
+#endif
+
+        uint32_t get_methods()
+        {
+            return methods_;
+        }
+
+        template <typename F>
+        void foreach_method(F f)
+        {
+            for(uint32_t method = 0, method_bit = 1; method < (uint32_t)HTTPMethod::InternalMethodCount; method++, method_bit<<=1)
+            {
+                if (methods_ & method_bit)
+                    f(method);
+            }
+        }
+
+        const std::string& rule() { return rule_; }
+
+    protected:
+        uint32_t methods_{1<<(int)HTTPMethod::Get};
+
+        std::string rule_;
+        std::string name_;
+
+        std::unique_ptr<BaseRule> rule_to_upgrade_;
+
+        friend class Router;
+        template <typename T>
+        friend struct RuleParameterTraits;
+    };
+
+
+    namespace detail
+    {
+        // Ends `res' with whatever a handler returned.
+        template <typename T>
+        void complete_response(response& res, T&& result)
+        {
+            res = response(std::forward<T>(result));
+            res.end();
+        }
+
+#ifdef CROW_CAN_USE_COROUTINES
+        // coroutine handlers end `res' when they finish
+        inline void complete_response(response& res, task<response>&& result)
+        {
+            start_response_task(std::move(result), res);
+        }
+#endif
+
+        namespace routing_handler_call_helper
+        {
+            template <typename T, int Pos>
+            struct call_pair
+            {
+                using type = T;
+                static const int pos = Pos;
+            };
+
+            template <typename H1>
+            struct call_params
+            {
+                H1& handler;
+                const routing_params& params;
+                const request& req;
+                response& res;
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename S1, typename S2> 
+            struct call
+            {
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename ... Args1, typename ... Args2> 
+            struct call<F, NInt, NUint, NDouble, NString, black_magic::S<int64_t, Args1...>, black_magic::S<Args2...>>
+            {
+                void operator()(F cparams)
+                {
+                    using pushed = typename black_magic::S<Args2...>::template push_back<call_pair<int64_t, NInt>>;
+                    call<F, NInt+1, NUint, NDouble, NString,
+                        black_magic::S<Args1...>, pushed>()(cparams);
+                }
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename ... Args1, typename ... Args2> 
+            struct call<F, NInt, NUint, NDouble, NString, black_magic::S<uint64_t, Args1...>, black_magic::S<Args2...>>
+            {
+                void operator()(F cparams)
+                {
+                    using pushed = typename black_magic::S<Args2...>::template push_back<call_pair<uint64_t, NUint>>;
+                    call<F, NInt, NUint+1, NDouble, NString,
+                        black_magic::S<Args1...>, pushed>()(cparams);
+                }
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename ... Args1, typename ... Args2> 
+            struct call<F, NInt, NUint, NDouble, NString, black_magic::S<double, Args1...>, black_magic::S<Args2...>>
+            {
+                void operator()(F cparams)
+                {
+                    using pushed = typename black_magic::S<Args2...>::template push_back<call_pair<double, NDouble>>;
+                    call<F, NInt, NUint, NDouble+1, NString,
+                        black_magic::S<Args1...>, pushed>()(cparams);
+                }
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename ... Args1, typename ... Args2> 
+            struct call<F, NInt, NUint, NDouble, NString, black_magic::S<std::string, Args1...>, black_magic::S<Args2...>>
+            {
+                void operator()(F cparams)
+                {
+                    using pushed = typename black_magic::S<Args2...>::template push_back<call_pair<std::string, NString>>;
+                    call<F, NInt, NUint, NDouble, NString+1,
+                        black_magic::S<Args1...>, pushed>()(cparams);
+                }
+            };
+
+            template <typename F, int NInt, int NUint, int NDouble, int NString, typename ... Args1> 
+            struct call<F, NInt, NUint, NDouble, NString, black_magic::S<>, black_magic::S<Args1...>>
+            {
+                void operator()(F cparams)
+                {
+                    cparams.handler(
+                        cparams.req,
+                        cparams.res,
+                        cparams.params.template get<typename Args1::type>(Args1::pos)... 
+                    );
+                }
+            };
+
+            template <typename Func, typename ... ArgsWrapped>
+            struct Wrapped
+            {
+                template <typename ... Args>
+                void set_(Func f, typename std::enable_if<
+                    !std::is_same<typename std::tuple_element<0, std::tuple<Args..., void>>::type, const request&>::value
+                , int>::type = 0)
+                {
+                    handler_ = (
+#ifdef CROW_CAN_USE_CPP14
+                        [f = std::move(f)]
+#else
+                        [f]
+#endif
+                        (const request&, response& res, Args... args){
+                            detail::complete_response(res, f(args...));
+                        });
+                }
+
+                template <typename Req, typename ... Args>
+                struct req_handler_wrapper
+                {
+                    req_handler_wrapper(Func f)
+                        : f(std::move(f))
+                    {
+                    }
+
+                    void operator()(const request& req, response& res, Args... args)
+                    {
+                        detail::complete_response(res, f(req, args...));
+                    }
+
+                    Func f;
+                };
+
+                template <typename ... Args>
+                void set_(Func f, typename std::enable_if<
+                        std::is_same<typename std::tuple_element<0, std::tuple<Args..., void>>::type, const request&>::value &&
+                        !std::is_same<typename std::tuple_element<1, std::tuple<Args..., void, void>>::type, response&>::value
+                        , int>::type = 0)
+                {
+                    handler_ = req_handler_wrapper<Args...>(std::move(f));
+                    /*handler_ = (
+                        [f = std::move(f)]
+                        (const request& req, response& res, Args... args){
+                             res = response(f(req, args...));
+                             res.end();
+                        });*/
+                }
+
+                template <typename ... Args>
+                void set_(Func f, typename std::enable_if<
+                        std::is_same<typename std::tuple_element<0, std::tuple<Args..., void>>::type, const request&>::value &&
+                        std::is_same<typename std::tuple_element<1, std::tuple<Args..., void, void>>::type, response&>::value
+                        , int>::type = 0)
+                {
+                    handler_ = std::move(f);
+                }
+
+                template <typename ... Args>
+                struct handler_type_helper
+                {
+                    using type = std::function<void(const crow::request&, crow::response&, Args...)>;
+                    using args_type = black_magic::S<typename black_magic::promote_t<Args>...>; 
+                };
+
+                template <typename ... Args>
+                struct handler_type_helper<const request&, Args...>
+                {
+                    using type = std::function<void(const crow::request&, crow::response&, Args...)>;
+                    using args_type = black_magic::S<typename black_magic::promote_t<Args>...>; 
+                };
+
+                template <typename ... Args>
+                struct handler_type_helper<const request&, response&, Args...>
+                {
+                    using type = std::function<void(const crow::request&, crow::response&, Args...)>;
+                    using args_type = black_magic::S<typename black_magic::promote_t<Args>...>; 
+                };
+
+                typename handler_type_helper<ArgsWrapped...>::type handler_;
+
+                void operator()(const request& req, response& res, const routing_params& params)
+                {
+                    detail::routing_handler_call_helper::call<
+                        detail::routing_handler_call_helper::call_params<
+                            decltype(handler_)>,
+                        0, 0, 0, 0, 
+                        typename handler_type_helper<ArgsWrapped...>::args_type,
+                        black_magic::S<>
+                    >()(
+                        detail::routing_handler_call_helper::call_params<
+                            decltype(handler_)>
+                        {handler_, params, req, res}
+                   );
+                }
+            };
+
+        }
+    }
+
+    class WebSocketRule : public BaseRule
+    {
+        using self_t = WebSocketRule;
+    public:
+        WebSocketRule(std::string rule)
+            : BaseRule(std::move(rule))
+        {
+        }
+
+        void validate() override
+        {
+        }
+
+        void handle(const request&, response& res, const routing_params&) override
+        {
+            res = response(404);
+            res.end();
+        }
+
+        void handle_upgrade(const request& req, response&, SocketAdaptor&& adaptor) override 
+        {
+            new crow::websocket::Connection<SocketAdaptor>(req, std::move(adaptor), open_handler_, message_handler_, close_handler_, error_handler_, accept_handler_);
+        }
+#ifdef CROW_ENABLE_SSL
+        void handle_upgrade(const request& req, response&, SSLAdaptor&& adaptor) override
+        {
+            new crow::websocket::Connection<SSLAdaptor>(req, std::move(adaptor), open_handler_, message_handler_, close_handler_, error_handler_, accept_handler_);
+        }
+#endif
+
+        template <typename Func>
+        self_t& onopen(Func f)
+        {
+            open_handler_ = f;
+            return *this;
+        }
+
+        template <typename Func>
+        self_t& onmessage(Func f)
+        {
+            message_handler_ = f;
+            return *this;
+        }
+
+        template <typename Func>
+        self_t& onclose(Func f)
+        {
+            close_handler_ = f;
+            return *this;
+        }
+
+        template <typename Func>
+        self_t& onerror(Func f)
+        {
+            error_handler_ = f;
+            return *this;
+        }
+
+        template <typename Func>
+        self_t& onaccept(Func f)
+        {
+            accept_handler_ = f;
+            return *this;
+        }
+
+    protected:
+        std::function<void(crow::websocket::connection&)> open_handler_;
+        std::function<void(crow::websocket::connection&, const std::string&, bool)> message_handler_;
+        std::function<void(crow::websocket::connection&, const std::string&)> close_handler_;
+        std::function<void(crow::websocket::connection&)> error_handler_;
+        std::function<bool(const crow::request&)> accept_handler_;
+    };
+
+    template <typename T>
+    struct RuleParameterTraits
+    {
+        using self_t = T;
+        WebSocketRule& websocket() 
+        {
+            auto p =new WebSocketRule(((self_t*)this)->rule_);
+            ((self_t*)this)->rule_to_upgrade_.reset(p);
+            return *p;
+        }
+
+        self_t& name(std::string name) noexcept
+        {
+            ((self_t*)this)->name_ = std::move(name);
+            return (self_t&)*this;
+        }
+
+        self_t& methods(HTTPMethod method)
+        {
+            ((self_t*)this)->methods_ = 1 << (int)method;
+            return (self_t&)*this;
+        }
+
+        template <typename ... MethodArgs>
+        self_t& methods(HTTPMethod method, MethodArgs ... args_method)
+        {
+            methods(args_method...);
+            ((self_t*)this)->methods_ |= 1 << (int)method;
+            return (self_t&)*this;
+        }
+
+    };
+
+    class DynamicRule : public BaseRule, public RuleParameterTraits<DynamicRule>
+    {
+    public:
+
+        DynamicRule(std::string rule)
+            : BaseRule(std::move(rule))
+        {
+        }
+
+        void validate() override
+        {
+            if (!erased_handler_)
+            {
+                throw std::runtime_error(name_ + (!name_.empty() ? ": " : "") + "no handler for url " + rule_);
+            }
+        }
+
+        void handle(const request& req, response& res, const routing_params& params) override
+        {
+            erased_handler_(req, res, params);
+        }
+
+        template <typename Func>
+        void operator()(Func f)
+        {
+#ifdef CROW_MSVC_WORKAROUND
+            using function_t = utility::function_traits<decltype(&Func::operator())>;
+#else
+            using function_t = utility::function_traits<Func>;
+#endif
+            erased_handler_ = wrap(std::move(f), black_magic::gen_seq<function_t::arity>());
+        }
+
+        // enable_if Arg1 == request && Arg2 == response
+        // enable_if Arg1 == request && Arg2 != resposne
+        // enable_if Arg1 != request
+#ifdef CROW_MSVC_WORKAROUND
+        template <typename Func, size_t ... Indices>
+#else
+        template <typename Func, unsigned ... Indices>
+#endif
+        std::function<void(const request&, response&, const routing_params&)> 
+        wrap(Func f, black_magic::seq<Indices...>)
+        {
+#ifdef CROW_MSVC_WORKAROUND
+            using function_t = utility::function_traits<decltype(&Func::operator())>;
+#else
+            using function_t = utility::function_traits<Func>;
+#endif
+            if (!black_magic::is_parameter_tag_compatible(
+                black_magic::get_parameter_tag_runtime(rule_.c_str()), 
+                black_magic::compute_parameter_tag_from_args_list<
+                    typename function_t::template arg<Indices>...>::value))
+            {
+                throw std::runtime_error("route_dynamic: Handler type is mismatched with URL parameters: " + rule_);
+            }
+            auto ret = detail::routing_handler_call_helper::Wrapped<Func, typename function_t::template arg<Indices>...>();
+            ret.template set_<
+                typename function_t::template arg<Indices>...
+            >(std::move(f));
+            return ret;
+        }
+
+        template <typename Func>
+        void operator()(std::string name, Func&& f)
+        {
+            name_ = std::move(name);
+            (*this).template operator()<Func>(std::forward(f));
+        }
+    private:
+        std::function<void(const request&, response&, const routing_params&)> erased_handler_;
+
+    };
+
+    template <typename ... Args>
+    class TaggedRule : public BaseRule, public RuleParameterTraits<TaggedRule<Args...>>
+    {
+    public:
+        using self_t = TaggedRule<Args...>;
+
+        TaggedRule(std::string rule)
+            : BaseRule(std::move(rule))
+        {
+        }
+
+        void validate() override
+        {
+            if (!handler_)
+            {
+                throw std::runtime_error(name_ + (!name_.empty() ? ": " : "") + "no handler for url " + rule_);
+            }
+        }
+
+        template <typename Func>
+        typename std::enable_if<black_magic::CallHelper<Func, black_magic::S<Args...>>::value, void>::type
+        operator()(Func&& f)
+        {
+            static_assert(black_magic::CallHelper<Func, black_magic::S<Args...>>::value ||
+                black_magic::CallHelper<Func, black_magic::S<crow::request, Args...>>::value , 
+                "Handler type is mismatched with URL parameters");
+            static_assert(!std::is_same<void, decltype(f(std::declval<Args>()...))>::value, 
+                "Handler function cannot have void return type; valid return types: string, int, crow::resposne, crow::json::wvalue");
+
+            handler_ = (
+#ifdef CROW_CAN_USE_CPP14
+                [f = std::move(f)]
+#else
+                [f]
+#endif
+                (const request&, response& res, Args ... args){
+                    detail::complete_response(res, f(args...));
+                });
+        }
+
+        template <typename Func>
+        typename std::enable_if<
+            !black_magic::CallHelper<Func, black_magic::S<Args...>>::value &&
+            black_magic::CallHelper<Func, black_magic::S<crow::request, Args...>>::value, 
+            void>::type
+        operator()(Func&& f)
+        {
+            static_assert(black_magic::CallHelper<Func, black_magic::S<Args...>>::value ||
+                black_magic::CallHelper<Func, black_magic::S<crow::request, Args...>>::value, 
+                "Handler type is mismatched with URL parameters");
+            static_assert(!std::is_same<void, decltype(f(std::declval<crow::request>(), std::declval<Args>()...))>::value, 
+                "Handler function cannot have void return type; valid return types: string, int, crow::resposne, crow::json::wvalue");
+
+            handler_ = (
+#ifdef CROW_CAN_USE_CPP14
+                [f = std::move(f)]
+#else
+                [f]
+#endif
+                (const crow::request& req, crow::response& res, Args ... args){
+                    detail::complete_response(res, f(req, args...));
+                });
+        }
+
+        template <typename Func>
+        typename std::enable_if<
+            !black_magic::CallHelper<Func, black_magic::S<Args...>>::value &&
+            !black_magic::CallHelper<Func, black_magic::S<crow::request, Args...>>::value, 
+            void>::type
+        operator()(Func&& f)
+        {
+            static_assert(black_magic::CallHelper<Func, black_magic::S<Args...>>::value ||
+                black_magic::CallHelper<Func, black_magic::S<crow::request, Args...>>::value ||
+                black_magic::CallHelper<Func, black_magic::S<crow::request, crow::response&, Args...>>::value
+                , 
+                "Handler type is mismatched with URL parameters");
+            static_assert(std::is_same<void, decltype(f(std::declval<crow::request>(), std::declval<crow::response&>(), std::declval<Args>()...))>::value, 
+                "Handler function with response argument should have void return type");
+
+                handler_ = std::move(f);
+        }
+
+        template <typename Func>
+        void operator()(std::string name, Func&& f)
+        {
+            name_ = std::move(name);
+            (*this).template operator()<Func>(std::forward(f));
+        }
+
+        void handle(const request& req, response& res, const routing_params& params) override
+        {
+            detail::routing_handler_call_helper::call<
+                detail::routing_handler_call_helper::call_params<
+                    decltype(handler_)>, 
+                0, 0, 0, 0, 
+                black_magic::S<Args...>, 
+                black_magic::S<>
+            >()(
+                detail::routing_handler_call_helper::call_params<
+                    decltype(handler_)>
+                {handler_, params, req, res}
+            );
+        }
+
+    private:
+        std::function<void(const crow::request&, crow::response&, Args...)> handler_;
+
+    };
+
+    const int RULE_SPECIAL_REDIRECT_SLASH = 1;
+
+    class Trie
+    {
+    public:
+        // Routes are added one character at a time into `Node's and compiled by validate()
+        // into a radix tree of `CompactNode's: chains of single children become one edge,
+        // every node's edges are contiguous and sorted by first byte, and each node knows the
+        // lowest rule index below it so find() can stop as soon as no branch can do better.
+        // All methods share the tree; a node where urls end carries a bitmap of the methods
+        // that have a rule there and the rules themselves, in method order.
+        struct Node
+        {
+            // 1 + index in endpoints_, 0 if no url ends here
+            unsigned endpoint{};
+            std::array<unsigned, (int)ParamType::MAX> param_childrens{};
+            std::map<char, unsigned> children;
+
+            bool IsSimpleNode() const
+            {
+                return 
+                    !endpoint &&
+                    std::all_of(
+                        std::begin(param_childrens), 
+                        std::end(param_childrens), 
+                        [](unsigned x){ return !x; });
+            }
+        };
+
+        struct CompactNode
+        {
+            // bit (1 << method) is set for each method with a rule ending here
+            uint32_t methods{};
+            // those rules are method_rules_[rules, rules + popcount(methods))
+            unsigned rules{};
+            // lowest rule index reachable through this node for any method (0 if none)
+            unsigned priority{};
+            std::array<unsigned, (int)ParamType::MAX> param_childrens{};
+            // this node's static edges are edges_[edges_begin, edges_end)
+            unsigned edges_begin{};
+            unsigned edges_end{};
+        };
+
+        struct Edge
+        {
+            char first;
+            unsigned label;
+            unsigned size;
+            unsigned child;
+        };
+
+        static_assert((int)HTTPMethod::InternalMethodCount <= 32, "method bitmaps are 32 bits wide");
+
+        Trie() : nodes_(1)
+        {
+        }
+
+private:
+        static unsigned popcount(uint32_t x)
+        {
+            x = x - ((x >> 1) & 0x55555555);
+            x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+            return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+        }
+
+        unsigned rule_for(uint32_t methods, unsigned rules, HTTPMethod method) const
+        {
+            uint32_t bit = 1u << (unsigned)method;
+            if (!(methods & bit))
+                return 0;
+            return method_rules_[rules + popcount(methods & (bit - 1))];
+        }
+
+        // returns the index of the compiled node for nodes_[idx]
+        unsigned compile(unsigned idx, std::vector<unsigned>& endpoint_nodes)
+        {
+            unsigned cidx = static_cast<unsigned>(compact_.size());
+            compact_.emplace_back();
+
+            unsigned priority = 0;
+            auto update = [&priority](unsigned p)
+            {
+                if (p && (!priority || p < priority))
+                    priority = p;
+            };
+
+            if (nodes_[idx].endpoint)
+            {
+                auto& endpoint = endpoints_[nodes_[idx].endpoint - 1];
+                endpoint_nodes[nodes_[idx].endpoint - 1] = cidx;
+                compact_[cidx].rules = static_cast<unsigned>(method_rules_.size());
+                for(int m = 0; m < (int)HTTPMethod::InternalMethodCount; m ++)
+                {
+                    if (endpoint[m])
+                    {
+                        compact_[cidx].methods |= 1u << m;
+                        method_rules_.push_back(endpoint[m]);
+                        update(endpoint[m]);
+                    }
+                }
+            }
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
+            {
+                if (nodes_[idx].param_childrens[i])
+                {
+                    unsigned child = compile(nodes_[idx].param_childrens[i], endpoint_nodes);
+                    compact_[cidx].param_childrens[i] = child;
+                    update(compact_[child].priority);
+                }
+            }
+
+            // edges of one node are laid out together; their children come after them
+            unsigned begin = static_cast<unsigned>(edges_.size());
+            edges_.resize(begin + nodes_[idx].children.size());
+            compact_[cidx].edges_begin = begin;
+            compact_[cidx].edges_end = static_cast<unsigned>(edges_.size());
+
+            unsigned e = begin;
+            for(auto& kv : nodes_[idx].children)
+            {
+                unsigned label = static_cast<unsigned>(labels_.size());
+                labels_ += kv.first;
+                unsigned child = kv.second;
+                while (nodes_[child].IsSimpleNode() && nodes_[child].children.size() == 1)
+                {
+                    labels_ += nodes_[child].children.begin()->first;
+                    child = nodes_[child].children.begin()->second;
+                }
+                unsigned size = static_cast<unsigned>(labels_.size()) - label;
+                unsigned compiled = compile(child, endpoint_nodes);
+                edges_[e++] = Edge{kv.first, label, size, compiled};
+                update(compact_[compiled].priority);
+            }
+
+            compact_[cidx].priority = priority;
+            return cidx;
+        }
+
+        void optimize()
+        {
+            compact_.clear();
+            edges_.clear();
+            labels_.clear();
+            method_rules_.clear();
+            std::vector<unsigned> endpoint_nodes(endpoints_.size());
+            compile(0, endpoint_nodes);
+            build_static_table(endpoint_nodes);
+        }
+
+        static uint64_t hash_url(const char* data, size_t size)
+        {
+            // 8 bytes at a time, with a final avalanche so the low bits can index the table
+            uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+            uint64_t w;
+            for(; size >= 8; data += 8, size -= 8)
+            {
+                std::memcpy(&w, data, 8);
+                h = (h ^ w) * 0xff51afd7ed558ccdULL;
+                h ^= h >> 32;
+            }
+            w = 0;
+            std::memcpy(&w, data, size);
+            h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 29;
+            return h;
+        }
+
+        // Urls without parameters go in an open addressing table kept at most half full, for
+        // the methods whose lookup in the trie resolves to the url's own rule. A slot holds
+        // everything needed to reject it, so a miss usually touches a single cache line.
+        void build_static_table(const std::vector<unsigned>& endpoint_nodes)
+        {
+            static_slots_.clear();
+            static_labels_.clear();
+
+            std::vector<StaticSlot> entries;
+            for(auto& kv : static_urls_)
+            {
+                const CompactNode& node = compact_[endpoint_nodes[kv.second - 1]];
+                uint32_t safe = 0;
+                for(int m = 0; m < (int)HTTPMethod::InternalMethodCount; m ++)
+                {
+                    routing_params params;
+                    unsigned rule_index = rule_for(node.methods, node.rules, (HTTPMethod)m);
+                    if (rule_index && find_in_trie(kv.first, (HTTPMethod)m, params) == rule_index)
+                        safe |= 1u << m;
+                }
+                if (!safe)
+                    continue;
+                entries.push_back(StaticSlot{hash_url(kv.first.data(), kv.first.size()),
+                        static_cast<unsigned>(static_labels_.size()), static_cast<unsigned>(kv.first.size()),
+                        node.methods, safe, node.rules});
+                static_labels_ += kv.first;
+            }
+            if (entries.empty())
+                return;
+
+            size_t size = 2;
+            while (size < entries.size() * 2)
+                size *= 2;
+            static_slots_.assign(size, StaticSlot{});
+            for(auto& e : entries)
+            {
+                size_t slot = e.hash & (size - 1);
+                while (static_slots_[slot].safe)
+                    slot = (slot + 1) & (size - 1);
+                static_slots_[slot] = e;
+            }
+        }
+
+        // 0: the url is not in the table (or not for this method), fall back to the trie
+        unsigned find_static(const std::string& req_url, HTTPMethod method) const
+        {
+            uint64_t h = hash_url(req_url.data(), req_url.size());
+            size_t mask = static_slots_.size() - 1;
+            for(size_t slot = h & mask; static_slots_[slot].safe; slot = (slot + 1) & mask)
+            {
+                const StaticSlot& e = static_slots_[slot];
+                if (e.hash == h && e.size == req_url.size() &&
+                    std::memcmp(static_labels_.data() + e.label, req_url.data(), e.size) == 0)
+                {
+                    if (!(e.safe & (1u << (unsigned)method)))
+                        return 0;
+                    return rule_for(e.methods, e.rules, method);
+                }
+            }
+            return 0;
+        }
+
+public:
+        void validate()
+        {
+            if (!head()->IsSimpleNode())
+                throw std::runtime_error("Internal error: Trie header should be simple!");
+            optimize();
+        }
+
+        // Returns the lowest index among the rules for `method' matching `req_url' (0 if none)
+        // and leaves that match's parameters in `params', as views into `req_url'.
+        unsigned find(const std::string& req_url, HTTPMethod method, routing_params& params) const
+        {
+            if (!static_slots_.empty())
+            {
+                unsigned rule_index = find_static(req_url, method);
+                if (rule_index)
+                    return rule_index;
+            }
+            return find_in_trie(req_url, method, params);
+        }
+
+        // Bitmap of the methods that have a rule matching `req_url'.
+        uint32_t allowed_methods(const std::string& req_url) const
+        {
+            uint32_t methods = 0;
+            if (!compact_.empty())
+                collect_methods(req_url, &compact_.front(), 0, methods);
+            return methods;
+        }
+
+private:
+        unsigned find_in_trie(const std::string& req_url, HTTPMethod method, routing_params& params) const
+        {
+            if (compact_.empty())
+                return 0;
+            routing_params current;
+            unsigned found{};
+            find(req_url, method, &compact_.front(), 0, current, params, found);
+            return found;
+        }
+
+        // Branches are tried best priority first, so the first match found is normally the
+        // answer and the remaining branches are cut off by the priority check.
+        void find(const std::string& req_url, HTTPMethod method, const CompactNode* node, unsigned pos, routing_params& current, routing_params& match, unsigned& found) const
+        {
+            if (!node->priority || (found && found <= node->priority))
+                return;
+
+            if (pos == req_url.size())
+            {
+                unsigned rule_index = rule_for(node->methods, node->rules, method);
+                if (rule_index && (!found || rule_index < found))
+                {
+                    found = rule_index;
+                    match = current;
+                }
+                return;
+            }
+
+            struct Branch
+            {
+                int type; // ParamType, or MAX for the static edge
+                const CompactNode* child;
+            } branches[(int)ParamType::MAX + 1];
+            int count = 0;
+
+            auto insert = [&](int type, const CompactNode* child)
+            {
+                int i = count++;
+                for(; i > 0 && branches[i-1].child->priority > child->priority; i --)
+                    branches[i] = branches[i-1];
+                branches[i] = Branch{type, child};
+            };
+
+            const Edge* edge = match_edge(node, req_url, pos);
+            if (edge)
+                insert((int)ParamType::MAX, &compact_[edge->child]);
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
+            {
+                if (node->param_childrens[i] && compact_[node->param_childrens[i]].priority)
+                    insert(i, &compact_[node->param_childrens[i]]);
+            }
+
+            for(int i = 0; i < count; i ++)
+            {
+                const Branch& b = branches[i];
+                if (found && found <= b.child->priority)
+                    break;
+                if (b.type == (int)ParamType::MAX)
+                {
+                    find(req_url, method, b.child, pos + edge->size, current, match, found);
+                    continue;
+                }
+                size_t epos = param_end((ParamType)b.type, req_url, pos);
+                if (epos == pos)
+                    continue;
+                current.push((ParamType)b.type, req_url.data()+pos, epos-pos);
+                find(req_url, method, b.child, static_cast<unsigned int>(epos), current, match, found);
+                current.pop();
+            }
+        }
+
+        void collect_methods(const std::string& req_url, const CompactNode* node, unsigned pos, uint32_t& methods) const
+        {
+            if (pos == req_url.size())
+            {
+                methods |= node->methods;
+                return;
+            }
+
+            const Edge* edge = match_edge(node, req_url, pos);
+            if (edge)
+                collect_methods(req_url, &compact_[edge->child], pos + edge->size, methods);
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
+            {
+                if (!node->param_childrens[i])
+                    continue;
+                size_t epos = param_end((ParamType)i, req_url, pos);
+                if (epos != pos)
+                    collect_methods(req_url, &compact_[node->param_childrens[i]], static_cast<unsigned int>(epos), methods);
+            }
+        }
+
+        // the edge whose label matches `req_url' at `pos', if any
+        const Edge* match_edge(const CompactNode* node, const std::string& req_url, unsigned pos) const
+        {
+            char c = req_url[pos];
+            auto first = edges_.begin() + node->edges_begin;
+            auto last = edges_.begin() + node->edges_end;
+            auto it = std::lower_bound(first, last, c, [](const Edge& e, char c){ return e.first < c; });
+            if (it == last || it->first != c)
+                return nullptr;
+            if (req_url.size() - pos < it->size ||
+                std::memcmp(req_url.data() + pos, labels_.data() + it->label, it->size) != 0)
+                return nullptr;
+            return &*it;
+        }
+
+        // end of the parameter of the given type starting at `pos' (`pos' if there is none)
+        static size_t param_end(ParamType type, const std::string& req_url, size_t pos)
+        {
+            char c = req_url[pos];
+            char* eptr = nullptr;
+            errno = 0;
+            switch(type)
+            {
+                case ParamType::INT:
+                    if ((c >= '0' && c <= '9') || c == '+' || c == '-')
+                        strtoll(req_url.data()+pos, &eptr, 10);
+                    break;
+                case ParamType::UINT:
+                    if ((c >= '0' && c <= '9') || c == '+')
+                        strtoull(req_url.data()+pos, &eptr, 10);
+                    break;
+                case ParamType::DOUBLE:
+                    if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')
+                        strtod(req_url.data()+pos, &eptr);
+                    break;
+                case ParamType::STRING:
+                {
+                    size_t epos = req_url.find('/', pos);
+                    return epos == std::string::npos ? req_url.size() : epos;
+                }
+                case ParamType::PATH:
+                    return req_url.size();
+                default:
+                    break;
+            }
+            if (!eptr || errno == ERANGE)
+                return pos;
+            return eptr - req_url.data();
+        }
+
+public:
+        void add(const std::string& url, unsigned rule_index, HTTPMethod method)
+        {
+            unsigned idx{0};
+
+            for(unsigned i = 0; i < url.size(); i ++)
+            {
+                char c = url[i];
+                if (c == '<')
+                {
+                    static struct ParamTraits
+                    {
+                        ParamType type;
+                        std::string name;
+                    } paramTraits[] =
+                    {
+                        { ParamType::INT, "<int>" },
+                        { ParamType::UINT, "<uint>" },
+                        { ParamType::DOUBLE, "<float>" },
+                        { ParamType::DOUBLE, "<double>" },
+                        { ParamType::STRING, "<str>" },
+                        { ParamType::STRING, "<string>" },
+                        { ParamType::PATH, "<path>" },
+                    };
+
+                    for(auto& x:paramTraits)
+                    {
+                        if (url.compare(i, x.name.size(), x.name) == 0)
+                        {
+                            if (!nodes_[idx].param_childrens[(int)x.type])
+                            {
+                                auto new_node_idx = new_node();
+                                nodes_[idx].param_childrens[(int)x.type] = new_node_idx;
+                            }
+                            idx = nodes_[idx].param_childrens[(int)x.type];
+                            i += static_cast<unsigned int>(x.name.size());
+                            break;
+                        }
+                    }
+
+                    i --;
+                }
+                else
+                {
+                    if (!nodes_[idx].children.count(c))
+                    {
+                        auto new_node_idx = new_node();
+                        nodes_[idx].children.emplace(c, new_node_idx);
+                    }
+                    idx = nodes_[idx].children[c];
+                }
+            }
+            if (!nodes_[idx].endpoint)
+            {
+                endpoints_.emplace_back();
+                nodes_[idx].endpoint = static_cast<unsigned>(endpoints_.size());
+                if (url.find('<') == std::string::npos)
+                    static_urls_.emplace(url, nodes_[idx].endpoint);
+            }
+            auto& endpoint = endpoints_[nodes_[idx].endpoint - 1];
+            if (endpoint[(int)method])
+                throw std::runtime_error("handler already exists for " + url);
+            endpoint[(int)method] = rule_index;
+        }
+    private:
+        void debug_node_print(const CompactNode* n, int level)
+        {
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
+            {
+                if (n->param_childrens[i])
+                {
+                    CROW_LOG_DEBUG << std::string(2*level, ' ') /*<< "("<<n->param_childrens[i]<<") "*/;
+                    switch((ParamType)i)
+                    {
+                        case ParamType::INT:
+                            CROW_LOG_DEBUG << "<int>";
+                            break;
+                        case ParamType::UINT:
+                            CROW_LOG_DEBUG << "<uint>";
+                            break;
+                        case ParamType::DOUBLE:
+                            CROW_LOG_DEBUG << "<float>";
+                            break;
+                        case ParamType::STRING:
+                            CROW_LOG_DEBUG << "<str>";
+                            break;
+                        case ParamType::PATH:
+                            CROW_LOG_DEBUG << "<path>";
+                            break;
+                        default:
+                            CROW_LOG_DEBUG << "<ERROR>";
+                            break;
+                    }
+
+                    debug_node_print(&compact_[n->param_childrens[i]], level+1);
+                }
+            }
+            for(unsigned e = n->edges_begin; e < n->edges_end; e ++)
+            {
+                CROW_LOG_DEBUG << std::string(2*level, ' ') /*<< "(" << edges_[e].child << ") "*/ << labels_.substr(edges_[e].label, edges_[e].size);
+                debug_node_print(&compact_[edges_[e].child], level+1);
+            }
+        }
+
+    public:
+        void debug_print()
+        {
+            if (!compact_.empty())
+                debug_node_print(&compact_.front(), 0);
+        }
+
+    private:
+        const Node* head() const
+        {
+            return &nodes_.front();
+        }
+
+        Node* head()
+        {
+            return &nodes_.front();
+        }
+
+        unsigned new_node()
+        {
+            nodes_.resize(nodes_.size()+1);
+            return static_cast<unsigned int>(nodes_.size() - 1);
+        }
+
+        std::vector<Node> nodes_;
+        // rule index per method, 0 if the method has none
+        std::vector<std::array<unsigned, (int)HTTPMethod::InternalMethodCount>> endpoints_;
+
+        std::vector<CompactNode> compact_;
+        std::vector<Edge> edges_;
+        std::string labels_;
+        std::vector<unsigned> method_rules_;
+
+        struct StaticSlot
+        {
+            uint64_t hash;
+            unsigned label;
+            unsigned size;
+            uint32_t methods;
+            // methods the table may answer for; 0 marks an empty slot
+            uint32_t safe;
+            unsigned rules;
+        };
+        // url -> endpoint
+        std::map<std::string, unsigned> static_urls_;
+        std::vector<StaticSlot> static_slots_;
+        std::string static_labels_;
+    };
+
+    namespace detail
+    {
+        // Epoch based reclamation for data that is read on every request and replaced rarely.
+        // A reader counts itself in the current epoch while it uses the data; after unpublishing
+        // something a writer flips the epoch twice, each time waiting for the previous epoch's
+        // readers to leave, and can then free it. Counters are striped by thread so that readers
+        // on different threads don't fight over one cache line.
+        class epoch
+        {
+        public:
+            class guard
+            {
+            public:
+                guard(epoch& e) : counter_(e.enter())
+                {
+                }
+
+                ~guard()
+                {
+                    counter_->fetch_sub(1, std::memory_order_release);
+                }
+
+                guard(const guard&) = delete;
+                guard& operator=(const guard&) = delete;
+
+            private:
+                std::atomic<unsigned>* counter_;
+            };
+
+            // returns once every reader that was in before the call has left
+            void synchronize()
+            {
+                for(int i = 0; i < 2; i ++)
+                {
+                    unsigned e = current_.fetch_xor(1) & 1;
+                    for(auto& c : counters_[e])
+                    {
+                        while (c.value.load() != 0)
+                            std::this_thread::yield();
+                    }
+                }
+            }
+
+        private:
+            std::atomic<unsigned>* enter()
+            {
+                unsigned stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % stripes;
+                auto& c = counters_[current_.load() & 1][stripe].value;
+                // sequentially consistent, so it is ordered before the reader loads the data
+                c.fetch_add(1);
+                return &c;
+            }
+
+            static const unsigned stripes = 8;
+            struct counter
+            {
+                std::atomic<unsigned> value{0};
+                char padding[64 - sizeof(std::atomic<unsigned>)];
+            };
+            std::atomic<unsigned> current_{0};
+            counter counters_[2][stripes];
+        };
+    }
+
+    class Router
+    {
+    public:
+        Router() : routes_(new routes)
+        {
+        }
+
+        ~Router()
+        {
+            delete routes_.load();
+        }
+
+        DynamicRule& new_rule_dynamic(const std::string& rule)
+        {
+            auto ruleObject = new DynamicRule(rule);
+            std::lock_guard<std::mutex> lock(mutex_);
+            all_rules_.emplace_back(ruleObject);
+
+            return *ruleObject;
+        }
+
+        template <uint64_t N>
+        typename black_magic::arguments<N>::type::template rebind<TaggedRule>& new_rule_tagged(const std::string& rule)
+        {
+            using RuleT = typename black_magic::arguments<N>::type::template rebind<TaggedRule>;
+
+            auto ruleObject = new RuleT(rule);
+            std::lock_guard<std::mutex> lock(mutex_);
+            all_rules_.emplace_back(ruleObject);
+
+            return *ruleObject;
+        }
+
+        // Builds the routing table from the current rules and publishes it. This may be called
+        // again while requests are served, e.g. after adding rules: lookups keep using the
+        // previous table until the new one is in place. Rules that fail validation are left out
+        // and the first error is rethrown once the others are published.
+        void validate()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            publish();
+        }
+
+        // Removes every rule registered for `rule' (as written in CROW_ROUTE) and publishes the
+        // table without them. Handlers already running finish normally.
+        bool remove_rule(const std::string& rule)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::remove_if(all_rules_.begin(), all_rules_.end(),
+                    [&](const std::shared_ptr<BaseRule>& r){ return r && r->rule() == rule; });
+            if (it == all_rules_.end())
+                return false;
+            all_rules_.erase(it, all_rules_.end());
+            publish();
+            return true;
+        }
+
+        template <typename Adaptor> 
+        void handle_upgrade(const request& req, response& res, Adaptor&& adaptor)
+        {
+            routing_params params;
+            auto rule = match(req, res, params);
+            if (!rule)
+                return;
+
+            CROW_LOG_DEBUG << "Matched rule (upgrade) '" << rule->rule_ << "' " << (uint32_t)req.method << " / " << rule->get_methods();
+
+            // any uncaught exceptions become 500s
+            try
+            {
+                rule->handle_upgrade(req, res, std::move(adaptor));
+            }
+            catch(std::exception& e)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
+                res = response(500);
+                res.end();
+                return;   
+            }
+            catch(...)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
+                res = response(500);
+                res.end();
+                return;   
+            }
+        }
+
+        void handle(const request& req, response& res)
+        {
+            routing_params params;
+            auto rule = match(req, res, params);
+            if (!rule)
+                return;
+
+            CROW_LOG_DEBUG << "Matched rule '" << rule->rule_ << "' " << (uint32_t)req.method << " / " << rule->get_methods();
+
+            // any uncaught exceptions become 500s
+            try
+            {
+                rule->handle(req, res, params);
+            }
+            catch(std::exception& e)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
+                res = response(500);
+                res.end();
+                return;   
+            }
+            catch(...)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
+                res = response(500);
+                res.end();
+                return;   
+            }
+        }
+
+        void debug_print()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            routes_.load()->trie.debug_print();
+        }
+
+    private:
+        // A published routing table; never modified once lookups can see it.
+        struct routes
+        {
+            // rule index 0, 1 has special meaning; preallocate it to avoid duplication.
+            std::vector<std::shared_ptr<BaseRule>> rules = std::vector<std::shared_ptr<BaseRule>>(2);
+            Trie trie;
+        };
+
+        static void add_rule_object(routes& table, const std::shared_ptr<BaseRule>& ruleObject)
+        {
+            const std::string& rule = ruleObject->rule();
+            bool has_trailing_slash = false;
+            std::string rule_without_trailing_slash;
+            if (rule.size() > 1 && rule.back() == '/')
+            {
+                has_trailing_slash = true;
+                rule_without_trailing_slash = rule;
+                rule_without_trailing_slash.pop_back();
+            }
+
+            table.rules.push_back(ruleObject);
+            unsigned rule_index = static_cast<unsigned int>(table.rules.size() - 1);
+            ruleObject->foreach_method([&](int method)
+                    {
+                        table.trie.add(rule, rule_index, (HTTPMethod)method);
+
+                        // directory case: 
+                        //   request to `/about' url matches `/about/' rule 
+                        if (has_trailing_slash)
+                        {
+                            table.trie.add(rule_without_trailing_slash, RULE_SPECIAL_REDIRECT_SLASH, (HTTPMethod)method);
+                        }
+                    });
+        }
+
+        // called with mutex_ held
+        void publish()
+        {
+            std::unique_ptr<routes> next(new routes);
+            std::exception_ptr error;
+            for(auto& rule:all_rules_)
+            {
+                if (!rule)
+                    continue;
+                try
+                {
+                    auto upgraded = rule->upgrade();
+                    if (upgraded)
+                        rule = std::move(upgraded);
+                    rule->validate();
+                    add_rule_object(*next, rule);
+                }
+                catch(...)
+                {
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+            next->trie.validate();
+
+            routes* previous = routes_.exchange(next.release());
+            epoch_.synchronize();
+            delete previous;
+
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // The rule for `req', or null when there is none; `res' is then already filled in with
+        // a 404, a 405 or a redirect.
+        std::shared_ptr<BaseRule> match(const request& req, response& res, routing_params& params)
+        {
+            if (req.method >= HTTPMethod::InternalMethodCount)
+                return {};
+
+            unsigned rule_index;
+            uint32_t allowed = 0;
+            std::shared_ptr<BaseRule> rule;
+            {
+                detail::epoch::guard guard(epoch_);
+                const routes* current = routes_.load();
+                rule_index = current->trie.find(req.url, req.method, params);
+                if (!rule_index)
+                    allowed = current->trie.allowed_methods(req.url);
+                else if (rule_index >= current->rules.size())
+                    throw std::runtime_error("Trie internal structure corrupted!");
+                else if (rule_index != RULE_SPECIAL_REDIRECT_SLASH)
+                    rule = current->rules[rule_index];
+            }
+
+            if (!rule_index)
+            {
+                handle_no_match(req, res, allowed);
+                return {};
+            }
+
+            if (rule_index == RULE_SPECIAL_REDIRECT_SLASH)
+            {
+                CROW_LOG_INFO << "Redirecting to a url with trailing slash: " << req.url;
+                res = response(301);
+
+                // TODO absolute url building
+                if (req.get_header_value("Host").empty())
+                {
+                    res.add_header("Location", req.url + "/");
+                }
+                else
+                {
+                    res.add_header("Location", "http://" + req.get_header_value("Host") + req.url + "/");
+                }
+                res.end();
+                return {};
+            }
+
+            return rule;
+        }
+
+        // 405 with the methods the url does have rules for, 404 if there are none
+        void handle_no_match(const request& req, response& res, uint32_t allowed)
+        {
+            if (!allowed)
+            {
+                CROW_LOG_DEBUG << "Cannot match rules " << req.url << ' ' << method_name(req.method);
+                res = response(404);
+                res.end();
+                return;
+            }
+
+            std::string allow;
+            for(int i = 0; i < (int)HTTPMethod::InternalMethodCount; i ++)
+            {
+                if (allowed & (1u << i))
+                {
+                    if (!allow.empty())
+                        allow += ", ";
+                    allow += method_name((HTTPMethod)i);
+                }
+            }
+            CROW_LOG_DEBUG << "Method not allowed " << req.url << ' ' << method_name(req.method) << ", allowed: " << allow;
+            res = response(405);
+            res.set_header("Allow", allow);
+            res.end();
+        }
+
+        std::atomic<routes*> routes_;
+        detail::epoch epoch_;
+        // serializes changes to the rules; never taken on the request path
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<BaseRule>> all_rules_;
+    };
+}
+
+
+
+#pragma once
+#include <boost/algorithm/string/trim.hpp>
+
+
+
+
+
+namespace crow
+{
+    // Any middleware requires following 3 members:
+
+    // struct context;
+    //      storing data for the middleware; can be read from another middleware or handlers
+
+    // before_handle
+    //      called before handling the request.
+    //      if res.end() is called, the operation is halted. 
+    //      (still call after_handle of this middleware)
+    //      2 signatures:
+    //      void before_handle(request& req, response& res, context& ctx)
+    //          if you only need to access this middlewares context.
+    //      template <typename AllContext>
+    //      void before_handle(request& req, response& res, context& ctx, AllContext& all_ctx)
+    //          you can access another middlewares' context by calling `all_ctx.template get<MW>()'
+    //          ctx == all_ctx.template get<CurrentMiddleware>()
+
+    // after_handle
+    //      called after handling the request.
+    //      void after_handle(request& req, response& res, context& ctx)
+    //      template <typename AllContext>
+    //      void after_handle(request& req, response& res, context& ctx, AllContext& all_ctx)
+
+    struct CookieParser
+    {
+        struct context
+        {
+            mutable std::unordered_map<std::string, std::string> jar;
+            std::unordered_map<std::string, std::string> cookies_to_add;
+
+            std::string get_cookie(const std::string& key) const
+            {
+                parse_cookies();
+                auto cookie = jar.find(key);
+                if (cookie != jar.end())
+                    return cookie->second;
+                return {};
+            }
+
+            void set_cookie(const std::string& key, const std::string& value)
+            {
+                cookies_to_add.emplace(key, value);
+            }
+
+            // `jar' is filled from the Cookie header the first time a cookie is read
+            void parse_cookies() const
+            {
+                if (!cookie_header_)
+                    return;
+                const std::string& cookies = *cookie_header_;
+                cookie_header_ = nullptr;
+
+                size_t pos = 0;
+                while(pos < cookies.size())
+                {
+                    size_t pos_equal = cookies.find('=', pos);
+                    if (pos_equal == cookies.npos)
+                        break;
+                    std::string name = cookies.substr(pos, pos_equal-pos);
+                    boost::trim(name);
+                    pos = pos_equal+1;
+                    while(pos < cookies.size() && cookies[pos] == ' ') pos++;
+                    if (pos == cookies.size())
+                        break;
+
+                    size_t pos_semicolon = cookies.find(';', pos);
+                    std::string value = cookies.substr(pos, pos_semicolon-pos);
+
+                    boost::trim(value);
+                    if (value[0] == '"' && value[value.size()-1] == '"')
+                    {
+                        value = value.substr(1, value.size()-2);
+                    }
+
+                    jar.emplace(std::move(name), std::move(value));
+
+                    pos = pos_semicolon;
+                    if (pos == cookies.npos)
+                        break;
+                    pos++;
+                    while(pos < cookies.size() && cookies[pos] == ' ') pos++;
+                }
+            }
+
+        private:
+            friend struct CookieParser;
+            // points into req.headers, which outlives the context
+            mutable const std::string* cookie_header_{};
+        };
+
+        void before_handle(request& req, response& res, context& ctx)
+        {
+            int count = req.headers.count(known_header::cookie);
+            if (!count)
+                return;
+            if (count > 1)
+            {
+                res.code = 400;
+                res.end();
+                return;
+            }
+            ctx.cookie_header_ = &req.get_header_value(known_header::cookie);
+        }
+
+        void after_handle(request& /*req*/, response& res, context& ctx)
+        {
+            for(auto& cookie:ctx.cookies_to_add)
+            {
+                if (cookie.second.empty())
+                    res.add_header("Set-Cookie", cookie.first + "=\"\"");
+                else
+                    res.add_header("Set-Cookie", cookie.first + "=" + cookie.second);
+            }
+        }
+    };
+
+    /*
+    App<CookieParser, AnotherJarMW> app;
+    A B C
+    A::context
+        int aa;
+
+    ctx1 : public A::context
+    ctx2 : public ctx1, public B::context
+    ctx3 : public ctx2, public C::context
+
+    C depends on A
+
+    C::handle
+        context.aaa
+
+    App::context : private CookieParser::contetx, ... 
+    {
+        jar
+
+    }
+
+    SimpleApp
+    */
+}
+
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <boost/asio/buffer.hpp>
+#include <boost/utility/string_ref.hpp>
+
+
+
+
+
+
+
+
+
+
+namespace crow
+{
+    // HTTPParser backends, chosen with its second template argument or CROW_ENABLE_SIMD_PARSER.
+    // http_parser_merged.h, one byte at a time
+    struct http_parser_backend {};
+    // Waits for a complete head and splits it with the searches in parser_simd.h. Anything
+    // unusual (folded lines, bare LFs, chunked bodies, upgrades, errors) goes to http_parser,
+    // from the start of the message, so both backends always agree.
+    struct simd_parser_backend {};
+
+#ifdef CROW_ENABLE_SIMD_PARSER
+    using default_parser_backend = simd_parser_backend;
+#else
+    using default_parser_backend = http_parser_backend;
+#endif
+
+    // Reads go straight into a buffer owned by the parser, and the url, headers and body of
+    // the current message are kept as ranges of it. Nothing is copied or allocated while a
+    // message is parsed; the buffer only grows when a message does not fit in what is left.
+    template <typename Handler, typename Backend = default_parser_backend>
+    struct HTTPParser : public http_parser
+    {
+        // Offsets rather than pointers, so the buffer can be compacted or grown under them
+        struct range
+        {
+            size_t offset{};
+            size_t size{};
+        };
+
+        static int on_message_begin(http_parser* self_)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            self->clear();
+            return 0;
+        }
+        static int on_url(http_parser* self_, const char* at, size_t length)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            if (self->keep_ == npos)
+                self->keep_ = at - self->buffer_.data();
+            self->extend(self->url_, at, length);
+            return 0;
+        }
+        static int on_header_field(http_parser* self_, const char* at, size_t length)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            // a name is only split by the end of a read, so a piece that does not follow
+            // the last one starts a new header (the previous value may have been empty)
+            if (self->header_building_state == 0 || !self->adjacent(self->headers_.back().first, at))
+            {
+                self->headers_.emplace_back();
+                self->header_building_state = 1;
+            }
+            self->extend(self->headers_.back().first, at, length);
+            return 0;
+        }
+        static int on_header_value(http_parser* self_, const char* at, size_t length)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            self->header_building_state = 0;
+            self->extend(self->headers_.back().second, at, length);
+            return 0;
+        }
+        static int on_headers_complete(http_parser* self_)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            // an h2c upgrade request may have a body, which still arrives as HTTP/1 (RFC 7540 3.2)
+            if (self->upgrade)
+            {
+                auto value = self->get_header_value("upgrade");
+                if (value.size() == 3 && detail::iequals_ascii(value.data(), "h2c", 3))
+                {
+                    self->upgrade = 0;
+                    self->h2c_upgrade = true;
+                }
+            }
+            self->process_header();
+            return 0;
+        }
+        static int on_body(http_parser* self_, const char* at, size_t length)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            self->extend(self->body_, at, length);
+            return 0;
+        }
+        static int on_message_complete(http_parser* self_)
+        {
+            HTTPParser* self = static_cast<HTTPParser*>(self_);
+            self->process_message();
+            // the handler has taken what it needs; the next read may reuse the whole buffer
+            self->keep_ = npos;
+            return 0;
+        }
+        HTTPParser(Handler* handler) :
+            buffer_(initial_buffer_size),
+            handler_(handler)
+        {
+            http_parser_init(this, HTTP_REQUEST);
+        }
+
+
+        // The free space the next read should go to. Bytes still referred to by an
+        // unfinished message are moved to the front first, and the buffer is doubled only
+        // when they leave too little room.
+        boost::asio::mutable_buffers_1 prepare()
+        {
+            if (keep_ == npos)
+            {
+                size_ = 0;
+                next_ = 0;
+                if (buffer_.size() > max_idle_buffer_size)
+                    std::vector<char>(initial_buffer_size).swap(buffer_);
+            }
+            else if (keep_ > 0)
+            {
+                size_t shift = keep_;
+                std::memmove(buffer_.data(), buffer_.data() + shift, size_ - shift);
+                size_ -= shift;
+                keep_ = 0;
+                rebase(url_, shift);
+                for(auto& h : headers_)
+                {
+                    rebase(h.first, shift);
+                    rebase(h.second, shift);
+                }
+                rebase(body_, shift);
+                if (next_ >= shift)
+                    next_ -= shift;
+            }
+            if (buffer_.size() - size_ < min_read_size)
+                buffer_.resize(buffer_.size() * 2);
+            return boost::asio::buffer(buffer_.data() + size_, buffer_.size() - size_);
+        }
+
+        // Parses `length' bytes read into the space returned by prepare().
+        // return false on error
+        bool commit(size_t length)
+        {
+            size_t begin = size_;
+            size_ += length;
+            return parse(begin, Backend());
+        }
+
+        // Copies `buffer' in and parses it; the connection reads in place through prepare()/commit().
+        // return false on error
+        bool feed(const char* buffer, int length)
+        {
+            size_t done = 0;
+            while(done < static_cast<size_t>(length))
+            {
+                auto space = prepare();
+                size_t n = std::min(boost::asio::buffer_size(space), static_cast<size_t>(length) - done);
+                std::memcpy(boost::asio::buffer_cast<char*>(space), buffer + done, n);
+                if (!commit(n))
+                    return false;
+                done += n;
+            }
+            return true;
+        }
+
+        bool done()
+        {
+            if (!finish(Backend()))
+                return false;
+            return http_parser_execute(this, &settings(), nullptr, 0) == 0;
+        }
+
+        void clear()
+        {
+            url_ = range();
+            body_ = range();
+            headers_.clear();
+            header_building_state = 0;
+            h2c_upgrade = false;
+        }
+
+        void process_header()
+        {
+            handler_->handle_header();
+        }
+
+        void process_message()
+        {
+            handler_->handle();
+        }
+
+        boost::string_ref raw_url() const
+        {
+            return view(url_);
+        }
+
+        boost::string_ref body() const
+        {
+            return view(body_);
+        }
+
+        // The first header named `key', empty if there is none
+        boost::string_ref get_header_value(const std::string& key) const
+        {
+            for(auto& h : headers_)
+            {
+                if (h.first.size == key.size() && detail::iequals_ascii(buffer_.data() + h.first.offset, key.data(), key.size()))
+                    return view(h.second);
+            }
+            return {};
+        }
+
+        // Fills `req' in place, so the strings it already holds are reused
+        void to_request(request& req) const
+        {
+            auto raw = raw_url();
+            req.method = (HTTPMethod)method;
+            req.raw_url.assign(raw.data(), raw.size());
+
+            // url params; only the query part is kept and it is parsed on first use
+            req.url.assign(raw.data(), std::min(raw.find('?'), raw.size()));
+            auto query_pos = raw.find_first_of("?#");
+            if (query_pos != boost::string_ref::npos)
+                req.url_params.assign(raw.data() + query_pos, raw.size() - query_pos);
+            else
+                req.url_params.clear();
+
+            req.headers.clear();
+            for(auto& h : headers_)
+                req.headers.emplace(view(h.first), view(h.second));
+
+            auto b = body();
+            req.body.assign(b.data(), b.size());
+            req.middleware_context = nullptr;
+            req.io_service = nullptr;
+        }
+
+        request to_request() const
+        {
+            request req;
+            to_request(req);
+            return req;
+        }
+
+		bool is_upgrade() const
+		{
+			return upgrade;
+		}
+
+        bool is_h2c_upgrade() const
+        {
+            return h2c_upgrade;
+        }
+
+        bool check_version(int major, int minor) const
+        {
+            return http_major == major && http_minor == minor;
+        }
+
+        int header_building_state = 0;
+        bool h2c_upgrade{};
+
+        // bytes consumed by the last commit(); after an upgrade the rest belongs to the new protocol
+        size_t parsed_length{};
+
+    private:
+        static const http_parser_settings& settings()
+        {
+            const static http_parser_settings settings{
+                on_message_begin,
+                on_url,
+                nullptr,
+                on_header_field,
+                on_header_value,
+                on_headers_complete,
+                on_body,
+                on_message_complete,
+            };
+            return settings;
+        }
+
+        bool parse(size_t begin, http_parser_backend)
+        {
+            return execute(begin, begin);
+        }
+
+        bool parse(size_t begin, simd_parser_backend)
+        {
+            size_t from = begin;
+            if (!slow_)
+            {
+                int ret = 0;
+                while(next_ < size_ && (ret = parse_message()) > 0)
+                    ;
+                if (ret >= 0)
+                {
+                    keep_ = next_ < size_ ? next_ : npos;
+                    parsed_length = size_ - begin;
+                    return true;
+                }
+                slow_ = true;
+                from = next_;
+            }
+            if (!execute(from, begin))
+                return false;
+            if (state == s_start_req)
+            {
+                // between messages; the next one may take the fast path again
+                slow_ = false;
+                next_ = size_;
+                reset_head();
+            }
+            return true;
+        }
+
+        bool finish(http_parser_backend)
+        {
+            return true;
+        }
+
+        // A head still waiting for its end goes to http_parser, which has the last word on it
+        bool finish(simd_parser_backend)
+        {
+            if (slow_)
+                return true;
+            if (body_pending_)
+            {
+                // the head went to the handler already; this is where http_parser would give up
+                http_errno = HPE_INVALID_EOF_STATE;
+                return false;
+            }
+            if (next_ < size_)
+            {
+                slow_ = true;
+                execute(next_, next_);
+            }
+            return true;
+        }
+
+        // Hands [from, size_) to http_parser; `begin' is where the latest read starts
+        bool execute(size_t from, size_t begin)
+        {
+            size_t length = size_ - from;
+            size_t nparsed = http_parser_execute(this, &settings(), buffer_.data() + from, length);
+            parsed_length = from + nparsed > begin ? from + nparsed - begin : 0;
+            return nparsed == length;
+        }
+
+        // Parses the message at next_: 1 when it is complete, 0 when more bytes are needed,
+        // -1 when it has to go to http_parser instead
+        int parse_message()
+        {
+            const char* base = buffer_.data() + next_;
+            if (!body_pending_)
+            {
+                // after a message that is not kept alive, only http_parser knows what to do
+                if (state != s_start_req || (scan_ == 0 && (base[0] < 'A' || base[0] > 'Z')))
+                    return -1;
+
+                // every line has to end in CRLF; the head ends with an empty one
+                const char* end = buffer_.data() + size_;
+                const char* p = base + scan_;
+                size_t head_size = 0;
+                while(!head_size)
+                {
+                    p = detail::find_crlf(p, end);
+                    if (p == end || (*p == '\r' && p + 1 == end))
+                        break;
+                    if (*p == '\n' || p[1] != '\n')
+                        return -1;
+                    size_t lf = p + 1 - base;
+                    if (!line_ends_.empty() && line_ends_.back() + 2 == lf)
+                        head_size = lf + 1;
+                    else
+                        line_ends_.push_back(lf);
+                    p += 2;
+                }
+                if (!head_size)
+                {
+                    scan_ = p - base;
+                    return size_ - next_ > CROW_HTTP_MAX_HEADER_SIZE ? -1 : 0;
+                }
+                if (head_size > CROW_HTTP_MAX_HEADER_SIZE || !parse_head())
+                    return -1;
+
+                body_.offset = next_ + head_size;
+                on_headers_complete(this);
+                if (content_length == 0 || content_length == CROW_ULLONG_MAX)
+                    return complete_message(body_.offset);
+                body_pending_ = true;
+            }
+
+            if (size_ - body_.offset < content_length)
+                return 0;
+            body_.size = content_length;
+            content_length = 0;
+            return complete_message(body_.offset + body_.size);
+        }
+
+        // The request line and the header lines found by parse_message(). Only the common
+        // forms are accepted here; false leaves the message to http_parser.
+        bool parse_head()
+        {
+            const char* base = buffer_.data() + next_;
+            clear();
+            flags = 0;
+            upgrade = 0;
+            content_length = CROW_ULLONG_MAX;
+
+            // METHOD SP /target SP HTTP/1.x
+            const char* line_end = base + line_ends_[0] - 1;
+            const char* sp = static_cast<const char*>(std::memchr(base, ' ', line_end - base));
+            if (!sp || !match_method(base, sp - base))
+                return false;
+            const char* target = sp + 1;
+            if (target == line_end || *target != '/')
+                return false;
+            const char* target_end = detail::find_non_printable(target, line_end);
+            if (line_end - target_end != 9 || std::memcmp(target_end, " HTTP/1.", 8) != 0 || (target_end[8] != '0' && target_end[8] != '1'))
+                return false;
+            http_major = 1;
+            http_minor = target_end[8] - '0';
+            url_.offset = target - buffer_.data();
+            url_.size = target_end - target;
+
+            for(size_t i = 1; i < line_ends_.size(); i ++)
+            {
+                const char* name = base + line_ends_[i - 1] + 1;
+                const char* end = base + line_ends_[i] - 1;
+                // a line starting with whitespace is folded; it stops here as well
+                const char* colon = detail::find_non_token(name, end);
+                if (colon == name || colon == end || *colon != ':')
+                    return false;
+                const char* value = colon + 1;
+                while(value != end && (*value == ' ' || *value == '\t'))
+                    value ++;
+                if (!check_header(name, colon - name, value, end - value))
+                    return false;
+
+                headers_.emplace_back();
+                headers_.back().first.offset = name - buffer_.data();
+                headers_.back().first.size = colon - name;
+                headers_.back().second.offset = value - buffer_.data();
+                headers_.back().second.size = end - value;
+            }
+            nread = 0;
+            return true;
+        }
+
+        bool match_method(const char* name, size_t size)
+        {
+            for(unsigned m = 0; m <= HTTP_MKCALENDAR; m ++)
+            {
+                const char* s = http_method_str(static_cast<http_method>(m));
+                if (std::strlen(s) == size && std::memcmp(s, name, size) == 0)
+                {
+                    method = m;
+                    // CONNECT is always an upgrade
+                    return m != HTTP_CONNECT;
+                }
+            }
+            return false;
+        }
+
+        // Applies what http_parser takes from a header to the flags and the content length
+        bool check_header(const char* name, size_t name_size, const char* value, size_t value_size)
+        {
+            auto is = [&](const char* s, size_t size){ return name_size == size && detail::iequals_ascii(name, s, size); };
+            if (is("content-length", 14))
+            {
+                if (value_size == 0 || value_size > 18)
+                    return false;
+                uint64_t n = 0;
+                for(size_t i = 0; i < value_size; i ++)
+                {
+                    if (value[i] < '0' || value[i] > '9')
+                        return false;
+                    n = n * 10 + (value[i] - '0');
+                }
+                content_length = n;
+            }
+            else if (is("connection", 10) || is("proxy-connection", 16))
+            {
+                // only the whole value counts, with trailing spaces
+                while(value_size && value[value_size - 1] == ' ')
+                    value_size --;
+                if (value_size == 10 && detail::iequals_ascii(value, "keep-alive", 10))
+                    flags |= F_CONNECTION_KEEP_ALIVE;
+                else if (value_size == 5 && detail::iequals_ascii(value, "close", 5))
+                    flags |= F_CONNECTION_CLOSE;
+            }
+            else if (is("transfer-encoding", 17) || is("upgrade", 7))
+            {
+                return false;
+            }
+            return true;
+        }
+
+        int complete_message(size_t end)
+        {
+            next_ = end;
+            reset_head();
+            // http_parser is strict: nothing may follow a message that is not kept alive
+            state = http_should_keep_alive(this) ? s_start_req : s_dead;
+            on_message_complete(this);
+            return 1;
+        }
+
+        void reset_head()
+        {
+            scan_ = 0;
+            line_ends_.clear();
+            body_pending_ = false;
+        }
+
+        static const size_t npos = static_cast<size_t>(-1);
+        static const size_t initial_buffer_size = 4096;
+        static const size_t min_read_size = 2048;
+        // a buffer grown for a large message is given back once it is done with
+        static const size_t max_idle_buffer_size = 64 * 1024;
+
+        // The parser hands over values in pieces: at the end of a read, and around folded
+        // header lines and chunk headers. Pieces that are not adjacent are moved down over
+        // the framing bytes in between, which the parser has consumed already.
+        void extend(range& r, const char* at, size_t length)
+        {
+            size_t offset = at - buffer_.data();
+            if (r.size == 0)
+            {
+                r.offset = offset;
+            }
+            else if (offset != r.offset + r.size)
+            {
+                std::memmove(buffer_.data() + r.offset + r.size, at, length);
+            }
+            r.size += length;
+        }
+
+        bool adjacent(const range& r, const char* at) const
+        {
+            return buffer_.data() + r.offset + r.size == at;
+        }
+
+        static void rebase(range& r, size_t shift)
+        {
+            // empty ranges may still be at 0
+            if (r.offset >= shift)
+                r.offset -= shift;
+        }
+
+        boost::string_ref view(const range& r) const
+        {
+            return boost::string_ref(buffer_.data() + r.offset, r.size);
+        }
+
+        std::vector<char> buffer_;
+        // bytes read into buffer_
+        size_t size_{};
+        // start of the bytes the current message refers to, npos when there are none
+        size_t keep_{npos};
+
+        range url_;
+        std::vector<std::pair<range, range>> headers_;
+        range body_;
+
+        // simd_parser_backend: the message being parsed starts at next_, unless http_parser has it
+        bool slow_{};
+        size_t next_{};
+        // how far the head has been searched, and the LFs found so far, relative to next_
+        size_t scan_{};
+        std::vector<size_t> line_ends_;
+        // the head has been handled; waiting for content_length bytes at body_.offset
+        bool body_pending_{};
+
+        Handler* handler_;
+    };
+}
+
+
+
+#pragma once
+
+
+
+
+
+
+
+
+namespace crow
+{
+    namespace detail
+    {
+        template <typename ... Middlewares>
+        struct partial_context
+            : public black_magic::pop_back<Middlewares...>::template rebind<partial_context>
+            , public black_magic::last_element_type<Middlewares...>::type::context
+        {
+            using parent_context = typename black_magic::pop_back<Middlewares...>::template rebind<::crow::detail::partial_context>;
+            template <int N>
+            using partial = typename std::conditional<N == sizeof...(Middlewares)-1, partial_context, typename parent_context::template partial<N>>::type;
+
+            template <typename T> 
+            typename T::context& get()
+            {
+                return static_cast<typename T::context&>(*this);
+            }
+        };
+
+        template <>
+        struct partial_context<>
+        {
+            template <int>
+            using partial = partial_context;
+        };
+
+        template <int N, typename Context, typename Container, typename CurrentMW, typename ... Middlewares>
+        bool middleware_call_helper(Container& middlewares, request& req, response& res, Context& ctx);
+
+        template <typename ... Middlewares>
+        struct context : private partial_context<Middlewares...>
+        //struct context : private Middlewares::context... // simple but less type-safe
+        {
+            template <int N, typename Context, typename Container>
+            friend typename std::enable_if<(N==0)>::type after_handlers_call_helper(Container& middlewares, Context& ctx, request& req, response& res);
+            template <int N, typename Context, typename Container>
+            friend typename std::enable_if<(N>0)>::type after_handlers_call_helper(Container& middlewares, Context& ctx, request& req, response& res);
+
+            template <int N, typename Context, typename Container, typename CurrentMW, typename ... Middlewares2>
+            friend bool middleware_call_helper(Container& middlewares, request& req, response& res, Context& ctx);
+
+            template <typename T> 
+            typename T::context& get()
+            {
+                return static_cast<typename T::context&>(*this);
+            }
+
+            template <int N>
+            using partial = typename partial_context<Middlewares...>::template partial<N>;
+        };
+    }
+}
+
+
+
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/array.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+namespace crow
+{
+    using namespace boost;
+    using tcp = asio::ip::tcp;
+
+    namespace detail
+    {
+        template <typename MW>
+        struct check_before_handle_arity_3_const
+        {
+            template <typename T,
+                void (T::*)(request&, response&, typename MW::context&) const = &T::before_handle
+            >
+            struct get
+            { };
+        };
+
+        template <typename MW>
+        struct check_before_handle_arity_3
+        {
+            template <typename T,
+                void (T::*)(request&, response&, typename MW::context&) = &T::before_handle
+            >
+            struct get
+            { };
+        };
+
+        template <typename MW>
+        struct check_after_handle_arity_3_const
+        {
+            template <typename T,
+                void (T::*)(request&, response&, typename MW::context&) const = &T::after_handle
+            >
+            struct get
+            { };
+        };
+
+        template <typename MW>
+        struct check_after_handle_arity_3
+        {
+            template <typename T,
+                void (T::*)(request&, response&, typename MW::context&) = &T::after_handle
+            >
+            struct get
+            { };
+        };
+
+        template <typename T>
+        struct is_before_handle_arity_3_impl
+        {
+            template <typename C>
+            static std::true_type f(typename check_before_handle_arity_3_const<T>::template get<C>*);
+
+            template <typename C>
+            static std::true_type f(typename check_before_handle_arity_3<T>::template get<C>*);
+
+            template <typename C>
+            static std::false_type f(...);
+
+        public:
+            static const bool value = decltype(f<T>(nullptr))::value;
+        };
+
+        template <typename T>
+        struct is_after_handle_arity_3_impl
+        {
+            template <typename C>
+            static std::true_type f(typename check_after_handle_arity_3_const<T>::template get<C>*);
+
+            template <typename C>
+            static std::true_type f(typename check_after_handle_arity_3<T>::template get<C>*);
+
+            template <typename C>
+            static std::false_type f(...);
+
+        public:
+            static const bool value = decltype(f<T>(nullptr))::value;
+        };
+
+        template <typename MW, typename Context, typename ParentContext>
+        typename std::enable_if<!is_before_handle_arity_3_impl<MW>::value>::type
+        before_handler_call(MW& mw, request& req, response& res, Context& ctx, ParentContext& /*parent_ctx*/)
+        {
+            mw.before_handle(req, res, ctx.template get<MW>(), ctx);
+        }
+
+        template <typename MW, typename Context, typename ParentContext>
+        typename std::enable_if<is_before_handle_arity_3_impl<MW>::value>::type
+        before_handler_call(MW& mw, request& req, response& res, Context& ctx, ParentContext& /*parent_ctx*/)
+        {
+            mw.before_handle(req, res, ctx.template get<MW>());
+        }
+
+        template <typename MW, typename Context, typename ParentContext>
+        typename std::enable_if<!is_after_handle_arity_3_impl<MW>::value>::type
+        after_handler_call(MW& mw, request& req, response& res, Context& ctx, ParentContext& /*parent_ctx*/)
+        {
+            mw.after_handle(req, res, ctx.template get<MW>(), ctx);
+        }
+
+        template <typename MW, typename Context, typename ParentContext>
+        typename std::enable_if<is_after_handle_arity_3_impl<MW>::value>::type
+        after_handler_call(MW& mw, request& req, response& res, Context& ctx, ParentContext& /*parent_ctx*/)
+        {
+            mw.after_handle(req, res, ctx.template get<MW>());
+        }
+
+        template <int N, typename Context, typename Container, typename CurrentMW, typename ... Middlewares>
+        bool middleware_call_helper(Container& middlewares, request& req, response& res, Context& ctx)
+        {
+            using parent_context_t = typename Context::template partial<N-1>;
+            before_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+
+            if (res.is_completed())
+            {
+                after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+                return true;
+            }
+
+            if (middleware_call_helper<N+1, Context, Container, Middlewares...>(middlewares, req, res, ctx))
+            {
+                after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+                return true;
+            }
+
+            return false;
+        }
+
+        template <int N, typename Context, typename Container>
+        bool middleware_call_helper(Container& /*middlewares*/, request& /*req*/, response& /*res*/, Context& /*ctx*/)
+        {
+            return false;
+        }
+
+        template <int N, typename Context, typename Container>
+        typename std::enable_if<(N<0)>::type
+        after_handlers_call_helper(Container& /*middlewares*/, Context& /*context*/, request& /*req*/, response& /*res*/)
+        {
+        }
+
+        template <int N, typename Context, typename Container>
+        typename std::enable_if<(N==0)>::type after_handlers_call_helper(Container& middlewares, Context& ctx, request& req, response& res)
+        {
+            using parent_context_t = typename Context::template partial<N-1>;
+            using CurrentMW = typename std::tuple_element<N, typename std::remove_reference<Container>::type>::type;
+            after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+        }
+
+        template <int N, typename Context, typename Container>
+        typename std::enable_if<(N>0)>::type after_handlers_call_helper(Container& middlewares, Context& ctx, request& req, response& res)
+        {
+            using parent_context_t = typename Context::template partial<N-1>;
+            using CurrentMW = typename std::tuple_element<N, typename std::remove_reference<Container>::type>::type;
+            after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+            after_handlers_call_helper<N-1, Context, Container>(middlewares, ctx, req, res);
+        }
+    }
+
+#ifdef CROW_ENABLE_DEBUG
+    static std::atomic<int> connectionCount;
+#endif
+    template <typename Adaptor, typename Handler, typename ... Middlewares>
+    class Connection
+    {
+    public:
+        Connection(
+            boost::asio::io_service& io_service,
+            Handler* handler,
+            const std::string& server_name,
+            std::tuple<Middlewares...>* middlewares,
+            std::function<const std::string&()>& get_cached_date_str_f,
+            detail::dumb_timer_queue& timer_queue,
+            typename Adaptor::context* adaptor_ctx_
+            )
+            : adaptor_(io_service, adaptor_ctx_),
+            handler_(handler),
+            parser_(this),
+            server_name_(server_name),
+            middlewares_(middlewares),
+            get_cached_date_str(get_cached_date_str_f),
+            timer_queue(timer_queue)
+        {
+#ifdef CROW_ENABLE_DEBUG
+            connectionCount ++;
+            CROW_LOG_DEBUG << "Connection open, total " << connectionCount << ", " << this;
+#endif
+        }
+
+        ~Connection()
+        {
+            res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
+            cancel_deadline_timer();
+#ifdef CROW_ENABLE_DEBUG
+            connectionCount --;
+            CROW_LOG_DEBUG << "Connection closed, total " << connectionCount << ", " << this;
+#endif
+        }
+
+        decltype(std::declval<Adaptor>().raw_socket())& socket()
+        {
+            return adaptor_.raw_socket();
+        }
+
+        void start()
+        {
+            adaptor_.start([this](const boost::system::error_code& ec) {
+                if (!ec)
+                {
+                    start_deadline();
+
+                    do_read();
+                }
+                else
+                {
+                    check_destroy();
+                }
+            });
+        }
+
+        void handle_header()
+        {
+            // HTTP 1.1 Expect: 100-continue
+            if (parser_.check_version(1, 1) && parser_.get_header_value("expect") == "100-continue")
+            {
+                static std::string expect_100_continue = "HTTP/1.1 100 Continue\r\n\r\n";
+                buffers_[0] = boost::asio::buffer(expect_100_continue);
+                buffers_[1] = boost::asio::const_buffer();
+                do_write();
+            }
+        }
+
+        void handle()
+        {
+            cancel_deadline_timer();
+            bool is_invalid_request = false;
+            add_keep_alive_ = false;
+
+            parser_.to_request(req_);
+            request& req = req_;
+            req.remote_ip_address_.clear();
+
+            req.remote_ip_address_helper_ = [this]{ return adaptor_.remote_endpoint().address().to_string(); };
+
+            auto connection = req.headers.find(known_header::connection);
+            if (parser_.check_version(1, 0))
+            {
+                // HTTP/1.0
+                if (connection != req.headers.end())
+                {
+                    if (boost::iequals(connection->second, "Keep-Alive"))
+                        add_keep_alive_ = true;
+                }
+                else
+                    close_connection_ = true;
+            }
+            else if (parser_.check_version(1, 1))
+            {
+                // HTTP/1.1
+                if (connection != req.headers.end())
+                {
+                    if (connection->second == "close")
+                        close_connection_ = true;
+                    else if (boost::iequals(connection->second, "Keep-Alive"))
+                        add_keep_alive_ = true;
+                }
+                if (!req.headers.count(known_header::host))
+                {
+                    is_invalid_request = true;
+                    res = response(400);
+                }
+				if (parser_.is_upgrade())
+				{
+                    close_connection_ = true;
+                    handler_->handle_upgrade(req, res, std::move(adaptor_));
+                    return;
+				}
+                // without exactly one HTTP2-Settings the h2c upgrade is ignored (RFC 7540 3.2.1)
+                if (parser_.is_h2c_upgrade() && !is_invalid_request && req.headers.count(known_header::http2_settings) == 1 && start_http2_upgrade())
+                    return;
+            }
+
+            CROW_LOG_INFO << "Request: " << boost::lexical_cast<std::string>(adaptor_.remote_endpoint()) << " " << this << " HTTP/" << parser_.http_major << "." << parser_.http_minor << ' '
+             << method_name(req.method) << " " << req.url;
+
+
+            need_to_call_after_handlers_ = false;
+            if (!is_invalid_request)
+            {
+                res.complete_request_handler_ = []{};
+                res.is_alive_helper_ = [this]()->bool{ return adaptor_.is_open(); };
+                res.io_service_ = &adaptor_.get_io_service();
+
+                ctx_ = detail::context<Middlewares...>();
+                req.middleware_context = (void*)&ctx_;
+                req.io_service = &adaptor_.get_io_service();
+                detail::middleware_call_helper<0, decltype(ctx_), decltype(*middlewares_), Middlewares...>(*middlewares_, req, res, ctx_);
+
+                if (!res.completed_)
+                {
+                    res.complete_request_handler_ = [this]{ this->complete_request(); };
+                    need_to_call_after_handlers_ = true;
+                    handler_->handle(req, res);
+                    if (add_keep_alive_)
+                        res.set_header("connection", "Keep-Alive");
+                }
+                else
+                {
+                    complete_request();
+                }
+            }
+            else
+            {
+                complete_request();
+            }
+        }
+
+        void complete_request()
+        {
+            CROW_LOG_INFO << "Response: " << this << ' ' << req_.raw_url << ' ' << res.code << ' ' << close_connection_;
+
+            if (need_to_call_after_handlers_)
+            {
+                need_to_call_after_handlers_ = false;
+
+                // call all after_handler of middlewares
+                detail::after_handlers_call_helper<
+                    ((int)sizeof...(Middlewares)-1),
+                    decltype(ctx_),
+                    decltype(*middlewares_)>
+                (*middlewares_, ctx_, req_, res);
+            }
+
+            //auto self = this->shared_from_this();
+            res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
+
+            if (!adaptor_.is_open())
+            {
+                //CROW_LOG_DEBUG << this << " delete (socket is closed) " << is_reading << ' ' << is_writing;
+                // the client went away while the handler was running; nothing else refers to us
+                check_destroy();
+                return;
+            }
+
+            static std::unordered_map<int, std::string> statusCodes = {
+                {200, "HTTP/1.1 200 OK\r\n"},
+                {201, "HTTP/1.1 201 Created\r\n"},
+                {202, "HTTP/1.1 202 Accepted\r\n"},
+                {204, "HTTP/1.1 204 No Content\r\n"},
+                {208, "HTTP/1.1 208 Already Reported\r\n"},
+
+                {300, "HTTP/1.1 300 Multiple Choices\r\n"},
+                {301, "HTTP/1.1 301 Moved Permanently\r\n"},
+                {302, "HTTP/1.1 302 Moved Temporarily\r\n"},
+                {304, "HTTP/1.1 304 Not Modified\r\n"},
+
+                {400, "HTTP/1.1 400 Bad Request\r\n"},
+                {401, "HTTP/1.1 401 Unauthorized\r\n"},
+                {403, "HTTP/1.1 403 Forbidden\r\n"},
+                {404, "HTTP/1.1 404 Not Found\r\n"},
+                {405, "HTTP/1.1 405 Method Not Allowed\r\n"},
+                {408, "HTTP/1.1 408 Request Timeout\r\n"},
+
+                {410, "HTTP/1.1 410 Gone\r\n"},
+                {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+                {415, "HTTP/1.1 415 Unsupported Media Type\r\n"},
+                {422, "HTTP/1.1 422 Unprocessable Entity\r\n"},
+                {429, "HTTP/1.1 429 Too Many Requests\r\n"},
+
+                {500, "HTTP/1.1 500 Internal Server Error\r\n"},
+                {501, "HTTP/1.1 501 Not Implemented\r\n"},
+                {502, "HTTP/1.1 502 Bad Gateway\r\n"},
+                {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+            };
+
+            static std::string seperator = ": ";
+            static std::string crlf = "\r\n";
+
+            if (res.body.empty() && res.json_value.t() == json::type::Object)
+            {
+                res.body = json::dump(res.json_value);
+            }
+
+            // the body is swapped out rather than copied; both copies keep their capacity
+            // for the next response
+            boost::asio::const_buffer body;
+            if (!res.bytes.empty())
+            {
+                res_bytes_copy_.swap(res.bytes);
+                body = boost::asio::buffer(res_bytes_copy_);
+            }
+            else
+            {
+                res_body_copy_.swap(res.body);
+                body = boost::asio::buffer(res_body_copy_);
+            }
+
+            if (!statusCodes.count(res.code))
+                res.code = 500;
+            // the head goes into one buffer that is cleared, not freed, after each write
+            head_.clear();
+            head_ += statusCodes.find(res.code)->second;
+
+            if (res.code >= 400 && res.body.empty())
+                res.body = statusCodes[res.code].substr(9);
+
+            for(auto& kv : res.headers)
+            {
+                head_ += kv.first;
+                head_ += seperator;
+                head_ += kv.second;
+                head_ += crlf;
+            }
+
+            if (!res.headers.count(known_header::content_length))
+            {
+                head_ += "Content-Length: ";
+                head_ += std::to_string(boost::asio::buffer_size(body));
+                head_ += crlf;
+            }
+            if (!res.headers.count(known_header::server))
+            {
+                head_ += "Server: ";
+                head_ += server_name_;
+                head_ += crlf;
+            }
+            if (!res.headers.count(known_header::date))
+            {
+                head_ += "Date: ";
+                head_ += get_cached_date_str();
+                head_ += crlf;
+            }
+            if (add_keep_alive_)
+            {
+                head_ += "Connection: Keep-Alive";
+                head_ += crlf;
+            }
+            head_ += crlf;
+
+            buffers_[0] = boost::asio::buffer(head_);
+            buffers_[1] = body;
+
+            do_write();
+
+            if (need_to_start_read_after_complete_)
+            {
+                start_deadline();
+                // otherwise the disconnect watch starts reading when it completes
+                if (!is_watching_disconnect_)
+                {
+                    need_to_start_read_after_complete_ = false;
+                    do_read();
+                }
+            }
+        }
+
+        // HTTP/2: called by the session for every complete request. Streams are handled like
+        // HTTP/1 requests, except that any number of them can be pending at once.
+        void handle_stream(uint32_t stream_id, request&& r)
+        {
+            cancel_deadline_timer();
+            std::unique_ptr<http2_stream> owned(new http2_stream);
+            http2_stream& s = *owned;
+            http2_streams_[stream_id] = std::move(owned);
+
+            s.req = std::move(r);
+            request& req = s.req;
+            response& res = s.res;
+            req.remote_ip_address_helper_ = [this]{ return adaptor_.remote_endpoint().address().to_string(); };
+
+            CROW_LOG_INFO << "Request: " << boost::lexical_cast<std::string>(adaptor_.remote_endpoint()) << " " << this << " HTTP/2 stream " << stream_id << ' '
+             << method_name(req.method) << " " << req.url;
+
+            res.complete_request_handler_ = []{};
+            res.is_alive_helper_ = [this]()->bool{ return adaptor_.is_open(); };
+            res.io_service_ = &adaptor_.get_io_service();
+
+            req.middleware_context = (void*)&s.ctx;
+            req.io_service = &adaptor_.get_io_service();
+            detail::middleware_call_helper<0, decltype(s.ctx), decltype(*middlewares_), Middlewares...>(*middlewares_, req, res, s.ctx);
+
+            if (!res.completed_)
+            {
+                res.complete_request_handler_ = [this, stream_id]{ this->complete_http2_request(stream_id); };
+                s.need_to_call_after_handlers = true;
+                handler_->handle(req, res);
+            }
+            else
+            {
+                complete_http2_request(stream_id);
+            }
+        }
+
+        // HTTP/2: the client cancelled the stream
+        void handle_stream_reset(uint32_t stream_id)
+        {
+            auto it = http2_streams_.find(stream_id);
+            if (it == http2_streams_.end())
+                return;
+            auto handler = std::move(it->second->res.disconnect_handler_);
+            it->second->res.disconnect_handler_ = nullptr;
+            if (handler)
+                handler();
+        }
+
+        void complete_http2_request(uint32_t stream_id)
+        {
+            auto it = http2_streams_.find(stream_id);
+            if (it == http2_streams_.end())
+                return;
+            // the response may be in the middle of end(); it is freed on the next io callback
+            http2_finished_streams_.push_back(std::move(it->second));
+            http2_streams_.erase(it);
+            request& req = http2_finished_streams_.back()->req;
+            response& res = http2_finished_streams_.back()->res;
+
+            CROW_LOG_INFO << "Response: " << this << ' ' << req.raw_url << ' ' << res.code << " HTTP/2 stream " << stream_id;
+
+            if (http2_finished_streams_.back()->need_to_call_after_handlers)
+            {
+                auto& ctx = http2_finished_streams_.back()->ctx;
+                detail::after_handlers_call_helper<
+                    ((int)sizeof...(Middlewares)-1),
+                    typename std::remove_reference<decltype(ctx)>::type,
+                    decltype(*middlewares_)>
+                (*middlewares_, ctx, req, res);
+            }
+
+            res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
+
+            if (adaptor_.is_open())
+            {
+                if (res.body.empty() && res.json_value.t() == json::type::Object)
+                {
+                    res.body = json::dump(res.json_value);
+                }
+                std::string body = res.bytes.empty() ? std::move(res.body) : std::string(res.bytes.begin(), res.bytes.end());
+
+                http2::hpack::header_list headers;
+                headers.reserve(res.headers.size() + 3);
+                for(auto& kv : res.headers)
+                    headers.emplace_back(kv.first, kv.second);
+                if (!res.headers.count(known_header::content_length))
+                    headers.emplace_back("content-length", std::to_string(body.size()));
+                if (!res.headers.count(known_header::server))
+                    headers.emplace_back("server", server_name_);
+                if (!res.headers.count(known_header::date))
+                    headers.emplace_back("date", get_cached_date_str());
+                if (req.method == HTTPMethod::Head)
+                    body.clear();
+
+                http2_->submit_response(stream_id, res.code, headers, std::move(body));
+                flush_http2();
+                if (http2_streams_.empty() && is_reading)
+                    start_deadline();
+            }
+
+            check_destroy();
+        }
+
+    private:
+        void do_read()
+        {
+            //auto self = this->shared_from_this();
+            is_reading = true;
+            auto space = parser_.prepare();
+            const char* data = boost::asio::buffer_cast<const char*>(space);
+            adaptor_.socket().async_read_some(space, detail::make_arena_handler(handler_arena_,
+                [this, data](const boost::system::error_code& ec, std::size_t bytes_transferred)
+                {
+                    if (!ec && is_first_read_ && is_http2_preface(data, bytes_transferred))
+                    {
+                        // HTTP/2 with prior knowledge
+                        http2_.reset(new http2::session<Connection>(this));
+                        http2_->start();
+                        on_http2_read(data, bytes_transferred);
+                        return;
+                    }
+                    is_first_read_ = false;
+
+                    bool error_while_reading = true;
+                    if (!ec)
+                    {
+                        bool ret = parser_.commit(bytes_transferred);
+                        if (http2_)
+                        {
+                            // upgraded to h2c; whatever followed the request is HTTP/2 already
+                            on_http2_read(data + parser_.parsed_length, bytes_transferred - parser_.parsed_length);
+                            return;
+                        }
+                        if (ret && adaptor_.is_open())
+                        {
+                            error_while_reading = false;
+                        }
+                    }
+
+                    if (error_while_reading)
+                    {
+                        cancel_deadline_timer();
+                        parser_.done();
+                        adaptor_.close();
+                        is_reading = false;
+                        CROW_LOG_DEBUG << this << " from read(1)";
+                        check_destroy();
+                    }
+                    else if (close_connection_)
+                    {
+                        cancel_deadline_timer();
+                        parser_.done();
+                        is_reading = false;
+                        check_destroy();
+                        // adaptor will close after write
+                    }
+                    else if (!need_to_call_after_handlers_)
+                    {
+                        start_deadline();
+                        do_read();
+                    }
+                    else
+                    {
+                        // res will be completed later by user
+                        need_to_start_read_after_complete_ = true;
+                        watch_disconnect();
+                    }
+                }));
+        }
+
+        // Nothing reads from the socket while a handler is completing the response
+        // asynchronously, so watch it to tell the handler when the client goes away.
+        void watch_disconnect()
+        {
+            is_watching_disconnect_ = true;
+            adaptor_.wait_readable(
+                [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                {
+                    is_watching_disconnect_ = false;
+                    if (need_to_call_after_handlers_)
+                    {
+                        boost::system::error_code available_ec;
+                        if (!ec && adaptor_.raw_socket().available(available_ec) && !available_ec)
+                        {
+                            // pipelined request; read after the response is completed
+                            return;
+                        }
+
+                        CROW_LOG_DEBUG << this << " client disconnected before the response was completed";
+                        is_reading = false;
+                        adaptor_.close();
+
+                        // the handler may complete the response (and so destroy us) right away
+                        auto handler = std::move(res.disconnect_handler_);
+                        res.disconnect_handler_ = nullptr;
+                        if (handler)
+                            handler();
+                    }
+                    else if (need_to_start_read_after_complete_)
+                    {
+                        need_to_start_read_after_complete_ = false;
+                        do_read();
+                    }
+                });
+        }
+
+        void do_write()
+        {
+            //auto self = this->shared_from_this();
+            is_writing = true;
+            boost::asio::async_write(adaptor_.socket(), buffers_, detail::make_arena_handler(handler_arena_,
+                [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                {
+                    is_writing = false;
+                    res.clear();
+                    res_body_copy_.clear();
+                    res_bytes_copy_.clear();
+                    if (http2_)
+                    {
+                        // the 100 Continue of an h2c upgrade request; frames may be queued behind it
+                        flush_http2();
+                        check_destroy();
+                        return;
+                    }
+                    if (!ec)
+                    {
+                        if (close_connection_)
+                        {
+                            adaptor_.close();
+                            CROW_LOG_DEBUG << this << " from write(1)";
+                            check_destroy();
+                        }
+                    }
+                    else
+                    {
+                        CROW_LOG_DEBUG << this << " from write(2)";
+                        check_destroy();
+                    }
+                }));
+        }
+
+        bool is_http2_preface(const char* data, std::size_t size)
+        {
+            // "PRI " alone already rules out every HTTP/1 method
+            if (size < 4)
+                return false;
+            std::size_t n = std::min(size, http2::client_preface_size);
+            return std::equal(data, data + n, http2::client_preface);
+        }
+
+        bool start_http2_upgrade()
+        {
+            http2_.reset(new http2::session<Connection>(this));
+            if (!http2_->upgrade(req_.get_header_value(known_header::http2_settings)))
+            {
+                http2_.reset();
+                return false;
+            }
+            // whatever follows the request is HTTP/2; stop the parser right after it
+            http_parser_pause(&parser_, 1);
+
+            // written on its own: some clients cannot take much data following the 101 in one read
+            http2_->output() = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+            http2_->start();
+            flush_http2();
+
+            handle_stream(1, std::move(req_));
+            return true;
+        }
+
+        void on_http2_read(const char* data, std::size_t size)
+        {
+            if (http2_->feed(data, size) && !http2_->is_finished())
+            {
+                if (http2_streams_.empty())
+                    start_deadline();
+                flush_http2();
+                do_read_http2();
+                return;
+            }
+
+            // a GOAWAY, if any, is written before the socket is closed
+            cancel_deadline_timer();
+            close_connection_ = true;
+            flush_http2();
+            notify_http2_disconnect();
+            is_reading = false;
+            check_destroy();
+        }
+
+        void do_read_http2()
+        {
+            is_reading = true;
+            adaptor_.socket().async_read_some(boost::asio::buffer(buffer_), detail::make_arena_handler(handler_arena_,
+                [this](const boost::system::error_code& ec, std::size_t bytes_transferred)
+                {
+                    http2_finished_streams_.clear();
+                    if (!ec && adaptor_.is_open())
+                    {
+                        on_http2_read(buffer_.data(), bytes_transferred);
+                        return;
+                    }
+
+                    cancel_deadline_timer();
+                    adaptor_.close();
+                    // still reading as far as check_destroy is concerned, so a handler ending
+                    // its response from the disconnect handler cannot delete us here
+                    notify_http2_disconnect();
+                    is_reading = false;
+                    CROW_LOG_DEBUG << this << " from read(http2)";
+                    check_destroy();
+                }));
+        }
+
+        void notify_http2_disconnect()
+        {
+            std::vector<uint32_t> stream_ids;
+            for(auto& kv : http2_streams_)
+                stream_ids.push_back(kv.first);
+            for(auto stream_id : stream_ids)
+                handle_stream_reset(stream_id);
+        }
+
+        // one write in flight at a time; frames queued meanwhile go out when it completes
+        void flush_http2()
+        {
+            if (is_writing)
+                return;
+            if (http2_->output().empty())
+            {
+                if (close_connection_)
+                    adaptor_.close();
+                return;
+            }
+
+            is_writing = true;
+            http2_write_buffer_.clear();
+            http2_write_buffer_.swap(http2_->output());
+            boost::asio::async_write(adaptor_.socket(), boost::asio::buffer(http2_write_buffer_), detail::make_arena_handler(handler_arena_,
+                [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                {
+                    is_writing = false;
+                    http2_finished_streams_.clear();
+                    if (ec)
+                    {
+                        adaptor_.close();
+                        CROW_LOG_DEBUG << this << " from write(http2)";
+                        check_destroy();
+                        return;
+                    }
+                    flush_http2();
+                    check_destroy();
+                }));
+        }
+
+        void check_destroy()
+        {
+            CROW_LOG_DEBUG << this << " is_reading " << is_reading << " is_writing " << is_writing;
+            if (!is_reading && !is_writing && http2_streams_.empty())
+            {
+                CROW_LOG_DEBUG << this << " delete (idle) ";
+                delete this;
+            }
+        }
+
+        void cancel_deadline_timer()
+        {
+            CROW_LOG_DEBUG << this << " timer cancelled: " << timer_cancel_key_.first << ' ' << timer_cancel_key_.second;
+            timer_queue.cancel(timer_cancel_key_);
+        }
+
+        void start_deadline(/*int timeout = 5*/)
+        {
+            cancel_deadline_timer();
+
+            timer_cancel_key_ = timer_queue.add([this]
+            {
+                if (!adaptor_.is_open())
+                {
+                    return;
+                }
+                adaptor_.close();
+            });
+            CROW_LOG_DEBUG << this << " timer added: " << timer_cancel_key_.first << ' ' << timer_cancel_key_.second;
+        }
+
+    private:
+        Adaptor adaptor_;
+        Handler* handler_;
+
+        // HTTP/1 reads go to the parser's buffer; this one is for HTTP/2
+        boost::array<char, 4096> buffer_;
+
+        HTTPParser<Connection> parser_;
+        request req_;
+        response res;
+
+        bool close_connection_ = false;
+
+        const std::string& server_name_;
+        // the response head and body, or a 100 Continue
+        std::array<boost::asio::const_buffer, 2> buffers_;
+
+        std::string head_;
+        std::string res_body_copy_;
+        std::vector<char> res_bytes_copy_;
+
+        // memory for the read and write operations above
+        detail::handler_arena handler_arena_;
+
+        //boost::asio::deadline_timer deadline_;
+        detail::dumb_timer_queue::key timer_cancel_key_;
+
+        bool is_reading{};
+        bool is_writing{};
+        bool need_to_call_after_handlers_{};
+        bool need_to_start_read_after_complete_{};
+        bool is_watching_disconnect_{};
+        bool add_keep_alive_{};
+
+        std::tuple<Middlewares...>* middlewares_;
+        detail::context<Middlewares...> ctx_;
+
+        struct http2_stream
+        {
+            request req;
+            response res;
+            detail::context<Middlewares...> ctx;
+            bool need_to_call_after_handlers{};
+        };
+
+        bool is_first_read_{true};
+        std::unique_ptr<http2::session<Connection>> http2_;
+        std::map<uint32_t, std::unique_ptr<http2_stream>> http2_streams_;
+        std::vector<std::unique_ptr<http2_stream>> http2_finished_streams_;
+        std::string http2_write_buffer_;
+
+        std::function<const std::string&()>& get_cached_date_str;
+        detail::dumb_timer_queue& timer_queue;
+    };
+
+}
+
+
+
+#pragma once
+
+#include <chrono>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/asio.hpp>
+#ifdef CROW_ENABLE_SSL
+#include <boost/asio/ssl.hpp>
+#endif
+#include <cstdint>
+#include <atomic>
+#include <future>
+#include <vector>
+
+#include <memory>
+
+
+
+
+
+
+
+
+namespace crow
+{
+    using namespace boost;
+    using tcp = asio::ip::tcp;
+
+    template <typename Handler, typename Adaptor = SocketAdaptor, typename ... Middlewares>
+    class Server
+    {
+    public:
+    Server(Handler* handler, const std::string &bindaddr, uint16_t port,
+           std::tuple<Middlewares...>* middlewares = nullptr, uint16_t concurrency = 1,
+           typename Adaptor::context* adaptor_ctx = nullptr)
+            : acceptor_(io_service_, tcp::endpoint(boost::asio::ip::address::from_string(bindaddr), port)),
+            signals_(io_service_, SIGINT, SIGTERM),
+            tick_timer_(io_service_),
+            handler_(handler),
+            concurrency_(concurrency),
+            port_(port),
+            bindaddr_(bindaddr),
+            middlewares_(middlewares),
+            adaptor_ctx_(adaptor_ctx)
+        {
+        }
+
+        void set_tick_function(std::chrono::milliseconds d, std::function<void()> f)
+        {
+            tick_interval_ = d;
+            tick_function_ = f;
+        }
+
+        void on_tick()
+        {
+            tick_function_();
+            tick_timer_.expires_from_now(boost::posix_time::milliseconds(tick_interval_.count()));
+            tick_timer_.async_wait([this](const boost::system::error_code& ec)
+                    {
+                        if (ec)
+                            return;
+                        on_tick();
+                    });
+        }
+
+        void run()
+        {
+            for(int i = 0; i < concurrency_;  i++)
+                io_service_pool_.emplace_back(new boost::asio::io_service());
+            get_cached_date_str_pool_.resize(concurrency_);
+            timer_queue_pool_.resize(concurrency_);
+
+            std::vector<std::future<void>> v;
+            std::atomic<int> init_count(0);
+            for(uint16_t i = 0; i < concurrency_; i ++)
+                v.push_back(
+                        std::async(std::launch::async, [this, i, &init_count]{
+
+                            // thread local date string get function
+                            auto last = std::chrono::steady_clock::now();
+
+                            std::string date_str;
+                            auto update_date_str = [&]
+                            {
+                                auto last_time_t = time(0);
+                                tm my_tm;
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+                                gmtime_s(&my_tm, &last_time_t);
+#else
+                                gmtime_r(&last_time_t, &my_tm);
+#endif
+                                date_str.resize(100);
+                                size_t date_str_sz = strftime(&date_str[0], 99, "%a, %d %b %Y %H:%M:%S GMT", &my_tm);
+                                date_str.resize(date_str_sz);
+                            };
+                            update_date_str();
+                            get_cached_date_str_pool_[i] = [&]()->const std::string&
+                            {
+                                if (std::chrono::steady_clock::now() - last >= std::chrono::seconds(1))
+                                {
+                                    last = std::chrono::steady_clock::now();
+                                    update_date_str();
+                                }
+                                return date_str;
+                            };
+
+                            // initializing timer queue
+                            detail::dumb_timer_queue timer_queue;
+                            timer_queue_pool_[i] = &timer_queue;
+
+                            timer_queue.set_io_service(*io_service_pool_[i]);
+                            boost::asio::deadline_timer timer(*io_service_pool_[i]);
+                            timer.expires_from_now(boost::posix_time::seconds(1));
+
+                            std::function<void(const boost::system::error_code& ec)> handler;
+                            handler = [&](const boost::system::error_code& ec){
+                                if (ec)
+                                    return;
+                                timer_queue.process();
+                                timer.expires_from_now(boost::posix_time::seconds(1));
+                                timer.async_wait(handler);
+                            };
+                            timer.async_wait(handler);
+
+                            init_count ++;
+                            while(1)
+                            {
+                                try 
+                                {
+                                    if (io_service_pool_[i]->run() == 0)
+                                    {
+                                        // when io_service.run returns 0, there are no more works to do.
+                                        break;
+                                    }
+                                } catch(std::exception& e)
+                                {
+                                    CROW_LOG_ERROR << "Worker Crash: An uncaught exception occurred: " << e.what();
+                                }
+                            }
+                        }));
+
+            if (tick_function_ && tick_interval_.count() > 0) 
+            {
+                tick_timer_.expires_from_now(boost::posix_time::milliseconds(tick_interval_.count()));
+                tick_timer_.async_wait([this](const boost::system::error_code& ec)
+                        {
+                            if (ec)
+                                return;
+                            on_tick();
+                        });
+            }
+
+            CROW_LOG_INFO << server_name_ << " server is running at " << bindaddr_ <<":" << port_
+                          << " using " << concurrency_ << " threads";
+            CROW_LOG_INFO << "Call `app.loglevel(crow::LogLevel::Warning)` to hide Info level logs.";
+
+            signals_.async_wait(
+                [&](const boost::system::error_code& /*error*/, int /*signal_number*/){
+                    stop();
+                });
+
+            while(concurrency_ != init_count)
+                std::this_thread::yield();
+
+            do_accept();
+
+            std::thread([this]{
+                io_service_.run();
+                CROW_LOG_INFO << "Exiting.";
+            }).join();
+        }
+
+        void stop()
+        {
+            io_service_.stop();
+            for(auto& io_service:io_service_pool_)
+                io_service->stop();
+        }
+
+    private:
+        asio::io_service& pick_io_service()
+        {
+            // TODO load balancing
+            roundrobin_index_++;
+            if (roundrobin_index_ >= io_service_pool_.size())
+                roundrobin_index_ = 0;
+            return *io_service_pool_[roundrobin_index_];
+        }
+
+        void do_accept()
+        {
+            asio::io_service& is = pick_io_service();
+            auto p = new Connection<Adaptor, Handler, Middlewares...>(
+                is, handler_, server_name_, middlewares_,
+                get_cached_date_str_pool_[roundrobin_index_], *timer_queue_pool_[roundrobin_index_],
+                adaptor_ctx_);
+            acceptor_.async_accept(p->socket(),
+                [this, p, &is](boost::system::error_code ec)
+                {
+                    if (!ec)
+                    {
+                        is.post([p]
+                        {
+                            p->start();
+                        });
+                    }
+                    else
+                    {
+                        delete p;
+                    }
+                    do_accept();
+                });
+        }
+
+    private:
+        asio::io_service io_service_;
+        std::vector<std::unique_ptr<asio::io_service>> io_service_pool_;
+        std::vector<detail::dumb_timer_queue*> timer_queue_pool_;
+        std::vector<std::function<const std::string&()>> get_cached_date_str_pool_;
+        tcp::acceptor acceptor_;
+        boost::asio::signal_set signals_;
+        boost::asio::deadline_timer tick_timer_;
+
+        Handler* handler_;
+        uint16_t concurrency_{1};
+        std::string server_name_ = "Crow/0.1";
+        uint16_t port_;
+        std::string bindaddr_;
+        unsigned int roundrobin_index_{};
+
+        std::chrono::milliseconds tick_interval_;
+        std::function<void()> tick_function_;
+
+        std::tuple<Middlewares...>* middlewares_;
+
+#ifdef CROW_ENABLE_SSL
+        bool use_ssl_{false};
+        boost::asio::ssl::context ssl_context_{boost::asio::ssl::context::sslv23};
+#endif
+        typename Adaptor::context* adaptor_ctx_;
+    };
+}
+
+
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <functional>
+#include <memory>
+#include <future>
+#include <cstdint>
+#include <type_traits>
+#include <thread>
+#include <condition_variable>
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#ifdef CROW_MSVC_WORKAROUND
+#define CROW_ROUTE(app, url) app.route_dynamic(url)
+#else
+#define CROW_ROUTE(app, url) app.route<crow::black_magic::get_parameter_tag(url)>(url)
+#endif
+
+namespace crow
+{
+#ifdef CROW_ENABLE_SSL
+    using ssl_context_t = boost::asio::ssl::context;
+#endif
+    template <typename ... Middlewares>
+    class Crow
+    {
+    public:
+        using self_t = Crow;
+        using server_t = Server<Crow, SocketAdaptor, Middlewares...>;
+#ifdef CROW_ENABLE_SSL
+        using ssl_server_t = Server<Crow, SSLAdaptor, Middlewares...>;
+#endif
+        Crow()
+        {
+        }
+
+		template <typename Adaptor> 
+        void handle_upgrade(const request& req, response& res, Adaptor&& adaptor)
+        {
+            router_.handle_upgrade(req, res, adaptor);
+        }
+
+        void handle(const request& req, response& res)
+        {
+            router_.handle(req, res);
+        }
+
+        DynamicRule& route_dynamic(std::string&& rule)
+        {
+            return router_.new_rule_dynamic(std::move(rule));
+        }
+
+        /*
+          The following fix (using C++14 auto return type feature) circumvents a GCC 8.1+8.2
+          compiler error similar to:
+
+            crow/app.h: In instantiation of ‘typename std::result_of<decltype (& crow::Router::new_rule_tagged<Tag>)(crow::Router, std::__cxx11::basic_string<char>&&)>::type crow::Crow<Middlewares>::route(std::__cxx11::string&&) [with long unsigned int Tag = 2; Middlewares = {}]’:
+            crow/app.h:63:14: internal compiler error: in write_expression, at cp/mangle.c:3050
+
+          Note that Router::new_rule_tagged() returns a reference which is why we use "auto&".
+        */
+        template <uint64_t Tag>
+        auto &route(std::string &&rule)
+        {
+            return router_.new_rule_tagged<Tag>(std::move(rule));
+        }
+
+        self_t& port(std::uint16_t port)
+        {
+            port_ = port;
+            return *this;
+        }
+
+        self_t& bindaddr(const std::string &bindaddr)
+        {
+            bindaddr_ = bindaddr;
+            return *this;
+        }
+
+        self_t& multithreaded()
+        {
+            return concurrency(std::thread::hardware_concurrency());
+        }
+
+        self_t& concurrency(std::uint16_t concurrency)
+        {
+            if (concurrency < 1)
+                concurrency = 1;
+            concurrency_ = concurrency;
+            return *this;
+        }
+
+        // Publishes the routes; run() calls it. Routes added while the server is running take
+        // effect when it is called again.
+        void validate()
+        {
+            router_.validate();
+        }
+
+        // Stops serving `rule' (as passed to CROW_ROUTE); false if there was no such route.
+        bool remove_route(const std::string& rule)
+        {
+            return router_.remove_rule(rule);
+        }
+
+        void notify_server_start()
+        {
+            std::unique_lock<std::mutex> lock(start_mutex_);
+            server_started_ = true;
+            cv_started_.notify_all();
+        }
+
+        void run()
+        {
+            validate();
+#ifdef CROW_ENABLE_SSL
+            if (use_ssl_)
+            {
+                ssl_server_ = std::move(std::unique_ptr<ssl_server_t>(new ssl_server_t(this, bindaddr_, port_, &middlewares_, concurrency_, &ssl_context_)));
+                ssl_server_->set_tick_function(tick_interval_, tick_function_);
+                notify_server_start();
+                ssl_server_->run();
+            }
+            else
+#endif
+            {
+                server_ = std::move(std::unique_ptr<server_t>(new server_t(this, bindaddr_, port_, &middlewares_, concurrency_, nullptr)));
+                server_->set_tick_function(tick_interval_, tick_function_);
+                notify_server_start();
+                server_->run();
+            }
+        }
+
+        void stop()
+        {
+#ifdef CROW_ENABLE_SSL
+            if (use_ssl_)
+            {
+		if (ssl_server_) {
+                    ssl_server_->stop();
+		}
+            }
+            else
+#endif
+            {
+		if (server_) {
+                    server_->stop();
+		}
+            }
+        }
+
+        void debug_print()
+        {
+            CROW_LOG_DEBUG << "Routing:";
+            router_.debug_print();
+        }
+
+        self_t& loglevel(crow::LogLevel level)
+        {
+            crow::logger::setLogLevel(level);
+            return *this;
+        }
+
+#ifdef CROW_ENABLE_SSL
+        self_t& ssl_file(const std::string& crt_filename, const std::string& key_filename)
+        {
+            use_ssl_ = true;
+            ssl_context_.set_verify_mode(boost::asio::ssl::verify_peer);
+            ssl_context_.use_certificate_file(crt_filename, ssl_context_t::pem);
+            ssl_context_.use_private_key_file(key_filename, ssl_context_t::pem);
+            ssl_context_.set_options(
+                    boost::asio::ssl::context::default_workarounds
+                          | boost::asio::ssl::context::no_sslv2
+                          | boost::asio::ssl::context::no_sslv3
+                    );
+            return *this;
+        }
+
+        self_t& ssl_file(const std::string& pem_filename)
+        {
+            use_ssl_ = true;
+            ssl_context_.set_verify_mode(boost::asio::ssl::verify_peer);
+            ssl_context_.load_verify_file(pem_filename);
+            ssl_context_.set_options(
+                    boost::asio::ssl::context::default_workarounds
+                          | boost::asio::ssl::context::no_sslv2
+                          | boost::asio::ssl::context::no_sslv3
+                    );
+            return *this;
+        }
+
+        self_t& ssl(boost::asio::ssl::context&& ctx)
+        {
+            use_ssl_ = true;
+            ssl_context_ = std::move(ctx);
+            return *this;
+        }
+
+
+        bool use_ssl_{false};
+        ssl_context_t ssl_context_{boost::asio::ssl::context::sslv23};
+
+#else
+        template <typename T, typename ... Remain>
+        self_t& ssl_file(T&&, Remain&&...)
+        {
+            // We can't call .ssl() member function unless CROW_ENABLE_SSL is defined.
+            static_assert(
+                    // make static_assert dependent to T; always false
+                    std::is_base_of<T, void>::value,
+                    "Define CROW_ENABLE_SSL to enable ssl support.");
+            return *this;
+        }
+
+        template <typename T>
+        self_t& ssl(T&&)
+        {
+            // We can't call .ssl() member function unless CROW_ENABLE_SSL is defined.
+            static_assert(
+                    // make static_assert dependent to T; always false
+                    std::is_base_of<T, void>::value,
+                    "Define CROW_ENABLE_SSL to enable ssl support.");
+            return *this;
+        }
+#endif
+
+        // middleware
+        using context_t = detail::context<Middlewares...>;
+        template <typename T>
+        typename T::context& get_context(const request& req)
+        {
+            static_assert(black_magic::contains<T, Middlewares...>::value, "App doesn't have the specified middleware type.");
+            auto& ctx = *reinterpret_cast<context_t*>(req.middleware_context);
+            return ctx.template get<T>();
+        }
+
+        template <typename T>
+        T& get_middleware()
+        {
+            return utility::get_element_by_type<T, Middlewares...>(middlewares_);
+        }
+
+        template <typename Duration, typename Func>
+        self_t& tick(Duration d, Func f) {
+            tick_interval_ = std::chrono::duration_cast<std::chrono::milliseconds>(d);
+            tick_function_ = f;
+            return *this;
+        }
+
+        void wait_for_server_start()
+        {
+            std::unique_lock<std::mutex> lock(start_mutex_);
+            if (server_started_)
+                return;
+            cv_started_.wait(lock);
+        }
+
+    private:
+        uint16_t port_ = 80;
+        uint16_t concurrency_ = 1;
+        std::string bindaddr_ = "0.0.0.0";
+        Router router_;
+
+        std::chrono::milliseconds tick_interval_;
+        std::function<void()> tick_function_;
+
+        std::tuple<Middlewares...> middlewares_;
+
+#ifdef CROW_ENABLE_SSL
+        std::unique_ptr<ssl_server_t> ssl_server_;
+#endif
+        std::unique_ptr<server_t> server_;
+
+        bool server_started_{false};
+        std::condition_variable cv_started_;
+        std::mutex start_mutex_;
+    };
+    template <typename ... Middlewares>
+    using App = Crow<Middlewares...>;
+    using SimpleApp = Crow<>;
+}
+
+
+
+#pragma once
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
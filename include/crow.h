@@ -15,7 +15,9 @@
 #include "crow/websocket.h"
 #include "crow/parser.h"
 #include "crow/http_response.h"
+#include "crow/http2.h"
 #include "crow/middleware.h"
+#include "crow/coroutine.h"
 #include "crow/routing.h"
 #include "crow/middleware_context.h"
 #include "crow/http_connection.h"
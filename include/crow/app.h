@@ -99,11 +99,19 @@ namespace crow
             return *this;
         }
 
+        // Publishes the routes; run() calls it. Routes added while the server is running take
+        // effect when it is called again.
         void validate()
         {
             router_.validate();
         }
 
+        // Stops serving `rule' (as passed to CROW_ROUTE); false if there was no such route.
+        bool remove_route(const std::string& rule)
+        {
+            return router_.remove_rule(rule);
+        }
+
         void notify_server_start()
         {
             std::unique_lock<std::mutex> lock(start_mutex_);
@@ -1,34 +1,463 @@
 #pragma once
 
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/functional/hash.hpp>
-#include <unordered_map>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <boost/utility/string_ref.hpp>
 
 namespace crow
 {
-    struct ci_hash
+    namespace detail
     {
-        size_t operator()(const std::string& key) const
+        // Header names are ASCII; folding case by hand avoids going through std::locale.
+        inline bool iequals_ascii(const char* a, const char* b, size_t size)
         {
-            std::size_t seed = 0;
-            std::locale locale;
+            for(size_t i = 0; i < size; i ++)
+            {
+                char x = a[i], y = b[i];
+                if (x != y && ((x | 0x20) != (y | 0x20) || (unsigned char)((x | 0x20) - 'a') > 'z' - 'a'))
+                    return false;
+            }
+            return true;
+        }
 
-            for(auto c : key)
+        inline char to_lower_ascii(char c)
+        {
+            return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+        }
+
+        inline void assign_string(std::string& s, boost::string_ref v)
+        {
+            s.assign(v.data(), v.size());
+        }
+
+        // only a std::string rvalue is moved; everything else is copied into the existing buffer
+        template <typename T>
+        typename std::enable_if<std::is_same<T, std::string>::value>::type assign_string(std::string& s, T&& v)
+        {
+            s = std::move(v);
+        }
+    }
+
+    // Headers the server itself reads. ci_map remembers where the first of each is, so
+    // finding one is an array read instead of a search.
+    enum class known_header : uint8_t
+    {
+        connection,
+        host,
+        expect,
+        upgrade,
+        content_length,
+        server,
+        date,
+        cookie,
+        http2_settings,
+        none
+    };
+
+    namespace detail
+    {
+        constexpr size_t known_header_count = static_cast<size_t>(known_header::none);
+
+        inline known_header classify_header(boost::string_ref name)
+        {
+            auto is = [&](const char* s){ return iequals_ascii(name.data(), s, name.size()); };
+            switch(name.size())
             {
-                boost::hash_combine(seed, std::toupper(c, locale));
+                case 4:
+                    if (is("host")) return known_header::host;
+                    if (is("date")) return known_header::date;
+                    break;
+                case 6:
+                    if (is("expect")) return known_header::expect;
+                    if (is("server")) return known_header::server;
+                    if (is("cookie")) return known_header::cookie;
+                    break;
+                case 7:
+                    if (is("upgrade")) return known_header::upgrade;
+                    break;
+                case 10:
+                    if (is("connection")) return known_header::connection;
+                    break;
+                case 14:
+                    if (is("content-length")) return known_header::content_length;
+                    if (is("http2-settings")) return known_header::http2_settings;
+                    break;
             }
+            return known_header::none;
+        }
+    }
 
+    struct ci_hash
+    {
+        size_t operator()(boost::string_ref key) const
+        {
+            // FNV-1a over the lower case bytes
+            size_t seed = 2166136261u;
+            for(auto c : key)
+            {
+                seed ^= (unsigned char)detail::to_lower_ascii(c);
+                seed *= 16777619u;
+            }
             return seed;
         }
     };
 
     struct ci_key_eq
     {
-        bool operator()(const std::string& l, const std::string& r) const
+        bool operator()(boost::string_ref l, boost::string_ref r) const
         {
-            return boost::iequals(l, r);
+            return l.size() == r.size() && detail::iequals_ascii(l.data(), r.data(), l.size());
         }
     };
 
-    using ci_map = std::unordered_multimap<std::string, std::string, ci_hash, ci_key_eq>;
+    namespace detail
+    {
+        // Walks the entries of a ci_map that share the key of the one it starts at, skipping
+        // the others in between.
+        template <typename T>
+        class ci_key_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = typename std::remove_const<T>::type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+
+            ci_key_iterator() = default;
+
+            ci_key_iterator(T* pos, T* end)
+                : pos_(pos), end_(end), key_(pos != end ? &pos->first : nullptr)
+            {
+            }
+
+            template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+            ci_key_iterator(const ci_key_iterator<U>& other)
+                : pos_(other.pos_), end_(other.end_), key_(other.key_)
+            {
+            }
+
+            reference operator*() const { return *pos_; }
+            pointer operator->() const { return pos_; }
+
+            ci_key_iterator& operator++()
+            {
+                while(++ pos_ != end_ && !ci_key_eq()(pos_->first, *key_))
+                    ;
+                return *this;
+            }
+
+            ci_key_iterator operator++(int)
+            {
+                ci_key_iterator it = *this;
+                ++ *this;
+                return it;
+            }
+
+            bool operator==(const ci_key_iterator& other) const { return pos_ == other.pos_; }
+            bool operator!=(const ci_key_iterator& other) const { return pos_ != other.pos_; }
+
+        private:
+            template <typename U>
+            friend class ci_key_iterator;
+
+            T* pos_{};
+            T* end_{};
+            // the first entry's key; the one passed to equal_range may not outlive the range
+            const std::string* key_{};
+        };
+    }
+
+    // Case-insensitive multimap for headers. Entries live in one array, inline up to
+    // `inline_capacity', in insertion order, and are found by a linear search; a request
+    // only carries a dozen or two of them. The known_header ones are found directly.
+    // Inserting never moves the entries already there unless the array has to grow, so
+    // building a map is linear; equal_range skips over whatever lies between equal keys.
+    // Erasing and growing do move entries, so references into the map last until the
+    // next change to it.
+    // clear() keeps both the array and the strings in it, so a connection refilling the
+    // same map for every request stops allocating once it has seen its largest one.
+    class ci_map
+    {
+    public:
+        using key_type = std::string;
+        using mapped_type = std::string;
+        using value_type = std::pair<std::string, std::string>;
+        using size_type = size_t;
+        using iterator = value_type*;
+        using const_iterator = const value_type*;
+        using key_iterator = detail::ci_key_iterator<value_type>;
+        using const_key_iterator = detail::ci_key_iterator<const value_type>;
+
+        static constexpr size_t inline_capacity = 16;
+
+        ci_map()
+        {
+        }
+
+        ci_map(std::initializer_list<value_type> init)
+        {
+            for(auto& kv : init)
+                emplace(kv.first, kv.second);
+        }
+
+        ci_map(const ci_map& other)
+        {
+            for(auto& kv : other)
+                emplace_back(kv.first, kv.second);
+        }
+
+        ci_map(ci_map&& other)
+        {
+            steal(other);
+        }
+
+        ci_map& operator = (const ci_map& other)
+        {
+            if (this != &other)
+            {
+                clear();
+                for(auto& kv : other)
+                    emplace_back(kv.first, kv.second);
+            }
+            return *this;
+        }
+
+        ci_map& operator = (ci_map&& other)
+        {
+            if (this != &other)
+            {
+                release();
+                steal(other);
+            }
+            return *this;
+        }
+
+        ~ci_map()
+        {
+            release();
+        }
+
+        iterator begin() { return data_; }
+        iterator end() { return data_ + size_; }
+        const_iterator begin() const { return data_; }
+        const_iterator end() const { return data_ + size_; }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        void clear()
+        {
+            size_ = 0;
+            std::fill(std::begin(known_), std::end(known_), 0);
+        }
+
+        // Adds an entry at the end
+        template <typename Key, typename Value>
+        iterator emplace(Key&& key, Value&& value)
+        {
+            emplace_back(std::forward<Key>(key), std::forward<Value>(value));
+            return data_ + size_ - 1;
+        }
+
+        iterator insert(const value_type& kv)
+        {
+            return emplace(kv.first, kv.second);
+        }
+
+        iterator find(boost::string_ref key)
+        {
+            for(size_t i = 0; i < size_; i ++)
+            {
+                if (key_equal(data_[i].first, key))
+                    return data_ + i;
+            }
+            return end();
+        }
+
+        const_iterator find(boost::string_ref key) const
+        {
+            return const_cast<ci_map*>(this)->find(key);
+        }
+
+        iterator find(known_header key)
+        {
+            size_t pos = known_[static_cast<size_t>(key)];
+            return pos ? data_ + pos - 1 : end();
+        }
+
+        const_iterator find(known_header key) const
+        {
+            return const_cast<ci_map*>(this)->find(key);
+        }
+
+        std::pair<key_iterator, key_iterator> equal_range(boost::string_ref key)
+        {
+            return {key_iterator(find(key), end()), key_iterator(end(), end())};
+        }
+
+        std::pair<key_iterator, key_iterator> equal_range(known_header key)
+        {
+            return {key_iterator(find(key), end()), key_iterator(end(), end())};
+        }
+
+        std::pair<const_key_iterator, const_key_iterator> equal_range(boost::string_ref key) const
+        {
+            return {const_key_iterator(find(key), end()), const_key_iterator(end(), end())};
+        }
+
+        std::pair<const_key_iterator, const_key_iterator> equal_range(known_header key) const
+        {
+            return {const_key_iterator(find(key), end()), const_key_iterator(end(), end())};
+        }
+
+        size_t count(boost::string_ref key) const
+        {
+            auto r = equal_range(key);
+            return std::distance(r.first, r.second);
+        }
+
+        size_t count(known_header key) const
+        {
+            auto r = equal_range(key);
+            return std::distance(r.first, r.second);
+        }
+
+        size_t erase(boost::string_ref key)
+        {
+            size_t kept = find(key) - data_;
+            if (kept == size_)
+                return 0;
+            // key may point into one of the entries swapped around below
+            const std::string k(key.data(), key.size());
+            // swapping the erased entries past the end keeps their strings for reuse, as clear() does
+            for(size_t i = kept + 1; i < size_; i ++)
+            {
+                if (!key_equal(data_[i].first, k))
+                    std::swap(data_[kept ++], data_[i]);
+            }
+            size_t n = size_ - kept;
+            size_ = kept;
+            reindex();
+            return n;
+        }
+
+        iterator erase(const_iterator pos)
+        {
+            iterator it = data_ + (pos - data_);
+            std::rotate(it, it + 1, end());
+            size_ --;
+            reindex();
+            return it;
+        }
+
+    private:
+        static bool key_equal(boost::string_ref l, boost::string_ref r)
+        {
+            return ci_key_eq()(l, r);
+        }
+
+        template <typename Key, typename Value>
+        void emplace_back(Key&& key, Value&& value)
+        {
+            if (size_ == constructed_)
+            {
+                if (constructed_ == capacity_)
+                    grow();
+                new (data_ + constructed_) value_type();
+                constructed_ ++;
+            }
+            value_type& kv = data_[size_];
+            detail::assign_string(kv.first, std::forward<Key>(key));
+            detail::assign_string(kv.second, std::forward<Value>(value));
+            size_ ++;
+            note_known(size_ - 1);
+        }
+
+        // Records entry i if it is the first of a known header
+        void note_known(size_t i)
+        {
+            known_header h = detail::classify_header(data_[i].first);
+            if (h != known_header::none && !known_[static_cast<size_t>(h)])
+                known_[static_cast<size_t>(h)] = i + 1;
+        }
+
+        void reindex()
+        {
+            std::fill(std::begin(known_), std::end(known_), 0);
+            for(size_t i = 0; i < size_; i ++)
+                note_known(i);
+        }
+
+        void grow()
+        {
+            size_t capacity = capacity_ * 2;
+            value_type* data = static_cast<value_type*>(std::malloc(capacity * sizeof(value_type)));
+            if (!data)
+                throw std::bad_alloc();
+            for(size_t i = 0; i < constructed_; i ++)
+            {
+                new (data + i) value_type(std::move(data_[i]));
+                data_[i].~value_type();
+            }
+            if (data_ != inline_data())
+                std::free(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+
+        void release()
+        {
+            for(size_t i = 0; i < constructed_; i ++)
+                data_[i].~value_type();
+            if (data_ != inline_data())
+                std::free(data_);
+            data_ = inline_data();
+            size_ = constructed_ = 0;
+            capacity_ = inline_capacity;
+            std::fill(std::begin(known_), std::end(known_), 0);
+        }
+
+        // Takes over other's entries, leaving it empty; expects *this to be released
+        void steal(ci_map& other)
+        {
+            std::copy(std::begin(other.known_), std::end(other.known_), std::begin(known_));
+            if (other.data_ != other.inline_data())
+            {
+                data_ = other.data_;
+                capacity_ = other.capacity_;
+                size_ = other.size_;
+                constructed_ = other.constructed_;
+                other.data_ = other.inline_data();
+                other.size_ = other.constructed_ = 0;
+                other.capacity_ = inline_capacity;
+                other.clear();
+                return;
+            }
+            for(size_t i = 0; i < other.size_; i ++)
+                new (data_ + i) value_type(std::move(other.data_[i]));
+            size_ = constructed_ = other.size_;
+            other.clear();
+        }
+
+        value_type* inline_data()
+        {
+            return reinterpret_cast<value_type*>(&inline_);
+        }
+
+        typename std::aligned_storage<sizeof(value_type) * inline_capacity, alignof(value_type)>::type inline_;
+        value_type* data_{inline_data()};
+        size_t size_{};
+        size_t constructed_{};
+        size_t capacity_{inline_capacity};
+        // 1 + the index of the first entry of each known_header, 0 if there is none
+        uint32_t known_[detail::known_header_count]{};
+    };
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -80,57 +84,103 @@ namespace crow
         MAX
     };
 
+    // Parameters matched by the router. They are kept as views into the request url, which
+    // outlives the handler call, and converted to the handler's argument types only when it is
+    // invoked, so matching a route never allocates.
     struct routing_params
     {
-        std::vector<int64_t> int_params;
-        std::vector<uint64_t> uint_params;
-        std::vector<double> double_params;
-        std::vector<std::string> string_params;
+        static const unsigned capacity = 16;
+
+        struct param
+        {
+            const char* data;
+            uint32_t size;
+            ParamType type;
+        };
+
+        // <path> parameters are read back as strings, in the same sequence as <string> ones.
+        // Trie::add refuses rules with more than `capacity' parameters, so matching never
+        // pushes past it.
+        void push(ParamType type, const char* data, size_t size)
+        {
+            params_[count_++] = param{data, static_cast<uint32_t>(size), type == ParamType::PATH ? ParamType::STRING : type};
+        }
+
+        void pop()
+        {
+            count_ --;
+        }
+
+        unsigned size() const
+        {
+            return count_;
+        }
 
         void debug_print() const
         {
             std::cerr << "routing_params" << std::endl;
-            for(auto i:int_params)
-                std::cerr<<i <<", " ;
-            std::cerr<<std::endl;
-            for(auto i:uint_params)
-                std::cerr<<i <<", " ;
-            std::cerr<<std::endl;
-            for(auto i:double_params)
-                std::cerr<<i <<", " ;
-            std::cerr<<std::endl;
-            for(auto& i:string_params)
-                std::cerr<<i <<", " ;
-            std::cerr<<std::endl;
+            for(unsigned i = 0; i < count_; i ++)
+                std::cerr << (int)params_[i].type << ':' << std::string(params_[i].data, params_[i].size) << ", ";
+            std::cerr << std::endl;
         }
 
         template <typename T>
         T get(unsigned) const;
 
+    private:
+        // `index'th parameter of the given type
+        const param& nth(ParamType type, unsigned index) const
+        {
+            for(unsigned i = 0; i < count_; i ++)
+            {
+                if (params_[i].type == type && index-- == 0)
+                    return params_[i];
+            }
+            throw std::out_of_range("routing_params: no such parameter");
+        }
+
+        // strto* need a terminated string; numbers too long for the stack buffer are rare enough to allocate
+        template <typename F>
+        static auto convert(const param& p, F f) -> decltype(f(""))
+        {
+            char buf[64];
+            if (p.size < sizeof(buf))
+            {
+                std::memcpy(buf, p.data, p.size);
+                buf[p.size] = 0;
+                return f(buf);
+            }
+            std::string copy(p.data, p.size);
+            return f(copy.c_str());
+        }
+
+        std::array<param, capacity> params_{};
+        unsigned count_{};
     };
 
     template<>
     inline int64_t routing_params::get<int64_t>(unsigned index) const
     {
-        return int_params[index];
+        return convert(nth(ParamType::INT, index), [](const char* s){ return static_cast<int64_t>(std::strtoll(s, nullptr, 10)); });
     }
 
     template<>
     inline uint64_t routing_params::get<uint64_t>(unsigned index) const
     {
-        return uint_params[index];
+        return convert(nth(ParamType::UINT, index), [](const char* s){ return static_cast<uint64_t>(std::strtoull(s, nullptr, 10)); });
     }
 
     template<>
     inline double routing_params::get<double>(unsigned index) const
     {
-        return double_params[index];
+        return convert(nth(ParamType::DOUBLE, index), [](const char* s){ return std::strtod(s, nullptr); });
     }
 
     template<>
     inline std::string routing_params::get<std::string>(unsigned index) const
     {
-        return string_params[index];
+        const param& p = nth(ParamType::STRING, index);
+        return std::string(p.data, p.size);
     }
 }
 
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "crow/settings.h"
+
+#ifdef CROW_CAN_USE_COROUTINES
+#include <coroutine>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "crow/http_response.h"
+#include "crow/logging.h"
+
+namespace crow
+{
+    // Lazily started coroutine producing a T.
+    //
+    // A route handler may return task<response> instead of a response:
+    //
+    //      CROW_ROUTE(app, "/slow")([](const crow::request& req) -> crow::task<crow::response> {
+    //          co_await crow::sleep_for(*req.io_service, std::chrono::seconds(1));
+    //          co_return crow::response("done");
+    //      });
+    //
+    // The router starts it on the connection's io_service and completes the response when it
+    // finishes. Other tasks can be awaited with co_await; the awaitables below all resume on the
+    // io_service they were given, so a handler stays on its connection's thread throughout.
+    template <typename T = void>
+    class task;
+
+    inline void start_response_task(task<response>&& t, response& res);
+
+    namespace detail
+    {
+        template <typename Promise>
+        struct task_final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                auto& promise = h.promise();
+                if (promise.continuation_)
+                    return promise.continuation_;
+                if (promise.on_done_)
+                    promise.on_done_(h, promise.on_done_context_);
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        template <typename T, typename Derived>
+        struct task_promise_base
+        {
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            task_final_awaiter<Derived> final_suspend() noexcept { return {}; }
+
+            void unhandled_exception()
+            {
+                exception_ = std::current_exception();
+            }
+
+            std::coroutine_handle<> continuation_;
+            // called instead of resuming a continuation; responsible for destroying the frame
+            void (*on_done_)(std::coroutine_handle<Derived>, void*){};
+            void* on_done_context_{};
+            std::exception_ptr exception_;
+        };
+
+        template <typename T>
+        struct task_promise : task_promise_base<T, task_promise<T>>
+        {
+            task<T> get_return_object() noexcept;
+
+            template <typename U>
+            void return_value(U&& value)
+            {
+                value_.emplace(std::forward<U>(value));
+            }
+
+            T result()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+                return std::move(*value_);
+            }
+
+            std::optional<T> value_;
+        };
+
+        template <>
+        struct task_promise<void> : task_promise_base<void, task_promise<void>>
+        {
+            task<void> get_return_object() noexcept;
+
+            void return_void() noexcept {}
+
+            void result()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+            }
+        };
+    }
+
+    template <typename T>
+    class task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        explicit task(handle_type handle) noexcept
+            : handle_(handle)
+        {
+        }
+
+        task(task&& other) noexcept
+            : handle_(std::exchange(other.handle_, nullptr))
+        {
+        }
+
+        task& operator = (task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator = (const task&) = delete;
+
+        ~task()
+        {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                handle_type handle_;
+
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle_.promise().continuation_ = awaiting;
+                    return handle_;
+                }
+
+                T await_resume()
+                {
+                    return handle_.promise().result();
+                }
+            };
+            return awaiter{handle_};
+        }
+
+        auto operator co_await() & noexcept
+        {
+            return std::move(*this).operator co_await();
+        }
+
+    private:
+        friend void start_response_task(task<response>&& t, response& res);
+
+        handle_type handle_;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return task<T>{std::coroutine_handle<task_promise<T>>::from_promise(*this)};
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return task<void>{std::coroutine_handle<task_promise<void>>::from_promise(*this)};
+        }
+    }
+
+    // Runs a handler's task to completion and ends `res' with its result; an exception ends
+    // it with a 500, as it would for an ordinary handler.
+    inline void start_response_task(task<response>&& t, response& res)
+    {
+        auto handle = std::exchange(t.handle_, nullptr);
+        handle.promise().on_done_context_ = &res;
+        handle.promise().on_done_ = [](std::coroutine_handle<detail::task_promise<response>> h, void* context)
+        {
+            response& res = *static_cast<response*>(context);
+            try
+            {
+                res = h.promise().result();
+            }
+            catch(std::exception& e)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
+                res = response(500);
+            }
+            catch(...)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
+                res = response(500);
+            }
+            h.destroy();
+            res.end();
+        };
+        handle.resume();
+    }
+
+    namespace detail
+    {
+        // Awaits an asio-style asynchronous operation: `initiate' is given the completion
+        // handler, which resumes the coroutine on whatever io_service runs the operation.
+        template <typename Result, typename Initiate>
+        struct asio_awaiter
+        {
+            Initiate initiate_;
+            Result result_{};
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                initiate_(result_, h);
+            }
+
+            Result await_resume() noexcept
+            {
+                return std::move(result_);
+            }
+        };
+
+        template <typename Result, typename Initiate>
+        asio_awaiter<Result, Initiate> make_asio_awaiter(Initiate initiate)
+        {
+            return {std::move(initiate)};
+        }
+    }
+
+    struct io_result
+    {
+        boost::system::error_code ec;
+        std::size_t bytes_transferred{};
+    };
+
+    // Timer: resumes on `io_service' after `duration'.
+    template <typename Rep, typename Period>
+    auto sleep_for(boost::asio::io_service& io_service, std::chrono::duration<Rep, Period> duration)
+    {
+        struct awaiter
+        {
+            boost::asio::steady_timer timer_;
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                timer_.async_wait([h](const boost::system::error_code&) { h.resume(); });
+            }
+
+            void await_resume() noexcept {}
+        };
+        awaiter ret{boost::asio::steady_timer(io_service)};
+        ret.timer_.expires_after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+        return ret;
+    }
+
+    // Socket I/O on any asio stream; resumes on the stream's io_service.
+    template <typename AsyncStream, typename MutableBufferSequence>
+    auto async_read_some(AsyncStream& stream, const MutableBufferSequence& buffers)
+    {
+        return detail::make_asio_awaiter<io_result>([&stream, buffers](io_result& result, std::coroutine_handle<> h) {
+            stream.async_read_some(buffers, [&result, h](const boost::system::error_code& ec, std::size_t n) {
+                result = {ec, n};
+                h.resume();
+            });
+        });
+    }
+
+    template <typename AsyncStream, typename ConstBufferSequence>
+    auto async_write(AsyncStream& stream, const ConstBufferSequence& buffers)
+    {
+        return detail::make_asio_awaiter<io_result>([&stream, buffers](io_result& result, std::coroutine_handle<> h) {
+            boost::asio::async_write(stream, buffers, [&result, h](const boost::system::error_code& ec, std::size_t n) {
+                result = {ec, n};
+                h.resume();
+            });
+        });
+    }
+
+    template <typename Socket>
+    auto async_connect(Socket& socket, const typename Socket::endpoint_type& endpoint)
+    {
+        return detail::make_asio_awaiter<boost::system::error_code>([&socket, endpoint](boost::system::error_code& result, std::coroutine_handle<> h) {
+            socket.async_connect(endpoint, [&result, h](const boost::system::error_code& ec) {
+                result = ec;
+                h.resume();
+            });
+        });
+    }
+
+    // Executor pool: runs `f' on `pool' (an io_service run by worker threads) and resumes with
+    // its result on `home', normally the connection's *req.io_service.
+    template <typename F>
+    auto offload(boost::asio::io_service& pool, boost::asio::io_service& home, F f)
+    {
+        using result_t = decltype(f());
+        using stored_t = typename std::conditional<std::is_void<result_t>::value, bool, result_t>::type;
+
+        struct awaiter
+        {
+            boost::asio::io_service& pool_;
+            boost::asio::io_service& home_;
+            F f_;
+            std::optional<stored_t> result_;
+            std::exception_ptr exception_;
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                pool_.post([this, h] {
+                    try
+                    {
+                        if constexpr (std::is_void<result_t>::value)
+                        {
+                            f_();
+                            result_.emplace(true);
+                        }
+                        else
+                            result_.emplace(f_());
+                    }
+                    catch(...)
+                    {
+                        exception_ = std::current_exception();
+                    }
+                    home_.post([h] { h.resume(); });
+                });
+            }
+
+            result_t await_resume()
+            {
+                if (exception_)
+                    std::rethrow_exception(exception_);
+                if constexpr (!std::is_void<result_t>::value)
+                    return std::move(*result_);
+            }
+        };
+        return awaiter{pool, home, std::move(f), {}, {}};
+    }
+}
+#endif
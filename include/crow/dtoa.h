@@ -0,0 +1,387 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+// Shortest round-trip formatting of doubles, with Grisu2 (Florian Loitsch, "Printing
+// Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010). The digits always
+// read back to the same double, and are the shortest that do in all but rare cases, where
+// there is one digit too many.
+namespace crow
+{
+    namespace detail
+    {
+        namespace dtoa
+        {
+            // f * 2^e
+            struct diyfp
+            {
+                uint64_t f;
+                int e;
+            };
+
+            inline diyfp sub(diyfp x, diyfp y)
+            {
+                return {x.f - y.f, x.e};
+            }
+
+            // The upper 64 bits of the product, rounded
+            inline diyfp mul(diyfp x, diyfp y)
+            {
+                uint64_t x_lo = x.f & 0xFFFFFFFFu, x_hi = x.f >> 32;
+                uint64_t y_lo = y.f & 0xFFFFFFFFu, y_hi = y.f >> 32;
+                uint64_t p0 = x_lo * y_lo;
+                uint64_t p1 = x_lo * y_hi;
+                uint64_t p2 = x_hi * y_lo;
+                uint64_t p3 = x_hi * y_hi;
+                uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu) + (uint64_t(1) << 31);
+                return {p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64};
+            }
+
+            inline diyfp normalize(diyfp x)
+            {
+                while((x.f >> 63) == 0)
+                {
+                    x.f <<= 1;
+                    x.e --;
+                }
+                return x;
+            }
+
+            // v and the midpoints to its neighbours, m- and m+, all with m+'s exponent
+            struct boundaries
+            {
+                diyfp w;
+                diyfp minus;
+                diyfp plus;
+            };
+
+            // v must be finite and positive
+            inline boundaries compute_boundaries(double v)
+            {
+                const uint64_t hidden_bit = uint64_t(1) << 52;
+                const int bias = 1023 + 52;
+                uint64_t bits;
+                memcpy(&bits, &v, sizeof(bits));
+                uint64_t F = bits & (hidden_bit - 1);
+                int E = static_cast<int>(bits >> 52);
+
+                diyfp x = E == 0 ? diyfp{F, 1 - bias} : diyfp{F + hidden_bit, E - bias};
+                // at a power of two the lower neighbour is half as far
+                bool lower_closer = F == 0 && E > 1;
+                diyfp plus = normalize({2 * x.f + 1, x.e - 1});
+                diyfp minus = lower_closer ? diyfp{4 * x.f - 1, x.e - 2} : diyfp{2 * x.f - 1, x.e - 1};
+                minus.f <<= minus.e - plus.e;
+                minus.e = plus.e;
+                return {normalize(x), minus, plus};
+            }
+
+            struct cached_power
+            {
+                uint64_t f;
+                int e;
+                int k;
+            };
+
+            // A power of ten c = f * 2^e = 10^k with -60 <= e + 64 + `e' <= -32, so that
+            // scaling by it leaves the integer part of the result in 32 bits
+            inline cached_power get_cached_power(int e)
+            {
+                // 10^k for k = -300, -292, ..., 324
+                static const cached_power powers[] = {
+                    {0xAB70FE17C79AC6CA, -1060, -300},
+                    {0xFF77B1FCBEBCDC4F, -1034, -292},
+                    {0xBE5691EF416BD60C, -1007, -284},
+                    {0x8DD01FAD907FFC3C, -980, -276},
+                    {0xD3515C2831559A83, -954, -268},
+                    {0x9D71AC8FADA6C9B5, -927, -260},
+                    {0xEA9C227723EE8BCB, -901, -252},
+                    {0xAECC49914078536D, -874, -244},
+                    {0x823C12795DB6CE57, -847, -236},
+                    {0xC21094364DFB5637, -821, -228},
+                    {0x9096EA6F3848984F, -794, -220},
+                    {0xD77485CB25823AC7, -768, -212},
+                    {0xA086CFCD97BF97F4, -741, -204},
+                    {0xEF340A98172AACE5, -715, -196},
+                    {0xB23867FB2A35B28E, -688, -188},
+                    {0x84C8D4DFD2C63F3B, -661, -180},
+                    {0xC5DD44271AD3CDBA, -635, -172},
+                    {0x936B9FCEBB25C996, -608, -164},
+                    {0xDBAC6C247D62A584, -582, -156},
+                    {0xA3AB66580D5FDAF6, -555, -148},
+                    {0xF3E2F893DEC3F126, -529, -140},
+                    {0xB5B5ADA8AAFF80B8, -502, -132},
+                    {0x87625F056C7C4A8B, -475, -124},
+                    {0xC9BCFF6034C13053, -449, -116},
+                    {0x964E858C91BA2655, -422, -108},
+                    {0xDFF9772470297EBD, -396, -100},
+                    {0xA6DFBD9FB8E5B88F, -369, -92},
+                    {0xF8A95FCF88747D94, -343, -84},
+                    {0xB94470938FA89BCF, -316, -76},
+                    {0x8A08F0F8BF0F156B, -289, -68},
+                    {0xCDB02555653131B6, -263, -60},
+                    {0x993FE2C6D07B7FAC, -236, -52},
+                    {0xE45C10C42A2B3B06, -210, -44},
+                    {0xAA242499697392D3, -183, -36},
+                    {0xFD87B5F28300CA0E, -157, -28},
+                    {0xBCE5086492111AEB, -130, -20},
+                    {0x8CBCCC096F5088CC, -103, -12},
+                    {0xD1B71758E219652C, -77, -4},
+                    {0x9C40000000000000, -50, 4},
+                    {0xE8D4A51000000000, -24, 12},
+                    {0xAD78EBC5AC620000, 3, 20},
+                    {0x813F3978F8940984, 30, 28},
+                    {0xC097CE7BC90715B3, 56, 36},
+                    {0x8F7E32CE7BEA5C70, 83, 44},
+                    {0xD5D238A4ABE98068, 109, 52},
+                    {0x9F4F2726179A2245, 136, 60},
+                    {0xED63A231D4C4FB27, 162, 68},
+                    {0xB0DE65388CC8ADA8, 189, 76},
+                    {0x83C7088E1AAB65DB, 216, 84},
+                    {0xC45D1DF942711D9A, 242, 92},
+                    {0x924D692CA61BE758, 269, 100},
+                    {0xDA01EE641A708DEA, 295, 108},
+                    {0xA26DA3999AEF774A, 322, 116},
+                    {0xF209787BB47D6B85, 348, 124},
+                    {0xB454E4A179DD1877, 375, 132},
+                    {0x865B86925B9BC5C2, 402, 140},
+                    {0xC83553C5C8965D3D, 428, 148},
+                    {0x952AB45CFA97A0B3, 455, 156},
+                    {0xDE469FBD99A05FE3, 481, 164},
+                    {0xA59BC234DB398C25, 508, 172},
+                    {0xF6C69A72A3989F5C, 534, 180},
+                    {0xB7DCBF5354E9BECE, 561, 188},
+                    {0x88FCF317F22241E2, 588, 196},
+                    {0xCC20CE9BD35C78A5, 614, 204},
+                    {0x98165AF37B2153DF, 641, 212},
+                    {0xE2A0B5DC971F303A, 667, 220},
+                    {0xA8D9D1535CE3B396, 694, 228},
+                    {0xFB9B7CD9A4A7443C, 720, 236},
+                    {0xBB764C4CA7A44410, 747, 244},
+                    {0x8BAB8EEFB6409C1A, 774, 252},
+                    {0xD01FEF10A657842C, 800, 260},
+                    {0x9B10A4E5E9913129, 827, 268},
+                    {0xE7109BFBA19C0C9D, 853, 276},
+                    {0xAC2820D9623BF429, 880, 284},
+                    {0x80444B5E7AA7CF85, 907, 292},
+                    {0xBF21E44003ACDD2D, 933, 300},
+                    {0x8E679C2F5E44FF8F, 960, 308},
+                    {0xD433179D9C8CB841, 986, 316},
+                    {0x9E19DB92B4E31BA9, 1013, 324},
+                };
+                const int alpha = -60;
+                int f = alpha - e - 1;
+                // ceil(f * log10(2))
+                int k = (f * 78913) / (1 << 18) + (f > 0);
+                return powers[(300 + k + 7) / 8];
+            }
+
+            // The number of decimal digits of n, and the largest power of ten below it
+            inline int find_largest_pow10(uint32_t n, uint32_t& pow10)
+            {
+                static const uint32_t powers[] = {
+                    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+                };
+                int digits = 10;
+                while(digits > 1 && n < powers[digits - 1])
+                    digits --;
+                pow10 = powers[digits - 1];
+                return digits;
+            }
+
+            // Moves the last digit towards w while that stays inside the interval
+            inline void round(char* buffer, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+            {
+                while(rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+                {
+                    buffer[length - 1] --;
+                    rest += ten_k;
+                }
+            }
+
+            // Writes the digits of w, as few as keep the value between M- and M+
+            inline void digit_gen(char* buffer, int& length, int& decimal_exponent, diyfp M_minus, diyfp w, diyfp M_plus)
+            {
+                uint64_t delta = sub(M_plus, M_minus).f;
+                uint64_t dist = sub(M_plus, w).f;
+                diyfp one{uint64_t(1) << -M_plus.e, M_plus.e};
+
+                uint32_t p1 = static_cast<uint32_t>(M_plus.f >> -one.e);
+                uint64_t p2 = M_plus.f & (one.f - 1);
+
+                uint32_t pow10;
+                int n = find_largest_pow10(p1, pow10);
+                while(n > 0)
+                {
+                    uint32_t d = p1 / pow10;
+                    p1 %= pow10;
+                    buffer[length++] = static_cast<char>('0' + d);
+                    n --;
+                    uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+                    if (rest <= delta)
+                    {
+                        decimal_exponent += n;
+                        round(buffer, length, dist, delta, rest, uint64_t(pow10) << -one.e);
+                        return;
+                    }
+                    pow10 /= 10;
+                }
+
+                int m = 0;
+                while(1)
+                {
+                    p2 *= 10;
+                    buffer[length++] = static_cast<char>('0' + (p2 >> -one.e));
+                    p2 &= one.f - 1;
+                    m ++;
+                    delta *= 10;
+                    dist *= 10;
+                    if (p2 <= delta)
+                        break;
+                }
+                decimal_exponent -= m;
+                round(buffer, length, dist, delta, p2, one.f);
+            }
+
+            // The shortest digits of a finite positive v, which is digits * 10^decimal_exponent;
+            // buffer needs room for 17
+            inline void grisu2(char* buffer, int& length, int& decimal_exponent, double v)
+            {
+                boundaries b = compute_boundaries(v);
+                cached_power cached = get_cached_power(b.plus.e);
+                diyfp c{cached.f, cached.e};
+                diyfp w = mul(b.w, c);
+                diyfp w_minus = mul(b.minus, c);
+                diyfp w_plus = mul(b.plus, c);
+                // the products may be off by one either way, so the interval is narrowed to
+                // what is certainly inside
+                diyfp M_minus{w_minus.f + 1, w_minus.e};
+                diyfp M_plus{w_plus.f - 1, w_plus.e};
+                length = 0;
+                decimal_exponent = -cached.k;
+                digit_gen(buffer, length, decimal_exponent, M_minus, w, M_plus);
+            }
+
+            // Writes `exponent' as e+N or e-N
+            inline char* write_exponent(char* out, int exponent)
+            {
+                *out++ = 'e';
+                *out++ = exponent < 0 ? '-' : '+';
+                if (exponent < 0)
+                    exponent = -exponent;
+                if (exponent >= 100)
+                {
+                    *out++ = static_cast<char>('0' + exponent / 100);
+                    exponent %= 100;
+                    *out++ = static_cast<char>('0' + exponent / 10);
+                }
+                else if (exponent >= 10)
+                    *out++ = static_cast<char>('0' + exponent / 10);
+                *out++ = static_cast<char>('0' + exponent % 10);
+                return out;
+            }
+        }
+
+        // Writes v the way JavaScript would: plain decimals from 1e-6 up to 1e21 and
+        // d.ddde+N outside that, the shortest digits that read back to v. Non-finite values,
+        // which JSON has no way to write, come out as printf would. Needs 32 bytes at out and
+        // returns the end.
+        inline char* format_double(double v, char* out)
+        {
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            if (bits >> 63)
+            {
+                *out++ = '-';
+                bits &= ~(uint64_t(1) << 63);
+                memcpy(&v, &bits, sizeof(bits));
+            }
+            if ((bits >> 52) == 0x7FF)
+            {
+                const char* text = bits & ((uint64_t(1) << 52) - 1) ? "nan" : "inf";
+                memcpy(out, text, 3);
+                return out + 3;
+            }
+            if (bits == 0)
+            {
+                *out++ = '0';
+                return out;
+            }
+
+            char digits[17];
+            int k, exponent;
+            dtoa::grisu2(digits, k, exponent, v);
+            // the value is 0.digits * 10^n
+            int n = k + exponent;
+            if (k <= n && n <= 21)
+            {
+                memcpy(out, digits, k);
+                memset(out + k, '0', n - k);
+                return out + n;
+            }
+            if (0 < n && n <= 21)
+            {
+                memcpy(out, digits, n);
+                out[n] = '.';
+                memcpy(out + n + 1, digits + n, k - n);
+                return out + k + 1;
+            }
+            if (-6 < n && n <= 0)
+            {
+                out[0] = '0';
+                out[1] = '.';
+                memset(out + 2, '0', -n);
+                memcpy(out + 2 - n, digits, k);
+                return out + 2 - n + k;
+            }
+            *out++ = digits[0];
+            if (k > 1)
+            {
+                *out++ = '.';
+                memcpy(out, digits + 1, k - 1);
+                out += k - 1;
+            }
+            return dtoa::write_exponent(out, n - 1);
+        }
+
+        // Writes the decimal digits of v, two at a time, and returns the end; needs 20 bytes
+        inline char* format_integer(uint64_t v, char* out)
+        {
+            static const char pairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+            char buffer[20];
+            char* p = buffer + sizeof(buffer);
+            while(v >= 100)
+            {
+                unsigned i = static_cast<unsigned>(v % 100) * 2;
+                v /= 100;
+                *--p = pairs[i + 1];
+                *--p = pairs[i];
+            }
+            if (v >= 10)
+            {
+                unsigned i = static_cast<unsigned>(v) * 2;
+                *--p = pairs[i + 1];
+                *--p = pairs[i];
+            }
+            else
+                *--p = static_cast<char>('0' + v);
+            size_t length = buffer + sizeof(buffer) - p;
+            memcpy(out, p, length);
+            return out + length;
+        }
+
+        inline char* format_integer(int64_t v, char* out)
+        {
+            uint64_t magnitude = static_cast<uint64_t>(v);
+            if (v < 0)
+            {
+                *out++ = '-';
+                magnitude = 0 - magnitude;
+            }
+            return format_integer(magnitude, out);
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace crow
+{
+    namespace detail
+    {
+        // Memory for the asio operations of one connection. A connection has at most a read
+        // and a write in flight, so two blocks that live as long as the connection serve every
+        // operation after the first; anything that does not fit goes to operator new.
+        class handler_arena
+        {
+        public:
+            handler_arena() = default;
+            handler_arena(const handler_arena&) = delete;
+            handler_arena& operator = (const handler_arena&) = delete;
+
+            void* allocate(std::size_t size)
+            {
+                for(auto& b : blocks_)
+                {
+                    if (!b.in_use && size <= sizeof(b.storage))
+                    {
+                        b.in_use = true;
+                        return &b.storage;
+                    }
+                }
+                return ::operator new(size);
+            }
+
+            void deallocate(void* p)
+            {
+                for(auto& b : blocks_)
+                {
+                    if (p == &b.storage)
+                    {
+                        b.in_use = false;
+                        return;
+                    }
+                }
+                ::operator delete(p);
+            }
+
+        private:
+            struct block
+            {
+                typename std::aligned_storage<512>::type storage;
+                bool in_use{};
+            };
+            block blocks_[2];
+        };
+
+        template <typename T>
+        struct handler_arena_allocator
+        {
+            using value_type = T;
+
+            explicit handler_arena_allocator(handler_arena& arena) noexcept
+                : arena(&arena)
+            {
+            }
+
+            template <typename U>
+            handler_arena_allocator(const handler_arena_allocator<U>& other) noexcept
+                : arena(other.arena)
+            {
+            }
+
+            T* allocate(std::size_t n)
+            {
+                return static_cast<T*>(arena->allocate(sizeof(T) * n));
+            }
+
+            void deallocate(T* p, std::size_t)
+            {
+                arena->deallocate(p);
+            }
+
+            template <typename U>
+            bool operator == (const handler_arena_allocator<U>& other) const noexcept
+            {
+                return arena == other.arena;
+            }
+
+            template <typename U>
+            bool operator != (const handler_arena_allocator<U>& other) const noexcept
+            {
+                return arena != other.arena;
+            }
+
+            handler_arena* arena;
+        };
+
+        // A completion handler whose operation is allocated from `arena'; asio finds the
+        // allocator through the nested allocator_type.
+        template <typename Handler>
+        struct arena_handler
+        {
+            using allocator_type = handler_arena_allocator<Handler>;
+
+            allocator_type get_allocator() const noexcept
+            {
+                return allocator_type(*arena);
+            }
+
+            template <typename ... Args>
+            void operator()(Args&& ... args)
+            {
+                handler(std::forward<Args>(args)...);
+            }
+
+            handler_arena* arena;
+            Handler handler;
+        };
+
+        template <typename Handler>
+        arena_handler<typename std::decay<Handler>::type> make_arena_handler(handler_arena& arena, Handler&& handler)
+        {
+            return {&arena, std::forward<Handler>(handler)};
+        }
+    }
+}
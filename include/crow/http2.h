@@ -0,0 +1,1416 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+
+#include "crow/common.h"
+#include "crow/http_request.h"
+#include "crow/logging.h"
+#include "crow/utility.h"
+
+namespace crow
+{
+    // HTTP/2 (RFC 7540) framing and HPACK (RFC 7541) header compression.
+    //
+    // Nothing in here touches a socket: a session is fed the bytes read from the peer and leaves
+    // the bytes to be sent in output(), so Connection decides when they are written.
+    namespace http2
+    {
+        static const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static const size_t client_preface_size = sizeof(client_preface) - 1;
+        static const size_t frame_header_size = 9;
+
+        enum class frame_type : uint8_t
+        {
+            data = 0,
+            headers,
+            priority,
+            rst_stream,
+            settings,
+            push_promise,
+            ping,
+            goaway,
+            window_update,
+            continuation,
+        };
+
+        namespace flags
+        {
+            enum : uint8_t
+            {
+                end_stream = 0x1,
+                ack = 0x1,
+                end_headers = 0x4,
+                padded = 0x8,
+                priority = 0x20,
+            };
+        }
+
+        enum class error_code : uint32_t
+        {
+            no_error = 0,
+            protocol_error,
+            internal_error,
+            flow_control_error,
+            settings_timeout,
+            stream_closed,
+            frame_size_error,
+            refused_stream,
+            cancel,
+            compression_error,
+            connect_error,
+            enhance_your_calm,
+            inadequate_security,
+            http_1_1_required,
+        };
+
+        enum class settings_id : uint16_t
+        {
+            header_table_size = 1,
+            enable_push,
+            max_concurrent_streams,
+            initial_window_size,
+            max_frame_size,
+            max_header_list_size,
+        };
+
+        struct frame_header
+        {
+            uint32_t length;
+            frame_type type;
+            uint8_t flags;
+            uint32_t stream_id;
+        };
+
+        inline uint32_t read_uint32(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+        }
+
+        inline void append_uint32(std::string& out, uint32_t v)
+        {
+            out.push_back(static_cast<char>(v >> 24));
+            out.push_back(static_cast<char>(v >> 16));
+            out.push_back(static_cast<char>(v >> 8));
+            out.push_back(static_cast<char>(v));
+        }
+
+        inline frame_header parse_frame_header(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            frame_header h;
+            h.length = (uint32_t(u[0]) << 16) | (uint32_t(u[1]) << 8) | uint32_t(u[2]);
+            h.type = static_cast<frame_type>(u[3]);
+            h.flags = u[4];
+            h.stream_id = read_uint32(p + 5) & 0x7FFFFFFF;
+            return h;
+        }
+
+        inline void append_frame_header(std::string& out, uint32_t length, frame_type type, uint8_t flags, uint32_t stream_id)
+        {
+            out.push_back(static_cast<char>(length >> 16));
+            out.push_back(static_cast<char>(length >> 8));
+            out.push_back(static_cast<char>(length));
+            out.push_back(static_cast<char>(type));
+            out.push_back(static_cast<char>(flags));
+            append_uint32(out, stream_id & 0x7FFFFFFF);
+        }
+
+        inline void append_setting(std::string& out, settings_id id, uint32_t value)
+        {
+            out.push_back(static_cast<char>(static_cast<uint16_t>(id) >> 8));
+            out.push_back(static_cast<char>(static_cast<uint16_t>(id)));
+            append_uint32(out, value);
+        }
+
+        namespace hpack
+        {
+            using header_list = std::vector<std::pair<std::string, std::string>>;
+
+            // 5.1 integer representation; `first' holds the bits above the prefix
+            inline void encode_integer(std::string& out, uint8_t first, int prefix_bits, uint64_t value)
+            {
+                const uint64_t max_prefix = (1u << prefix_bits) - 1;
+                if (value < max_prefix)
+                {
+                    out.push_back(static_cast<char>(first | value));
+                    return;
+                }
+                out.push_back(static_cast<char>(first | max_prefix));
+                value -= max_prefix;
+                while (value >= 128)
+                {
+                    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                    value >>= 7;
+                }
+                out.push_back(static_cast<char>(value));
+            }
+
+            inline uint64_t decode_integer(const char*& p, const char* end, int prefix_bits)
+            {
+                if (p == end)
+                    throw std::runtime_error("hpack: truncated integer");
+                const uint64_t max_prefix = (1u << prefix_bits) - 1;
+                uint64_t value = static_cast<unsigned char>(*p++) & max_prefix;
+                if (value < max_prefix)
+                    return value;
+                for(int shift = 0; ; shift += 7)
+                {
+                    if (p == end)
+                        throw std::runtime_error("hpack: truncated integer");
+                    if (shift > 28)
+                        throw std::runtime_error("hpack: integer overflow");
+                    unsigned char b = static_cast<unsigned char>(*p++);
+                    value += uint64_t(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                        return value;
+                }
+            }
+
+            struct huffman_code
+            {
+                uint32_t code;
+                uint8_t bits;
+            };
+
+            // Appendix B; symbol 256 is EOS
+            inline const huffman_code* huffman_table()
+            {
+                static const huffman_code table[257] = {
+                    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+                    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+                    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+                    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+                    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+                    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+                    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+                    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+                    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+                    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+                    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+                    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+                    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+                    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+                    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+                    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+                    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+                    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+                    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+                    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+                    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+                    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+                    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+                    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+                    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+                    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+                    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+                    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+                    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+                    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+                    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+                    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+                    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+                    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+                    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+                    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+                    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+                    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+                    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+                    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+                    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+                    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+                    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+                    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+                    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+                    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+                    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+                    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+                    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+                    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+                    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+                    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+                    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+                    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+                    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+                    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+                    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+                    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+                    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+                    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+                    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+                    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+                    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+                    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+                    {0x3fffffff, 30}
+                };
+                return table;
+            }
+
+            struct huffman_node
+            {
+                int16_t next[2];
+                int16_t symbol;
+            };
+
+            inline const std::vector<huffman_node>& huffman_tree()
+            {
+                static const std::vector<huffman_node> tree = []{
+                    std::vector<huffman_node> nodes(1, huffman_node{{-1, -1}, -1});
+                    for(int symbol = 0; symbol < 257; symbol ++)
+                    {
+                        const huffman_code& c = huffman_table()[symbol];
+                        size_t current = 0;
+                        for(int i = c.bits - 1; i >= 0; i --)
+                        {
+                            int bit = (c.code >> i) & 1;
+                            if (nodes[current].next[bit] < 0)
+                            {
+                                nodes[current].next[bit] = static_cast<int16_t>(nodes.size());
+                                nodes.push_back(huffman_node{{-1, -1}, -1});
+                            }
+                            current = static_cast<size_t>(nodes[current].next[bit]);
+                        }
+                        nodes[current].symbol = static_cast<int16_t>(symbol);
+                    }
+                    return nodes;
+                }();
+                return tree;
+            }
+
+            inline size_t huffman_encoded_size(const std::string& s)
+            {
+                uint64_t bits = 0;
+                for(auto c : s)
+                    bits += huffman_table()[static_cast<unsigned char>(c)].bits;
+                return (bits + 7) / 8;
+            }
+
+            inline void huffman_encode(std::string& out, const std::string& s)
+            {
+                uint64_t acc = 0;
+                int bits = 0;
+                for(auto c : s)
+                {
+                    const huffman_code& code = huffman_table()[static_cast<unsigned char>(c)];
+                    acc = (acc << code.bits) | code.code;
+                    bits += code.bits;
+                    while (bits >= 8)
+                    {
+                        bits -= 8;
+                        out.push_back(static_cast<char>(acc >> bits));
+                    }
+                    acc &= (uint64_t(1) << bits) - 1;
+                }
+                // pad with the most significant bits of EOS
+                if (bits)
+                    out.push_back(static_cast<char>((acc << (8 - bits)) | (0xFF >> bits)));
+            }
+
+            inline std::string huffman_decode(const char* p, size_t size)
+            {
+                const auto& tree = huffman_tree();
+                std::string ret;
+                ret.reserve(size * 8 / 5);
+                size_t current = 0;
+                int depth = 0;
+                bool all_ones = true;
+                for(size_t i = 0; i < size; i ++)
+                {
+                    unsigned char b = static_cast<unsigned char>(p[i]);
+                    for(int shift = 7; shift >= 0; shift --)
+                    {
+                        int bit = (b >> shift) & 1;
+                        current = static_cast<size_t>(tree[current].next[bit]);
+                        depth ++;
+                        all_ones = all_ones && bit;
+                        int symbol = tree[current].symbol;
+                        if (symbol >= 0)
+                        {
+                            if (symbol == 256)
+                                throw std::runtime_error("hpack: EOS in huffman string");
+                            ret.push_back(static_cast<char>(symbol));
+                            current = 0;
+                            depth = 0;
+                            all_ones = true;
+                        }
+                    }
+                }
+                if (depth > 7 || !all_ones)
+                    throw std::runtime_error("hpack: invalid huffman padding");
+                return ret;
+            }
+
+            // 5.2 string literal, huffman coded when that is shorter
+            inline void encode_string(std::string& out, const std::string& s)
+            {
+                size_t huffman_size = huffman_encoded_size(s);
+                if (huffman_size < s.size())
+                {
+                    encode_integer(out, 0x80, 7, huffman_size);
+                    huffman_encode(out, s);
+                }
+                else
+                {
+                    encode_integer(out, 0, 7, s.size());
+                    out += s;
+                }
+            }
+
+            inline std::string decode_string(const char*& p, const char* end)
+            {
+                if (p == end)
+                    throw std::runtime_error("hpack: truncated string");
+                bool huffman = (*p & 0x80) != 0;
+                uint64_t length = decode_integer(p, end, 7);
+                if (length > static_cast<uint64_t>(end - p))
+                    throw std::runtime_error("hpack: truncated string");
+                const char* begin = p;
+                p += length;
+                if (huffman)
+                    return huffman_decode(begin, length);
+                return std::string(begin, length);
+            }
+
+            struct static_entry
+            {
+                const char* name;
+                const char* value;
+            };
+
+            static const size_t static_table_size = 61;
+
+            // Appendix A; index 1 is the first entry
+            inline const static_entry* static_table()
+            {
+                static const static_entry table[static_table_size] = {
+                    {":authority", ""},
+                    {":method", "GET"},
+                    {":method", "POST"},
+                    {":path", "/"},
+                    {":path", "/index.html"},
+                    {":scheme", "http"},
+                    {":scheme", "https"},
+                    {":status", "200"},
+                    {":status", "204"},
+                    {":status", "206"},
+                    {":status", "304"},
+                    {":status", "400"},
+                    {":status", "404"},
+                    {":status", "500"},
+                    {"accept-charset", ""},
+                    {"accept-encoding", "gzip, deflate"},
+                    {"accept-language", ""},
+                    {"accept-ranges", ""},
+                    {"accept", ""},
+                    {"access-control-allow-origin", ""},
+                    {"age", ""},
+                    {"allow", ""},
+                    {"authorization", ""},
+                    {"cache-control", ""},
+                    {"content-disposition", ""},
+                    {"content-encoding", ""},
+                    {"content-language", ""},
+                    {"content-length", ""},
+                    {"content-location", ""},
+                    {"content-range", ""},
+                    {"content-type", ""},
+                    {"cookie", ""},
+                    {"date", ""},
+                    {"etag", ""},
+                    {"expect", ""},
+                    {"expires", ""},
+                    {"from", ""},
+                    {"host", ""},
+                    {"if-match", ""},
+                    {"if-modified-since", ""},
+                    {"if-none-match", ""},
+                    {"if-range", ""},
+                    {"if-unmodified-since", ""},
+                    {"last-modified", ""},
+                    {"link", ""},
+                    {"location", ""},
+                    {"max-forwards", ""},
+                    {"proxy-authenticate", ""},
+                    {"proxy-authorization", ""},
+                    {"range", ""},
+                    {"referer", ""},
+                    {"refresh", ""},
+                    {"retry-after", ""},
+                    {"server", ""},
+                    {"set-cookie", ""},
+                    {"strict-transport-security", ""},
+                    {"transfer-encoding", ""},
+                    {"user-agent", ""},
+                    {"vary", ""},
+                    {"via", ""},
+                    {"www-authenticate", ""},
+                };
+                return table;
+            }
+
+            // 2.3.2 dynamic table; index 1 is the most recently inserted entry
+            class header_table
+            {
+            public:
+                static const size_t entry_overhead = 32;
+
+                explicit header_table(size_t max_size = 4096)
+                    : max_size_(max_size)
+                {
+                }
+
+                size_t size() const { return size_; }
+                size_t max_size() const { return max_size_; }
+                size_t count() const { return entries_.size(); }
+
+                const std::pair<std::string, std::string>& get(size_t index) const
+                {
+                    return entries_[index - 1];
+                }
+
+                void set_max_size(size_t max_size)
+                {
+                    max_size_ = max_size;
+                    evict(0);
+                }
+
+                void insert(std::string name, std::string value)
+                {
+                    size_t entry_size = name.size() + value.size() + entry_overhead;
+                    if (entry_size > max_size_)
+                    {
+                        // an entry larger than the table empties it (4.4)
+                        entries_.clear();
+                        size_ = 0;
+                        return;
+                    }
+                    evict(entry_size);
+                    entries_.emplace_front(std::move(name), std::move(value));
+                    size_ += entry_size;
+                }
+
+            private:
+                void evict(size_t room)
+                {
+                    while (!entries_.empty() && size_ + room > max_size_)
+                    {
+                        auto& e = entries_.back();
+                        size_ -= e.first.size() + e.second.size() + entry_overhead;
+                        entries_.pop_back();
+                    }
+                }
+
+                std::deque<std::pair<std::string, std::string>> entries_;
+                size_t size_{};
+                size_t max_size_;
+            };
+
+            class decoder
+            {
+            public:
+                // `max_table_size' is the SETTINGS_HEADER_TABLE_SIZE we advertised
+                explicit decoder(size_t max_table_size = 4096)
+                    : table_(max_table_size), max_table_size_(max_table_size)
+                {
+                }
+
+                const header_table& table() const { return table_; }
+
+                // Appends the fields of one header block to `headers'. Throws std::runtime_error
+                // on malformed input, which is a connection error (COMPRESSION_ERROR).
+                void decode(const char* p, size_t size, header_list& headers)
+                {
+                    const char* end = p + size;
+                    bool fields_seen = false;
+                    while (p != end)
+                    {
+                        unsigned char b = static_cast<unsigned char>(*p);
+                        if (b & 0x80)
+                        {
+                            // 6.1 indexed header field
+                            uint64_t index = decode_integer(p, end, 7);
+                            if (index == 0)
+                                throw std::runtime_error("hpack: index 0");
+                            auto e = lookup(index);
+                            headers.emplace_back(e.first, e.second);
+                            fields_seen = true;
+                        }
+                        else if ((b & 0xE0) == 0x20)
+                        {
+                            // 6.3 dynamic table size update, only at the start of a block
+                            if (fields_seen)
+                                throw std::runtime_error("hpack: misplaced table size update");
+                            uint64_t new_size = decode_integer(p, end, 5);
+                            if (new_size > max_table_size_)
+                                throw std::runtime_error("hpack: table size update too large");
+                            table_.set_max_size(new_size);
+                        }
+                        else
+                        {
+                            // 6.2 literal: with incremental indexing (01), without indexing (0000)
+                            // or never indexed (0001)
+                            bool index_it = (b & 0xC0) == 0x40;
+                            uint64_t name_index = decode_integer(p, end, index_it ? 6 : 4);
+                            std::string name = name_index ? lookup(name_index).first : decode_string(p, end);
+                            std::string value = decode_string(p, end);
+                            if (index_it)
+                                table_.insert(name, value);
+                            headers.emplace_back(std::move(name), std::move(value));
+                            fields_seen = true;
+                        }
+                    }
+                }
+
+            private:
+                std::pair<std::string, std::string> lookup(uint64_t index) const
+                {
+                    if (index <= static_table_size)
+                    {
+                        auto& e = static_table()[index - 1];
+                        return {e.name, e.value};
+                    }
+                    index -= static_table_size;
+                    if (index > table_.count())
+                        throw std::runtime_error("hpack: index out of range");
+                    return table_.get(index);
+                }
+
+                header_table table_;
+                size_t max_table_size_;
+            };
+
+            class encoder
+            {
+            public:
+                // the peer's SETTINGS_HEADER_TABLE_SIZE; announced at the start of the next block
+                void set_max_table_size(size_t size)
+                {
+                    if (size == table_.max_size() && !pending_size_update_)
+                        return;
+                    table_.set_max_size(size);
+                    pending_size_update_ = true;
+                }
+
+                const header_table& table() const { return table_; }
+
+                // Field names must already be lower case.
+                void encode(const header_list& headers, std::string& out)
+                {
+                    if (pending_size_update_)
+                    {
+                        encode_integer(out, 0x20, 5, table_.max_size());
+                        pending_size_update_ = false;
+                    }
+
+                    for(auto& kv : headers)
+                    {
+                        size_t name_index = 0;
+                        size_t index = find(kv.first, kv.second, name_index);
+                        if (index)
+                        {
+                            encode_integer(out, 0x80, 7, index);
+                            continue;
+                        }
+
+                        if (is_sensitive(kv.first))
+                            encode_integer(out, 0x10, 4, name_index);
+                        else if (!worth_indexing(kv.first, kv.second))
+                            encode_integer(out, 0x00, 4, name_index);
+                        else
+                        {
+                            encode_integer(out, 0x40, 6, name_index);
+                            table_.insert(kv.first, kv.second);
+                        }
+                        if (!name_index)
+                            encode_string(out, kv.first);
+                        encode_string(out, kv.second);
+                    }
+                }
+
+            private:
+                // Returns the index of an exact match, or 0 and sets `name_index' to an entry with
+                // the same name (0 if there is none).
+                size_t find(const std::string& name, const std::string& value, size_t& name_index) const
+                {
+                    for(size_t i = 0; i < static_table_size; i ++)
+                    {
+                        auto& e = static_table()[i];
+                        if (name == e.name)
+                        {
+                            if (value == e.value)
+                                return i + 1;
+                            if (!name_index)
+                                name_index = i + 1;
+                        }
+                    }
+                    for(size_t i = 1; i <= table_.count(); i ++)
+                    {
+                        auto& e = table_.get(i);
+                        if (e.first == name)
+                        {
+                            if (e.second == value)
+                                return static_table_size + i;
+                            if (!name_index)
+                                name_index = static_table_size + i;
+                        }
+                    }
+                    return 0;
+                }
+
+                static bool is_sensitive(const std::string& name)
+                {
+                    return name == "set-cookie" || name == "authorization" || name == "cookie";
+                }
+
+                // values that differ from one response to the next would only churn the table
+                bool worth_indexing(const std::string& name, const std::string& value) const
+                {
+                    if (name == "content-length" || name == "etag" || name == "location" || name == ":path" || name == "last-modified")
+                        return false;
+                    return name.size() + value.size() + header_table::entry_overhead <= table_.max_size() / 4;
+                }
+
+                header_table table_;
+                bool pending_size_update_{};
+            };
+        }
+
+        // Server side of one HTTP/2 connection.
+        //
+        // Handler must provide
+        //      void handle_stream(uint32_t stream_id, request&& req);  // a complete request arrived
+        //      void handle_stream_reset(uint32_t stream_id);           // the client cancelled it
+        // and answers each request, possibly later, with submit_response(). Both callbacks may be
+        // made from inside feed().
+        template <typename Handler>
+        class session
+        {
+        public:
+            static const uint32_t default_window_size = 65535;
+            static const uint32_t default_max_frame_size = 16384;
+            static const uint32_t max_concurrent_streams = 128;
+            // bounds the memory a client can pin with CONTINUATION frames
+            static const size_t max_header_block_size = 256 * 1024;
+            // and with a request body, which is buffered until the request is complete
+            static const size_t max_body_size = 1024 * 1024;
+            // Flow control windows are only handed back as far as the bodies still being
+            // received on a connection stay within this, so a client sending them faster than
+            // they complete is stalled rather than buffered without bound.
+            static const size_t max_buffered_body_size = 4 * 1024 * 1024;
+
+            explicit session(Handler* handler)
+                : handler_(handler)
+            {
+            }
+
+            // Queues the server connection preface; the client's one is expected first in feed().
+            void start()
+            {
+                std::string payload;
+                append_setting(payload, settings_id::max_concurrent_streams, max_concurrent_streams);
+                append_frame_header(output_, static_cast<uint32_t>(payload.size()), frame_type::settings, 0, 0);
+                output_ += payload;
+            }
+
+            // h2c upgrade (3.2): `http2_settings' is the HTTP2-Settings header of the upgrade request.
+            // Opens stream 1, half closed from the client's side, for the handler to answer the
+            // upgrade request on. Returns false if the settings are malformed.
+            bool upgrade(const std::string& http2_settings)
+            {
+                std::string payload;
+                try
+                {
+                    payload = utility::base64decode(http2_settings);
+                }
+                catch(std::exception&)
+                {
+                    return false;
+                }
+                if (payload.size() % 6 || apply_settings(payload.data(), payload.size()) != error_code::no_error)
+                    return false;
+
+                last_stream_id_ = 1;
+                stream& s = open_stream(1);
+                s.remote_closed = true;
+                s.dispatched = true;
+                return true;
+            }
+
+            // Returns false once the connection has failed; output() then ends with a GOAWAY and
+            // the socket should be closed after writing it.
+            bool feed(const char* data, size_t size)
+            {
+                if (goaway_sent_)
+                    return false;
+                input_.append(data, size);
+
+                size_t pos = 0;
+                if (!preface_received_)
+                {
+                    size_t n = std::min(input_.size(), client_preface_size);
+                    if (input_.compare(0, n, client_preface, n) != 0)
+                        return connection_error(error_code::protocol_error);
+                    if (n < client_preface_size)
+                        return true;
+                    preface_received_ = true;
+                    pos = client_preface_size;
+                }
+
+                while (input_.size() - pos >= frame_header_size)
+                {
+                    frame_header h = parse_frame_header(input_.data() + pos);
+                    if (h.length > default_max_frame_size)
+                        return connection_error(error_code::frame_size_error);
+                    if (input_.size() - pos - frame_header_size < h.length)
+                        break;
+                    if (!process_frame(h, input_.data() + pos + frame_header_size))
+                    {
+                        input_.clear();
+                        return false;
+                    }
+                    pos += frame_header_size + h.length;
+                }
+                input_.erase(0, pos);
+                return true;
+            }
+
+            // Sends the response for `stream_id'; the body goes out as the peer's flow control
+            // windows allow. Does nothing if the stream was reset meanwhile.
+            void submit_response(uint32_t stream_id, int status, const hpack::header_list& headers, std::string body)
+            {
+                auto it = streams_.find(stream_id);
+                if (it == streams_.end() || it->second.response_submitted || goaway_sent_)
+                    return;
+                stream& s = it->second;
+                s.response_submitted = true;
+
+                hpack::header_list fields;
+                fields.reserve(headers.size() + 1);
+                fields.emplace_back(":status", std::to_string(status));
+                for(auto& kv : headers)
+                {
+                    std::string name = boost::algorithm::to_lower_copy(kv.first);
+                    // connection specific fields are not allowed in HTTP/2 (8.1.2.2)
+                    if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade")
+                        continue;
+                    fields.emplace_back(std::move(name), kv.second);
+                }
+
+                std::string block;
+                encoder_.encode(fields, block);
+                write_header_block(stream_id, block, body.empty());
+
+                if (body.empty())
+                {
+                    s.local_closed = true;
+                    close_stream_if_done(it);
+                    return;
+                }
+                s.pending_body = std::move(body);
+                flush_pending_data();
+            }
+
+            std::string& output()
+            {
+                return output_;
+            }
+
+            // no more frames will be processed: a GOAWAY was sent, or the client sent one and
+            // everything it asked for has been answered
+            bool is_finished() const
+            {
+                return goaway_sent_ || (goaway_received_ && streams_.empty());
+            }
+
+            size_t stream_count() const
+            {
+                return streams_.size();
+            }
+
+        private:
+            struct stream
+            {
+                request req;
+                std::string method;
+                int64_t send_window{};
+                int64_t recv_window{default_window_size};
+                bool remote_closed{};
+                bool local_closed{};
+                bool dispatched{};
+                bool response_submitted{};
+                std::string pending_body;
+                size_t pending_offset{};
+                // the part of req.body counted in buffered_body_
+                size_t buffered{};
+            };
+
+            stream& open_stream(uint32_t stream_id)
+            {
+                stream& s = streams_[stream_id];
+                s.send_window = peer_initial_window_;
+                return s;
+            }
+
+            bool connection_error(error_code code)
+            {
+                CROW_LOG_DEBUG << "http2 connection error " << static_cast<uint32_t>(code);
+                if (!goaway_sent_)
+                {
+                    append_frame_header(output_, 8, frame_type::goaway, 0, 0);
+                    append_uint32(output_, last_stream_id_);
+                    append_uint32(output_, static_cast<uint32_t>(code));
+                    goaway_sent_ = true;
+                }
+                return false;
+            }
+
+            void reset_stream(uint32_t stream_id, error_code code)
+            {
+                append_frame_header(output_, 4, frame_type::rst_stream, 0, stream_id);
+                append_uint32(output_, static_cast<uint32_t>(code));
+                auto it = streams_.find(stream_id);
+                if (it != streams_.end())
+                {
+                    bool dispatched = it->second.dispatched;
+                    release_body(it->second);
+                    streams_.erase(it);
+                    if (dispatched)
+                        handler_->handle_stream_reset(stream_id);
+                }
+            }
+
+            void window_update(uint32_t stream_id, uint32_t increment)
+            {
+                append_frame_header(output_, 4, frame_type::window_update, 0, stream_id);
+                append_uint32(output_, increment);
+            }
+
+            // Opens the connection window as far as max_buffered_body_size allows
+            void return_connection_window()
+            {
+                int64_t target = static_cast<int64_t>(max_buffered_body_size - buffered_body_);
+                if (target > conn_recv_window_)
+                {
+                    window_update(0, static_cast<uint32_t>(target - conn_recv_window_));
+                    conn_recv_window_ = target;
+                }
+            }
+
+            // The body of `s' was handed to the handler or dropped; the client may send as much
+            // again
+            void release_body(stream& s)
+            {
+                if (!s.buffered)
+                    return;
+                buffered_body_ -= s.buffered;
+                s.buffered = 0;
+                return_connection_window();
+            }
+
+            void close_stream_if_done(typename std::map<uint32_t, stream>::iterator it)
+            {
+                stream& s = it->second;
+                if (!s.local_closed)
+                    return;
+                if (!s.remote_closed)
+                {
+                    // answered before the request body was complete; the rest is not needed (8.1)
+                    append_frame_header(output_, 4, frame_type::rst_stream, 0, it->first);
+                    append_uint32(output_, static_cast<uint32_t>(error_code::no_error));
+                }
+                release_body(s);
+                streams_.erase(it);
+            }
+
+            void write_header_block(uint32_t stream_id, const std::string& block, bool end_stream)
+            {
+                size_t offset = 0;
+                bool first = true;
+                do
+                {
+                    size_t n = std::min<size_t>(block.size() - offset, peer_max_frame_size_);
+                    bool last = offset + n == block.size();
+                    uint8_t f = last ? flags::end_headers : 0;
+                    if (first && end_stream)
+                        f |= flags::end_stream;
+                    append_frame_header(output_, static_cast<uint32_t>(n), first ? frame_type::headers : frame_type::continuation, f, stream_id);
+                    output_.append(block, offset, n);
+                    offset += n;
+                    first = false;
+                } while (offset < block.size());
+            }
+
+            void flush_pending_data()
+            {
+                for(auto it = streams_.begin(); it != streams_.end() && conn_send_window_ > 0; )
+                {
+                    stream& s = it->second;
+                    if (!s.response_submitted || s.local_closed)
+                    {
+                        ++it;
+                        continue;
+                    }
+                    while (s.pending_offset < s.pending_body.size() && conn_send_window_ > 0 && s.send_window > 0)
+                    {
+                        size_t remaining = s.pending_body.size() - s.pending_offset;
+                        size_t n = std::min<size_t>(remaining, peer_max_frame_size_);
+                        n = std::min<size_t>(n, static_cast<size_t>(std::min(conn_send_window_, s.send_window)));
+                        bool last = n == remaining;
+                        append_frame_header(output_, static_cast<uint32_t>(n), frame_type::data, last ? flags::end_stream : 0, it->first);
+                        output_.append(s.pending_body, s.pending_offset, n);
+                        s.pending_offset += n;
+                        conn_send_window_ -= static_cast<int64_t>(n);
+                        s.send_window -= static_cast<int64_t>(n);
+                        if (last)
+                            s.local_closed = true;
+                    }
+                    if (s.local_closed)
+                    {
+                        auto next = std::next(it);
+                        close_stream_if_done(it);
+                        it = next;
+                    }
+                    else
+                        ++it;
+                }
+            }
+
+            error_code apply_settings(const char* p, size_t size)
+            {
+                for(size_t i = 0; i + 6 <= size; i += 6)
+                {
+                    auto id = static_cast<settings_id>((static_cast<unsigned char>(p[i]) << 8) | static_cast<unsigned char>(p[i+1]));
+                    uint32_t value = read_uint32(p + i + 2);
+                    switch(id)
+                    {
+                        case settings_id::header_table_size:
+                            encoder_.set_max_table_size(std::min<uint32_t>(value, 4096));
+                            break;
+                        case settings_id::enable_push:
+                            if (value > 1)
+                                return error_code::protocol_error;
+                            break;
+                        case settings_id::initial_window_size:
+                            {
+                                if (value > 0x7FFFFFFF)
+                                    return error_code::flow_control_error;
+                                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                                for(auto& kv : streams_)
+                                    kv.second.send_window += delta;
+                                peer_initial_window_ = value;
+                            }
+                            break;
+                        case settings_id::max_frame_size:
+                            if (value < default_max_frame_size || value > 0xFFFFFF)
+                                return error_code::protocol_error;
+                            peer_max_frame_size_ = value;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                return error_code::no_error;
+            }
+
+            // strips padding and priority fields from DATA and HEADERS payloads
+            bool strip_payload(const frame_header& h, const char*& payload, size_t& length)
+            {
+                length = h.length;
+                size_t pad = 0;
+                if (h.flags & flags::padded)
+                {
+                    if (length < 1)
+                        return false;
+                    pad = static_cast<unsigned char>(*payload);
+                    payload ++;
+                    length --;
+                }
+                if (h.type == frame_type::headers && (h.flags & flags::priority))
+                {
+                    if (length < 5)
+                        return false;
+                    payload += 5;
+                    length -= 5;
+                }
+                if (pad > length)
+                    return false;
+                length -= pad;
+                return true;
+            }
+
+            bool process_frame(const frame_header& h, const char* payload)
+            {
+                if (continuation_stream_ && h.type != frame_type::continuation)
+                    return connection_error(error_code::protocol_error);
+                if (!settings_received_ && h.type != frame_type::settings)
+                    return connection_error(error_code::protocol_error);
+
+                switch(h.type)
+                {
+                    case frame_type::data:
+                        return on_data(h, payload);
+                    case frame_type::headers:
+                        return on_headers(h, payload);
+                    case frame_type::continuation:
+                        if (h.stream_id != continuation_stream_)
+                            return connection_error(error_code::protocol_error);
+                        header_block_.append(payload, h.length);
+                        if (header_block_.size() > max_header_block_size)
+                            return connection_error(error_code::enhance_your_calm);
+                        if (h.flags & flags::end_headers)
+                        {
+                            continuation_stream_ = 0;
+                            return on_header_block();
+                        }
+                        return true;
+                    case frame_type::priority:
+                        if (h.stream_id == 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 5)
+                            return connection_error(error_code::frame_size_error);
+                        return true;
+                    case frame_type::rst_stream:
+                        if (h.stream_id == 0 || h.stream_id > last_stream_id_)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 4)
+                            return connection_error(error_code::frame_size_error);
+                        {
+                            auto it = streams_.find(h.stream_id);
+                            if (it != streams_.end())
+                            {
+                                bool dispatched = it->second.dispatched;
+                                release_body(it->second);
+                                streams_.erase(it);
+                                if (dispatched)
+                                    handler_->handle_stream_reset(h.stream_id);
+                            }
+                        }
+                        return true;
+                    case frame_type::settings:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.flags & flags::ack)
+                        {
+                            if (h.length != 0)
+                                return connection_error(error_code::frame_size_error);
+                            return true;
+                        }
+                        if (h.length % 6)
+                            return connection_error(error_code::frame_size_error);
+                        {
+                            error_code ec = apply_settings(payload, h.length);
+                            if (ec != error_code::no_error)
+                                return connection_error(ec);
+                        }
+                        settings_received_ = true;
+                        append_frame_header(output_, 0, frame_type::settings, flags::ack, 0);
+                        flush_pending_data();
+                        return true;
+                    case frame_type::push_promise:
+                        // clients never push
+                        return connection_error(error_code::protocol_error);
+                    case frame_type::ping:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        if (h.length != 8)
+                            return connection_error(error_code::frame_size_error);
+                        if (!(h.flags & flags::ack))
+                        {
+                            append_frame_header(output_, 8, frame_type::ping, flags::ack, 0);
+                            output_.append(payload, 8);
+                        }
+                        return true;
+                    case frame_type::goaway:
+                        if (h.stream_id != 0)
+                            return connection_error(error_code::protocol_error);
+                        goaway_received_ = true;
+                        return true;
+                    case frame_type::window_update:
+                        return on_window_update(h, payload);
+                    default:
+                        // unknown frame types are ignored (4.1)
+                        return true;
+                }
+            }
+
+            bool on_data(const frame_header& h, const char* payload)
+            {
+                if (h.stream_id == 0)
+                    return connection_error(error_code::protocol_error);
+
+                // the whole frame, padding included, counts against flow control; what is not
+                // buffered is handed back at once, the body once it has been passed on
+                conn_recv_window_ -= h.length;
+                if (conn_recv_window_ < 0)
+                    return connection_error(error_code::flow_control_error);
+
+                const char* data = payload;
+                size_t length;
+                if (!strip_payload(h, data, length))
+                    return connection_error(error_code::protocol_error);
+
+                auto it = streams_.find(h.stream_id);
+                if (it == streams_.end() || it->second.remote_closed)
+                {
+                    if (h.stream_id > last_stream_id_)
+                        return connection_error(error_code::protocol_error);
+                    reset_stream(h.stream_id, error_code::stream_closed);
+                    return_connection_window();
+                    return true;
+                }
+
+                stream& s = it->second;
+                s.recv_window -= h.length;
+                if (s.recv_window < 0)
+                {
+                    reset_stream(h.stream_id, error_code::flow_control_error);
+                    return_connection_window();
+                    return true;
+                }
+                if (s.req.body.size() + length > max_body_size)
+                {
+                    // answered now; the rest of the body is discarded as it arrives
+                    submit_response(h.stream_id, 413, {}, {});
+                    return_connection_window();
+                    return true;
+                }
+                s.req.body.append(data, length);
+                s.buffered += length;
+                buffered_body_ += length;
+
+                if (h.flags & flags::end_stream)
+                {
+                    s.remote_closed = true;
+                    dispatch(h.stream_id, s);
+                }
+                else if (s.req.body.size() < max_body_size && s.recv_window < default_window_size)
+                {
+                    // past max_body_size the next frame gets the 413
+                    window_update(h.stream_id, static_cast<uint32_t>(default_window_size - s.recv_window));
+                    s.recv_window = default_window_size;
+                }
+                return_connection_window();
+                return true;
+            }
+
+            bool on_headers(const frame_header& h, const char* payload)
+            {
+                if (h.stream_id == 0 || h.stream_id % 2 == 0)
+                    return connection_error(error_code::protocol_error);
+
+                const char* fragment = payload;
+                size_t length;
+                if (!strip_payload(h, fragment, length))
+                    return connection_error(error_code::protocol_error);
+
+                auto it = streams_.find(h.stream_id);
+                if (it != streams_.end())
+                {
+                    // trailers
+                    if (it->second.remote_closed)
+                        return connection_error(error_code::stream_closed);
+                    if (!(h.flags & flags::end_stream))
+                        return connection_error(error_code::protocol_error);
+                }
+                else if (h.stream_id <= last_stream_id_)
+                    return connection_error(error_code::stream_closed);
+
+                header_stream_ = h.stream_id;
+                header_end_stream_ = (h.flags & flags::end_stream) != 0;
+                header_block_.assign(fragment, length);
+                if (h.flags & flags::end_headers)
+                    return on_header_block();
+                continuation_stream_ = h.stream_id;
+                return true;
+            }
+
+            bool on_header_block()
+            {
+                hpack::header_list fields;
+                try
+                {
+                    // decoded even for refused streams; the table state is shared by all of them
+                    decoder_.decode(header_block_.data(), header_block_.size(), fields);
+                }
+                catch(std::exception& e)
+                {
+                    CROW_LOG_DEBUG << e.what();
+                    return connection_error(error_code::compression_error);
+                }
+                header_block_.clear();
+
+                uint32_t stream_id = header_stream_;
+                auto it = streams_.find(stream_id);
+                if (it != streams_.end())
+                {
+                    // trailer fields are not passed on
+                    it->second.remote_closed = true;
+                    dispatch(stream_id, it->second);
+                    return true;
+                }
+
+                last_stream_id_ = stream_id;
+                if (streams_.size() >= max_concurrent_streams || goaway_received_)
+                {
+                    reset_stream(stream_id, error_code::refused_stream);
+                    return true;
+                }
+
+                stream& s = open_stream(stream_id);
+                if (!build_request(fields, s))
+                {
+                    reset_stream(stream_id, error_code::protocol_error);
+                    return true;
+                }
+                if (header_end_stream_)
+                {
+                    s.remote_closed = true;
+                    dispatch(stream_id, s);
+                }
+                return true;
+            }
+
+            // 8.1.2 request pseudo-header fields; returns false for a malformed request
+            bool build_request(hpack::header_list& fields, stream& s)
+            {
+                request& req = s.req;
+                std::string authority;
+                bool regular_seen = false;
+                for(auto& kv : fields)
+                {
+                    auto& name = kv.first;
+                    if (!name.empty() && name[0] == ':')
+                    {
+                        if (regular_seen)
+                            return false;
+                        if (name == ":method")
+                            s.method = std::move(kv.second);
+                        else if (name == ":path")
+                            req.raw_url = std::move(kv.second);
+                        else if (name == ":authority")
+                            authority = std::move(kv.second);
+                        else if (name != ":scheme")
+                            return false;
+                        continue;
+                    }
+                    regular_seen = true;
+                    if (std::any_of(name.begin(), name.end(), [](char c){ return c >= 'A' && c <= 'Z'; }))
+                        return false;
+                    if (name == "connection")
+                        return false;
+                    if (name == "cookie" && req.headers.count(known_header::cookie))
+                    {
+                        // split cookie fields are joined again for HTTP/1 style consumers (8.1.2.5)
+                        auto& cookie = req.headers.find(known_header::cookie)->second;
+                        cookie += "; ";
+                        cookie += kv.second;
+                        continue;
+                    }
+                    req.headers.emplace(std::move(kv.first), std::move(kv.second));
+                }
+                if (s.method.empty() || req.raw_url.empty())
+                    return false;
+                if (!authority.empty() && !req.headers.count(known_header::host))
+                    req.headers.emplace("host", std::move(authority));
+
+                req.url = req.raw_url.substr(0, req.raw_url.find("?"));
+                auto query_pos = req.raw_url.find_first_of("?#");
+                if (query_pos != std::string::npos)
+                    req.url_params = query_string(req.raw_url.substr(query_pos));
+                return true;
+            }
+
+            void dispatch(uint32_t stream_id, stream& s)
+            {
+                for(int i = 0; i < static_cast<int>(HTTPMethod::InternalMethodCount); i ++)
+                {
+                    if (method_name(static_cast<HTTPMethod>(i)) == s.method)
+                    {
+                        s.req.method = static_cast<HTTPMethod>(i);
+                        release_body(s);
+                        s.dispatched = true;
+                        handler_->handle_stream(stream_id, std::move(s.req));
+                        return;
+                    }
+                }
+                submit_response(stream_id, 501, {}, {});
+            }
+
+            bool on_window_update(const frame_header& h, const char* payload)
+            {
+                if (h.length != 4)
+                    return connection_error(error_code::frame_size_error);
+                uint32_t increment = read_uint32(payload) & 0x7FFFFFFF;
+                if (h.stream_id == 0)
+                {
+                    if (increment == 0)
+                        return connection_error(error_code::protocol_error);
+                    conn_send_window_ += increment;
+                    if (conn_send_window_ > 0x7FFFFFFF)
+                        return connection_error(error_code::flow_control_error);
+                }
+                else
+                {
+                    auto it = streams_.find(h.stream_id);
+                    if (it == streams_.end())
+                    {
+                        if (h.stream_id > last_stream_id_)
+                            return connection_error(error_code::protocol_error);
+                        return true;
+                    }
+                    if (increment == 0)
+                    {
+                        reset_stream(h.stream_id, error_code::protocol_error);
+                        return true;
+                    }
+                    it->second.send_window += increment;
+                    if (it->second.send_window > 0x7FFFFFFF)
+                    {
+                        reset_stream(h.stream_id, error_code::flow_control_error);
+                        return true;
+                    }
+                }
+                flush_pending_data();
+                return true;
+            }
+
+            Handler* handler_;
+
+            std::string input_;
+            std::string output_;
+
+            hpack::decoder decoder_;
+            hpack::encoder encoder_;
+
+            std::map<uint32_t, stream> streams_;
+            uint32_t last_stream_id_{};
+
+            std::string header_block_;
+            uint32_t header_stream_{};
+            bool header_end_stream_{};
+            uint32_t continuation_stream_{};
+
+            int64_t conn_send_window_{default_window_size};
+            int64_t conn_recv_window_{default_window_size};
+            // bytes of request bodies that are still being received
+            size_t buffered_body_{};
+            int64_t peer_initial_window_{default_window_size};
+            uint32_t peer_max_frame_size_{default_max_frame_size};
+
+            bool preface_received_{};
+            bool settings_received_{};
+            bool goaway_sent_{};
+            bool goaway_received_{};
+        };
+    }
+}
@@ -3,17 +3,22 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/array.hpp>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "crow/http_parser_merged.h"
 
 #include "crow/parser.h"
 #include "crow/http_response.h"
+#include "crow/http2.h"
 #include "crow/logging.h"
 #include "crow/settings.h"
 #include "crow/dumb_timer_queue.h"
+#include "crow/handler_arena.h"
 #include "crow/middleware_context.h"
 #include "crow/socket_adaptors.h"
 
@@ -187,7 +192,7 @@ namespace crow
             Handler* handler,
             const std::string& server_name,
             std::tuple<Middlewares...>* middlewares,
-            std::function<std::string()>& get_cached_date_str_f,
+            std::function<const std::string&()>& get_cached_date_str_f,
             detail::dumb_timer_queue& timer_queue,
             typename Adaptor::context* adaptor_ctx_
             )
@@ -208,6 +213,7 @@ namespace crow
         ~Connection()
         {
             res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
             cancel_deadline_timer();
 #ifdef CROW_ENABLE_DEBUG
             connectionCount --;
@@ -225,6 +231,10 @@ namespace crow
             adaptor_.start([this](const boost::system::error_code& ec) {
                 if (!ec)
                 {
+                    // kept for the requests to copy; the socket may be gone by the time a
+                    // handler asks
+                    boost::system::error_code endpoint_ec;
+                    remote_endpoint_ = adaptor_.remote_endpoint(endpoint_ec);
                     start_deadline();
 
                     do_read();
@@ -239,11 +249,11 @@ namespace crow
         void handle_header()
         {
             // HTTP 1.1 Expect: 100-continue
-            if (parser_.check_version(1, 1) && parser_.headers.count("expect") && get_header_value(parser_.headers, "expect") == "100-continue")
+            if (parser_.check_version(1, 1) && parser_.get_header_value("expect") == "100-continue")
             {
-                buffers_.clear();
                 static std::string expect_100_continue = "HTTP/1.1 100 Continue\r\n\r\n";
-                buffers_.emplace_back(expect_100_continue.data(), expect_100_continue.size());
+                buffers_[0] = boost::asio::buffer(expect_100_continue);
+                buffers_[1] = boost::asio::const_buffer();
                 do_write();
             }
         }
@@ -254,17 +264,17 @@ namespace crow
             bool is_invalid_request = false;
             add_keep_alive_ = false;
 
-            req_ = std::move(parser_.to_request());
+            parser_.to_request(req_);
             request& req = req_;
+            req.remoteIpAddress = remote_endpoint_;
 
-            req.remoteIpAddress = adaptor_.remote_endpoint().address().to_string();
-
+            auto connection = req.headers.find(known_header::connection);
             if (parser_.check_version(1, 0))
             {
                 // HTTP/1.0
-                if (req.headers.count("connection"))
+                if (connection != req.headers.end())
                 {
-                    if (boost::iequals(req.get_header_value("connection"),"Keep-Alive"))
+                    if (boost::iequals(connection->second, "Keep-Alive"))
                         add_keep_alive_ = true;
                 }
                 else
@@ -273,35 +283,30 @@ namespace crow
             else if (parser_.check_version(1, 1))
             {
                 // HTTP/1.1
-                if (req.headers.count("connection"))
+                if (connection != req.headers.end())
                 {
-                    if (req.get_header_value("connection") == "close")
+                    if (connection->second == "close")
                         close_connection_ = true;
-                    else if (boost::iequals(req.get_header_value("connection"),"Keep-Alive"))
+                    else if (boost::iequals(connection->second, "Keep-Alive"))
                         add_keep_alive_ = true;
                 }
-                if (!req.headers.count("host"))
+                if (!req.headers.count(known_header::host))
                 {
                     is_invalid_request = true;
                     res = response(400);
                 }
 				if (parser_.is_upgrade())
 				{
-					if (req.get_header_value("upgrade") == "h2c")
-					{
-						// TODO HTTP/2
-                        // currently, ignore upgrade header
-					}
-                    else
-                    {
-                        close_connection_ = true;
-                        handler_->handle_upgrade(req, res, std::move(adaptor_));
-                        return;
-                    }
+                    close_connection_ = true;
+                    handler_->handle_upgrade(req, res, std::move(adaptor_));
+                    return;
 				}
+                // without exactly one HTTP2-Settings the h2c upgrade is ignored (RFC 7540 3.2.1)
+                if (parser_.is_h2c_upgrade() && !is_invalid_request && req.headers.count(known_header::http2_settings) == 1 && start_http2_upgrade())
+                    return;
             }
 
-            CROW_LOG_INFO << "Request: " << boost::lexical_cast<std::string>(adaptor_.remote_endpoint()) << " " << this << " HTTP/" << parser_.http_major << "." << parser_.http_minor << ' '
+            CROW_LOG_INFO << "Request: " << req.remoteIpAddress << ":" << remote_endpoint_.port() << " " << this << " HTTP/" << parser_.http_major << "." << parser_.http_minor << ' '
              << method_name(req.method) << " " << req.url;
 
 
@@ -310,6 +315,7 @@ namespace crow
             {
                 res.complete_request_handler_ = []{};
                 res.is_alive_helper_ = [this]()->bool{ return adaptor_.is_open(); };
+                res.io_service_ = &adaptor_.get_io_service();
 
                 ctx_ = detail::context<Middlewares...>();
                 req.middleware_context = (void*)&ctx_;
@@ -320,9 +326,9 @@ namespace crow
                 {
                     res.complete_request_handler_ = [this]{ this->complete_request(); };
                     need_to_call_after_handlers_ = true;
+                    // the Keep-Alive header is written by complete_request; once the handler has
+                    // run, the response may belong to another thread
                     handler_->handle(req, res);
-                    if (add_keep_alive_)
-                        res.set_header("connection", "Keep-Alive");
                 }
                 else
                 {
@@ -338,6 +344,8 @@ namespace crow
         void complete_request()
         {
             CROW_LOG_INFO << "Response: " << this << ' ' << req_.raw_url << ' ' << res.code << ' ' << close_connection_;
+            // the deadline ran while the handler did; a keep-alive connection restarts it below
+            cancel_deadline_timer();
 
             if (need_to_call_after_handlers_)
             {
@@ -353,11 +361,13 @@ namespace crow
 
             //auto self = this->shared_from_this();
             res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
 
             if (!adaptor_.is_open())
             {
                 //CROW_LOG_DEBUG << this << " delete (socket is closed) " << is_reading << ' ' << is_writing;
-                //delete this;
+                // the client went away while the handler was running; nothing else refers to us
+                check_destroy();
                 return;
             }
 
@@ -395,82 +405,187 @@ namespace crow
             static std::string seperator = ": ";
             static std::string crlf = "\r\n";
 
-            buffers_.clear();
-            buffers_.reserve(4*(res.headers.size()+5)+3);
-
             if (res.body.empty() && res.json_value.t() == json::type::Object)
             {
                 res.body = json::dump(res.json_value);
             }
 
-            if(res.bytes.empty())
+            // the body is swapped out rather than copied; both copies keep their capacity
+            // for the next response
+            boost::asio::const_buffer body;
+            if (!res.bytes.empty())
             {
-                std::copy(res.body.begin(), res.body.end(), std::back_inserter(res.bytes));
+                res_bytes_copy_.swap(res.bytes);
+                body = boost::asio::buffer(res_bytes_copy_);
+            }
+            else
+            {
+                res_body_copy_.swap(res.body);
+                body = boost::asio::buffer(res_body_copy_);
             }
 
             if (!statusCodes.count(res.code))
                 res.code = 500;
-            {
-                auto& status = statusCodes.find(res.code)->second;
-                buffers_.emplace_back(status.data(), status.size());
-            }
+            // the head goes into one buffer that is cleared, not freed, after each write
+            head_.clear();
+            head_ += statusCodes.find(res.code)->second;
 
             if (res.code >= 400 && res.body.empty())
                 res.body = statusCodes[res.code].substr(9);
 
             for(auto& kv : res.headers)
             {
-                buffers_.emplace_back(kv.first.data(), kv.first.size());
-                buffers_.emplace_back(seperator.data(), seperator.size());
-                buffers_.emplace_back(kv.second.data(), kv.second.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
-
+                head_ += kv.first;
+                head_ += seperator;
+                head_ += kv.second;
+                head_ += crlf;
             }
 
-            if (!res.headers.count("content-length"))
+            if (!res.headers.count(known_header::content_length))
             {
-                content_length_ = std::to_string(res.bytes.size());
-                static std::string content_length_tag = "Content-Length: ";
-                buffers_.emplace_back(content_length_tag.data(), content_length_tag.size());
-                buffers_.emplace_back(content_length_.data(), content_length_.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
+                head_ += "Content-Length: ";
+                head_ += std::to_string(boost::asio::buffer_size(body));
+                head_ += crlf;
             }
-            if (!res.headers.count("server"))
+            if (!res.headers.count(known_header::server))
             {
-                static std::string server_tag = "Server: ";
-                buffers_.emplace_back(server_tag.data(), server_tag.size());
-                buffers_.emplace_back(server_name_.data(), server_name_.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
+                head_ += "Server: ";
+                head_ += server_name_;
+                head_ += crlf;
             }
-            if (!res.headers.count("date"))
+            if (!res.headers.count(known_header::date))
             {
-                static std::string date_tag = "Date: ";
-                date_str_ = get_cached_date_str();
-                buffers_.emplace_back(date_tag.data(), date_tag.size());
-                buffers_.emplace_back(date_str_.data(), date_str_.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
+                head_ += "Date: ";
+                head_ += get_cached_date_str();
+                head_ += crlf;
             }
             if (add_keep_alive_)
             {
-                static std::string keep_alive_tag = "Connection: Keep-Alive";
-                buffers_.emplace_back(keep_alive_tag.data(), keep_alive_tag.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
+                head_ += "Connection: Keep-Alive";
+                head_ += crlf;
             }
+            head_ += crlf;
 
-            buffers_.emplace_back(crlf.data(), crlf.size());
-            //res_body_copy_.swap(res.body);
-            res_bytes_copy_.swap(res.bytes);
-            //buffers_.emplace_back(res_body_copy_.data(), res_body_copy_.size());
-            buffers_.emplace_back(res_bytes_copy_.data(), res_bytes_copy_.size());
+            buffers_[0] = boost::asio::buffer(head_);
+            buffers_[1] = body;
 
             do_write();
 
             if (need_to_start_read_after_complete_)
             {
-                need_to_start_read_after_complete_ = false;
                 start_deadline();
-                do_read();
+                // otherwise the disconnect watch starts reading when it completes
+                if (!is_watching_disconnect_)
+                {
+                    need_to_start_read_after_complete_ = false;
+                    do_read();
+                }
+            }
+        }
+
+        // HTTP/2: called by the session for every complete request. Streams are handled like
+        // HTTP/1 requests, except that any number of them can be pending at once.
+        void handle_stream(uint32_t stream_id, request&& r)
+        {
+            cancel_deadline_timer();
+            std::unique_ptr<http2_stream> owned(new http2_stream);
+            http2_stream& s = *owned;
+            http2_streams_[stream_id] = std::move(owned);
+
+            s.req = std::move(r);
+            request& req = s.req;
+            response& res = s.res;
+            req.remoteIpAddress = remote_endpoint_;
+
+            CROW_LOG_INFO << "Request: " << req.remoteIpAddress << ":" << remote_endpoint_.port() << " " << this << " HTTP/2 stream " << stream_id << ' '
+             << method_name(req.method) << " " << req.url;
+
+            res.complete_request_handler_ = []{};
+            res.is_alive_helper_ = [this]()->bool{ return adaptor_.is_open(); };
+            res.io_service_ = &adaptor_.get_io_service();
+
+            req.middleware_context = (void*)&s.ctx;
+            req.io_service = &adaptor_.get_io_service();
+            detail::middleware_call_helper<0, decltype(s.ctx), decltype(*middlewares_), Middlewares...>(*middlewares_, req, res, s.ctx);
+
+            if (!res.completed_)
+            {
+                res.complete_request_handler_ = [this, stream_id]{ this->complete_http2_request(stream_id); };
+                s.need_to_call_after_handlers = true;
+                handler_->handle(req, res);
+            }
+            else
+            {
+                complete_http2_request(stream_id);
+            }
+        }
+
+        // HTTP/2: the client cancelled the stream
+        void handle_stream_reset(uint32_t stream_id)
+        {
+            auto it = http2_streams_.find(stream_id);
+            if (it == http2_streams_.end())
+                return;
+            auto handler = std::move(it->second->res.disconnect_handler_);
+            it->second->res.disconnect_handler_ = nullptr;
+            if (handler)
+                handler();
+        }
+
+        void complete_http2_request(uint32_t stream_id)
+        {
+            auto it = http2_streams_.find(stream_id);
+            if (it == http2_streams_.end())
+                return;
+            // the response may be in the middle of end(); it is freed on the next io callback
+            http2_finished_streams_.push_back(std::move(it->second));
+            http2_streams_.erase(it);
+            request& req = http2_finished_streams_.back()->req;
+            response& res = http2_finished_streams_.back()->res;
+
+            CROW_LOG_INFO << "Response: " << this << ' ' << req.raw_url << ' ' << res.code << " HTTP/2 stream " << stream_id;
+
+            if (http2_finished_streams_.back()->need_to_call_after_handlers)
+            {
+                auto& ctx = http2_finished_streams_.back()->ctx;
+                detail::after_handlers_call_helper<
+                    ((int)sizeof...(Middlewares)-1),
+                    typename std::remove_reference<decltype(ctx)>::type,
+                    decltype(*middlewares_)>
+                (*middlewares_, ctx, req, res);
+            }
+
+            res.complete_request_handler_ = nullptr;
+            res.disconnect_handler_ = nullptr;
+
+            if (adaptor_.is_open())
+            {
+                if (res.body.empty() && res.json_value.t() == json::type::Object)
+                {
+                    res.body = json::dump(res.json_value);
+                }
+                std::string body = res.bytes.empty() ? std::move(res.body) : std::string(res.bytes.begin(), res.bytes.end());
+
+                http2::hpack::header_list headers;
+                headers.reserve(res.headers.size() + 3);
+                for(auto& kv : res.headers)
+                    headers.emplace_back(kv.first, kv.second);
+                if (!res.headers.count(known_header::content_length))
+                    headers.emplace_back("content-length", std::to_string(body.size()));
+                if (!res.headers.count(known_header::server))
+                    headers.emplace_back("server", server_name_);
+                if (!res.headers.count(known_header::date))
+                    headers.emplace_back("date", get_cached_date_str());
+                if (req.method == HTTPMethod::Head)
+                    body.clear();
+
+                http2_->submit_response(stream_id, res.code, headers, std::move(body));
+                flush_http2();
+                if (http2_streams_.empty() && is_reading)
+                    start_deadline();
             }
+
+            check_destroy();
         }
 
     private:
@@ -478,13 +593,31 @@ namespace crow
         {
             //auto self = this->shared_from_this();
             is_reading = true;
-            adaptor_.socket().async_read_some(boost::asio::buffer(buffer_),
-                [this](const boost::system::error_code& ec, std::size_t bytes_transferred)
+            auto space = parser_.prepare();
+            const char* data = boost::asio::buffer_cast<const char*>(space);
+            adaptor_.socket().async_read_some(space, detail::make_arena_handler(handler_arena_,
+                [this, data](const boost::system::error_code& ec, std::size_t bytes_transferred)
                 {
+                    if (!ec && is_first_read_ && is_http2_preface(data, bytes_transferred))
+                    {
+                        // HTTP/2 with prior knowledge
+                        http2_.reset(new http2::session<Connection>(this));
+                        http2_->start();
+                        on_http2_read(data, bytes_transferred);
+                        return;
+                    }
+                    is_first_read_ = false;
+
                     bool error_while_reading = true;
                     if (!ec)
                     {
-                        bool ret = parser_.feed(buffer_.data(), static_cast<int>(bytes_transferred));
+                        bool ret = parser_.commit(bytes_transferred);
+                        if (http2_)
+                        {
+                            // upgraded to h2c; whatever followed the request is HTTP/2 already
+                            on_http2_read(data + parser_.parsed_length, bytes_transferred - parser_.parsed_length);
+                            return;
+                        }
                         if (ret && adaptor_.is_open())
                         {
                             error_while_reading = false;
@@ -502,8 +635,15 @@ namespace crow
                     }
                     else if (close_connection_)
                     {
-                        cancel_deadline_timer();
                         parser_.done();
+                        if (need_to_call_after_handlers_)
+                        {
+                            // res will be completed later by user; the watch ends the read
+                            start_deadline();
+                            watch_disconnect();
+                            return;
+                        }
+                        cancel_deadline_timer();
                         is_reading = false;
                         check_destroy();
                         // adaptor will close after write
@@ -517,6 +657,55 @@ namespace crow
                     {
                         // res will be completed later by user
                         need_to_start_read_after_complete_ = true;
+                        start_deadline();
+                        watch_disconnect();
+                    }
+                }));
+        }
+
+        // Nothing reads from the socket while a handler is completing the response
+        // asynchronously, so watch it to tell the handler when the client goes away. The
+        // deadline keeps running meanwhile; when it closes the socket the watch ends the same
+        // way, so a handler that takes too long is told to give up too.
+        void watch_disconnect()
+        {
+            is_watching_disconnect_ = true;
+            adaptor_.wait_readable(
+                [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                {
+                    is_watching_disconnect_ = false;
+                    if (need_to_call_after_handlers_)
+                    {
+                        boost::system::error_code available_ec;
+                        if (!ec && adaptor_.raw_socket().available(available_ec) && !available_ec)
+                        {
+                            // pipelined request; read after the response is completed,
+                            // unless the connection closes after it anyway
+                            if (close_connection_)
+                                is_reading = false;
+                            return;
+                        }
+
+                        CROW_LOG_DEBUG << this << " connection closed before the response was completed";
+                        is_reading = false;
+                        adaptor_.close();
+
+                        // the handler may complete the response (and so destroy us) right away
+                        auto handler = std::move(res.disconnect_handler_);
+                        res.disconnect_handler_ = nullptr;
+                        if (handler)
+                            handler();
+                    }
+                    else if (need_to_start_read_after_complete_)
+                    {
+                        need_to_start_read_after_complete_ = false;
+                        do_read();
+                    }
+                    else
+                    {
+                        // Connection: close; the socket was closed after the response was written
+                        is_reading = false;
+                        check_destroy();
                     }
                 });
         }
@@ -525,12 +714,20 @@ namespace crow
         {
             //auto self = this->shared_from_this();
             is_writing = true;
-            boost::asio::async_write(adaptor_.socket(), buffers_,
+            boost::asio::async_write(adaptor_.socket(), buffers_, detail::make_arena_handler(handler_arena_,
                 [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
                 {
                     is_writing = false;
                     res.clear();
                     res_body_copy_.clear();
+                    res_bytes_copy_.clear();
+                    if (http2_)
+                    {
+                        // the 100 Continue of an h2c upgrade request; frames may be queued behind it
+                        flush_http2();
+                        check_destroy();
+                        return;
+                    }
                     if (!ec)
                     {
                         if (close_connection_)
@@ -545,13 +742,127 @@ namespace crow
                         CROW_LOG_DEBUG << this << " from write(2)";
                         check_destroy();
                     }
-                });
+                }));
+        }
+
+        bool is_http2_preface(const char* data, std::size_t size)
+        {
+            // "PRI " alone already rules out every HTTP/1 method
+            if (size < 4)
+                return false;
+            std::size_t n = std::min(size, http2::client_preface_size);
+            return std::equal(data, data + n, http2::client_preface);
+        }
+
+        bool start_http2_upgrade()
+        {
+            http2_.reset(new http2::session<Connection>(this));
+            if (!http2_->upgrade(req_.get_header_value(known_header::http2_settings)))
+            {
+                http2_.reset();
+                return false;
+            }
+            // whatever follows the request is HTTP/2; stop the parser right after it
+            http_parser_pause(&parser_, 1);
+
+            // written on its own: some clients cannot take much data following the 101 in one read
+            http2_->output() = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+            http2_->start();
+            flush_http2();
+
+            handle_stream(1, std::move(req_));
+            return true;
+        }
+
+        void on_http2_read(const char* data, std::size_t size)
+        {
+            if (http2_->feed(data, size) && !http2_->is_finished())
+            {
+                if (http2_streams_.empty())
+                    start_deadline();
+                flush_http2();
+                do_read_http2();
+                return;
+            }
+
+            // a GOAWAY, if any, is written before the socket is closed
+            cancel_deadline_timer();
+            close_connection_ = true;
+            flush_http2();
+            notify_http2_disconnect();
+            is_reading = false;
+            check_destroy();
+        }
+
+        void do_read_http2()
+        {
+            is_reading = true;
+            adaptor_.socket().async_read_some(boost::asio::buffer(buffer_), detail::make_arena_handler(handler_arena_,
+                [this](const boost::system::error_code& ec, std::size_t bytes_transferred)
+                {
+                    http2_finished_streams_.clear();
+                    if (!ec && adaptor_.is_open())
+                    {
+                        on_http2_read(buffer_.data(), bytes_transferred);
+                        return;
+                    }
+
+                    cancel_deadline_timer();
+                    adaptor_.close();
+                    // still reading as far as check_destroy is concerned, so a handler ending
+                    // its response from the disconnect handler cannot delete us here
+                    notify_http2_disconnect();
+                    is_reading = false;
+                    CROW_LOG_DEBUG << this << " from read(http2)";
+                    check_destroy();
+                }));
+        }
+
+        void notify_http2_disconnect()
+        {
+            std::vector<uint32_t> stream_ids;
+            for(auto& kv : http2_streams_)
+                stream_ids.push_back(kv.first);
+            for(auto stream_id : stream_ids)
+                handle_stream_reset(stream_id);
+        }
+
+        // one write in flight at a time; frames queued meanwhile go out when it completes
+        void flush_http2()
+        {
+            if (is_writing)
+                return;
+            if (http2_->output().empty())
+            {
+                if (close_connection_)
+                    adaptor_.close();
+                return;
+            }
+
+            is_writing = true;
+            http2_write_buffer_.clear();
+            http2_write_buffer_.swap(http2_->output());
+            boost::asio::async_write(adaptor_.socket(), boost::asio::buffer(http2_write_buffer_), detail::make_arena_handler(handler_arena_,
+                [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/)
+                {
+                    is_writing = false;
+                    http2_finished_streams_.clear();
+                    if (ec)
+                    {
+                        adaptor_.close();
+                        CROW_LOG_DEBUG << this << " from write(http2)";
+                        check_destroy();
+                        return;
+                    }
+                    flush_http2();
+                    check_destroy();
+                }));
         }
 
         void check_destroy()
         {
             CROW_LOG_DEBUG << this << " is_reading " << is_reading << " is_writing " << is_writing;
-            if (!is_reading && !is_writing)
+            if (!is_reading && !is_writing && http2_streams_.empty())
             {
                 CROW_LOG_DEBUG << this << " delete (idle) ";
                 delete this;
@@ -581,8 +892,10 @@ namespace crow
 
     private:
         Adaptor adaptor_;
+        boost::asio::ip::tcp::endpoint remote_endpoint_;
         Handler* handler_;
 
+        // HTTP/1 reads go to the parser's buffer; this one is for HTTP/2
         boost::array<char, 4096> buffer_;
 
         HTTPParser<Connection> parser_;
@@ -592,13 +905,16 @@ namespace crow
         bool close_connection_ = false;
 
         const std::string& server_name_;
-        std::vector<boost::asio::const_buffer> buffers_;
+        // the response head and body, or a 100 Continue
+        std::array<boost::asio::const_buffer, 2> buffers_;
 
-        std::string content_length_;
-        std::string date_str_;
+        std::string head_;
         std::string res_body_copy_;
         std::vector<char> res_bytes_copy_;
 
+        // memory for the read and write operations above
+        detail::handler_arena handler_arena_;
+
         //boost::asio::deadline_timer deadline_;
         detail::dumb_timer_queue::key timer_cancel_key_;
 
@@ -606,12 +922,27 @@ namespace crow
         bool is_writing{};
         bool need_to_call_after_handlers_{};
         bool need_to_start_read_after_complete_{};
+        bool is_watching_disconnect_{};
         bool add_keep_alive_{};
 
         std::tuple<Middlewares...>* middlewares_;
         detail::context<Middlewares...> ctx_;
 
-        std::function<std::string()>& get_cached_date_str;
+        struct http2_stream
+        {
+            request req;
+            response res;
+            detail::context<Middlewares...> ctx;
+            bool need_to_call_after_handlers{};
+        };
+
+        bool is_first_read_{true};
+        std::unique_ptr<http2::session<Connection>> http2_;
+        std::map<uint32_t, std::unique_ptr<http2_stream>> http2_streams_;
+        std::vector<std::unique_ptr<http2_stream>> http2_finished_streams_;
+        std::string http2_write_buffer_;
+
+        std::function<const std::string&()>& get_cached_date_str;
         detail::dumb_timer_queue& timer_queue;
     };
 
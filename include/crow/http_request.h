@@ -8,12 +8,13 @@
 
 namespace crow
 {
-    template <typename T>
-    inline const std::string& get_header_value(const T& headers, const std::string& key)
+    template <typename T, typename Key>
+    inline const std::string& get_header_value(const T& headers, const Key& key)
     {
-        if (headers.count(key))
+        auto it = headers.find(key);
+        if (it != headers.end())
         {
-            return headers.find(key)->second;
+            return it->second;
         }
         static std::string empty;
         return empty;
@@ -21,6 +22,58 @@ namespace crow
 
 	struct DetachHelper;
 
+    // The peer's address as a string, the way request::remoteIpAddress has always been one.
+    // The connection only copies in the endpoint; the text is made on first use, since most
+    // handlers never ask for it.
+    class remote_address
+    {
+    public:
+        remote_address() = default;
+
+        remote_address& operator = (const boost::asio::ip::tcp::endpoint& endpoint)
+        {
+            endpoint_ = endpoint;
+            has_endpoint_ = true;
+            text_.clear();
+            return *this;
+        }
+
+        remote_address& operator = (std::string text)
+        {
+            text_ = std::move(text);
+            has_endpoint_ = false;
+            return *this;
+        }
+
+        const std::string& str() const
+        {
+            if (text_.empty() && has_endpoint_)
+            {
+                boost::system::error_code ec;
+                text_ = endpoint_.address().to_string(ec);
+            }
+            return text_;
+        }
+
+        operator const std::string&() const { return str(); }
+        const char* c_str() const { return str().c_str(); }
+        size_t size() const { return str().size(); }
+        bool empty() const { return str().empty(); }
+
+        const boost::asio::ip::tcp::endpoint& endpoint() const { return endpoint_; }
+
+        friend bool operator == (const remote_address& l, const std::string& r) { return l.str() == r; }
+        friend bool operator == (const std::string& l, const remote_address& r) { return l == r.str(); }
+        friend bool operator != (const remote_address& l, const std::string& r) { return l.str() != r; }
+        friend bool operator != (const std::string& l, const remote_address& r) { return l != r.str(); }
+        friend std::ostream& operator << (std::ostream& os, const remote_address& a) { return os << a.str(); }
+
+    private:
+        boost::asio::ip::tcp::endpoint endpoint_;
+        mutable std::string text_;
+        bool has_endpoint_{};
+    };
+
     struct request
     {
         HTTPMethod method;
@@ -29,7 +82,7 @@ namespace crow
         query_string url_params;
         ci_map headers;
         std::string body;
-        std::string remoteIpAddress;
+        remote_address remoteIpAddress;
 
         void* middleware_context{};
         boost::asio::io_service* io_service{};
@@ -54,6 +107,11 @@ namespace crow
             return crow::get_header_value(headers, key);
         }
 
+        const std::string& get_header_value(known_header key) const
+        {
+            return crow::get_header_value(headers, key);
+        }
+
         template<typename CompletionHandler>
         void post(CompletionHandler handler)
         {
@@ -65,6 +123,5 @@ namespace crow
         {
             io_service->dispatch(handler);
         }
-
     };
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 #include "crow/json.h"
 #include "crow/http_request.h"
@@ -11,10 +12,24 @@ namespace crow
 {
     template <typename Adaptor, typename Handler, typename ... Middlewares>
     class Connection;
+    class Router;
+    struct response;
+
+    namespace detail
+    {
+        // What a DetachHelper completes; `res' is cleared on the io thread once the exchange
+        // is over, so a late completion finds nothing to do.
+        struct detached_exchange
+        {
+            response* res;
+        };
+    }
+
     struct response
     {
         template <typename Adaptor, typename Handler, typename ... Middlewares>
         friend class crow::Connection;
+        friend class crow::Router;
 
         int code{200};
         std::string body;
@@ -39,6 +54,11 @@ namespace crow
             return crow::get_header_value(headers, key);
         }
 
+        const std::string& get_header_value(known_header key)
+        {
+            return crow::get_header_value(headers, key);
+        }
+
 
         response() {}
         explicit response(int code) : code(code) {}
@@ -66,6 +86,11 @@ namespace crow
 
         response& operator = (const response& r) = delete;
 
+        ~response()
+        {
+            forget_detached();
+        }
+
         response& operator = (response&& r) noexcept
         {
             body = std::move(r.body);
@@ -90,6 +115,7 @@ namespace crow
             code = 200;
             headers.clear();
             completed_ = false;
+            keep_alive_.reset();
         }
 
         void redirect(const std::string& location)
@@ -113,6 +139,8 @@ namespace crow
             if (!completed_)
             {
                 completed_ = true;
+                forget_detached();
+                keep_alive_.reset();
 
                 if (complete_request_handler_)
                 {
@@ -127,15 +155,49 @@ namespace crow
             end();
         }
 
+        // Starts a JSON body that is written in place, with no wvalue tree in between. The
+        // writer appends to `body', so it must not outlive the response.
+        json::writer write_json()
+        {
+            json_mode();
+            return json::writer(body);
+        }
+
         bool is_alive()
         {
             return is_alive_helper_ && is_alive_helper_();
         }
 
+        // `handler' is called on the connection's io_service if the client disconnects
+        // before end() is called; use it to abandon expensive work. The connection is
+        // already closed at that point, but end() must still be called.
+        void on_disconnect(std::function<void()> handler)
+        {
+            disconnect_handler_ = std::move(handler);
+        }
+
+        // Hands the response over to another thread. After this, the handler must not touch
+        // the response on the io_service thread; the returned helper completes it instead.
+        DetachHelper detach();
+
         private:
+            boost::asio::io_service* io_service_{};
             bool completed_{};
             std::function<void()> complete_request_handler_;
             std::function<bool()> is_alive_helper_;
+            std::function<void()> disconnect_handler_;
+            std::shared_ptr<detail::detached_exchange> detached_;
+            // the route of a response that is ended after its handler returns
+            std::shared_ptr<void> keep_alive_;
+
+            void forget_detached()
+            {
+                if (detached_)
+                {
+                    detached_->res = nullptr;
+                    detached_.reset();
+                }
+            }
 
             //In case of a JSON object, set the Content-Type header
             void json_mode()
@@ -143,4 +205,75 @@ namespace crow
                 set_header("Content-Type", "application/json");
             }
     };
+
+    // Completes a detached response from any thread. The helper fills in a response of its
+    // own, which is moved into the connection's on the io_service owning the connection, so
+    // the connection itself is only ever touched by that thread. The helper can be moved but
+    // not copied, and ends the response at most once. An end() that arrives after the
+    // exchange is already over, because the handler threw and was answered with a 500 or the
+    // response was ended some other way, is dropped rather than completing the connection's
+    // next response.
+    struct DetachHelper
+    {
+        DetachHelper(std::shared_ptr<detail::detached_exchange> exchange, boost::asio::io_service* io_service)
+            : exchange_(std::move(exchange)), io_service_(io_service)
+        {
+        }
+
+        DetachHelper(DetachHelper&&) = default;
+        DetachHelper& operator = (DetachHelper&&) = default;
+        DetachHelper(const DetachHelper&) = delete;
+        DetachHelper& operator = (const DetachHelper&) = delete;
+
+        // The response end() sends, replacing whatever the handler had put in the
+        // connection's one.
+        response& res()
+        {
+            return res_;
+        }
+
+        void end()
+        {
+            end(std::move(res_));
+        }
+
+        // Replaces the response with `r' and completes it.
+        void end(response&& r)
+        {
+            auto exchange = std::move(exchange_);
+            if (!exchange)
+                return;
+            if (!io_service_)
+            {
+                if (exchange->res)
+                {
+                    *exchange->res = std::move(r);
+                    exchange->res->end();
+                }
+                return;
+            }
+            // handlers passed to post must be copyable, so the response travels on the heap
+            std::shared_ptr<response> moved = std::make_shared<response>(std::move(r));
+            io_service_->post([exchange, moved]{
+                if (exchange->res)
+                {
+                    *exchange->res = std::move(*moved);
+                    exchange->res->end();
+                }
+            });
+        }
+
+    private:
+        response res_;
+        // `exchange_->res' is only read on the io thread, where it is also cleared
+        std::shared_ptr<detail::detached_exchange> exchange_;
+        boost::asio::io_service* io_service_;
+    };
+
+    inline DetachHelper response::detach()
+    {
+        if (!detached_)
+            detached_ = std::make_shared<detail::detached_exchange>(detail::detached_exchange{this});
+        return DetachHelper(detached_, io_service_);
+    }
 }
@@ -91,7 +91,7 @@ namespace crow
                                 date_str.resize(date_str_sz);
                             };
                             update_date_str();
-                            get_cached_date_str_pool_[i] = [&]()->std::string
+                            get_cached_date_str_pool_[i] = [&]()->const std::string&
                             {
                                 if (std::chrono::steady_clock::now() - last >= std::chrono::seconds(1))
                                 {
@@ -213,7 +213,7 @@ namespace crow
         asio::io_service io_service_;
         std::vector<std::unique_ptr<asio::io_service>> io_service_pool_;
         std::vector<detail::dumb_timer_queue*> timer_queue_pool_;
-        std::vector<std::function<std::string()>> get_cached_date_str_pool_;
+        std::vector<std::function<const std::string&()>> get_cached_date_str_pool_;
         tcp::acceptor acceptor_;
         boost::asio::signal_set signals_;
         boost::asio::deadline_timer tick_timer_;
@@ -11,8 +11,14 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/operators.hpp>
 #include <vector>
+#include <deque>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
 
 #include "crow/settings.h"
+#include "crow/parser_simd.h"
+#include "crow/dtoa.h"
 
 #if defined(__GNUG__) || defined(__clang__)
 #define crow_json_likely(x) __builtin_expect(x, 1)
@@ -32,11 +38,20 @@ namespace crow
 
     namespace json
     {
-        inline void escape(const std::string& str, std::string& ret)
+        inline void escape(const char* str, size_t size, std::string& ret)
         {
-            ret.reserve(ret.size() + str.size()+str.size()/4);
-            for(char c:str)
-            {
+            ret.reserve(ret.size() + size+size/4);
+            const char* end = str + size;
+            for(const char* p = str; p != end; ++p)
+            {
+                // copy the run of characters that need no escaping in one go
+                const char* run = p;
+                while(p != end && *p != '"' && *p != '\\' && !(0 <= *p && *p < 0x20))
+                    ++p;
+                ret.append(run, p);
+                if (p == end)
+                    break;
+                char c = *p;
                 switch(c)
                 {
                     case '"': ret += "\\\""; break;
@@ -66,6 +81,10 @@ namespace crow
                 }
             }
         }
+        inline void escape(const std::string& str, std::string& ret)
+        {
+            escape(str.data(), str.size(), ret);
+        }
         inline std::string escape(const std::string& str)
         {
             std::string ret;
@@ -105,9 +124,440 @@ namespace crow
 
         class rvalue;
         rvalue load(const char* data, size_t size);
+        rvalue load(std::string&& str);
 
         namespace detail 
         {
+            // Decodes the escapes in [head, end) in place; returns the new end
+            inline char* unescape(char* head, char* end)
+            {
+                char* tail = head;
+                while(head != end)
+                {
+                    if (*head == '\\')
+                    {
+                        switch(*++head)
+                        {
+                            case '"':  *tail++ = '"'; break;
+                            case '\\': *tail++ = '\\'; break;
+                            case '/':  *tail++ = '/'; break;
+                            case 'b':  *tail++ = '\b'; break;
+                            case 'f':  *tail++ = '\f'; break;
+                            case 'n':  *tail++ = '\n'; break;
+                            case 'r':  *tail++ = '\r'; break;
+                            case 't':  *tail++ = '\t'; break;
+                            case 'u':
+                                {
+                                    auto from_hex = [](char c)
+                                    {
+                                        if (c >= 'a')
+                                            return c - 'a' + 10;
+                                        if (c >= 'A')
+                                            return c - 'A' + 10;
+                                        return c - '0';
+                                    };
+                                    unsigned int code = 
+                                        (from_hex(head[1])<<12) + 
+                                        (from_hex(head[2])<< 8) + 
+                                        (from_hex(head[3])<< 4) + 
+                                        from_hex(head[4]);
+                                    if (code >= 0x800)
+                                    {
+                                        *tail++ = 0xE0 | (code >> 12);
+                                        *tail++ = 0x80 | ((code >> 6) & 0x3F);
+                                        *tail++ = 0x80 | (code & 0x3F);
+                                    }
+                                    else if (code >= 0x80)
+                                    {
+                                        *tail++ = 0xC0 | (code >> 6);
+                                        *tail++ = 0x80 | (code & 0x3F);
+                                    }
+                                    else
+                                    {
+                                        *tail++ = code;
+                                    }
+                                    head += 4;
+                                }
+                                break;
+                        }
+                    }
+                    else
+                        *tail++ = *head;
+                    head++;
+                }
+                return tail;
+            }
+
+            // A number's value, parsed once
+            union number
+            {
+                double d;
+                int64_t si;
+                uint64_t ui;
+            };
+
+            // Works out the type and value of a number skip_number has accepted, in one pass.
+            // Integers are accumulated directly. A float is exact through Clinger's fast path
+            // when its digits fit in 53 bits and its power of ten is one a double holds exactly,
+            // which covers nearly all the numbers found in practice. Anything else (integers out
+            // of range, long or extreme floats) returns false and is left to lexical_cast.
+            inline bool parse_number(const char* start, const char* end, num_type& nt, number& value)
+            {
+                static const double powers_of_ten[] = {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+                };
+                const char* p = start;
+                bool negative = *p == '-';
+                if (negative)
+                    p++;
+
+                uint64_t mantissa = 0;
+                int digits = 0;
+                int exponent = 0;
+                bool overflow = false;
+                for(; p != end && *p >= '0' && *p <= '9'; p++)
+                {
+                    if (digits < 19)
+                    {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits += mantissa != 0;
+                    }
+                    else
+                    {
+                        // 20 digits may still fit an unsigned integer
+                        unsigned d = *p - '0';
+                        if (!overflow && digits == 19 && mantissa <= (UINT64_MAX - d) / 10)
+                            mantissa = mantissa * 10 + d;
+                        else
+                            overflow = true;
+                        digits++;
+                        exponent++;
+                    }
+                }
+
+                if (p == end)
+                {
+                    if (overflow)
+                    {
+                        nt = negative ? num_type::Signed_integer : num_type::Unsigned_integer;
+                        return false;
+                    }
+                    if (negative)
+                    {
+                        nt = num_type::Signed_integer;
+                        if (mantissa > uint64_t(INT64_MAX) + 1)
+                            return false;
+                        value.si = mantissa == uint64_t(INT64_MAX) + 1 ? INT64_MIN : -static_cast<int64_t>(mantissa);
+                    }
+                    else
+                    {
+                        nt = num_type::Unsigned_integer;
+                        value.ui = mantissa;
+                    }
+                    return true;
+                }
+
+                nt = num_type::Floating_point;
+                if (digits > 19)
+                    return false;
+                if (*p == '.')
+                {
+                    for(p++; p != end && *p >= '0' && *p <= '9'; p++)
+                    {
+                        if (digits >= 19)
+                            return false;
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits += mantissa != 0;
+                        exponent--;
+                    }
+                }
+                if (p != end)
+                {
+                    // 'e' or 'E'
+                    p++;
+                    bool negative_exponent = *p == '-';
+                    if (*p == '-' || *p == '+')
+                        p++;
+                    int e = 0;
+                    for(; p != end; p++)
+                    {
+                        if (e > 10000)
+                            return false;
+                        e = e * 10 + (*p - '0');
+                    }
+                    exponent += negative_exponent ? -e : e;
+                }
+
+                if (mantissa > (uint64_t(1) << 53))
+                    return false;
+                double d = static_cast<double>(mantissa);
+                if (mantissa != 0)
+                {
+                    if (exponent < -22 || exponent > 22)
+                        return false;
+                    d = exponent < 0 ? d / powers_of_ten[-exponent] : d * powers_of_ten[exponent];
+                }
+                value.d = negative ? -d : d;
+                return true;
+            }
+
+            // Moves `data' past a number, false if it is malformed
+            inline bool skip_number(char*& data)
+            {
+                enum NumberParsingState
+                {
+                    Minus,
+                    AfterMinus,
+                    ZeroFirst,
+                    Digits,
+                    DigitsAfterPoints,
+                    E,
+                    DigitsAfterE,
+                    Invalid,
+                } state{Minus};
+                while(crow_json_likely(state != Invalid))
+                {
+                    switch(*data)
+                    {
+                        case '0':
+                            state = (NumberParsingState)"\2\2\7\3\4\6\6"[state];
+                            /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
+                            {
+                                state = NumberParsingState::ZeroFirst;
+                            }
+                            else if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterE || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                // ok; pass
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '1': case '2': case '3': 
+                        case '4': case '5': case '6': 
+                        case '7': case '8': case '9':
+                            state = (NumberParsingState)"\3\3\7\3\4\6\6"[state];
+                            while(*(data+1) >= '0' && *(data+1) <= '9') data++;
+                            /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
+                            {
+                                state = NumberParsingState::Digits;
+                            }
+                            else if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterE || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                // ok; pass
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '.':
+                            state = (NumberParsingState)"\7\7\4\4\7\7\7"[state];
+                            /*
+                            if (state == NumberParsingState::Digits || state == NumberParsingState::ZeroFirst)
+                            {
+                                state = NumberParsingState::DigitsAfterPoints;
+                            }
+                            else
+                                return false;
+                            */
+                            break;
+                        case '-':
+                            state = (NumberParsingState)"\1\7\7\7\7\6\7"[state];
+                            /*if (state == NumberParsingState::Minus)
+                            {
+                                state = NumberParsingState::AfterMinus;
+                            }
+                            else if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case '+':
+                            state = (NumberParsingState)"\7\7\7\7\7\6\7"[state];
+                            /*if (state == NumberParsingState::E)
+                            {
+                                state = NumberParsingState::DigitsAfterE;
+                            }
+                            else
+                                return false;*/
+                            break;
+                        case 'e': case 'E':
+                            state = (NumberParsingState)"\7\7\7\5\5\7\7"[state];
+                            /*if (state == NumberParsingState::Digits || 
+                                state == NumberParsingState::DigitsAfterPoints)
+                            {
+                                state = NumberParsingState::E;
+                            }
+                            else 
+                                return false;*/
+                            break;
+                        default:
+                            if (crow_json_likely(state == NumberParsingState::ZeroFirst || 
+                                    state == NumberParsingState::Digits || 
+                                    state == NumberParsingState::DigitsAfterPoints || 
+                                    state == NumberParsingState::DigitsAfterE))
+                                return true;
+                            else
+                                return false;
+                    }
+                    data++;
+                }
+
+                return false;
+            }
+
+            // Moves `data' from just after an opening quote to the closing one, checking escapes
+            inline bool skip_string(char*& data, bool& has_escaping)
+            {
+                has_escaping = false;
+                while(1)
+                {
+                    if (crow_json_likely(*data != '"' && *data != '\\' && *data != '\0'))
+                    {
+                        data ++;
+                    }
+                    else if (*data == '"')
+                    {
+                        return true;
+                    }
+                    else if (*data == '\\')
+                    {
+                        has_escaping = true;
+                        data++;
+                        switch(*data)
+                        {
+                            case 'u':
+                                {
+                                    auto check = [](char c)
+                                    {
+                                        return 
+                                            ('0' <= c && c <= '9') ||
+                                            ('a' <= c && c <= 'f') ||
+                                            ('A' <= c && c <= 'F');
+                                    };
+                                    if (!(check(*(data+1)) && 
+                                        check(*(data+2)) && 
+                                        check(*(data+3)) && 
+                                        check(*(data+4))))
+                                        return false;
+                                }
+                                data += 5;
+                                break;
+                            case '"':
+                            case '\\':
+                            case '/':
+                            case 'b':
+                            case 'f':
+                            case 'n':
+                            case 'r':
+                            case 't':
+                                data ++;
+                                break;
+                            default:
+                                return false;
+                        }
+                    }
+                    else
+                        return false;
+                }
+            }
+
+            // Where the strings of a document start and end, found 64 bytes at a time before
+            // parsing: the quotes that are not escaped, and the backslashes that start an escape.
+            // A string without escapes is then skipped in one step instead of byte by byte; one
+            // with escapes is still walked by skip_string, which checks them. The index stops at
+            // the first NUL like the parsers do, and is left empty for short documents or
+            // without SSE2.
+            class string_index
+            {
+            public:
+                string_index(char* data, size_t size)
+                    : data_(data)
+                {
+#ifdef CROW_PARSER_SSE2
+                    if (size >= 64 && size <= UINT32_MAX)
+                        build(size);
+#else
+                    (void)size;
+#endif
+                }
+
+                // skip_string, for `data' just after an opening quote
+                bool skip_string(char*& data, bool& has_escaping)
+                {
+                    uint32_t open = static_cast<uint32_t>(data - 1 - data_);
+                    while(next_ < positions_.size() && positions_[next_] < open)
+                        next_ ++;
+                    if (next_ + 1 < positions_.size() && positions_[next_] == open && data_[positions_[next_+1]] == '"')
+                    {
+                        data = data_ + positions_[next_+1];
+                        next_ += 2;
+                        has_escaping = false;
+                        return true;
+                    }
+                    return detail::skip_string(data, has_escaping);
+                }
+
+            private:
+#ifdef CROW_PARSER_SSE2
+                void build(size_t size)
+                {
+                    positions_.reserve(size / 8);
+                    // whether the first byte of the next block is escaped
+                    uint64_t carry = 0;
+                    for(size_t at = 0; at < size; at += 64)
+                    {
+                        uint64_t quotes, backslashes, zeros;
+                        if (size - at >= 64)
+                            crow::detail::classify_json_block(data_ + at, quotes, backslashes, zeros);
+                        else
+                        {
+                            // the zeros past the end stop the index
+                            char tail[64] = {};
+                            memcpy(tail, data_ + at, size - at);
+                            crow::detail::classify_json_block(tail, quotes, backslashes, zeros);
+                        }
+                        // backslashes are rare, so the escaped bytes are worked out one by one
+                        uint64_t escaped = carry;
+                        carry = 0;
+                        for(uint64_t m = backslashes; m; m &= m - 1)
+                        {
+                            uint64_t bit = m & (~m + 1);
+                            if (escaped & bit)
+                                continue;
+                            if (bit >> 63)
+                                carry = 1;
+                            else
+                                escaped |= bit << 1;
+                        }
+                        uint64_t found = (quotes | backslashes) & ~escaped;
+                        if (zeros)
+                            found &= (zeros & (~zeros + 1)) - 1;
+                        for(; found; found &= found - 1)
+                            positions_.push_back(static_cast<uint32_t>(at + crow::detail::count_trailing_zeros(found)));
+                        if (zeros)
+                            return;
+                    }
+                }
+#endif
+
+                char* data_;
+                std::vector<uint32_t> positions_;
+                size_t next_{};
+            };
 
             struct r_string 
                 : boost::less_than_comparable<r_string>,
@@ -121,8 +571,10 @@ namespace crow
                 {};
                 ~r_string()
                 {
-                    if (owned_)
+                    if (owned_ == 1)
                         delete[] s_;
+                    else if (owned_ == 2)
+                        delete reinterpret_cast<std::string*>(s_);
                 }
 
                 r_string(const r_string& r)
@@ -181,7 +633,14 @@ namespace crow
                     e_ = s_ + length;
                     owned_ = 1;
                 }
+                // owns a whole std::string, and so reads as empty
+                void force(std::string* s)
+                {
+                    s_ = e_ = reinterpret_cast<char*>(s);
+                    owned_ = 2;
+                }
                 friend rvalue crow::json::load(const char* data, size_t size);
+                friend rvalue crow::json::load(std::string&& str);
             };
 
             inline bool operator < (const r_string& l, const r_string& r)
@@ -208,12 +667,27 @@ namespace crow
             {
                 return boost::equals(l,r);
             }
+
+            // FNV-1a, for the key indexes of rvalue and wvalue objects
+            inline size_t hash_key(const char* s, size_t size)
+            {
+                size_t seed = 2166136261u;
+                for(size_t i = 0; i < size; i ++)
+                {
+                    seed ^= static_cast<unsigned char>(s[i]);
+                    seed *= 16777619u;
+                }
+                return seed;
+            }
         }
 
         class rvalue
         {
-            static const int cached_bit = 2;
+            // set when num_ holds the number's value
+            static const int parsed_bit = 2;
             static const int error_bit = 4;
+            // Objects with more members than this get a hash index of their keys
+            static const uint32_t index_threshold = 16;
         public:
             rvalue() noexcept : option_{error_bit}
             {}
@@ -234,6 +708,7 @@ namespace crow
                 key_(r.key_),
                 t_(r.t_),
                 nt_(r.nt_),
+                num_(r.num_),
                 option_(r.option_)
             {
                 copy_l(r);
@@ -251,6 +726,7 @@ namespace crow
                 key_ = r.key_;
                 t_ = r.t_;
                 nt_ = r.nt_;
+                num_ = r.num_;
                 option_ = r.option_;
                 copy_l(r);
                 return *this;
@@ -261,10 +737,12 @@ namespace crow
                 end_ = r.end_;
                 key_ = std::move(r.key_);
                 l_ = std::move(r.l_);
+                index_ = std::move(r.index_);
                 lsize_ = r.lsize_;
                 lremain_ = r.lremain_;
                 t_ = r.t_;
                 nt_ = r.nt_;
+                num_ = r.num_;
                 option_ = r.option_;
                 return *this;
             }
@@ -317,13 +795,20 @@ namespace crow
                 switch (t()) {
                     case type::Number:
                     case type::String:
-                        return boost::lexical_cast<int64_t>(start_, end_-start_);
+                        break;
                     default:
                         const std::string msg = "expected number, got: "
                             + std::string(get_type_str(t()));
                         throw std::runtime_error(msg);
                 }
 #endif
+                if (option_ & parsed_bit)
+                {
+                    if (nt_ == num_type::Signed_integer)
+                        return num_.si;
+                    if (nt_ == num_type::Unsigned_integer && num_.ui <= INT64_MAX)
+                        return num_.ui;
+                }
                 return boost::lexical_cast<int64_t>(start_, end_-start_);
             }
 
@@ -333,11 +818,13 @@ namespace crow
                 switch (t()) {
                     case type::Number:
                     case type::String:
-                        return boost::lexical_cast<uint64_t>(start_, end_-start_);
+                        break;
                     default:
                         throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
                 }
 #endif
+                if ((option_ & parsed_bit) && nt_ == num_type::Unsigned_integer)
+                    return num_.ui;
                 return boost::lexical_cast<uint64_t>(start_, end_-start_);
             }
 
@@ -347,6 +834,16 @@ namespace crow
                 if (t() != type::Number)
                     throw std::runtime_error("value is not number");
 #endif
+                if (option_ & parsed_bit)
+                {
+                    switch(nt_)
+                    {
+                        case num_type::Floating_point: return num_.d;
+                        case num_type::Signed_integer: return static_cast<double>(num_.si);
+                        case num_type::Unsigned_integer: return static_cast<double>(num_.ui);
+                        case num_type::Null: break;
+                    }
+                }
                 return boost::lexical_cast<double>(start_, end_-start_);
             }
 
@@ -363,62 +860,7 @@ namespace crow
             {
                 if (*(start_-1))
                 {
-                    char* head = start_;
-                    char* tail = start_;
-                    while(head != end_)
-                    {
-                        if (*head == '\\')
-                        {
-                            switch(*++head)
-                            {
-                                case '"':  *tail++ = '"'; break;
-                                case '\\': *tail++ = '\\'; break;
-                                case '/':  *tail++ = '/'; break;
-                                case 'b':  *tail++ = '\b'; break;
-                                case 'f':  *tail++ = '\f'; break;
-                                case 'n':  *tail++ = '\n'; break;
-                                case 'r':  *tail++ = '\r'; break;
-                                case 't':  *tail++ = '\t'; break;
-                                case 'u':
-                                    {
-                                        auto from_hex = [](char c)
-                                        {
-                                            if (c >= 'a')
-                                                return c - 'a' + 10;
-                                            if (c >= 'A')
-                                                return c - 'A' + 10;
-                                            return c - '0';
-                                        };
-                                        unsigned int code = 
-                                            (from_hex(head[1])<<12) + 
-                                            (from_hex(head[2])<< 8) + 
-                                            (from_hex(head[3])<< 4) + 
-                                            from_hex(head[4]);
-                                        if (code >= 0x800)
-                                        {
-                                            *tail++ = 0xE0 | (code >> 12);
-                                            *tail++ = 0x80 | ((code >> 6) & 0x3F);
-                                            *tail++ = 0x80 | (code & 0x3F);
-                                        }
-                                        else if (code >= 0x80)
-                                        {
-                                            *tail++ = 0xC0 | (code >> 6);
-                                            *tail++ = 0x80 | (code & 0x3F);
-                                        }
-                                        else
-                                        {
-                                            *tail++ = code;
-                                        }
-                                        head += 4;
-                                    }
-                                    break;
-                            }
-                        }
-                        else
-                            *tail++ = *head;
-                        head++;
-                    }
-                    end_ = tail;
+                    end_ = detail::unescape(start_, end_);
                     *end_ = 0;
                     *(start_-1) = 0;
                 }
@@ -441,28 +883,7 @@ namespace crow
 
             bool has(const std::string& str) const
             {
-                struct Pred 
-                {
-                    bool operator()(const rvalue& l, const rvalue& r) const
-                    {
-                        return l.key_ < r.key_;
-                    };
-                    bool operator()(const rvalue& l, const std::string& r) const
-                    {
-                        return l.key_ < r;
-                    };
-                    bool operator()(const std::string& l, const rvalue& r) const
-                    {
-                        return l < r.key_;
-                    };
-                };
-                if (!is_cached())
-                {
-                    std::sort(begin(), end(), Pred());
-                    set_cached();
-                }
-                auto it = lower_bound(begin(), end(), str, Pred());
-                return it != end() && it->key_ == str;
+                return find(str) != nullptr;
             }
 
             int count(const std::string& str)
@@ -536,29 +957,8 @@ namespace crow
                 if (t() != type::Object)
                     throw std::runtime_error("value is not an object");
 #endif
-                struct Pred 
-                {
-                    bool operator()(const rvalue& l, const rvalue& r) const
-                    {
-                        return l.key_ < r.key_;
-                    };
-                    bool operator()(const rvalue& l, const std::string& r) const
-                    {
-                        return l.key_ < r;
-                    };
-                    bool operator()(const std::string& l, const rvalue& r) const
-                    {
-                        return l < r.key_;
-                    };
-                };
-                if (!is_cached())
-                {
-                    std::sort(begin(), end(), Pred());
-                    set_cached();
-                }
-                auto it = lower_bound(begin(), end(), str, Pred());
-                if (it != end() && it->key_ == str)
-                    return *it;
+                if (auto v = find(str))
+                    return *v;
 #ifndef CROW_JSON_NO_ERROR_CHECK
                 throw std::runtime_error("cannot find key");
 #else
@@ -577,14 +977,6 @@ namespace crow
                 return (option_&error_bit)!=0;
             }
         private:
-            bool is_cached() const
-            {
-                return (option_&cached_bit)!=0;
-            }
-            void set_cached() const
-            {
-                option_ |= cached_bit;
-            }
             void copy_l(const rvalue& r)
             {
                 if (r.t() != type::Object && r.t() != type::List)
@@ -593,6 +985,64 @@ namespace crow
                 lremain_ = 0;
                 l_.reset(new rvalue[lsize_]);
                 std::copy(r.begin(), r.end(), begin());
+                index_.reset();
+                if (r.index_)
+                {
+                    size_t capacity = index_capacity();
+                    index_.reset(new uint32_t[capacity]);
+                    std::copy(r.index_.get(), r.index_.get() + capacity, index_.get());
+                }
+            }
+
+            // A power of two at least twice the number of members
+            size_t index_capacity() const
+            {
+                size_t capacity = 32;
+                while(capacity < 2 * static_cast<size_t>(lsize_))
+                    capacity *= 2;
+                return capacity;
+            }
+
+            // Open addressing over the members: each slot holds 1 + a member's position, or 0.
+            // Built once while parsing, so lookups never write to a document, and the members
+            // keep their order.
+            void build_index()
+            {
+                size_t mask = index_capacity() - 1;
+                index_.reset(new uint32_t[mask + 1]());
+                for(uint32_t i = 0; i < lsize_; i ++)
+                {
+                    size_t slot = detail::hash_key(l_[i].key_.begin(), l_[i].key_.size()) & mask;
+                    while(index_[slot])
+                        slot = (slot + 1) & mask;
+                    index_[slot] = i + 1;
+                }
+            }
+
+            // The first member called `str', if any
+            const rvalue* find(const std::string& str) const
+            {
+                auto matches = [&](const rvalue& v)
+                {
+                    return v.key_.size() == str.size() && memcmp(v.key_.begin(), str.data(), str.size()) == 0;
+                };
+                if (index_)
+                {
+                    size_t mask = index_capacity() - 1;
+                    for(size_t slot = detail::hash_key(str.data(), str.size()) & mask; index_[slot]; slot = (slot + 1) & mask)
+                    {
+                        const rvalue& v = l_[index_[slot] - 1];
+                        if (matches(v))
+                            return &v;
+                    }
+                    return nullptr;
+                }
+                for(auto& v : *this)
+                {
+                    if (matches(v))
+                        return &v;
+                }
+                return nullptr;
             }
 
             void emplace_back(rvalue&& v)
@@ -615,7 +1065,7 @@ namespace crow
                 lremain_ --;
             }
 
-            // determines num_type from the string
+            // determines num_type from the string, and the value along with it
             void determine_num_type()
             {
                 if (t_ != type::Number)
@@ -624,31 +1074,25 @@ namespace crow
                     return;
                 }
 
-                const std::size_t len = end_ - start_;
-                const bool has_minus = std::memchr(start_, '-', len) != nullptr;
-                const bool has_e = std::memchr(start_, 'e', len) != nullptr
-                                || std::memchr(start_, 'E', len) != nullptr;
-                const bool has_dec_sep = std::memchr(start_, '.', len) != nullptr;
-                if (has_dec_sep || has_e)
-                  nt_ = num_type::Floating_point;
-                else if (has_minus)
-                  nt_ = num_type::Signed_integer;
-                else
-                  nt_ = num_type::Unsigned_integer;
+                if (detail::parse_number(start_, end_, nt_, num_))
+                    option_ |= parsed_bit;
             }
 
             mutable char* start_ = nullptr;
             mutable char* end_ = nullptr;
             detail::r_string key_;
             std::unique_ptr<rvalue[]> l_;
+            std::unique_ptr<uint32_t[]> index_;
             uint32_t lsize_ = 0;
             uint16_t lremain_ = 0;
             type t_ = type::Null;
             num_type nt_{num_type::Null};
+            detail::number num_{};
             mutable uint8_t option_{0};
 
             friend rvalue load_nocopy_internal(char* data, size_t size);
             friend rvalue load(const char* data, size_t size);
+            friend rvalue load(std::string&& str);
             friend std::ostream& operator <<(std::ostream& os, const rvalue& r)
             {
                 switch(r.t_)
@@ -751,8 +1195,8 @@ namespace crow
             //static const char* escaped = "\"\\/\b\f\n\r\t";
             struct Parser
             {
-                Parser(char* data, size_t /*size*/)
-                    : data(data)
+                Parser(char* data, size_t size)
+                    : data(data), strings(data, size)
                 {
                 }
 
@@ -774,61 +1218,16 @@ namespace crow
                     if (crow_json_unlikely(!consume('"')))
                         return {};
                     char* start = data;
-                    uint8_t has_escaping = 0;
-                    while(1)
-                    {
-                        if (crow_json_likely(*data != '"' && *data != '\\' && *data != '\0'))
-                        {
-                            data ++;
-                        }
-                        else if (*data == '"')
-                        {
-                            *data = 0;
-                            *(start-1) = has_escaping;
-                            data++;
-                            return {type::String, start, data-1};
-                        }
-                        else if (*data == '\\')
-                        {
-                            has_escaping = 1;
-                            data++;
-                            switch(*data)
-                            {
-                                case 'u':
-                                    {
-                                        auto check = [](char c)
-                                        {
-                                            return 
-                                                ('0' <= c && c <= '9') ||
-                                                ('a' <= c && c <= 'f') ||
-                                                ('A' <= c && c <= 'F');
-                                        };
-                                        if (!(check(*(data+1)) && 
-                                            check(*(data+2)) && 
-                                            check(*(data+3)) && 
-                                            check(*(data+4))))
-                                            return {};
-                                    }
-                                    data += 5;
-                                    break;
-                                case '"':
-                                case '\\':
-                                case '/':
-                                case 'b':
-                                case 'f':
-                                case 'n':
-                                case 'r':
-                                case 't':
-                                    data ++;
-                                    break;
-                                default:
-                                    return {};
-                            }
-                        }
-                        else
-                            return {};
-                    }
-                    return {};
+                    bool has_escaping;
+                    if (crow_json_unlikely(!strings.skip_string(data, has_escaping)))
+                        return {};
+                    // unescaped now rather than on first access, so that reading a document
+                    // never writes to it
+                    char* end = has_escaping ? detail::unescape(start, data) : data;
+                    *end = 0;
+                    *(start-1) = 0;
+                    data++;
+                    return {type::String, start, end};
                 }
 
                 rvalue decode_list()
@@ -874,124 +1273,14 @@ namespace crow
                 rvalue decode_number()
                 {
                     char* start = data;
+                    if (crow_json_likely(detail::skip_number(data)))
+                        return {type::Number, start, data};
+                    return {};
+                }
 
-                    enum NumberParsingState
-                    {
-                        Minus,
-                        AfterMinus,
-                        ZeroFirst,
-                        Digits,
-                        DigitsAfterPoints,
-                        E,
-                        DigitsAfterE,
-                        Invalid,
-                    } state{Minus};
-                    while(crow_json_likely(state != Invalid))
-                    {
-                        switch(*data)
-                        {
-                            case '0':
-                                state = (NumberParsingState)"\2\2\7\3\4\6\6"[state];
-                                /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
-                                {
-                                    state = NumberParsingState::ZeroFirst;
-                                }
-                                else if (state == NumberParsingState::Digits || 
-                                    state == NumberParsingState::DigitsAfterE || 
-                                    state == NumberParsingState::DigitsAfterPoints)
-                                {
-                                    // ok; pass
-                                }
-                                else if (state == NumberParsingState::E)
-                                {
-                                    state = NumberParsingState::DigitsAfterE;
-                                }
-                                else
-                                    return {};*/
-                                break;
-                            case '1': case '2': case '3': 
-                            case '4': case '5': case '6': 
-                            case '7': case '8': case '9':
-                                state = (NumberParsingState)"\3\3\7\3\4\6\6"[state];
-                                while(*(data+1) >= '0' && *(data+1) <= '9') data++;
-                                /*if (state == NumberParsingState::Minus || state == NumberParsingState::AfterMinus)
-                                {
-                                    state = NumberParsingState::Digits;
-                                }
-                                else if (state == NumberParsingState::Digits || 
-                                    state == NumberParsingState::DigitsAfterE || 
-                                    state == NumberParsingState::DigitsAfterPoints)
-                                {
-                                    // ok; pass
-                                }
-                                else if (state == NumberParsingState::E)
-                                {
-                                    state = NumberParsingState::DigitsAfterE;
-                                }
-                                else
-                                    return {};*/
-                                break;
-                            case '.':
-                                state = (NumberParsingState)"\7\7\4\4\7\7\7"[state];
-                                /*
-                                if (state == NumberParsingState::Digits || state == NumberParsingState::ZeroFirst)
-                                {
-                                    state = NumberParsingState::DigitsAfterPoints;
-                                }
-                                else
-                                    return {};
-                                */
-                                break;
-                            case '-':
-                                state = (NumberParsingState)"\1\7\7\7\7\6\7"[state];
-                                /*if (state == NumberParsingState::Minus)
-                                {
-                                    state = NumberParsingState::AfterMinus;
-                                }
-                                else if (state == NumberParsingState::E)
-                                {
-                                    state = NumberParsingState::DigitsAfterE;
-                                }
-                                else
-                                    return {};*/
-                                break;
-                            case '+':
-                                state = (NumberParsingState)"\7\7\7\7\7\6\7"[state];
-                                /*if (state == NumberParsingState::E)
-                                {
-                                    state = NumberParsingState::DigitsAfterE;
-                                }
-                                else
-                                    return {};*/
-                                break;
-                            case 'e': case 'E':
-                                state = (NumberParsingState)"\7\7\7\5\5\7\7"[state];
-                                /*if (state == NumberParsingState::Digits || 
-                                    state == NumberParsingState::DigitsAfterPoints)
-                                {
-                                    state = NumberParsingState::E;
-                                }
-                                else 
-                                    return {};*/
-                                break;
-                            default:
-                                if (crow_json_likely(state == NumberParsingState::ZeroFirst || 
-                                        state == NumberParsingState::Digits || 
-                                        state == NumberParsingState::DigitsAfterPoints || 
-                                        state == NumberParsingState::DigitsAfterE))
-                                    return {type::Number, start, data};
-                                else
-                                    return {};
-                        }
-                        data++;
-                    }
-
-                    return {};
-                }
-
-                rvalue decode_value()
-                {
-                    switch(*data)
+                rvalue decode_value()
+                {
+                    switch(*data)
                     {
                         case '[':
                             return decode_list();
@@ -1093,6 +1382,8 @@ namespace crow
                         if (crow_json_unlikely(*data == '}'))
                         {
                             data++;
+                            if (ret.lsize_ > rvalue::index_threshold)
+                                ret.build_index();
                             break;
                         }
                         if (crow_json_unlikely(!consume(',')))
@@ -1116,6 +1407,7 @@ namespace crow
                 }
 
                 char* data;
+                detail::string_index strings;
             };
             return Parser(data, size).parse();
         }
@@ -1132,6 +1424,17 @@ namespace crow
             return ret;
         }
 
+        // Parses `str' where it is, without the copy the other overloads make; the returned
+        // value keeps the string alive and its contents are overwritten while parsing.
+        inline rvalue load(std::string&& str)
+        {
+            std::unique_ptr<std::string> owned(new std::string(std::move(str)));
+            auto ret = load_nocopy_internal(&(*owned)[0], owned->size());
+            if (ret)
+                ret.key_.force(owned.release());
+            return ret;
+        }
+
         inline rvalue load(const char* data)
         {
             return load(data, strlen(data));
@@ -1142,36 +1445,710 @@ namespace crow
             return load(str.data(), str.size());
         }
 
+        class tape;
+        tape load_tape(const char* data, size_t size);
+        tape load_tape(std::string&& str);
+
+        // A document parsed into one flat array of 64-bit words, the way simdjson lays it out,
+        // instead of a tree of rvalues. Parsing allocates the text and the tape and nothing
+        // per value. Each value starts with a word carrying its type in the top byte:
+        //   null, true, false  that word alone
+        //   string             the offset of the text in the low bits, then its length
+        //   number             the offset of the text in the low bits, then its value, parsed
+        //                      while loading; numbers parse_number can't handle are tagged in
+        //                      upper case and keep their length instead, for lexical_cast
+        //   list, object       the index just past the value, then the number of elements;
+        //                      an object's elements are key strings, each followed by its value
+        // Strings are unescaped in place while parsing. Values refer to the tape, which has to
+        // outlive them and stay where it is.
+        class tape
+        {
+        public:
+            class value;
+            class iterator;
+
+            explicit operator bool() const noexcept
+            {
+                return !error_;
+            }
+
+            bool error() const
+            {
+                return error_;
+            }
+
+            value root() const;
+
+        private:
+            static const int tag_shift = 56;
+            static const uint64_t payload_mask = (uint64_t(1) << tag_shift) - 1;
+
+            char tag(size_t index) const
+            {
+                return static_cast<char>(words_[index] >> tag_shift);
+            }
+
+            uint64_t payload(size_t index) const
+            {
+                return words_[index] & payload_mask;
+            }
+
+            // The index of the value after the one at `index'
+            size_t next(size_t index) const
+            {
+                switch(tag(index))
+                {
+                    case '[': case '{': return payload(index);
+                    case '"': case 'u': case 'i': case 'd': case 'U': case 'I': case 'D': return index + 2;
+                    default: return index + 1;
+                }
+            }
+
+            void push(char tag, uint64_t payload)
+            {
+                words_.push_back((uint64_t(static_cast<unsigned char>(tag)) << tag_shift) | payload);
+            }
+
+            static void ws_skip(char*& data)
+            {
+                while(*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') ++data;
+            }
+
+            bool parse()
+            {
+                char* data = &text_[0];
+                detail::string_index strings(data, text_.size());
+                ws_skip(data);
+                if (!parse_value(data, strings))
+                    return false;
+                ws_skip(data);
+                return *data == '\0';
+            }
+
+            bool parse_value(char*& data, detail::string_index& strings)
+            {
+                switch(*data)
+                {
+                    case '[':
+                        return parse_container(data, '[', ']', strings);
+                    case '{':
+                        return parse_container(data, '{', '}', strings);
+                    case '"':
+                        return parse_string(data, strings);
+                    case 't':
+                        if (data[1] == 'r' && data[2] == 'u' && data[3] == 'e')
+                        {
+                            data += 4;
+                            push('t', 0);
+                            return true;
+                        }
+                        return false;
+                    case 'f':
+                        if (data[1] == 'a' && data[2] == 'l' && data[3] == 's' && data[4] == 'e')
+                        {
+                            data += 5;
+                            push('f', 0);
+                            return true;
+                        }
+                        return false;
+                    case 'n':
+                        if (data[1] == 'u' && data[2] == 'l' && data[3] == 'l')
+                        {
+                            data += 4;
+                            push('n', 0);
+                            return true;
+                        }
+                        return false;
+                    default:
+                        {
+                            char* start = data;
+                            if (crow_json_unlikely(!detail::skip_number(data)))
+                                return false;
+                            num_type nt;
+                            detail::number n;
+                            if (crow_json_likely(detail::parse_number(start, data, nt, n)))
+                            {
+                                static const char tags[] = {'i', 'u', 'd'};
+                                push(tags[static_cast<int>(nt)], start - &text_[0]);
+                                uint64_t bits;
+                                memcpy(&bits, &n, sizeof(bits));
+                                words_.push_back(bits);
+                            }
+                            else
+                            {
+                                static const char tags[] = {'I', 'U', 'D'};
+                                push(tags[static_cast<int>(nt)], start - &text_[0]);
+                                words_.push_back(data - start);
+                            }
+                            return true;
+                        }
+                }
+            }
+
+            bool parse_string(char*& data, detail::string_index& strings)
+            {
+                char* start = ++data;
+                bool has_escaping;
+                if (crow_json_unlikely(!strings.skip_string(data, has_escaping)))
+                    return false;
+                char* end = has_escaping ? detail::unescape(start, data) : data;
+                push('"', start - &text_[0]);
+                words_.push_back(end - start);
+                data++;
+                return true;
+            }
+
+            bool parse_container(char*& data, char open, char close, detail::string_index& strings)
+            {
+                size_t at = words_.size();
+                push(open, 0);
+                words_.push_back(0);
+                data++;
+                ws_skip(data);
+                uint64_t count = 0;
+                if (*data == close)
+                    data++;
+                else
+                {
+                    while(1)
+                    {
+                        if (open == '{')
+                        {
+                            if (crow_json_unlikely(*data != '"' || !parse_string(data, strings)))
+                                return false;
+                            ws_skip(data);
+                            if (crow_json_unlikely(*data != ':'))
+                                return false;
+                            data++;
+                            ws_skip(data);
+                        }
+                        if (crow_json_unlikely(!parse_value(data, strings)))
+                            return false;
+                        count++;
+                        ws_skip(data);
+                        if (*data == close)
+                        {
+                            data++;
+                            break;
+                        }
+                        if (crow_json_unlikely(*data != ','))
+                            return false;
+                        data++;
+                        ws_skip(data);
+                    }
+                }
+                words_[at] |= words_.size();
+                words_[at + 1] = count;
+                return true;
+            }
+
+            std::string text_;
+            std::vector<uint64_t> words_;
+            bool error_{true};
+
+            friend tape load_tape(const char* data, size_t size);
+            friend tape load_tape(std::string&& str);
+        };
+
+        // A value on a tape, with the accessors of rvalue
+        class tape::value
+        {
+        public:
+            static const size_t npos = static_cast<size_t>(-1);
+
+            value() = default;
+            value(const tape* doc, size_t index, size_t key = npos)
+                : doc_(doc), index_(index), key_(key)
+            {
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return doc_ != nullptr;
+            }
+
+            bool error() const
+            {
+                return doc_ == nullptr;
+            }
+
+            type t() const
+            {
+                if (!doc_)
+                {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                    throw std::runtime_error("invalid json object");
+#else
+                    return type::Null;
+#endif
+                }
+                switch(doc_->tag(index_))
+                {
+                    case 't': return type::True;
+                    case 'f': return type::False;
+                    case '"': return type::String;
+                    case 'u': case 'i': case 'd': case 'U': case 'I': case 'D': return type::Number;
+                    case '[': return type::List;
+                    case '{': return type::Object;
+                    default: return type::Null;
+                }
+            }
+
+            num_type nt() const
+            {
+                if (t() != type::Number)
+                    return num_type::Null;
+                switch(doc_->tag(index_))
+                {
+                    case 'i': case 'I': return num_type::Signed_integer;
+                    case 'u': case 'U': return num_type::Unsigned_integer;
+                    default: return num_type::Floating_point;
+                }
+            }
+
+            int64_t i() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number && t() != type::String)
+                    throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
+#endif
+                detail::number n = number();
+                if (doc_->tag(index_) == 'i')
+                    return n.si;
+                if (doc_->tag(index_) == 'u' && n.ui <= INT64_MAX)
+                    return n.ui;
+                return boost::lexical_cast<int64_t>(text(), length());
+            }
+
+            uint64_t u() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number && t() != type::String)
+                    throw std::runtime_error(std::string("expected number, got: ") + get_type_str(t()));
+#endif
+                if (doc_->tag(index_) == 'u')
+                    return number().ui;
+                return boost::lexical_cast<uint64_t>(text(), length());
+            }
+
+            double d() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Number)
+                    throw std::runtime_error("value is not number");
+#endif
+                switch(doc_->tag(index_))
+                {
+                    case 'd': return number().d;
+                    case 'i': return static_cast<double>(number().si);
+                    case 'u': return static_cast<double>(number().ui);
+                    default: return boost::lexical_cast<double>(text(), length());
+                }
+            }
+
+            bool b() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::True && t() != type::False)
+                    throw std::runtime_error("value is not boolean");
+#endif
+                return t() == type::True;
+            }
+
+            detail::r_string s() const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::String)
+                    throw std::runtime_error("value is not string");
+#endif
+                return {text(), text() + length()};
+            }
+
+            detail::r_string key() const
+            {
+                if (key_ == npos)
+                    return {};
+                return value(doc_, key_).s();
+            }
+
+            size_t size() const
+            {
+                if (t() == type::String)
+                    return length();
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object && t() != type::List)
+                    throw std::runtime_error("value is not a container");
+#endif
+                return doc_->words_[index_ + 1];
+            }
+
+            iterator begin() const;
+            iterator end() const;
+
+            value operator[](size_t index) const;
+
+            value operator[](int index) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (index < 0)
+                    throw std::runtime_error("list out of bound");
+#endif
+                return (*this)[static_cast<size_t>(index)];
+            }
+
+            value operator[](const std::string& str) const;
+
+            value operator[](const char* str) const
+            {
+                return (*this)[std::string(str)];
+            }
+
+            bool has(const std::string& str) const;
+
+            bool has(const char* str) const
+            {
+                return has(std::string(str));
+            }
+
+            int count(const std::string& str) const
+            {
+                return has(str) ? 1 : 0;
+            }
+
+            friend std::ostream& operator << (std::ostream& os, const value& v);
+
+        private:
+            char* text() const
+            {
+                return const_cast<char*>(doc_->text_.data()) + doc_->payload(index_);
+            }
+
+            size_t length() const
+            {
+                switch(doc_->tag(index_))
+                {
+                    case 'i': case 'u': case 'd':
+                        {
+                            // the second word holds the value, so the text is measured again
+                            char* end = text();
+                            detail::skip_number(end);
+                            return end - text();
+                        }
+                    default:
+                        return doc_->words_[index_ + 1];
+                }
+            }
+
+            // The value parsed while loading; only meaningful for lower case number tags
+            detail::number number() const
+            {
+                detail::number n;
+                memcpy(&n, &doc_->words_[index_ + 1], sizeof(n));
+                return n;
+            }
+
+            // The member called `str', or npos
+            size_t find(const std::string& str) const
+            {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+                if (t() != type::Object)
+                    throw std::runtime_error("value is not an object");
+#endif
+                if (t() != type::Object)
+                    return npos;
+                for(size_t i = index_ + 2; i != doc_->payload(index_); i = doc_->next(i + 2))
+                {
+                    if (value(doc_, i).s() == str)
+                        return i;
+                }
+                return npos;
+            }
+
+            const tape* doc_{};
+            size_t index_{};
+            // where the key of an object's member is
+            size_t key_{npos};
+
+            friend class iterator;
+        };
+
+        class tape::iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = tape::value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const tape::value*;
+            using reference = tape::value;
+
+            iterator(const tape* doc, size_t index, bool object)
+                : doc_(doc), index_(index), object_(object)
+            {
+                load();
+            }
+
+            tape::value operator*() const
+            {
+                return current_;
+            }
+
+            const tape::value* operator->() const
+            {
+                return &current_;
+            }
+
+            iterator& operator++()
+            {
+                index_ = doc_->next(current_.index_);
+                load();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            bool operator == (const iterator& other) const
+            {
+                return index_ == other.index_;
+            }
+
+            bool operator != (const iterator& other) const
+            {
+                return index_ != other.index_;
+            }
+
+        private:
+            void load()
+            {
+                if (object_)
+                    current_ = tape::value(doc_, index_ + 2, index_);
+                else
+                    current_ = tape::value(doc_, index_);
+            }
+
+            const tape* doc_;
+            size_t index_;
+            bool object_;
+            tape::value current_;
+        };
+
+        inline tape::value tape::root() const
+        {
+            if (error_)
+                return {};
+            return {this, 0};
+        }
+
+        inline tape::iterator tape::value::begin() const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::Object && t() != type::List)
+                throw std::runtime_error("value is not a container");
+#endif
+            return {doc_, index_ + 2, t() == type::Object};
+        }
+
+        inline tape::iterator tape::value::end() const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::Object && t() != type::List)
+                throw std::runtime_error("value is not a container");
+#endif
+            return {doc_, doc_->payload(index_), t() == type::Object};
+        }
+
+        inline tape::value tape::value::operator[](size_t index) const
+        {
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            if (t() != type::List)
+                throw std::runtime_error("value is not a list");
+            if (index >= size())
+                throw std::runtime_error("list out of bound");
+#endif
+            size_t i = index_ + 2;
+            while(index--)
+                i = doc_->next(i);
+            return {doc_, i};
+        }
+
+        inline tape::value tape::value::operator[](const std::string& str) const
+        {
+            size_t key = find(str);
+            if (key != npos)
+                return {doc_, key + 2, key};
+#ifndef CROW_JSON_NO_ERROR_CHECK
+            throw std::runtime_error("cannot find key");
+#else
+            return {};
+#endif
+        }
+
+        inline bool tape::value::has(const std::string& str) const
+        {
+            return find(str) != npos;
+        }
+
+        inline std::ostream& operator << (std::ostream& os, const tape::value& v)
+        {
+            switch(v.t())
+            {
+                case type::Null: os << "null"; break;
+                case type::False: os << "false"; break;
+                case type::True: os << "true"; break;
+                case type::Number: os.write(v.text(), v.length()); break;
+                case type::String: os << '"' << escape(v.s()) << '"'; break;
+                case type::List:
+                case type::Object:
+                    {
+                        bool object = v.t() == type::Object;
+                        os << (object ? '{' : '[');
+                        bool first = true;
+                        for(auto x : v)
+                        {
+                            if (!first)
+                                os << ',';
+                            first = false;
+                            if (object)
+                                os << '"' << escape(x.key()) << "\":";
+                            os << x;
+                        }
+                        os << (object ? '}' : ']');
+                    }
+                    break;
+            }
+            return os;
+        }
+
+        inline tape load_tape(const char* data, size_t size)
+        {
+            return load_tape(std::string(data, size));
+        }
+
+        inline tape load_tape(std::string&& str)
+        {
+            tape ret;
+            ret.text_ = std::move(str);
+            ret.error_ = !ret.parse();
+            if (ret.error_)
+                ret.words_.clear();
+            return ret;
+        }
+
+        inline tape load_tape(const char* data)
+        {
+            return load_tape(data, strlen(data));
+        }
+
+        inline tape load_tape(const std::string& str)
+        {
+            return load_tape(str.data(), str.size());
+        }
+
         class wvalue
         {
             friend class crow::mustache::template_t;
         public:
             type t() const { return t_; }
         private:
+            // Objects with more members than this get a hash index of their keys
+            static const size_t index_threshold = 32;
+
+            // An object's members, in the order they were added. A few are found by a linear
+            // search; past index_threshold an open-addressing index (1 + a member's position
+            // per slot, 0 for none) takes over. Members are kept in a deque so that references
+            // returned by operator[] stay valid while more are added.
+            struct object
+            {
+                static const size_t npos = static_cast<size_t>(-1);
+
+                std::deque<std::pair<std::string, wvalue>> members;
+                std::vector<uint32_t> index;
+
+                size_t find(const std::string& key) const
+                {
+                    if (index.empty())
+                    {
+                        for(size_t i = 0; i < members.size(); i ++)
+                        {
+                            if (members[i].first == key)
+                                return i;
+                        }
+                        return npos;
+                    }
+                    size_t mask = index.size() - 1;
+                    for(size_t slot = detail::hash_key(key.data(), key.size()) & mask; index[slot]; slot = (slot + 1) & mask)
+                    {
+                        if (members[index[slot] - 1].first == key)
+                            return index[slot] - 1;
+                    }
+                    return npos;
+                }
+
+                // Adds a member, which must not be there yet
+                wvalue& add(const std::string& key, wvalue&& value)
+                {
+                    members.emplace_back(key, std::move(value));
+                    if (members.size() > index_threshold)
+                    {
+                        if (index.size() < 2 * members.size())
+                            reindex();
+                        else
+                            insert(members.size() - 1);
+                    }
+                    return members.back().second;
+                }
+
+                void reindex()
+                {
+                    size_t capacity = 32;
+                    while(capacity < 2 * members.size())
+                        capacity *= 2;
+                    index.assign(capacity, 0);
+                    for(size_t i = 0; i < members.size(); i ++)
+                        insert(i);
+                }
+
+                void insert(size_t i)
+                {
+                    const std::string& key = members[i].first;
+                    size_t mask = index.size() - 1;
+                    size_t slot = detail::hash_key(key.data(), key.size()) & mask;
+                    while(index[slot])
+                        slot = (slot + 1) & mask;
+                    index[slot] = static_cast<uint32_t>(i + 1);
+                }
+            };
+
             type t_{type::Null};
             num_type nt{num_type::Null};
-            union {
-              double d;
-              int64_t si;
-              uint64_t ui {};
-            } num;
-            std::string s;
-            std::unique_ptr<std::vector<wvalue>> l;
-            std::unique_ptr<std::unordered_map<std::string, wvalue>> o;
+            // only the member for t_ is alive: num for a Number, s for a String, and the
+            // owned l or o for a List or an Object
+            union
+            {
+                detail::number num{};
+                std::string s;
+                std::vector<wvalue>* l;
+                object* o;
+            };
         public:
 
             wvalue() {}
 
             wvalue(const rvalue& r)
             {
-                t_ = r.t();
                 switch(r.t())
                 {
                     case type::Null:
                     case type::False:
                     case type::True:
+                        t_ = r.t();
                         return;
                     case type::Number:
+                        t_ = type::Number;
                         nt = r.nt();
                         if (nt == num_type::Floating_point)
                           num.d = r.d();
@@ -1181,40 +2158,50 @@ namespace crow
                           num.ui = r.u();
                         return;
                     case type::String:
-                        s = r.s();
+                        *this = std::string(r.s());
                         return;
                     case type::List:
-                        l = std::unique_ptr<std::vector<wvalue>>(new std::vector<wvalue>{});
-                        l->reserve(r.size());
-                        for(auto it = r.begin(); it != r.end(); ++it)
-                            l->emplace_back(*it);
+                        {
+                            auto& list = as_list();
+                            list.reserve(r.size());
+                            for(auto it = r.begin(); it != r.end(); ++it)
+                                list.emplace_back(*it);
+                        }
                         return;
                     case type::Object:
-                        o = std::unique_ptr<
-                                    std::unordered_map<std::string, wvalue>
-                                >(
-                                new std::unordered_map<std::string, wvalue>{});
-                        for(auto it = r.begin(); it != r.end(); ++it)
-                            o->emplace(it->key(), *it);
+                        {
+                            auto& obj = as_object();
+                            for(auto it = r.begin(); it != r.end(); ++it)
+                            {
+                                std::string key = it->key();
+                                if (obj.find(key) == object::npos)
+                                    obj.add(key, wvalue(*it));
+                            }
+                        }
                         return;
                 }
             }
 
-            wvalue(wvalue&& r)
+            wvalue(wvalue&& r) noexcept
             {
-                *this = std::move(r);
+                take(r);
             }
 
-            wvalue& operator = (wvalue&& r)
+            wvalue& operator = (wvalue&& r) noexcept
             {
-                t_ = r.t_;
-                num = r.num;
-                s = std::move(r.s);
-                l = std::move(r.l);
-                o = std::move(r.o);
+                if (this != &r)
+                {
+                    reset();
+                    take(r);
+                }
                 return *this;
             }
 
+            ~wvalue()
+            {
+                reset();
+            }
+
             void clear()
             {
                 reset();
@@ -1222,9 +2209,22 @@ namespace crow
 
             void reset()
             {
+                switch(t_)
+                {
+                    case type::String:
+                        s.~basic_string();
+                        break;
+                    case type::List:
+                        delete l;
+                        break;
+                    case type::Object:
+                        delete o;
+                        break;
+                    default:
+                        break;
+                }
                 t_ = type::Null;
-                l.reset();
-                o.reset();
+                num.ui = 0;
             }
 
             wvalue& operator = (std::nullptr_t)
@@ -1325,33 +2325,31 @@ namespace crow
 
             wvalue& operator=(const char* str)
             {
-                reset();
-                t_ = type::String;
-                s = str;
+                as_string() = str;
                 return *this;
             }
 
             wvalue& operator=(const std::string& str)
             {
-                reset();
-                t_ = type::String;
-                s = str;
+                as_string() = str;
+                return *this;
+            }
+
+            wvalue& operator=(std::string&& str)
+            {
+                as_string() = std::move(str);
                 return *this;
             }
 
             wvalue& operator=(std::vector<wvalue>&& v)
             {
-                if (t_ != type::List)
-                    reset();
-                t_ = type::List;
-                if (!l)
-                    l = std::unique_ptr<std::vector<wvalue>>(new std::vector<wvalue>{});
-                l->clear();
-                l->resize(v.size());
+                auto& list = as_list();
+                list.clear();
+                list.resize(v.size());
                 size_t idx = 0;
                 for(auto& x:v)
                 {
-                    (*l)[idx++] = std::move(x);
+                    list[idx++] = std::move(x);
                 }
                 return *this;
             }
@@ -1359,53 +2357,39 @@ namespace crow
             template <typename T>
             wvalue& operator=(const std::vector<T>& v)
             {
-                if (t_ != type::List)
-                    reset();
-                t_ = type::List;
-                if (!l)
-                    l = std::unique_ptr<std::vector<wvalue>>(new std::vector<wvalue>{});
-                l->clear();
-                l->resize(v.size());
+                auto& list = as_list();
+                list.clear();
+                list.resize(v.size());
                 size_t idx = 0;
                 for(auto& x:v)
                 {
-                    (*l)[idx++] = x;
+                    list[idx++] = x;
                 }
                 return *this;
             }
 
             wvalue& operator[](unsigned index)
             {
-                if (t_ != type::List)
-                    reset();
-                t_ = type::List;
-                if (!l)
-                    l = std::unique_ptr<std::vector<wvalue>>(new std::vector<wvalue>{});
-                if (l->size() < index+1)
-                    l->resize(index+1);
-                return (*l)[index];
+                auto& list = as_list();
+                if (list.size() < index+1)
+                    list.resize(index+1);
+                return list[index];
             }
 
             int count(const std::string& str)
             {
                 if (t_ != type::Object)
                     return 0;
-                if (!o)
-                    return 0;
-                return static_cast<int>(o->count(str));
+                return o->find(str) != object::npos ? 1 : 0;
             }
 
             wvalue& operator[](const std::string& str)
             {
-                if (t_ != type::Object)
-                    reset();
-                t_ = type::Object;
-                if (!o)
-                    o = std::unique_ptr<
-                                std::unordered_map<std::string, wvalue>
-                            >(
-                            new std::unordered_map<std::string, wvalue>{});
-                return (*o)[str];
+                auto& obj = as_object();
+                size_t i = obj.find(str);
+                if (i != object::npos)
+                    return obj.members[i].second;
+                return obj.add(str, wvalue());
             }
 
             std::vector<std::string> keys() const 
@@ -1413,7 +2397,8 @@ namespace crow
                 if (t_ != type::Object) 
                     return {};
                 std::vector<std::string> result;
-                for (auto& kv:*o) 
+                result.reserve(o->members.size());
+                for (auto& kv:o->members) 
                 {
                     result.push_back(kv.first);
                 }
@@ -1432,27 +2417,21 @@ namespace crow
                     case type::List: 
                         {
                             size_t sum{};
-                            if (l)
+                            for(auto& x:*l)
                             {
-                                for(auto& x:*l)
-                                {
-                                    sum += 1;
-                                    sum += x.estimate_length();
-                                }
+                                sum += 1;
+                                sum += x.estimate_length();
                             }
                             return sum+2;
                         }
                     case type::Object:
                         {
                             size_t sum{};
-                            if (o)
+                            for(auto& kv:o->members)
                             {
-                                for(auto& kv:*o)
-                                {
-                                    sum += 2;
-                                    sum += 2+kv.first.size()+kv.first.size()/2;
-                                    sum += kv.second.estimate_length();
-                                }
+                                sum += 2;
+                                sum += 2+kv.first.size()+kv.first.size()/2;
+                                sum += kv.second.estimate_length();
                             }
                             return sum+2;
                         }
@@ -1460,6 +2439,68 @@ namespace crow
                 return 1;
             }
 
+        private:
+            // Takes over r's value, leaving it null; expects *this to be null
+            void take(wvalue& r)
+            {
+                t_ = r.t_;
+                nt = r.nt;
+                switch(t_)
+                {
+                    case type::String:
+                        new (&s) std::string(std::move(r.s));
+                        r.reset();
+                        return;
+                    case type::List:
+                        l = r.l;
+                        break;
+                    case type::Object:
+                        o = r.o;
+                        break;
+                    default:
+                        num = r.num;
+                        break;
+                }
+                r.t_ = type::Null;
+                r.num.ui = 0;
+            }
+
+            // Turns this into a string, keeping the one there is
+            std::string& as_string()
+            {
+                if (t_ != type::String)
+                {
+                    reset();
+                    new (&s) std::string();
+                    t_ = type::String;
+                }
+                return s;
+            }
+
+            // Turns this into a list, keeping the one there is
+            std::vector<wvalue>& as_list()
+            {
+                if (t_ != type::List)
+                {
+                    reset();
+                    l = new std::vector<wvalue>();
+                    t_ = type::List;
+                }
+                return *l;
+            }
+
+            // Turns this into an object, keeping the one there is
+            object& as_object()
+            {
+                if (t_ != type::Object)
+                {
+                    reset();
+                    o = new object();
+                    t_ = type::Object;
+                }
+                return *o;
+            }
+
             friend void dump_internal(const wvalue& v, std::string& out);
             friend std::string dump(const wvalue& v);
         };
@@ -1479,26 +2520,15 @@ namespace crow
                 case type::True: out += "true"; break;
                 case type::Number: 
                     {
+                        char outbuf[32];
+                        char* end;
                         if (v.nt == num_type::Floating_point)
-                        {
-#ifdef _MSC_VER
-#define MSC_COMPATIBLE_SPRINTF(BUFFER_PTR, FORMAT_PTR, VALUE) sprintf_s((BUFFER_PTR), 128, (FORMAT_PTR), (VALUE))
-#else
-#define MSC_COMPATIBLE_SPRINTF(BUFFER_PTR, FORMAT_PTR, VALUE) sprintf((BUFFER_PTR), (FORMAT_PTR), (VALUE))
-#endif
-                            char outbuf[128];
-                            MSC_COMPATIBLE_SPRINTF(outbuf, "%g", v.num.d);
-                            out += outbuf;
-#undef MSC_COMPATIBLE_SPRINTF
-                        }
+                            end = crow::detail::format_double(v.num.d, outbuf);
                         else if (v.nt == num_type::Signed_integer)
-                        {
-                            out += std::to_string(v.num.si);
-                        }
+                            end = crow::detail::format_integer(v.num.si, outbuf);
                         else
-                        {
-                            out += std::to_string(v.num.ui);
-                        }
+                            end = crow::detail::format_integer(v.num.ui, outbuf);
+                        out.append(outbuf, end);
                     }
                     break;
                 case type::String: dump_string(v.s, out); break;
@@ -1527,7 +2557,7 @@ namespace crow
                          if (v.o)
                          {
                              bool first = true;
-                             for(auto& kv:*v.o)
+                             for(auto& kv:v.o->members)
                              {
                                  if (!first)
                                  {
@@ -1553,6 +2583,508 @@ namespace crow
             return ret;
         }
 
+        // Writes a document straight into `out' as it is produced, without building a wvalue
+        // first. Commas and colons are put in by the writer; the caller pairs up the begin and
+        // end calls and gives every object member a key() before its value:
+        //
+        //     json::writer w(res.body);
+        //     w.begin_object().key("items").begin_list();
+        //     for(auto& item : items)
+        //         w.value(item.id);
+        //     w.end_list().end_object();
+        class writer
+        {
+        public:
+            explicit writer(std::string& out) : out_(out) {}
+
+            writer& begin_object() { separate(); out_.push_back('{'); first_ = true; return *this; }
+            writer& end_object() { out_.push_back('}'); first_ = false; return *this; }
+            writer& begin_list() { separate(); out_.push_back('['); first_ = true; return *this; }
+            writer& end_list() { out_.push_back(']'); first_ = false; return *this; }
+
+            writer& key(const char* data, size_t size)
+            {
+                separate();
+                out_.push_back('"');
+                escape(data, size, out_);
+                out_ += "\":";
+                after_key_ = true;
+                return *this;
+            }
+            writer& key(const char* str) { return key(str, strlen(str)); }
+            writer& key(const std::string& str) { return key(str.data(), str.size()); }
+
+            writer& value(std::nullptr_t) { separate(); out_ += "null"; return *this; }
+            writer& value(bool b) { separate(); out_ += b ? "true" : "false"; return *this; }
+
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, writer&>::type value(T v)
+            {
+                return number(crow::detail::format_integer(static_cast<int64_t>(v), buf_));
+            }
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T, bool>::value, writer&>::type value(T v)
+            {
+                return number(crow::detail::format_integer(static_cast<uint64_t>(v), buf_));
+            }
+            writer& value(double v) { return number(crow::detail::format_double(v, buf_)); }
+
+            writer& value(const char* data, size_t size)
+            {
+                separate();
+                out_.push_back('"');
+                escape(data, size, out_);
+                out_.push_back('"');
+                return *this;
+            }
+            writer& value(const char* str) { return value(str, strlen(str)); }
+            writer& value(const std::string& str) { return value(str.data(), str.size()); }
+
+            // Splices in a prebuilt value
+            writer& value(const wvalue& v) { separate(); dump_internal(v, out_); return *this; }
+
+        private:
+            void separate()
+            {
+                if (after_key_)
+                    after_key_ = false;
+                else if (!first_)
+                    out_.push_back(',');
+                first_ = false;
+            }
+
+            writer& number(char* end)
+            {
+                separate();
+                out_.append(buf_, end);
+                return *this;
+            }
+
+            std::string& out_;
+            char buf_[32];
+            bool first_{true};
+            bool after_key_{};
+        };
+
+        // Parses a document handed over in pieces of any size, as a body arrives, and reports
+        // what it reads to `handler' instead of building an rvalue. The handler takes the same
+        // calls as json::writer, so a writer can be used to re-serialize what is read:
+        //
+        //     begin_object() end_object() begin_list() end_list() key(const std::string&)
+        //     value(std::nullptr_t) value(bool) value(int64_t) value(uint64_t) value(double)
+        //     value(const std::string&)
+        //
+        // Non-negative integers come as uint64_t, negative ones as int64_t and anything else,
+        // including integers too large for 64 bits, as double. The only state kept is the
+        // nesting stack and the token being read, bounded by max_depth and max_token, so memory
+        // does not grow with the document.
+        template <typename Handler>
+        class stream_parser
+        {
+        public:
+            explicit stream_parser(Handler* handler, size_t max_depth = 1024, size_t max_token = 1 << 20)
+                : handler_(handler), max_depth_(max_depth), max_token_(max_token)
+            {
+            }
+
+            // Returns false once the input is known to be invalid; nothing is reported after that
+            bool feed(const char* data, size_t size)
+            {
+                const char* p = data;
+                const char* end = data + size;
+                while(p != end)
+                {
+                    switch(state_)
+                    {
+                        case state::error:
+                            return false;
+                        case state::done:
+                            if (!is_space(*p))
+                                return fail();
+                            p++;
+                            break;
+                        case state::value:
+                        case state::value_or_end_list:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == ']' && state_ == state::value_or_end_list)
+                            {
+                                p++;
+                                close();
+                            }
+                            else if (!start_value(*p++))
+                                return fail();
+                            break;
+                        case state::key:
+                        case state::key_or_end_object:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == '}' && state_ == state::key_or_end_object)
+                            {
+                                p++;
+                                close();
+                            }
+                            else if (*p++ == '"')
+                            {
+                                token_.clear();
+                                string_is_key_ = true;
+                                state_ = state::string;
+                            }
+                            else
+                                return fail();
+                            break;
+                        case state::colon:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p++ == ':')
+                                state_ = state::value;
+                            else
+                                return fail();
+                            break;
+                        case state::comma_or_end:
+                            if (is_space(*p))
+                                p++;
+                            else if (*p == ',')
+                            {
+                                p++;
+                                state_ = stack_.back() == '{' ? state::key : state::value;
+                            }
+                            else if (*p == (stack_.back() == '{' ? '}' : ']'))
+                            {
+                                p++;
+                                close();
+                            }
+                            else
+                                return fail();
+                            break;
+                        case state::string:
+                            {
+                                const char* run = p;
+                                while(p != end && *p != '"' && *p != '\\')
+                                    p++;
+                                if (!append(run, p - run))
+                                    return fail();
+                                if (p == end)
+                                    break;
+                                if (*p++ == '"')
+                                    end_string();
+                                else
+                                    state_ = state::string_escape;
+                            }
+                            break;
+                        case state::string_escape:
+                            {
+                                char c;
+                                switch(*p++)
+                                {
+                                    case '"': c = '"'; break;
+                                    case '\\': c = '\\'; break;
+                                    case '/': c = '/'; break;
+                                    case 'b': c = '\b'; break;
+                                    case 'f': c = '\f'; break;
+                                    case 'n': c = '\n'; break;
+                                    case 'r': c = '\r'; break;
+                                    case 't': c = '\t'; break;
+                                    case 'u':
+                                        code_ = 0;
+                                        hex_digits_ = 0;
+                                        state_ = state::string_unicode;
+                                        continue;
+                                    default:
+                                        return fail();
+                                }
+                                if (!append(&c, 1))
+                                    return fail();
+                                state_ = state::string;
+                            }
+                            break;
+                        case state::string_unicode:
+                            {
+                                char c = *p++;
+                                unsigned digit;
+                                if (c >= '0' && c <= '9')
+                                    digit = c - '0';
+                                else if (c >= 'a' && c <= 'f')
+                                    digit = c - 'a' + 10;
+                                else if (c >= 'A' && c <= 'F')
+                                    digit = c - 'A' + 10;
+                                else
+                                    return fail();
+                                code_ = code_ * 16 + digit;
+                                if (++hex_digits_ == 4)
+                                {
+                                    if (!append_code_point())
+                                        return fail();
+                                    state_ = state::string;
+                                }
+                            }
+                            break;
+                        case state::number:
+                            {
+                                const char* run = p;
+                                while(p != end && is_number_char(*p))
+                                    p++;
+                                if (!append(run, p - run))
+                                    return fail();
+                                // the number goes on into the next piece, or ends at the end of input
+                                if (p != end && !end_number())
+                                    return fail();
+                            }
+                            break;
+                        case state::literal:
+                            if (*p++ != literal_[literal_pos_])
+                                return fail();
+                            if (literal_[++literal_pos_] == 0)
+                            {
+                                if (literal_[0] == 'n')
+                                    handler_->value(nullptr);
+                                else
+                                    handler_->value(literal_[0] == 't');
+                                value_done();
+                            }
+                            break;
+                    }
+                }
+                return state_ != state::error;
+            }
+
+            // Call at the end of input; true if it held exactly one complete value
+            bool finish()
+            {
+                if (state_ == state::number && !end_number())
+                    fail();
+                return state_ == state::done;
+            }
+
+            bool done() const
+            {
+                return state_ == state::done;
+            }
+
+            bool failed() const
+            {
+                return state_ == state::error;
+            }
+
+            // Gets ready for another document
+            void reset()
+            {
+                state_ = state::value;
+                stack_.clear();
+                token_.clear();
+            }
+
+        private:
+            enum class state : char
+            {
+                value,
+                value_or_end_list,
+                key,
+                key_or_end_object,
+                colon,
+                comma_or_end,
+                string,
+                string_escape,
+                string_unicode,
+                number,
+                literal,
+                done,
+                error,
+            };
+
+            static bool is_space(char c)
+            {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            }
+
+            static bool is_number_char(char c)
+            {
+                return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+            }
+
+            bool fail()
+            {
+                state_ = state::error;
+                return false;
+            }
+
+            bool append(const char* data, size_t size)
+            {
+                if (token_.size() + size > max_token_)
+                    return false;
+                token_.append(data, size);
+                return true;
+            }
+
+            // Same encoding as the \u escapes json::load reads
+            bool append_code_point()
+            {
+                char buf[3];
+                size_t size;
+                if (code_ >= 0x800)
+                {
+                    buf[0] = 0xE0 | (code_ >> 12);
+                    buf[1] = 0x80 | ((code_ >> 6) & 0x3F);
+                    buf[2] = 0x80 | (code_ & 0x3F);
+                    size = 3;
+                }
+                else if (code_ >= 0x80)
+                {
+                    buf[0] = 0xC0 | (code_ >> 6);
+                    buf[1] = 0x80 | (code_ & 0x3F);
+                    size = 2;
+                }
+                else
+                {
+                    buf[0] = code_;
+                    size = 1;
+                }
+                return append(buf, size);
+            }
+
+            bool start_value(char c)
+            {
+                switch(c)
+                {
+                    case '{':
+                    case '[':
+                        if (stack_.size() >= max_depth_)
+                            return false;
+                        stack_.push_back(c);
+                        if (c == '{')
+                        {
+                            handler_->begin_object();
+                            state_ = state::key_or_end_object;
+                        }
+                        else
+                        {
+                            handler_->begin_list();
+                            state_ = state::value_or_end_list;
+                        }
+                        return true;
+                    case '"':
+                        token_.clear();
+                        string_is_key_ = false;
+                        state_ = state::string;
+                        return true;
+                    case 't': literal_ = "true"; break;
+                    case 'f': literal_ = "false"; break;
+                    case 'n': literal_ = "null"; break;
+                    default:
+                        if (c != '-' && !(c >= '0' && c <= '9'))
+                            return false;
+                        token_.assign(1, c);
+                        state_ = state::number;
+                        return true;
+                }
+                literal_pos_ = 1;
+                state_ = state::literal;
+                return true;
+            }
+
+            void end_string()
+            {
+                if (string_is_key_)
+                {
+                    handler_->key(token_);
+                    state_ = state::colon;
+                }
+                else
+                {
+                    handler_->value(token_);
+                    value_done();
+                }
+            }
+
+            bool end_number()
+            {
+                const char* p = token_.data();
+                const char* end = p + token_.size();
+                if (!valid_number(p, end))
+                    return false;
+                num_type nt;
+                detail::number n;
+                if (detail::parse_number(p, end, nt, n))
+                {
+                    if (nt == num_type::Floating_point)
+                        handler_->value(n.d);
+                    else if (nt == num_type::Signed_integer)
+                        handler_->value(n.si);
+                    else
+                        handler_->value(n.ui);
+                }
+                else
+                {
+                    double d;
+                    if (!boost::conversion::try_lexical_convert(token_, d))
+                        return false;
+                    handler_->value(d);
+                }
+                value_done();
+                return true;
+            }
+
+            // The number grammar; the token is known to hold only number characters
+            static bool valid_number(const char* p, const char* end)
+            {
+                auto digits = [&]
+                {
+                    const char* start = p;
+                    while(p != end && *p >= '0' && *p <= '9')
+                        p++;
+                    return p != start;
+                };
+                if (*p == '-')
+                    p++;
+                if (p != end && *p == '0')
+                    p++;
+                else if (!digits())
+                    return false;
+                if (p != end && *p == '.')
+                {
+                    p++;
+                    if (!digits())
+                        return false;
+                }
+                if (p != end && (*p == 'e' || *p == 'E'))
+                {
+                    p++;
+                    if (p != end && (*p == '+' || *p == '-'))
+                        p++;
+                    if (!digits())
+                        return false;
+                }
+                return p == end;
+            }
+
+            void close()
+            {
+                if (stack_.back() == '{')
+                    handler_->end_object();
+                else
+                    handler_->end_list();
+                stack_.pop_back();
+                value_done();
+            }
+
+            void value_done()
+            {
+                state_ = stack_.empty() ? state::done : state::comma_or_end;
+            }
+
+            Handler* handler_;
+            size_t max_depth_;
+            size_t max_token_;
+            state state_{state::value};
+            std::vector<char> stack_;
+            std::string token_;
+            bool string_is_key_{};
+            const char* literal_{};
+            size_t literal_pos_{};
+            unsigned code_{};
+            int hex_digits_{};
+        };
+
         //std::vector<boost::asio::const_buffer> dump_ref(wvalue& v)
         //{
         //}
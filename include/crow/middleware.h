@@ -51,7 +51,7 @@ namespace crow
 
         void before_handle(request& req, response& res, context& ctx)
         {
-            int count = req.headers.count("Cookie");
+            int count = req.headers.count(known_header::cookie);
             if (!count)
                 return;
             if (count > 1)
@@ -60,7 +60,7 @@ namespace crow
                 res.end();
                 return;
             }
-            std::string cookies = req.get_header_value("Cookie");
+            std::string cookies = req.get_header_value(known_header::cookie);
             size_t pos = 0;
             while(pos < cookies.size())
             {
@@ -1,18 +1,46 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
-#include <boost/algorithm/string.hpp>
+#include <vector>
 #include <algorithm>
+#include <cstring>
+#include <boost/asio/buffer.hpp>
+#include <boost/utility/string_ref.hpp>
 
+#include "crow/settings.h"
 #include "crow/http_parser_merged.h"
+#include "crow/parser_simd.h"
 #include "crow/http_request.h"
 
 namespace crow
 {
-    template <typename Handler>
+    // HTTPParser backends, chosen with its second template argument or CROW_ENABLE_SIMD_PARSER.
+    // http_parser_merged.h, one byte at a time
+    struct http_parser_backend {};
+    // Waits for a complete head and splits it with the searches in parser_simd.h. Anything
+    // unusual (folded lines, bare LFs, chunked bodies, upgrades, errors) goes to http_parser,
+    // from the start of the message, so both backends always agree.
+    struct simd_parser_backend {};
+
+#ifdef CROW_ENABLE_SIMD_PARSER
+    using default_parser_backend = simd_parser_backend;
+#else
+    using default_parser_backend = http_parser_backend;
+#endif
+
+    // Reads go straight into a buffer owned by the parser, and the url, headers and body of
+    // the current message are kept as ranges of it. Nothing is copied or allocated while a
+    // message is parsed; the buffer only grows when a message does not fit in what is left.
+    template <typename Handler, typename Backend = default_parser_backend>
     struct HTTPParser : public http_parser
     {
+        // Offsets rather than pointers, so the buffer can be compacted or grown under them
+        struct range
+        {
+            size_t offset{};
+            size_t size{};
+        };
+
         static int on_message_begin(http_parser* self_)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
@@ -22,49 +50,43 @@ namespace crow
         static int on_url(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            self->raw_url.insert(self->raw_url.end(), at, at+length);
+            if (self->keep_ == npos)
+                self->keep_ = at - self->buffer_.data();
+            self->extend(self->url_, at, length);
             return 0;
         }
         static int on_header_field(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            switch (self->header_building_state)
-            {
-                case 0:
-                    if (!self->header_value.empty())
-                    {
-                        self->headers.emplace(std::move(self->header_field), std::move(self->header_value));
-                    }
-                    self->header_field.assign(at, at+length);
-                    self->header_building_state = 1;
-                    break;
-                case 1:
-                    self->header_field.insert(self->header_field.end(), at, at+length);
-                    break;
+            // a name is only split by the end of a read, so a piece that does not follow
+            // the last one starts a new header (the previous value may have been empty)
+            if (self->header_building_state == 0 || !self->adjacent(self->headers_.back().first, at))
+            {
+                self->headers_.emplace_back();
+                self->header_building_state = 1;
             }
+            self->extend(self->headers_.back().first, at, length);
             return 0;
         }
         static int on_header_value(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            switch (self->header_building_state)
-            {
-                case 0:
-                    self->header_value.insert(self->header_value.end(), at, at+length);
-                    break;
-                case 1:
-                    self->header_building_state = 0;
-                    self->header_value.assign(at, at+length);
-                    break;
-            }
+            self->header_building_state = 0;
+            self->extend(self->headers_.back().second, at, length);
             return 0;
         }
         static int on_headers_complete(http_parser* self_)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            if (!self->header_field.empty())
+            // an h2c upgrade request may have a body, which still arrives as HTTP/1 (RFC 7540 3.2)
+            if (self->upgrade)
             {
-                self->headers.emplace(std::move(self->header_field), std::move(self->header_value));
+                auto value = self->get_header_value("upgrade");
+                if (value.size() == 3 && detail::iequals_ascii(value.data(), "h2c", 3))
+                {
+                    self->upgrade = 0;
+                    self->h2c_upgrade = true;
+                }
             }
             self->process_header();
             return 0;
@@ -72,59 +94,98 @@ namespace crow
         static int on_body(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            self->body.insert(self->body.end(), at, at+length);
+            self->extend(self->body_, at, length);
             return 0;
         }
         static int on_message_complete(http_parser* self_)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-
-            // url params
-            self->url = self->raw_url.substr(0, self->raw_url.find("?"));
-            self->url_params = query_string(self->raw_url);
-
             self->process_message();
+            // the handler has taken what it needs; the next read may reuse the whole buffer
+            self->keep_ = npos;
             return 0;
         }
         HTTPParser(Handler* handler) :
+            buffer_(initial_buffer_size),
             handler_(handler)
         {
             http_parser_init(this, HTTP_REQUEST);
         }
 
+
+        // The free space the next read should go to. Bytes still referred to by an
+        // unfinished message are moved to the front first, and the buffer is doubled only
+        // when they leave too little room.
+        boost::asio::mutable_buffers_1 prepare()
+        {
+            if (keep_ == npos)
+            {
+                size_ = 0;
+                next_ = 0;
+                if (buffer_.size() > max_idle_buffer_size)
+                    std::vector<char>(initial_buffer_size).swap(buffer_);
+            }
+            else if (keep_ > 0)
+            {
+                size_t shift = keep_;
+                std::memmove(buffer_.data(), buffer_.data() + shift, size_ - shift);
+                size_ -= shift;
+                keep_ = 0;
+                rebase(url_, shift);
+                for(auto& h : headers_)
+                {
+                    rebase(h.first, shift);
+                    rebase(h.second, shift);
+                }
+                rebase(body_, shift);
+                if (next_ >= shift)
+                    next_ -= shift;
+            }
+            if (buffer_.size() - size_ < min_read_size)
+                buffer_.resize(buffer_.size() * 2);
+            return boost::asio::buffer(buffer_.data() + size_, buffer_.size() - size_);
+        }
+
+        // Parses `length' bytes read into the space returned by prepare().
         // return false on error
-        bool feed(const char* buffer, int length)
+        bool commit(size_t length)
         {
-            const static http_parser_settings settings_{
-                on_message_begin,
-                on_url,
-                nullptr,
-                on_header_field,
-                on_header_value,
-                on_headers_complete,
-                on_body,
-                on_message_complete,
-            };
+            size_t begin = size_;
+            size_ += length;
+            return parse(begin, Backend());
+        }
 
-            int nparsed = static_cast<int>(http_parser_execute(this, &settings_, buffer, length));
-            return nparsed == length;
+        // Copies `buffer' in and parses it; the connection reads in place through prepare()/commit().
+        // return false on error
+        bool feed(const char* buffer, int length)
+        {
+            size_t done = 0;
+            while(done < static_cast<size_t>(length))
+            {
+                auto space = prepare();
+                size_t n = std::min(boost::asio::buffer_size(space), static_cast<size_t>(length) - done);
+                std::memcpy(boost::asio::buffer_cast<char*>(space), buffer + done, n);
+                if (!commit(n))
+                    return false;
+                done += n;
+            }
+            return true;
         }
 
         bool done()
         {
-            return feed(nullptr, 0);
+            if (!finish(Backend()))
+                return false;
+            return http_parser_execute(this, &settings(), nullptr, 0) == 0;
         }
 
         void clear()
         {
-            url.clear();
-            raw_url.clear();
+            url_ = range();
+            body_ = range();
+            headers_.clear();
             header_building_state = 0;
-            header_field.clear();
-            header_value.clear();
-            headers.clear();
-            url_params.clear();
-            body.clear();
+            h2c_upgrade = false;
         }
 
         void process_header()
@@ -137,9 +198,57 @@ namespace crow
             handler_->handle();
         }
 
+        boost::string_ref raw_url() const
+        {
+            return view(url_);
+        }
+
+        boost::string_ref body() const
+        {
+            return view(body_);
+        }
+
+        // The first header named `key', empty if there is none
+        boost::string_ref get_header_value(const std::string& key) const
+        {
+            for(auto& h : headers_)
+            {
+                if (h.first.size == key.size() && detail::iequals_ascii(buffer_.data() + h.first.offset, key.data(), key.size()))
+                    return view(h.second);
+            }
+            return {};
+        }
+
+        // Fills `req' in place, so the strings it already holds are reused
+        void to_request(request& req) const
+        {
+            auto raw = raw_url();
+            req.method = (HTTPMethod)method;
+            req.raw_url.assign(raw.data(), raw.size());
+
+            // url params; only the query part is kept and it is parsed on first use
+            req.url.assign(raw.data(), std::min(raw.find('?'), raw.size()));
+            auto query_pos = raw.find_first_of("?#");
+            if (query_pos != boost::string_ref::npos)
+                req.url_params.assign(raw.data() + query_pos, raw.size() - query_pos);
+            else
+                req.url_params.clear();
+
+            req.headers.clear();
+            for(auto& h : headers_)
+                req.headers.emplace(view(h.first), view(h.second));
+
+            auto b = body();
+            req.body.assign(b.data(), b.size());
+            req.middleware_context = nullptr;
+            req.io_service = nullptr;
+        }
+
         request to_request() const
         {
-            return request{(HTTPMethod)method, std::move(raw_url), std::move(url), std::move(url_params), std::move(headers), std::move(body)};
+            request req;
+            to_request(req);
+            return req;
         }
 
 		bool is_upgrade() const
@@ -147,20 +256,330 @@ namespace crow
 			return upgrade;
 		}
 
+        bool is_h2c_upgrade() const
+        {
+            return h2c_upgrade;
+        }
+
         bool check_version(int major, int minor) const
         {
             return http_major == major && http_minor == minor;
         }
 
-        std::string raw_url;
-        std::string url;
-
         int header_building_state = 0;
-        std::string header_field;
-        std::string header_value;
-        ci_map headers;
-        query_string url_params;
-        std::string body;
+        bool h2c_upgrade{};
+
+        // bytes consumed by the last commit(); after an upgrade the rest belongs to the new protocol
+        size_t parsed_length{};
+
+    private:
+        static const http_parser_settings& settings()
+        {
+            const static http_parser_settings settings{
+                on_message_begin,
+                on_url,
+                nullptr,
+                on_header_field,
+                on_header_value,
+                on_headers_complete,
+                on_body,
+                on_message_complete,
+            };
+            return settings;
+        }
+
+        bool parse(size_t begin, http_parser_backend)
+        {
+            return execute(begin, begin);
+        }
+
+        bool parse(size_t begin, simd_parser_backend)
+        {
+            size_t from = begin;
+            if (!slow_)
+            {
+                int ret = 0;
+                while(next_ < size_ && (ret = parse_message()) > 0)
+                    ;
+                if (ret >= 0)
+                {
+                    keep_ = next_ < size_ ? next_ : npos;
+                    parsed_length = size_ - begin;
+                    return true;
+                }
+                slow_ = true;
+                from = next_;
+            }
+            if (!execute(from, begin))
+                return false;
+            if (state == s_start_req)
+            {
+                // between messages; the next one may take the fast path again
+                slow_ = false;
+                next_ = size_;
+                reset_head();
+            }
+            return true;
+        }
+
+        bool finish(http_parser_backend)
+        {
+            return true;
+        }
+
+        // A head still waiting for its end goes to http_parser, which has the last word on it
+        bool finish(simd_parser_backend)
+        {
+            if (slow_)
+                return true;
+            if (body_pending_)
+            {
+                // the head went to the handler already; this is where http_parser would give up
+                http_errno = HPE_INVALID_EOF_STATE;
+                return false;
+            }
+            if (next_ < size_)
+            {
+                slow_ = true;
+                execute(next_, next_);
+            }
+            return true;
+        }
+
+        // Hands [from, size_) to http_parser; `begin' is where the latest read starts
+        bool execute(size_t from, size_t begin)
+        {
+            size_t length = size_ - from;
+            size_t nparsed = http_parser_execute(this, &settings(), buffer_.data() + from, length);
+            parsed_length = from + nparsed > begin ? from + nparsed - begin : 0;
+            return nparsed == length;
+        }
+
+        // Parses the message at next_: 1 when it is complete, 0 when more bytes are needed,
+        // -1 when it has to go to http_parser instead
+        int parse_message()
+        {
+            const char* base = buffer_.data() + next_;
+            if (!body_pending_)
+            {
+                // after a message that is not kept alive, only http_parser knows what to do
+                if (state != s_start_req || (scan_ == 0 && (base[0] < 'A' || base[0] > 'Z')))
+                    return -1;
+
+                // every line has to end in CRLF; the head ends with an empty one
+                const char* end = buffer_.data() + size_;
+                const char* p = base + scan_;
+                size_t head_size = 0;
+                while(!head_size)
+                {
+                    p = detail::find_crlf(p, end);
+                    if (p == end || (*p == '\r' && p + 1 == end))
+                        break;
+                    if (*p == '\n' || p[1] != '\n')
+                        return -1;
+                    size_t lf = p + 1 - base;
+                    if (!line_ends_.empty() && line_ends_.back() + 2 == lf)
+                        head_size = lf + 1;
+                    else
+                        line_ends_.push_back(lf);
+                    p += 2;
+                }
+                if (!head_size)
+                {
+                    scan_ = p - base;
+                    return size_ - next_ > CROW_HTTP_MAX_HEADER_SIZE ? -1 : 0;
+                }
+                if (head_size > CROW_HTTP_MAX_HEADER_SIZE || !parse_head())
+                    return -1;
+
+                body_.offset = next_ + head_size;
+                on_headers_complete(this);
+                if (content_length == 0 || content_length == CROW_ULLONG_MAX)
+                    return complete_message(body_.offset);
+                body_pending_ = true;
+            }
+
+            if (size_ - body_.offset < content_length)
+                return 0;
+            body_.size = content_length;
+            content_length = 0;
+            return complete_message(body_.offset + body_.size);
+        }
+
+        // The request line and the header lines found by parse_message(). Only the common
+        // forms are accepted here; false leaves the message to http_parser.
+        bool parse_head()
+        {
+            const char* base = buffer_.data() + next_;
+            clear();
+            flags = 0;
+            upgrade = 0;
+            content_length = CROW_ULLONG_MAX;
+
+            // METHOD SP /target SP HTTP/1.x
+            const char* line_end = base + line_ends_[0] - 1;
+            const char* sp = static_cast<const char*>(std::memchr(base, ' ', line_end - base));
+            if (!sp || !match_method(base, sp - base))
+                return false;
+            const char* target = sp + 1;
+            if (target == line_end || *target != '/')
+                return false;
+            const char* target_end = detail::find_non_printable(target, line_end);
+            if (line_end - target_end != 9 || std::memcmp(target_end, " HTTP/1.", 8) != 0 || (target_end[8] != '0' && target_end[8] != '1'))
+                return false;
+            http_major = 1;
+            http_minor = target_end[8] - '0';
+            url_.offset = target - buffer_.data();
+            url_.size = target_end - target;
+
+            for(size_t i = 1; i < line_ends_.size(); i ++)
+            {
+                const char* name = base + line_ends_[i - 1] + 1;
+                const char* end = base + line_ends_[i] - 1;
+                // a line starting with whitespace is folded; it stops here as well
+                const char* colon = detail::find_non_token(name, end);
+                if (colon == name || colon == end || *colon != ':')
+                    return false;
+                const char* value = colon + 1;
+                while(value != end && (*value == ' ' || *value == '\t'))
+                    value ++;
+                if (!check_header(name, colon - name, value, end - value))
+                    return false;
+
+                headers_.emplace_back();
+                headers_.back().first.offset = name - buffer_.data();
+                headers_.back().first.size = colon - name;
+                headers_.back().second.offset = value - buffer_.data();
+                headers_.back().second.size = end - value;
+            }
+            nread = 0;
+            return true;
+        }
+
+        bool match_method(const char* name, size_t size)
+        {
+            for(unsigned m = 0; m <= HTTP_MKCALENDAR; m ++)
+            {
+                const char* s = http_method_str(static_cast<http_method>(m));
+                if (std::strlen(s) == size && std::memcmp(s, name, size) == 0)
+                {
+                    method = m;
+                    // CONNECT is always an upgrade
+                    return m != HTTP_CONNECT;
+                }
+            }
+            return false;
+        }
+
+        // Applies what http_parser takes from a header to the flags and the content length
+        bool check_header(const char* name, size_t name_size, const char* value, size_t value_size)
+        {
+            auto is = [&](const char* s, size_t size){ return name_size == size && detail::iequals_ascii(name, s, size); };
+            if (is("content-length", 14))
+            {
+                if (value_size == 0 || value_size > 18)
+                    return false;
+                uint64_t n = 0;
+                for(size_t i = 0; i < value_size; i ++)
+                {
+                    if (value[i] < '0' || value[i] > '9')
+                        return false;
+                    n = n * 10 + (value[i] - '0');
+                }
+                content_length = n;
+            }
+            else if (is("connection", 10) || is("proxy-connection", 16))
+            {
+                // only the whole value counts, with trailing spaces
+                while(value_size && value[value_size - 1] == ' ')
+                    value_size --;
+                if (value_size == 10 && detail::iequals_ascii(value, "keep-alive", 10))
+                    flags |= F_CONNECTION_KEEP_ALIVE;
+                else if (value_size == 5 && detail::iequals_ascii(value, "close", 5))
+                    flags |= F_CONNECTION_CLOSE;
+            }
+            else if (is("transfer-encoding", 17) || is("upgrade", 7))
+            {
+                return false;
+            }
+            return true;
+        }
+
+        int complete_message(size_t end)
+        {
+            next_ = end;
+            reset_head();
+            // http_parser is strict: nothing may follow a message that is not kept alive
+            state = http_should_keep_alive(this) ? s_start_req : s_dead;
+            on_message_complete(this);
+            return 1;
+        }
+
+        void reset_head()
+        {
+            scan_ = 0;
+            line_ends_.clear();
+            body_pending_ = false;
+        }
+
+        static const size_t npos = static_cast<size_t>(-1);
+        static const size_t initial_buffer_size = 4096;
+        static const size_t min_read_size = 2048;
+        // a buffer grown for a large message is given back once it is done with
+        static const size_t max_idle_buffer_size = 64 * 1024;
+
+        // The parser hands over values in pieces: at the end of a read, and around folded
+        // header lines and chunk headers. Pieces that are not adjacent are moved down over
+        // the framing bytes in between, which the parser has consumed already.
+        void extend(range& r, const char* at, size_t length)
+        {
+            size_t offset = at - buffer_.data();
+            if (r.size == 0)
+            {
+                r.offset = offset;
+            }
+            else if (offset != r.offset + r.size)
+            {
+                std::memmove(buffer_.data() + r.offset + r.size, at, length);
+            }
+            r.size += length;
+        }
+
+        bool adjacent(const range& r, const char* at) const
+        {
+            return buffer_.data() + r.offset + r.size == at;
+        }
+
+        static void rebase(range& r, size_t shift)
+        {
+            // empty ranges may still be at 0
+            if (r.offset >= shift)
+                r.offset -= shift;
+        }
+
+        boost::string_ref view(const range& r) const
+        {
+            return boost::string_ref(buffer_.data() + r.offset, r.size);
+        }
+
+        std::vector<char> buffer_;
+        // bytes read into buffer_
+        size_t size_{};
+        // start of the bytes the current message refers to, npos when there are none
+        size_t keep_{npos};
+
+        range url_;
+        std::vector<std::pair<range, range>> headers_;
+        range body_;
+
+        // simd_parser_backend: the message being parsed starts at next_, unless http_parser has it
+        bool slow_{};
+        size_t next_{};
+        // how far the head has been searched, and the LFs found so far, relative to next_
+        size_t scan_{};
+        std::vector<size_t> line_ends_;
+        // the head has been handled; waiting for content_length bytes at body_.offset
+        bool body_pending_{};
 
         Handler* handler_;
     };
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__) || defined(__SSE4_2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define CROW_PARSER_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Delimiter searches for the SIMD parser backend and the JSON string index. Each one takes the widest instructions the
+// compiler is allowed to use (-mavx2, -msse4.2, SSE2 on x86-64) and finishes byte by byte.
+namespace crow
+{
+    namespace detail
+    {
+        inline unsigned count_trailing_zeros(uint32_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, x);
+            return index;
+#else
+            return __builtin_ctz(x);
+#endif
+        }
+
+        inline unsigned count_trailing_zeros(uint64_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, x);
+            return index;
+#else
+            return __builtin_ctzll(x);
+#endif
+        }
+
+        // RFC 7230 tchar; the same set as http_parser's `tokens' without the space it lets through
+        inline bool is_token_char(char c)
+        {
+            static const uint32_t bits[8] = {
+                0x00000000, 0x03ff6cfa, 0xc7fffffe, 0x57ffffff,
+                0x00000000, 0x00000000, 0x00000000, 0x00000000,
+            };
+            unsigned char u = static_cast<unsigned char>(c);
+            return (bits[u >> 5] >> (u & 31)) & 1;
+        }
+
+        // The first CR or LF in [p, end), end if there is none
+        inline const char* find_crlf(const char* p, const char* end)
+        {
+#if defined(__AVX2__)
+            const __m256i cr = _mm256_set1_epi8('\r');
+            const __m256i lf = _mm256_set1_epi8('\n');
+            for(; end - p >= 32; p += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+#ifdef CROW_PARSER_SSE2
+            const __m128i cr16 = _mm_set1_epi8('\r');
+            const __m128i lf16 = _mm_set1_epi8('\n');
+            for(; end - p >= 16; p += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr16), _mm_cmpeq_epi8(v, lf16)));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (*p == '\r' || *p == '\n')
+                    return p;
+            }
+            return end;
+        }
+
+        // The first byte of [p, end) that is not printable ASCII (0x21-0x7e), end if there is none.
+        // A request target ends at the first space, and anything else below 0x21 or above 0x7e
+        // is left to http_parser.
+        inline const char* find_non_printable(const char* p, const char* end)
+        {
+#if defined(__AVX2__)
+            // bytes above 0x7f are negative as signed chars, and so fail the first comparison
+            const __m256i low = _mm256_set1_epi8(0x20);
+            const __m256i high = _mm256_set1_epi8(0x7f);
+            for(; end - p >= 32; p += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+                uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+#ifdef CROW_PARSER_SSE2
+            const __m128i low16 = _mm_set1_epi8(0x20);
+            const __m128i high16 = _mm_set1_epi8(0x7f);
+            for(; end - p >= 16; p += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, low16), _mm_cmpgt_epi8(high16, v));
+                uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(ok)) & 0xffff;
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (static_cast<unsigned char>(*p) <= 0x20 || static_cast<unsigned char>(*p) >= 0x7f)
+                    return p;
+            }
+            return end;
+        }
+
+        // The first byte of [p, end) that cannot be part of a header name (normally the colon),
+        // end if there is none
+        inline const char* find_non_token(const char* p, const char* end)
+        {
+#if defined(__SSE4_2__)
+            // eight ranges covering every non-token byte; the last one also takes in `|' and `~',
+            // which are checked one by one
+            static const char ranges[16] = {
+                '\x00', ' ', '"', '"', '(', ')', ',', ',',
+                '/', '/', ':', '@', '[', ']', '{', '\xff',
+            };
+            const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+            while(end - p >= 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                int index = _mm_cmpestri(r, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+                if (index == 16)
+                {
+                    p += 16;
+                    continue;
+                }
+                p += index;
+                if (!is_token_char(*p))
+                    return p;
+                p ++;
+            }
+#endif
+            for(; p != end; p ++)
+            {
+                if (!is_token_char(*p))
+                    return p;
+            }
+            return end;
+        }
+
+#ifdef CROW_PARSER_SSE2
+        // Bit masks of the quotes, backslashes and NULs among the 64 bytes at p
+        inline void classify_json_block(const char* p, uint64_t& quotes, uint64_t& backslashes, uint64_t& zeros)
+        {
+#if defined(__AVX2__)
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            auto mask = [&](const __m256i& c)
+            {
+                return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c))) |
+                    static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c)))) << 32;
+            };
+#else
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i zero = _mm_setzero_si128();
+            __m128i v[4];
+            for(int i = 0; i < 4; i ++)
+                v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            auto mask = [&](const __m128i& c)
+            {
+                uint64_t ret = 0;
+                for(int i = 0; i < 4; i ++)
+                    ret |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], c)))) << (16 * i);
+                return ret;
+            };
+#endif
+            quotes = mask(quote);
+            backslashes = mask(backslash);
+            zeros = mask(zero);
+        }
+#endif
+    }
+}
@@ -2,6 +2,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -286,6 +292,11 @@ inline char * qs_scanvalue(const char * key, const char * qs, char * val, size_t
 
 namespace crow 
 {
+    // The query part of a url. It is decoded in place and indexed on first lookup: each pair
+    // becomes offsets into the owned copy of the query, and keys are hashed into an open
+    // addressing table, so a lookup costs one hash of the name whatever the number of pairs.
+    // Lookups may be made from several threads at once, e.g. by a detached handler; the first
+    // one parses and the others wait for it. Changing the url is not thread safe.
     class query_string
     {
     public:
@@ -296,111 +307,354 @@ namespace crow
 
         }
 
+        // copies are parsed first, so that the source is not read while another thread parses it
         query_string(const query_string& qs)
-            : url_(qs.url_)
         {
-            for(auto p:qs.key_value_pairs_)
-            {
-                key_value_pairs_.push_back((char*)(p-qs.url_.c_str()+url_.c_str()));
-            }
+            *this = qs;
         }
 
         query_string& operator = (const query_string& qs)
         {
-            url_ = qs.url_;
-            key_value_pairs_.clear();
-            for(auto p:qs.key_value_pairs_)
+            if (this != &qs)
             {
-                key_value_pairs_.push_back((char*)(p-qs.url_.c_str()+url_.c_str()));
+                qs.parse();
+                url_ = qs.url_;
+                entries_ = qs.entries_;
+                slots_ = qs.slots_;
+                state_.store(parsed, std::memory_order_relaxed);
             }
             return *this;
         }
 
+        query_string(query_string&& qs)
+            : url_(std::move(qs.url_)), entries_(std::move(qs.entries_)), slots_(std::move(qs.slots_)), state_(qs.state_.load(std::memory_order_relaxed))
+        {
+            qs.clear();
+        }
+
         query_string& operator = (query_string&& qs)
         {
-            key_value_pairs_ = std::move(qs.key_value_pairs_);
-            char* old_data = (char*)qs.url_.c_str();
             url_ = std::move(qs.url_);
-            for(auto& p:key_value_pairs_)
-            {
-                p += (char*)url_.c_str() - old_data;
-            }
+            entries_ = std::move(qs.entries_);
+            slots_ = std::move(qs.slots_);
+            state_.store(qs.state_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            qs.clear();
             return *this;
         }
 
-
+        // the url is only split into key/value pairs on first lookup
         query_string(std::string url)
             : url_(std::move(url))
         {
-            if (url_.empty())
-                return;
-
-            key_value_pairs_.resize(MAX_KEY_VALUE_PAIRS_COUNT);
+        }
 
-            int count = qs_parse(&url_[0], &key_value_pairs_[0], MAX_KEY_VALUE_PAIRS_COUNT);
-            key_value_pairs_.resize(count);
+        // Replaces the url, keeping the storage for reuse
+        void assign(const char* url, size_t size)
+        {
+            url_.assign(url, size);
+            entries_.clear();
+            slots_.clear();
+            state_.store(unparsed, std::memory_order_relaxed);
         }
 
         void clear() 
         {
-            key_value_pairs_.clear();
+            entries_.clear();
+            slots_.clear();
             url_.clear();
+            state_.store(unparsed, std::memory_order_relaxed);
         }
 
         friend std::ostream& operator<<(std::ostream& os, const query_string& qs)
         {
+            qs.parse();
             os << "[ ";
-            for(size_t i = 0; i < qs.key_value_pairs_.size(); ++i) {
+            for(size_t i = 0; i < qs.entries_.size(); ++i) {
                 if (i)
                     os << ", ";
-                os << qs.key_value_pairs_[i];
+                auto& e = qs.entries_[i];
+                os.write(qs.url_.data() + e.key, e.key_size);
+                if (e.has_value)
+                    os << '=' << qs.url_.data() + e.value;
             }
             os << " ]";
             return os;
 
         }
 
+        // The decoded value for `name', nullptr if there is none; "" for a key without a value.
         char* get (const std::string& name) const
         {
-            char* ret = qs_k2v(name.c_str(), key_value_pairs_.data(), static_cast<int>(key_value_pairs_.size()));
-            return ret;
+            parse();
+            const entry* e = find(name.data(), name.size(), "");
+            return e ? value(*e) : nullptr;
         }
 
         std::vector<char*> get_list (const std::string& name) const
         {
+            parse();
             std::vector<char*> ret;
-            std::string plus = name + "[]";
-            char* element = nullptr;
-
-            int count = 0;
-            while(1) {
-                element = qs_k2v(plus.c_str(), key_value_pairs_.data(),
-                                 static_cast<int>(key_value_pairs_.size()), count++);
-                if (!element)
-                    break;
-                ret.push_back(element);
-            }
+            for(const entry* e = find(name.data(), name.size(), "[]"); e; e = next(*e))
+                ret.push_back(value(*e));
             return ret;
         }
 
         std::unordered_map<std::string, std::string> get_dict (const std::string& name) const
         {
+            parse();
             std::unordered_map<std::string, std::string> ret;
 
-            int count = 0;
-            while(1)
+            for(auto& e : entries_)
             {
-                if (auto element = qs_dict_name2kv(name.c_str(), key_value_pairs_.data(), static_cast<int>(key_value_pairs_.size()), count++))
-                    ret.insert(*element);
-                else
-                    break;
+                const char* key = url_.data() + e.key;
+                if (e.key_size < name.size() || name.compare(0, name.size(), key, name.size()) != 0)
+                    continue;
+                // `name[sub]=value' -> sub, `name=value' -> ""
+                const char* open = std::find(key, key + e.key_size, '[');
+                const char* close = std::find(key, key + e.key_size, ']');
+                if (open != key + e.key_size)
+                    open ++;
+                if (open <= close)
+                    ret.insert({std::string(open, close), value(e)});
             }
             return ret;
         }
 
+        // Typed lookups; `fallback' is returned when the key is missing or its value does not
+        // parse completely. Values are converted in place, without allocating.
+        int64_t get_int (const std::string& name, int64_t fallback = 0) const
+        {
+            const char* v = get(name);
+            if (!v || !*v)
+                return fallback;
+            char* end;
+            errno = 0;
+            long long n = strtoll(v, &end, 10);
+            if (*end || errno == ERANGE)
+                return fallback;
+            return n;
+        }
+
+        double get_double (const std::string& name, double fallback = 0) const
+        {
+            const char* v = get(name);
+            if (!v || !*v)
+                return fallback;
+            char* end;
+            errno = 0;
+            double d = strtod(v, &end);
+            if (*end || errno == ERANGE)
+                return fallback;
+            return d;
+        }
+
+        // true/1/yes/on or a key without a value are true; false/0/no/off are false
+        bool get_bool (const std::string& name, bool fallback = false) const
+        {
+            const char* v = get(name);
+            if (!v)
+                return fallback;
+            static const char* const truthy[] = {"", "1", "true", "yes", "on"};
+            static const char* const falsy[] = {"0", "false", "no", "off"};
+            for(auto t : truthy)
+                if (strcasecmp_ascii(v, t))
+                    return true;
+            for(auto f : falsy)
+                if (strcasecmp_ascii(v, f))
+                    return false;
+            return fallback;
+        }
+
     private:
-        std::string url_;
-        std::vector<char*> key_value_pairs_;
+        struct entry
+        {
+            uint32_t key;
+            uint32_t key_size;
+            // the value is nul terminated
+            uint32_t value;
+            uint32_t hash;
+            // 1 + index of the next pair with the same key, 0 for the last one
+            uint32_t next;
+            bool has_value;
+        };
+
+        static bool strcasecmp_ascii(const char* a, const char* b)
+        {
+            auto lower = [](char c){ return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 'a' - 'A') : c; };
+            for(; *a && *b; a ++, b ++)
+            {
+                if (lower(*a) != lower(*b))
+                    return false;
+            }
+            return *a == *b;
+        }
+
+        static uint32_t hash_key(const char* data, size_t size, uint32_t h = 2166136261u)
+        {
+            // FNV-1a
+            for(size_t i = 0; i < size; i ++)
+            {
+                h ^= static_cast<unsigned char>(data[i]);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        // Decodes `+' and `%xx' escapes of s[0, size) in place, stopping at a `#' or a bad
+        // escape, and returns the decoded length.
+        static size_t decode(char* s, size_t size)
+        {
+            size_t i = 0, j = 0;
+            for(; j < size && s[j] != '#'; i ++, j ++)
+            {
+                if (s[j] == '+')
+                    s[i] = ' ';
+                else if (s[j] == '%')
+                {
+                    if (j + 2 >= size || !CROW_QS_ISHEX(s[j+1]) || !CROW_QS_ISHEX(s[j+2]))
+                        break;
+                    s[i] = static_cast<char>(CROW_QS_HEX2DEC(s[j+1]) * 16 + CROW_QS_HEX2DEC(s[j+2]));
+                    j += 2;
+                }
+                else
+                    s[i] = s[j];
+            }
+            return i;
+        }
+
+        char* value(const entry& e) const
+        {
+            return &url_[e.value];
+        }
+
+        const entry* next(const entry& e) const
+        {
+            return e.next ? &entries_[e.next - 1] : nullptr;
+        }
+
+        // First pair whose decoded key is `name' followed by `suffix'. Names are decoded like
+        // keys; short ones are decoded on the stack.
+        const entry* find(const char* name, size_t size, const char* suffix) const
+        {
+            if (slots_.empty())
+                return nullptr;
+
+            size_t suffix_size = strlen(suffix);
+            char buf[128];
+            std::string heap;
+            char* key = buf;
+            if (size + suffix_size > sizeof(buf))
+            {
+                heap.resize(size + suffix_size);
+                key = &heap[0];
+            }
+            memcpy(key, name, size);
+            size = decode(key, size);
+            memcpy(key + size, suffix, suffix_size);
+            size += suffix_size;
+
+            uint32_t h = hash_key(key, size);
+            size_t mask = slots_.size() - 1;
+            for(size_t slot = h & mask; slots_[slot]; slot = (slot + 1) & mask)
+            {
+                const entry& e = entries_[slots_[slot] - 1];
+                if (e.hash == h && e.key_size == size && memcmp(url_.data() + e.key, key, size) == 0)
+                    return &e;
+            }
+            return nullptr;
+        }
+
+        // Decodes the pairs in place, so this must run at most once per url_. Whoever moves
+        // state_ from unparsed does it; anyone else waits until it is done.
+        void parse() const
+        {
+            int state = state_.load(std::memory_order_acquire);
+            if (state == parsed)
+                return;
+            if (state != unparsed || !state_.compare_exchange_strong(state, parsing, std::memory_order_acquire))
+            {
+                while (state_.load(std::memory_order_acquire) != parsed)
+                    std::this_thread::yield();
+                return;
+            }
+            parse_pairs();
+            state_.store(parsed, std::memory_order_release);
+        }
+
+        void parse_pairs() const
+        {
+            size_t pos = url_.find_first_of("?#");
+            if (pos == std::string::npos)
+                return;
+            pos ++;
+
+            char* s = &url_[0];
+            // the fragment is not part of the query
+            size_t n = std::min(url_.find('#', pos), url_.size());
+            entries_.reserve(std::min<size_t>(std::count(url_.begin() + pos, url_.begin() + n, '&') + 1, MAX_KEY_VALUE_PAIRS_COUNT));
+            while (entries_.size() < (size_t)MAX_KEY_VALUE_PAIRS_COUNT)
+            {
+                size_t end = std::min(url_.find('&', pos), n);
+                size_t key_end = pos;
+                while (key_end < end && s[key_end] != '=' && s[key_end] != '#')
+                    key_end ++;
+
+                entry e{};
+                e.key = static_cast<uint32_t>(pos);
+                e.key_size = static_cast<uint32_t>(decode(s + pos, key_end - pos));
+                e.hash = hash_key(s + pos, e.key_size);
+                e.has_value = key_end < end && s[key_end] == '=';
+                if (e.has_value)
+                {
+                    e.value = static_cast<uint32_t>(key_end + 1);
+                    size_t value_size = decode(s + e.value, end - e.value);
+                    if (e.value + value_size < url_.size())
+                        s[e.value + value_size] = '\0';
+                }
+                else
+                {
+                    e.value = static_cast<uint32_t>(key_end);
+                    if (key_end < url_.size())
+                        s[key_end] = '\0';
+                }
+                entries_.push_back(e);
+
+                if (end == n)
+                    break;
+                pos = end + 1;
+            }
+
+            size_t size = 2;
+            while (size < entries_.size() * 2)
+                size *= 2;
+            slots_.assign(size, 0);
+            for(uint32_t i = 0; i < entries_.size(); i ++)
+            {
+                entry& e = entries_[i];
+                size_t slot = e.hash & (size - 1);
+                for(; slots_[slot]; slot = (slot + 1) & (size - 1))
+                {
+                    entry* first = &entries_[slots_[slot] - 1];
+                    if (first->hash == e.hash && first->key_size == e.key_size &&
+                        memcmp(s + first->key, s + e.key, e.key_size) == 0)
+                    {
+                        while (first->next)
+                            first = &entries_[first->next - 1];
+                        first->next = i + 1;
+                        break;
+                    }
+                }
+                if (!slots_[slot])
+                    slots_[slot] = i + 1;
+            }
+        }
+
+        mutable std::string url_;
+        mutable std::vector<entry> entries_;
+        // 1 + index of the first pair with a given key, 0 for an empty slot
+        mutable std::vector<uint32_t> slots_;
+        enum { unparsed, parsing, parsed };
+        mutable std::atomic<int> state_{unparsed};
     };
 
 } // end namespace
@@ -1,10 +1,17 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
 #include <utility>
 #include <tuple>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <boost/lexical_cast.hpp>
 #include <vector>
 
@@ -14,6 +21,7 @@
 #include "crow/utility.h"
 #include "crow/logging.h"
 #include "crow/websocket.h"
+#include "crow/coroutine.h"
 
 namespace crow
 {
@@ -84,6 +92,22 @@ namespace crow
 
     namespace detail
     {
+        // Ends `res' with whatever a handler returned.
+        template <typename T>
+        void complete_response(response& res, T&& result)
+        {
+            res = response(std::forward<T>(result));
+            res.end();
+        }
+
+#ifdef CROW_CAN_USE_COROUTINES
+        // coroutine handlers end `res' when they finish
+        inline void complete_response(response& res, task<response>&& result)
+        {
+            start_response_task(std::move(result), res);
+        }
+#endif
+
         namespace routing_handler_call_helper
         {
             template <typename T, int Pos>
@@ -179,8 +203,7 @@ namespace crow
                         [f]
 #endif
                         (const request&, response& res, Args... args){
-                            res = response(f(args...));
-                            res.end();
+                            detail::complete_response(res, f(args...));
                         });
                 }
 
@@ -194,8 +217,7 @@ namespace crow
 
                     void operator()(const request& req, response& res, Args... args)
                     {
-                        res = response(f(req, args...));
-                        res.end();
+                        detail::complete_response(res, f(req, args...));
                     }
 
                     Func f;
@@ -483,8 +505,7 @@ namespace crow
                 [f]
 #endif
                 (const request&, response& res, Args ... args){
-                    res = response(f(args...));
-                    res.end();
+                    detail::complete_response(res, f(args...));
                 });
         }
 
@@ -508,8 +529,7 @@ namespace crow
                 [f]
 #endif
                 (const crow::request& req, crow::response& res, Args ... args){
-                    res = response(f(req, args...));
-                    res.end();
+                    detail::complete_response(res, f(req, args...));
                 });
         }
 
@@ -563,16 +583,23 @@ namespace crow
     class Trie
     {
     public:
+        // Routes are added one character at a time into `Node's and compiled by validate()
+        // into a radix tree of `CompactNode's: chains of single children become one edge,
+        // every node's edges are contiguous and sorted by first byte, and each node knows the
+        // lowest rule index below it so find() can stop as soon as no branch can do better.
+        // All methods share the tree; a node where urls end carries a bitmap of the methods
+        // that have a rule there and the rules themselves, in method order.
         struct Node
         {
-            unsigned rule_index{};
+            // 1 + index in endpoints_, 0 if no url ends here
+            unsigned endpoint{};
             std::array<unsigned, (int)ParamType::MAX> param_childrens{};
-            std::unordered_map<std::string, unsigned> children;
+            std::map<char, unsigned> children;
 
             bool IsSimpleNode() const
             {
                 return 
-                    !rule_index &&
+                    !endpoint &&
                     std::all_of(
                         std::begin(param_childrens), 
                         std::end(param_childrens), 
@@ -580,59 +607,205 @@ namespace crow
             }
         };
 
+        struct CompactNode
+        {
+            // bit (1 << method) is set for each method with a rule ending here
+            uint32_t methods{};
+            // those rules are method_rules_[rules, rules + popcount(methods))
+            unsigned rules{};
+            // lowest rule index reachable through this node for any method (0 if none)
+            unsigned priority{};
+            std::array<unsigned, (int)ParamType::MAX> param_childrens{};
+            // this node's static edges are edges_[edges_begin, edges_end)
+            unsigned edges_begin{};
+            unsigned edges_end{};
+        };
+
+        struct Edge
+        {
+            char first;
+            unsigned label;
+            unsigned size;
+            unsigned child;
+        };
+
+        static_assert((int)HTTPMethod::InternalMethodCount <= 32, "method bitmaps are 32 bits wide");
+
         Trie() : nodes_(1)
         {
         }
 
 private:
-        void optimizeNode(Node* node)
+        static unsigned popcount(uint32_t x)
         {
-            for(auto x : node->param_childrens)
+            x = x - ((x >> 1) & 0x55555555);
+            x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+            return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+        }
+
+        unsigned rule_for(uint32_t methods, unsigned rules, HTTPMethod method) const
+        {
+            uint32_t bit = 1u << (unsigned)method;
+            if (!(methods & bit))
+                return 0;
+            return method_rules_[rules + popcount(methods & (bit - 1))];
+        }
+
+        // returns the index of the compiled node for nodes_[idx]
+        unsigned compile(unsigned idx, std::vector<unsigned>& endpoint_nodes)
+        {
+            unsigned cidx = static_cast<unsigned>(compact_.size());
+            compact_.emplace_back();
+
+            unsigned priority = 0;
+            auto update = [&priority](unsigned p)
             {
-                if (!x)
-                    continue;
-                Node* child = &nodes_[x];
-                optimizeNode(child);
-            }
-            if (node->children.empty())
-                return;
-            bool mergeWithChild = true;
-            for(auto& kv : node->children)
+                if (p && (!priority || p < priority))
+                    priority = p;
+            };
+
+            if (nodes_[idx].endpoint)
             {
-                Node* child = &nodes_[kv.second];
-                if (!child->IsSimpleNode())
+                auto& endpoint = endpoints_[nodes_[idx].endpoint - 1];
+                endpoint_nodes[nodes_[idx].endpoint - 1] = cidx;
+                compact_[cidx].rules = static_cast<unsigned>(method_rules_.size());
+                for(int m = 0; m < (int)HTTPMethod::InternalMethodCount; m ++)
                 {
-                    mergeWithChild = false;
-                    break;
+                    if (endpoint[m])
+                    {
+                        compact_[cidx].methods |= 1u << m;
+                        method_rules_.push_back(endpoint[m]);
+                        update(endpoint[m]);
+                    }
                 }
             }
-            if (mergeWithChild)
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
             {
-                decltype(node->children) merged;
-                for(auto& kv : node->children)
+                if (nodes_[idx].param_childrens[i])
                 {
-                    Node* child = &nodes_[kv.second];
-                    for(auto& child_kv : child->children)
-                    {
-                        merged[kv.first + child_kv.first] = child_kv.second;
-                    }
+                    unsigned child = compile(nodes_[idx].param_childrens[i], endpoint_nodes);
+                    compact_[cidx].param_childrens[i] = child;
+                    update(compact_[child].priority);
                 }
-                node->children = std::move(merged);
-                optimizeNode(node);
             }
-            else
+
+            // edges of one node are laid out together; their children come after them
+            unsigned begin = static_cast<unsigned>(edges_.size());
+            edges_.resize(begin + nodes_[idx].children.size());
+            compact_[cidx].edges_begin = begin;
+            compact_[cidx].edges_end = static_cast<unsigned>(edges_.size());
+
+            unsigned e = begin;
+            for(auto& kv : nodes_[idx].children)
             {
-                for(auto& kv : node->children)
+                unsigned label = static_cast<unsigned>(labels_.size());
+                labels_ += kv.first;
+                unsigned child = kv.second;
+                while (nodes_[child].IsSimpleNode() && nodes_[child].children.size() == 1)
                 {
-                    Node* child = &nodes_[kv.second];
-                    optimizeNode(child);
+                    labels_ += nodes_[child].children.begin()->first;
+                    child = nodes_[child].children.begin()->second;
                 }
+                unsigned size = static_cast<unsigned>(labels_.size()) - label;
+                unsigned compiled = compile(child, endpoint_nodes);
+                edges_[e++] = Edge{kv.first, label, size, compiled};
+                update(compact_[compiled].priority);
             }
+
+            compact_[cidx].priority = priority;
+            return cidx;
         }
 
         void optimize()
         {
-            optimizeNode(head());
+            compact_.clear();
+            edges_.clear();
+            labels_.clear();
+            method_rules_.clear();
+            std::vector<unsigned> endpoint_nodes(endpoints_.size());
+            compile(0, endpoint_nodes);
+            build_static_table(endpoint_nodes);
+        }
+
+        static uint64_t hash_url(const char* data, size_t size)
+        {
+            // 8 bytes at a time, with a final avalanche so the low bits can index the table
+            uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+            uint64_t w;
+            for(; size >= 8; data += 8, size -= 8)
+            {
+                std::memcpy(&w, data, 8);
+                h = (h ^ w) * 0xff51afd7ed558ccdULL;
+                h ^= h >> 32;
+            }
+            w = 0;
+            std::memcpy(&w, data, size);
+            h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 29;
+            return h;
+        }
+
+        // Urls without parameters go in an open addressing table kept at most half full, for
+        // the methods whose lookup in the trie resolves to the url's own rule. A slot holds
+        // everything needed to reject it, so a miss usually touches a single cache line.
+        void build_static_table(const std::vector<unsigned>& endpoint_nodes)
+        {
+            static_slots_.clear();
+            static_labels_.clear();
+
+            std::vector<StaticSlot> entries;
+            for(auto& kv : static_urls_)
+            {
+                const CompactNode& node = compact_[endpoint_nodes[kv.second - 1]];
+                uint32_t safe = 0;
+                for(int m = 0; m < (int)HTTPMethod::InternalMethodCount; m ++)
+                {
+                    routing_params params;
+                    unsigned rule_index = rule_for(node.methods, node.rules, (HTTPMethod)m);
+                    if (rule_index && find_in_trie(kv.first, (HTTPMethod)m, params) == rule_index)
+                        safe |= 1u << m;
+                }
+                if (!safe)
+                    continue;
+                entries.push_back(StaticSlot{hash_url(kv.first.data(), kv.first.size()),
+                        static_cast<unsigned>(static_labels_.size()), static_cast<unsigned>(kv.first.size()),
+                        node.methods, safe, node.rules});
+                static_labels_ += kv.first;
+            }
+            if (entries.empty())
+                return;
+
+            size_t size = 2;
+            while (size < entries.size() * 2)
+                size *= 2;
+            static_slots_.assign(size, StaticSlot{});
+            for(auto& e : entries)
+            {
+                size_t slot = e.hash & (size - 1);
+                while (static_slots_[slot].safe)
+                    slot = (slot + 1) & (size - 1);
+                static_slots_[slot] = e;
+            }
+        }
+
+        // 0: the url is not in the table (or not for this method), fall back to the trie
+        unsigned find_static(const std::string& req_url, HTTPMethod method) const
+        {
+            uint64_t h = hash_url(req_url.data(), req_url.size());
+            size_t mask = static_slots_.size() - 1;
+            for(size_t slot = h & mask; static_slots_[slot].safe; slot = (slot + 1) & mask)
+            {
+                const StaticSlot& e = static_slots_[slot];
+                if (e.hash == h && e.size == req_url.size() &&
+                    std::memcmp(static_labels_.data() + e.label, req_url.data(), e.size) == 0)
+                {
+                    if (!(e.safe & (1u << (unsigned)method)))
+                        return 0;
+                    return rule_for(e.methods, e.rules, method);
+                }
+            }
+            return 0;
         }
 
 public:
@@ -643,132 +816,178 @@ public:
             optimize();
         }
 
-        std::pair<unsigned, routing_params> find(const std::string& req_url, const Node* node = nullptr, unsigned pos = 0, routing_params* params = nullptr) const
+        // Returns the lowest index among the rules for `method' matching `req_url' (0 if none)
+        // and leaves that match's parameters in `params', as views into `req_url'.
+        unsigned find(const std::string& req_url, HTTPMethod method, routing_params& params) const
+        {
+            if (!static_slots_.empty())
+            {
+                unsigned rule_index = find_static(req_url, method);
+                if (rule_index)
+                    return rule_index;
+            }
+            return find_in_trie(req_url, method, params);
+        }
+
+        // Bitmap of the methods that have a rule matching `req_url'.
+        uint32_t allowed_methods(const std::string& req_url) const
         {
-            routing_params empty;
-            if (params == nullptr)
-                params = &empty;
+            uint32_t methods = 0;
+            if (!compact_.empty())
+                collect_methods(req_url, &compact_.front(), 0, methods);
+            return methods;
+        }
 
+private:
+        unsigned find_in_trie(const std::string& req_url, HTTPMethod method, routing_params& params) const
+        {
+            if (compact_.empty())
+                return 0;
+            routing_params current;
             unsigned found{};
-            routing_params match_params;
+            find(req_url, method, &compact_.front(), 0, current, params, found);
+            return found;
+        }
 
-            if (node == nullptr)
-                node = head();
-            if (pos == req_url.size())
-                return {node->rule_index, *params};
+        // Branches are tried best priority first, so the first match found is normally the
+        // answer and the remaining branches are cut off by the priority check.
+        void find(const std::string& req_url, HTTPMethod method, const CompactNode* node, unsigned pos, routing_params& current, routing_params& match, unsigned& found) const
+        {
+            if (!node->priority || (found && found <= node->priority))
+                return;
 
-            auto update_found = [&found, &match_params](std::pair<unsigned, routing_params>& ret)
+            if (pos == req_url.size())
             {
-                if (ret.first && (!found || found > ret.first))
+                unsigned rule_index = rule_for(node->methods, node->rules, method);
+                if (rule_index && (!found || rule_index < found))
                 {
-                    found = ret.first;
-                    match_params = std::move(ret.second);
+                    found = rule_index;
+                    match = current;
                 }
-            };
+                return;
+            }
 
-            if (node->param_childrens[(int)ParamType::INT])
+            struct Branch
             {
-                char c = req_url[pos];
-                if ((c >= '0' && c <= '9') || c == '+' || c == '-')
-                {
-                    char* eptr;
-                    errno = 0;
-                    long long int value = strtoll(req_url.data()+pos, &eptr, 10);
-                    if (errno != ERANGE && eptr != req_url.data()+pos)
-                    {
-                        params->int_params.push_back(value);
-                        auto ret = find(req_url, &nodes_[node->param_childrens[(int)ParamType::INT]], static_cast<unsigned int>(eptr - req_url.data()), params);
-                        update_found(ret);
-                        params->int_params.pop_back();
-                    }
-                }
-            }
+                int type; // ParamType, or MAX for the static edge
+                const CompactNode* child;
+            } branches[(int)ParamType::MAX + 1];
+            int count = 0;
 
-            if (node->param_childrens[(int)ParamType::UINT])
+            auto insert = [&](int type, const CompactNode* child)
             {
-                char c = req_url[pos];
-                if ((c >= '0' && c <= '9') || c == '+')
-                {
-                    char* eptr;
-                    errno = 0;
-                    unsigned long long int value = strtoull(req_url.data()+pos, &eptr, 10);
-                    if (errno != ERANGE && eptr != req_url.data()+pos)
-                    {
-                        params->uint_params.push_back(value);
-                        auto ret = find(req_url, &nodes_[node->param_childrens[(int)ParamType::UINT]], static_cast<unsigned int>(eptr - req_url.data()), params);
-                        update_found(ret);
-                        params->uint_params.pop_back();
-                    }
-                }
-            }
+                int i = count++;
+                for(; i > 0 && branches[i-1].child->priority > child->priority; i --)
+                    branches[i] = branches[i-1];
+                branches[i] = Branch{type, child};
+            };
 
-            if (node->param_childrens[(int)ParamType::DOUBLE])
+            const Edge* edge = match_edge(node, req_url, pos);
+            if (edge)
+                insert((int)ParamType::MAX, &compact_[edge->child]);
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
             {
-                char c = req_url[pos];
-                if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')
-                {
-                    char* eptr;
-                    errno = 0;
-                    double value = strtod(req_url.data()+pos, &eptr);
-                    if (errno != ERANGE && eptr != req_url.data()+pos)
-                    {
-                        params->double_params.push_back(value);
-                        auto ret = find(req_url, &nodes_[node->param_childrens[(int)ParamType::DOUBLE]], static_cast<unsigned int>(eptr - req_url.data()), params);
-                        update_found(ret);
-                        params->double_params.pop_back();
-                    }
-                }
+                if (node->param_childrens[i] && compact_[node->param_childrens[i]].priority)
+                    insert(i, &compact_[node->param_childrens[i]]);
             }
 
-            if (node->param_childrens[(int)ParamType::STRING])
+            for(int i = 0; i < count; i ++)
             {
-                size_t epos = pos;
-                for(; epos < req_url.size(); epos ++)
-                {
-                    if (req_url[epos] == '/')
-                        break;
-                }
-
-                if (epos != pos)
+                const Branch& b = branches[i];
+                if (found && found <= b.child->priority)
+                    break;
+                if (b.type == (int)ParamType::MAX)
                 {
-                    params->string_params.push_back(req_url.substr(pos, epos-pos));
-                    auto ret = find(req_url, &nodes_[node->param_childrens[(int)ParamType::STRING]], static_cast<unsigned int>(epos), params);
-                    update_found(ret);
-                    params->string_params.pop_back();
+                    find(req_url, method, b.child, pos + edge->size, current, match, found);
+                    continue;
                 }
+                size_t epos = param_end((ParamType)b.type, req_url, pos);
+                if (epos == pos)
+                    continue;
+                current.push((ParamType)b.type, req_url.data()+pos, epos-pos);
+                find(req_url, method, b.child, static_cast<unsigned int>(epos), current, match, found);
+                current.pop();
             }
+        }
 
-            if (node->param_childrens[(int)ParamType::PATH])
+        void collect_methods(const std::string& req_url, const CompactNode* node, unsigned pos, uint32_t& methods) const
+        {
+            if (pos == req_url.size())
             {
-                size_t epos = req_url.size();
+                methods |= node->methods;
+                return;
+            }
 
+            const Edge* edge = match_edge(node, req_url, pos);
+            if (edge)
+                collect_methods(req_url, &compact_[edge->child], pos + edge->size, methods);
+
+            for(int i = 0; i < (int)ParamType::MAX; i ++)
+            {
+                if (!node->param_childrens[i])
+                    continue;
+                size_t epos = param_end((ParamType)i, req_url, pos);
                 if (epos != pos)
-                {
-                    params->string_params.push_back(req_url.substr(pos, epos-pos));
-                    auto ret = find(req_url, &nodes_[node->param_childrens[(int)ParamType::PATH]], static_cast<unsigned int>(epos), params);
-                    update_found(ret);
-                    params->string_params.pop_back();
-                }
+                    collect_methods(req_url, &compact_[node->param_childrens[i]], static_cast<unsigned int>(epos), methods);
             }
+        }
 
-            for(auto& kv : node->children)
-            {
-                const std::string& fragment = kv.first;
-                const Node* child = &nodes_[kv.second];
+        // the edge whose label matches `req_url' at `pos', if any
+        const Edge* match_edge(const CompactNode* node, const std::string& req_url, unsigned pos) const
+        {
+            char c = req_url[pos];
+            auto first = edges_.begin() + node->edges_begin;
+            auto last = edges_.begin() + node->edges_end;
+            auto it = std::lower_bound(first, last, c, [](const Edge& e, char c){ return e.first < c; });
+            if (it == last || it->first != c)
+                return nullptr;
+            if (req_url.size() - pos < it->size ||
+                std::memcmp(req_url.data() + pos, labels_.data() + it->label, it->size) != 0)
+                return nullptr;
+            return &*it;
+        }
 
-                if (req_url.compare(pos, fragment.size(), fragment) == 0)
+        // end of the parameter of the given type starting at `pos' (`pos' if there is none)
+        static size_t param_end(ParamType type, const std::string& req_url, size_t pos)
+        {
+            char c = req_url[pos];
+            char* eptr = nullptr;
+            errno = 0;
+            switch(type)
+            {
+                case ParamType::INT:
+                    if ((c >= '0' && c <= '9') || c == '+' || c == '-')
+                        strtoll(req_url.data()+pos, &eptr, 10);
+                    break;
+                case ParamType::UINT:
+                    if ((c >= '0' && c <= '9') || c == '+')
+                        strtoull(req_url.data()+pos, &eptr, 10);
+                    break;
+                case ParamType::DOUBLE:
+                    if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')
+                        strtod(req_url.data()+pos, &eptr);
+                    break;
+                case ParamType::STRING:
                 {
-                    auto ret = find(req_url, child, static_cast<unsigned int>(pos + fragment.size()), params);
-                    update_found(ret);
+                    size_t epos = req_url.find('/', pos);
+                    return epos == std::string::npos ? req_url.size() : epos;
                 }
+                case ParamType::PATH:
+                    return req_url.size();
+                default:
+                    break;
             }
-
-            return {found, match_params};
+            if (!eptr || errno == ERANGE)
+                return pos;
+            return eptr - req_url.data();
         }
 
-        void add(const std::string& url, unsigned rule_index)
+public:
+        void add(const std::string& url, unsigned rule_index, HTTPMethod method)
         {
             unsigned idx{0};
+            unsigned params{0};
 
             for(unsigned i = 0; i < url.size(); i ++)
             {
@@ -794,6 +1013,9 @@ public:
                     {
                         if (url.compare(i, x.name.size(), x.name) == 0)
                         {
+                            // matching must never collect more than routing_params holds
+                            if (++params > routing_params::capacity)
+                                throw std::runtime_error("too many parameters in " + url);
                             if (!nodes_[idx].param_childrens[(int)x.type])
                             {
                                 auto new_node_idx = new_node();
@@ -809,21 +1031,28 @@ public:
                 }
                 else
                 {
-                    std::string piece(&c, 1);
-                    if (!nodes_[idx].children.count(piece))
+                    if (!nodes_[idx].children.count(c))
                     {
                         auto new_node_idx = new_node();
-                        nodes_[idx].children.emplace(piece, new_node_idx);
+                        nodes_[idx].children.emplace(c, new_node_idx);
                     }
-                    idx = nodes_[idx].children[piece];
+                    idx = nodes_[idx].children[c];
                 }
             }
-            if (nodes_[idx].rule_index)
+            if (!nodes_[idx].endpoint)
+            {
+                endpoints_.emplace_back();
+                nodes_[idx].endpoint = static_cast<unsigned>(endpoints_.size());
+                if (url.find('<') == std::string::npos)
+                    static_urls_.emplace(url, nodes_[idx].endpoint);
+            }
+            auto& endpoint = endpoints_[nodes_[idx].endpoint - 1];
+            if (endpoint[(int)method])
                 throw std::runtime_error("handler already exists for " + url);
-            nodes_[idx].rule_index = rule_index;
+            endpoint[(int)method] = rule_index;
         }
     private:
-        void debug_node_print(Node* n, int level)
+        void debug_node_print(const CompactNode* n, int level)
         {
             for(int i = 0; i < (int)ParamType::MAX; i ++)
             {
@@ -852,20 +1081,21 @@ public:
                             break;
                     }
 
-                    debug_node_print(&nodes_[n->param_childrens[i]], level+1);
+                    debug_node_print(&compact_[n->param_childrens[i]], level+1);
                 }
             }
-            for(auto& kv : n->children)
+            for(unsigned e = n->edges_begin; e < n->edges_end; e ++)
             {
-                CROW_LOG_DEBUG << std::string(2*level, ' ') /*<< "(" << kv.second << ") "*/ << kv.first;
-                debug_node_print(&nodes_[kv.second], level+1);
+                CROW_LOG_DEBUG << std::string(2*level, ' ') /*<< "(" << edges_[e].child << ") "*/ << labels_.substr(edges_[e].label, edges_[e].size);
+                debug_node_print(&compact_[edges_[e].child], level+1);
             }
         }
 
     public:
         void debug_print()
         {
-            debug_node_print(head(), 0);
+            if (!compact_.empty())
+                debug_node_print(&compact_.front(), 0);
         }
 
     private:
@@ -886,18 +1116,125 @@ public:
         }
 
         std::vector<Node> nodes_;
+        // rule index per method, 0 if the method has none
+        std::vector<std::array<unsigned, (int)HTTPMethod::InternalMethodCount>> endpoints_;
+
+        std::vector<CompactNode> compact_;
+        std::vector<Edge> edges_;
+        std::string labels_;
+        std::vector<unsigned> method_rules_;
+
+        struct StaticSlot
+        {
+            uint64_t hash;
+            unsigned label;
+            unsigned size;
+            uint32_t methods;
+            // methods the table may answer for; 0 marks an empty slot
+            uint32_t safe;
+            unsigned rules;
+        };
+        // url -> endpoint
+        std::map<std::string, unsigned> static_urls_;
+        std::vector<StaticSlot> static_slots_;
+        std::string static_labels_;
     };
 
+    namespace detail
+    {
+        // Epoch based reclamation for data that is read on every request and replaced rarely.
+        // A reader counts itself in the current epoch while it uses the data; after unpublishing
+        // something a writer flips the epoch twice, each time waiting for the previous epoch's
+        // readers to leave, and can then free it. Counters are striped by thread so that readers
+        // on different threads don't fight over one cache line.
+        class epoch
+        {
+        public:
+            class guard
+            {
+            public:
+                guard(epoch& e) : counter_(e.enter())
+                {
+                    depth() ++;
+                }
+
+                ~guard()
+                {
+                    depth() --;
+                    counter_->fetch_sub(1, std::memory_order_release);
+                }
+
+                guard(const guard&) = delete;
+                guard& operator=(const guard&) = delete;
+
+            private:
+                std::atomic<unsigned>* counter_;
+            };
+
+            // Whether this thread is a reader of some epoch; it must not synchronize() then, as
+            // it would wait for itself.
+            static bool reading()
+            {
+                return depth() != 0;
+            }
+
+            // returns once every reader that was in before the call has left
+            void synchronize()
+            {
+                for(int i = 0; i < 2; i ++)
+                {
+                    unsigned e = current_.fetch_xor(1) & 1;
+                    for(auto& c : counters_[e])
+                    {
+                        while (c.value.load() != 0)
+                            std::this_thread::yield();
+                    }
+                }
+            }
+
+        private:
+            static unsigned& depth()
+            {
+                static thread_local unsigned depth = 0;
+                return depth;
+            }
+
+            std::atomic<unsigned>* enter()
+            {
+                unsigned stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % stripes;
+                auto& c = counters_[current_.load() & 1][stripe].value;
+                // sequentially consistent, so it is ordered before the reader loads the data
+                c.fetch_add(1);
+                return &c;
+            }
+
+            static const unsigned stripes = 8;
+            struct counter
+            {
+                std::atomic<unsigned> value{0};
+                char padding[64 - sizeof(std::atomic<unsigned>)];
+            };
+            std::atomic<unsigned> current_{0};
+            counter counters_[2][stripes];
+        };
+    }
+
     class Router
     {
     public:
-        Router()
+        Router() : routes_(new routes)
         {
         }
 
+        ~Router()
+        {
+            delete routes_.load();
+        }
+
         DynamicRule& new_rule_dynamic(const std::string& rule)
         {
             auto ruleObject = new DynamicRule(rule);
+            std::lock_guard<std::mutex> lock(mutex_);
             all_rules_.emplace_back(ruleObject);
 
             return *ruleObject;
@@ -909,102 +1246,89 @@ public:
             using RuleT = typename black_magic::arguments<N>::type::template rebind<TaggedRule>;
 
             auto ruleObject = new RuleT(rule);
+            std::lock_guard<std::mutex> lock(mutex_);
             all_rules_.emplace_back(ruleObject);
 
             return *ruleObject;
         }
 
-        void internal_add_rule_object(const std::string& rule, BaseRule* ruleObject)
+        // Builds the routing table from the current rules and publishes it. This may be called
+        // again while requests are served, e.g. after adding rules: lookups keep using the
+        // previous table until the new one is in place. If a rule fails validation nothing is
+        // published and the previous table stays in use.
+        void validate()
         {
-            bool has_trailing_slash = false;
-            std::string rule_without_trailing_slash;
-            if (rule.size() > 1 && rule.back() == '/')
-            {
-                has_trailing_slash = true;
-                rule_without_trailing_slash = rule;
-                rule_without_trailing_slash.pop_back();
-            }
-
-            ruleObject->foreach_method([&](int method)
-                    {
-                        per_methods_[method].rules.emplace_back(ruleObject);
-                        per_methods_[method].trie.add(rule, static_cast<unsigned int>(per_methods_[method].rules.size() - 1));
-
-                        // directory case: 
-                        //   request to `/about' url matches `/about/' rule 
-                        if (has_trailing_slash)
-                        {
-                            per_methods_[method].trie.add(rule_without_trailing_slash, RULE_SPECIAL_REDIRECT_SLASH);
-                        }
-                    });
-
+            std::lock_guard<std::mutex> lock(mutex_);
+            publish();
         }
 
-        void validate()
+        // Removes every rule registered for `rule' (as written in CROW_ROUTE) and publishes the
+        // table without them. Handlers already running finish normally: a removed rule is freed
+        // once no lookup can still see it and the responses of any detached, async or coroutine
+        // handlers it started have ended.
+        bool remove_rule(const std::string& rule)
         {
-            for(auto& rule:all_rules_)
-            {
-                if (rule)
-                {
-                    auto upgraded = rule->upgrade();
-                    if (upgraded)
-                        rule = std::move(upgraded);
-                    rule->validate();
-                    internal_add_rule_object(rule->rule(), rule.get());
-                }
-            }
-            for(auto& per_method:per_methods_)
-            {
-                per_method.trie.validate();
-            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::remove_if(all_rules_.begin(), all_rules_.end(),
+                    [&](const std::shared_ptr<BaseRule>& r){ return r && r->rule() == rule; });
+            if (it == all_rules_.end())
+                return false;
+            all_rules_.erase(it, all_rules_.end());
+            publish();
+            return true;
         }
 
         template <typename Adaptor> 
         void handle_upgrade(const request& req, response& res, Adaptor&& adaptor)
         {
-            if (req.method >= HTTPMethod::InternalMethodCount)
+            routing_params params;
+            detail::epoch::guard guard(epoch_);
+            auto rule = match(req, res, params);
+            if (!rule)
                 return;
-            auto& per_method = per_methods_[(int)req.method];
-            auto& trie = per_method.trie;
-            auto& rules = per_method.rules;
 
-            auto found = trie.find(req.url);
-            unsigned rule_index = found.first;
-            if (!rule_index)
+            CROW_LOG_DEBUG << "Matched rule (upgrade) '" << (*rule)->rule_ << "' " << (uint32_t)req.method << " / " << (*rule)->get_methods();
+
+            // any uncaught exceptions become 500s
+            try
             {
-                CROW_LOG_DEBUG << "Cannot match rules " << req.url << ' ' << method_name(req.method);
-                res = response(404);
+                (*rule)->handle_upgrade(req, res, std::move(adaptor));
+            }
+            catch(std::exception& e)
+            {
+                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
+                res = response(500);
                 res.end();
-                return;
+                return;   
             }
-
-            if (rule_index >= rules.size())
-                throw std::runtime_error("Trie internal structure corrupted!");
-
-            if (rule_index == RULE_SPECIAL_REDIRECT_SLASH)
+            catch(...)
             {
-                CROW_LOG_INFO << "Redirecting to a url with trailing slash: " << req.url;
-                res = response(301);
-
-                // TODO absolute url building
-                if (req.get_header_value("Host").empty())
-                {
-                    res.add_header("Location", req.url + "/");
-                }
-                else
-                {
-                    res.add_header("Location", "http://" + req.get_header_value("Host") + req.url + "/");
-                }
+                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
+                res = response(500);
                 res.end();
-                return;
+                return;   
             }
+        }
+
+        void handle(const request& req, response& res)
+        {
+            routing_params params;
+            // the table, and so the rule, stay alive until the handler returns
+            detail::epoch::guard guard(epoch_);
+            auto rule = match(req, res, params);
+            if (!rule)
+                return;
 
-            CROW_LOG_DEBUG << "Matched rule (upgrade) '" << rules[rule_index]->rule_ << "' " << (uint32_t)req.method << " / " << rules[rule_index]->get_methods();
+            CROW_LOG_DEBUG << "Matched rule '" << (*rule)->rule_ << "' " << (uint32_t)req.method << " / " << (*rule)->get_methods();
 
             // any uncaught exceptions become 500s
             try
             {
-                rules[rule_index]->handle_upgrade(req, res, std::move(adaptor));
+                (*rule)->handle(req, res, params);
+                // a response that is still open has handed work to another thread or to a
+                // coroutine, which may still refer to the rule
+                if (!res.is_completed())
+                    res.keep_alive_ = *rule;
             }
             catch(std::exception& e)
             {
@@ -1022,28 +1346,99 @@ public:
             }
         }
 
-        void handle(const request& req, response& res)
+        void debug_print()
         {
-            if (req.method >= HTTPMethod::InternalMethodCount)
-                return;
-            auto& per_method = per_methods_[(int)req.method];
-            auto& trie = per_method.trie;
-            auto& rules = per_method.rules;
+            std::lock_guard<std::mutex> lock(mutex_);
+            routes_.load()->trie.debug_print();
+        }
+
+    private:
+        // A published routing table; never modified once lookups can see it.
+        struct routes
+        {
+            // rule index 0, 1 has special meaning; preallocate it to avoid duplication.
+            std::vector<std::shared_ptr<BaseRule>> rules = std::vector<std::shared_ptr<BaseRule>>(2);
+            Trie trie;
+        };
 
-            auto found = trie.find(req.url);
+        static void add_rule_object(routes& table, const std::shared_ptr<BaseRule>& ruleObject)
+        {
+            const std::string& rule = ruleObject->rule();
+            bool has_trailing_slash = false;
+            std::string rule_without_trailing_slash;
+            if (rule.size() > 1 && rule.back() == '/')
+            {
+                has_trailing_slash = true;
+                rule_without_trailing_slash = rule;
+                rule_without_trailing_slash.pop_back();
+            }
 
-            unsigned rule_index = found.first;
+            table.rules.push_back(ruleObject);
+            unsigned rule_index = static_cast<unsigned int>(table.rules.size() - 1);
+            ruleObject->foreach_method([&](int method)
+                    {
+                        table.trie.add(rule, rule_index, (HTTPMethod)method);
 
-            if (!rule_index)
+                        // directory case: 
+                        //   request to `/about' url matches `/about/' rule 
+                        if (has_trailing_slash)
+                        {
+                            table.trie.add(rule_without_trailing_slash, RULE_SPECIAL_REDIRECT_SLASH, (HTTPMethod)method);
+                        }
+                    });
+        }
+
+        // called with mutex_ held; throws before anything is published if a rule is invalid
+        void publish()
+        {
+            std::unique_ptr<routes> next(new routes);
+            for(auto& rule:all_rules_)
             {
-                CROW_LOG_DEBUG << "Cannot match rules " << req.url << ' ' << method_name(req.method);
-                res = response(404);
-                res.end();
-                return;
+                if (!rule)
+                    continue;
+                auto upgraded = rule->upgrade();
+                if (upgraded)
+                    rule = std::move(upgraded);
+                rule->validate();
+                add_rule_object(*next, rule);
             }
+            next->trie.validate();
+
+            // Rules that are gone from the new table are freed with the old one, unless a
+            // response still holds them. A handler changing routes can't wait for the readers
+            // to leave, being one of them, so the next change outside a handler frees it.
+            retired_.emplace_back(routes_.exchange(next.release()));
+            if (!detail::epoch::reading())
+            {
+                epoch_.synchronize();
+                retired_.clear();
+            }
+        }
+
+        // The rule for `req', or null when there is none; `res' is then already filled in with
+        // a 404, a 405 or a redirect. The caller has to be a reader of epoch_ for as long as it
+        // uses the rule.
+        const std::shared_ptr<BaseRule>* match(const request& req, response& res, routing_params& params)
+        {
+            if (req.method >= HTTPMethod::InternalMethodCount)
+                return nullptr;
 
-            if (rule_index >= rules.size())
+            const routes* current = routes_.load();
+            unsigned rule_index = current->trie.find(req.url, req.method, params);
+            uint32_t allowed = 0;
+            const std::shared_ptr<BaseRule>* rule = nullptr;
+            if (!rule_index)
+                allowed = current->trie.allowed_methods(req.url);
+            else if (rule_index >= current->rules.size())
                 throw std::runtime_error("Trie internal structure corrupted!");
+            else if (rule_index != RULE_SPECIAL_REDIRECT_SLASH)
+                rule = &current->rules[rule_index];
+
+            if (!rule_index)
+            {
+                handle_no_match(req, res, allowed);
+                return nullptr;
+            }
 
             if (rule_index == RULE_SPECIAL_REDIRECT_SLASH)
             {
@@ -1060,51 +1455,45 @@ public:
                     res.add_header("Location", "http://" + req.get_header_value("Host") + req.url + "/");
                 }
                 res.end();
-                return;
+                return nullptr;
             }
 
-            CROW_LOG_DEBUG << "Matched rule '" << rules[rule_index]->rule_ << "' " << (uint32_t)req.method << " / " << rules[rule_index]->get_methods();
+            return rule;
+        }
 
-            // any uncaught exceptions become 500s
-            try
-            {
-                rules[rule_index]->handle(req, res, found.second);
-            }
-            catch(std::exception& e)
-            {
-                CROW_LOG_ERROR << "An uncaught exception occurred: " << e.what();
-                res = response(500);
-                res.end();
-                return;   
-            }
-            catch(...)
+        // 405 with the methods the url does have rules for, 404 if there are none
+        void handle_no_match(const request& req, response& res, uint32_t allowed)
+        {
+            if (!allowed)
             {
-                CROW_LOG_ERROR << "An uncaught exception occurred. The type was unknown so no information was available.";
-                res = response(500);
+                CROW_LOG_DEBUG << "Cannot match rules " << req.url << ' ' << method_name(req.method);
+                res = response(404);
                 res.end();
-                return;   
+                return;
             }
-        }
 
-        void debug_print()
-        {
+            std::string allow;
             for(int i = 0; i < (int)HTTPMethod::InternalMethodCount; i ++)
             {
-                CROW_LOG_DEBUG << method_name((HTTPMethod)i);
-                per_methods_[i].trie.debug_print();
+                if (allowed & (1u << i))
+                {
+                    if (!allow.empty())
+                        allow += ", ";
+                    allow += method_name((HTTPMethod)i);
+                }
             }
+            CROW_LOG_DEBUG << "Method not allowed " << req.url << ' ' << method_name(req.method) << ", allowed: " << allow;
+            res = response(405);
+            res.set_header("Allow", allow);
+            res.end();
         }
 
-    private:
-        struct PerMethod
-        {
-            std::vector<BaseRule*> rules;
-            Trie trie;
-
-            // rule index 0, 1 has special meaning; preallocate it to avoid duplication.
-            PerMethod() : rules(2) {}
-        };
-        std::array<PerMethod, (int)HTTPMethod::InternalMethodCount> per_methods_;
-        std::vector<std::unique_ptr<BaseRule>> all_rules_;
+        std::atomic<routes*> routes_;
+        detail::epoch epoch_;
+        // serializes changes to the rules; never taken on the request path
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<BaseRule>> all_rules_;
+        // tables that were replaced while lookups may still be using them
+        std::vector<std::unique_ptr<routes>> retired_;
     };
 }
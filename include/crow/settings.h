@@ -11,6 +11,9 @@
 /* #ifdef - enables ssl */
 //#define CROW_ENABLE_SSL
 
+/* #ifdef - parses request heads with SIMD instructions (see parser.h) */
+//#define CROW_ENABLE_SIMD_PARSER
+
 /* #define - specifies log level */
 /*
     Debug       = 0
@@ -31,6 +34,12 @@
 #define CROW_CAN_USE_CPP14
 #endif
 
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CROW_CAN_USE_COROUTINES
+#endif
+#endif
+
 #if defined(_MSC_VER)
 #if _MSC_VER < 1900
 #define CROW_MSVC_WORKAROUND
@@ -37,6 +37,11 @@ namespace crow
             return socket_.remote_endpoint();
         }
 
+        tcp::endpoint remote_endpoint(boost::system::error_code& ec)
+        {
+            return socket_.remote_endpoint(ec);
+        }
+
         bool is_open()
         {
             return socket_.is_open();
@@ -54,6 +59,13 @@ namespace crow
             f(boost::system::error_code());
         }
 
+        // completes when the socket becomes readable, without consuming any data
+        template <typename F>
+        void wait_readable(F f)
+        {
+            socket_.async_read_some(boost::asio::null_buffers(), f);
+        }
+
         tcp::socket socket_;
     };
 
@@ -83,6 +95,11 @@ namespace crow
             return raw_socket().remote_endpoint();
         }
 
+        tcp::endpoint remote_endpoint(boost::system::error_code& ec)
+        {
+            return raw_socket().remote_endpoint(ec);
+        }
+
         bool is_open()
         {
             return raw_socket().is_open();
@@ -108,6 +125,12 @@ namespace crow
                     });
         }
 
+        template <typename F>
+        void wait_readable(F f)
+        {
+            ssl_socket_->next_layer().async_read_some(boost::asio::null_buffers(), f);
+        }
+
         std::unique_ptr<boost::asio::ssl::stream<tcp::socket>> ssl_socket_;
     };
 #endif
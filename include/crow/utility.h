@@ -543,6 +543,34 @@ template <typename F, typename Set>
             return base64encode(data, size, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_");
         }
 
+        // accepts both the standard and the url safe alphabet; padding is optional
+        inline static std::string base64decode(const std::string& data)
+        {
+            std::string ret;
+            ret.reserve(data.size() / 4 * 3 + 2);
+            unsigned int acc = 0;
+            int bits = 0;
+            for(auto c : data)
+            {
+                int v;
+                if (c >= 'A' && c <= 'Z') v = c - 'A';
+                else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') v = c - '0' + 52;
+                else if (c == '+' || c == '-') v = 62;
+                else if (c == '/' || c == '_') v = 63;
+                else if (c == '=') break;
+                else throw std::runtime_error("invalid base64 character");
+                acc = (acc << 6) | static_cast<unsigned int>(v);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    ret.push_back(static_cast<char>((acc >> bits) & 0xFF));
+                }
+            }
+            return ret;
+        }
+
 
     } // namespace utility
 }
@@ -44,3 +44,121 @@ TEST(ci_map, clear) {
   map.clear();
   EXPECT_EQ(map.size(), 0);
 }
+
+TEST(ci_map, caseInsensitive) {
+  ci_map map;
+  map.emplace("Content-Type", "text/plain");
+  EXPECT_EQ(map.count("content-type"), 1);
+  EXPECT_EQ(map.find("CONTENT-TYPE")->second, "text/plain");
+  EXPECT_EQ(map.find("content-typf"), map.end());
+  EXPECT_EQ(map.find("content-typ"), map.end());
+  EXPECT_EQ(ci_hash()("X-Abc"), ci_hash()("x-aBC"));
+}
+
+TEST(ci_map, insertionOrder) {
+  ci_map map;
+  map.emplace("a", "1");
+  map.emplace("b", "2");
+  map.emplace("A", "3");
+  map.emplace("c", "4");
+  std::string order;
+  for (auto& kv : map)
+    order += kv.second;
+  EXPECT_EQ(order, "1234");
+  EXPECT_EQ(map.erase("a"), 2);
+  order.clear();
+  for (auto& kv : map)
+    order += kv.second;
+  EXPECT_EQ(order, "24");
+}
+
+TEST(ci_map, growAndCopy) {
+  ci_map map;
+  for (int i = 0; i < 40; i++)
+    map.emplace("h" + std::to_string(i), std::string(i, 'v'));
+  ASSERT_EQ(map.size(), 40);
+  EXPECT_EQ(map.find("H39")->second, std::string(39, 'v'));
+
+  ci_map copy = map;
+  ci_map moved = std::move(map);
+  EXPECT_EQ(map.size(), 0);
+  ASSERT_EQ(moved.size(), 40);
+  EXPECT_EQ(copy.find("h20")->second, moved.find("h20")->second);
+
+  ci_map small;
+  small.emplace("x", "y");
+  ci_map small_moved = std::move(small);
+  EXPECT_EQ(small_moved.find("x")->second, "y");
+  EXPECT_TRUE(small.empty());
+}
+
+TEST(ci_map, clearKeepsStorage) {
+  ci_map map;
+  map.emplace("x-long", std::string(100, 'a'));
+  const char* data = map.begin()->second.data();
+  map.clear();
+  map.emplace("x-long", boost::string_ref("bbb"));
+  // the string left behind by clear() is refilled in place
+  EXPECT_EQ(map.begin()->second.data(), data);
+  EXPECT_EQ(map.begin()->second, "bbb");
+}
+
+TEST(ci_map, knownHeaders) {
+  ci_map map;
+  map.emplace("X-A", "1");
+  map.emplace("Host", "example.com");
+  map.emplace("x-a", "2");
+  map.emplace("Connection", "close");
+  EXPECT_EQ(map.find(known_header::host)->second, "example.com");
+  EXPECT_EQ(map.find(known_header::connection)->second, "close");
+  EXPECT_EQ(map.find(known_header::date), map.end());
+  EXPECT_EQ(map.count(known_header::date), 0);
+
+  map.emplace("HOST", "other");
+  EXPECT_EQ(map.find(known_header::host), map.find("host"));
+  EXPECT_EQ(map.count(known_header::host), 2);
+
+  map.erase("x-a");
+  EXPECT_EQ(map.find(known_header::host)->second, "example.com");
+  EXPECT_EQ(map.find(known_header::connection)->second, "close");
+  map.erase(map.find(known_header::host));
+  EXPECT_EQ(map.find(known_header::host)->second, "other");
+
+  ci_map moved = std::move(map);
+  EXPECT_EQ(moved.find(known_header::connection)->second, "close");
+  EXPECT_EQ(map.find(known_header::connection), map.end());
+  moved.clear();
+  EXPECT_EQ(moved.find(known_header::connection), moved.end());
+}
+
+TEST(ci_map, emplaceKeepsEntries) {
+  ci_map map;
+  map.emplace("a", "1");
+  map.emplace("b", "2");
+  const std::string* b = &map.find("b")->second;
+  const char* b_data = b->data();
+  map.emplace("A", "3");
+  map.emplace("c", "4");
+  map.emplace("a", "5");
+  // a duplicate is appended instead of being moved next to the first one
+  EXPECT_EQ(&map.find("b")->second, b);
+  EXPECT_EQ(b->data(), b_data);
+
+  std::string values;
+  const ci_map& cmap = map;
+  auto range = cmap.equal_range("A");
+  for (auto it = range.first; it != range.second; ++it)
+    values += it->second;
+  EXPECT_EQ(values, "135");
+  EXPECT_EQ(map.count("a"), 3);
+  EXPECT_EQ(map.count("c"), 1);
+  EXPECT_EQ(map.count("d"), 0);
+
+  // the key passed in may be one of the entries being erased
+  EXPECT_EQ(map.erase(map.find("a")->first), 3);
+  values.clear();
+  for (auto& kv : map)
+    values += kv.second;
+  EXPECT_EQ(values, "24");
+  EXPECT_EQ(map.erase("a"), 0);
+}
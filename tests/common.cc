@@ -36,33 +36,69 @@ TEST(common, methodStringLiteral) {
 #endif
 
 TEST(routing_params, get_int64_t) {
+  std::string url = "42/84";
   routing_params rp;
-  rp.int_params.push_back(42);
-  rp.int_params.push_back(84);
+  rp.push(ParamType::INT, url.data(), 2);
+  rp.push(ParamType::INT, url.data()+3, 2);
   EXPECT_EQ(rp.get<int64_t>(0), 42);
   EXPECT_EQ(rp.get<int64_t>(1), 84);
 }
 
 TEST(routing_params, get_uint64_t) {
+  std::string url = "42/84";
   routing_params rp;
-  rp.uint_params.push_back(42);
-  rp.uint_params.push_back(84);
+  rp.push(ParamType::UINT, url.data(), 2);
+  rp.push(ParamType::UINT, url.data()+3, 2);
   EXPECT_EQ(rp.get<uint64_t>(0), 42);
   EXPECT_EQ(rp.get<uint64_t>(1), 84);
 }
 
 TEST(routing_params, get_double) {
+  std::string url = "42.0/84.0";
   routing_params rp;
-  rp.double_params.push_back(42.0);
-  rp.double_params.push_back(84.0);
+  rp.push(ParamType::DOUBLE, url.data(), 4);
+  rp.push(ParamType::DOUBLE, url.data()+5, 4);
   EXPECT_DOUBLE_EQ(rp.get<double>(0), 42.0);
   EXPECT_DOUBLE_EQ(rp.get<double>(1), 84.0);
 }
 
 TEST(routing_params, get_string) {
+  std::string url = "a/b";
   routing_params rp;
-  rp.string_params.push_back("a");
-  rp.string_params.push_back("b");
+  rp.push(ParamType::STRING, url.data(), 1);
+  rp.push(ParamType::STRING, url.data()+2, 1);
   EXPECT_EQ(rp.get<std::string>(0), "a");
   EXPECT_EQ(rp.get<std::string>(1), "b");
 }
+
+TEST(routing_params, path_is_string) {
+  std::string url = "a/b/c";
+  routing_params rp;
+  rp.push(ParamType::STRING, url.data(), 1);
+  rp.push(ParamType::PATH, url.data()+2, 3);
+  EXPECT_EQ(rp.get<std::string>(0), "a");
+  EXPECT_EQ(rp.get<std::string>(1), "b/c");
+}
+
+TEST(routing_params, indexed_per_type) {
+  std::string url = "1/x/2";
+  routing_params rp;
+  rp.push(ParamType::INT, url.data(), 1);
+  rp.push(ParamType::STRING, url.data()+2, 1);
+  rp.push(ParamType::INT, url.data()+4, 1);
+  EXPECT_EQ(rp.get<int64_t>(1), 2);
+  EXPECT_EQ(rp.get<std::string>(0), "x");
+  EXPECT_THROW(rp.get<std::string>(1), std::out_of_range);
+}
+
+TEST(routing_params, capacity) {
+  std::string url = "x";
+  routing_params rp;
+  const unsigned capacity = routing_params::capacity;
+  for (unsigned i = 0; i < capacity; i++)
+    rp.push(ParamType::STRING, url.data(), 1);
+  EXPECT_EQ(rp.size(), capacity);
+  EXPECT_EQ(rp.get<std::string>(capacity - 1), "x");
+  rp.pop();
+  EXPECT_EQ(rp.size(), capacity - 1);
+}
@@ -0,0 +1,475 @@
+#include "gtest/gtest.h"
+
+#include "crow/http2.h"
+using namespace crow;
+using namespace crow::http2;
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+std::string unhex(const std::string& hex) {
+  std::string ret;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2)
+    ret.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+  return ret;
+}
+
+std::string frame(frame_type type, uint8_t f, uint32_t stream_id, const std::string& payload) {
+  std::string ret;
+  append_frame_header(ret, static_cast<uint32_t>(payload.size()), type, f, stream_id);
+  return ret + payload;
+}
+
+std::vector<frame_header> frames_of(const std::string& bytes, std::vector<std::string>* payloads = nullptr) {
+  std::vector<frame_header> ret;
+  for (size_t pos = 0; pos + frame_header_size <= bytes.size();) {
+    ret.push_back(parse_frame_header(bytes.data() + pos));
+    if (payloads)
+      payloads->push_back(bytes.substr(pos + frame_header_size, ret.back().length));
+    pos += frame_header_size + ret.back().length;
+  }
+  return ret;
+}
+
+struct test_handler {
+  std::vector<std::pair<uint32_t, request>> requests;
+  std::vector<uint32_t> resets;
+  void handle_stream(uint32_t stream_id, request&& req) { requests.emplace_back(stream_id, std::move(req)); }
+  void handle_stream_reset(uint32_t stream_id) { resets.push_back(stream_id); }
+};
+
+std::string request_headers(hpack::encoder& encoder, const std::string& method, const std::string& path) {
+  std::string block;
+  encoder.encode({{":method", method}, {":scheme", "http"}, {":path", path}, {":authority", "localhost"}}, block);
+  return block;
+}
+}
+
+TEST(http2, integerEncoding) {
+  // RFC 7541 C.1
+  std::string out;
+  hpack::encode_integer(out, 0, 5, 10);
+  EXPECT_EQ(out, unhex("0a"));
+  out.clear();
+  hpack::encode_integer(out, 0, 5, 1337);
+  EXPECT_EQ(out, unhex("1f9a0a"));
+  out.clear();
+  hpack::encode_integer(out, 0, 8, 42);
+  EXPECT_EQ(out, unhex("2a"));
+
+  const char* p = out.data();
+  EXPECT_EQ(hpack::decode_integer(p, out.data() + out.size(), 8), 42u);
+  std::string big = unhex("1f9a0a");
+  p = big.data();
+  EXPECT_EQ(hpack::decode_integer(p, big.data() + big.size(), 5), 1337u);
+  EXPECT_EQ(p, big.data() + big.size());
+  p = big.data();
+  EXPECT_THROW(hpack::decode_integer(p, big.data() + 2, 5), std::runtime_error);
+}
+
+TEST(http2, huffman) {
+  const std::pair<std::string, std::string> vectors[] = {
+    {"www.example.com", "f1e3c2e5f23a6ba0ab90f4ff"},
+    {"no-cache", "a8eb10649cbf"},
+    {"custom-key", "25a849e95ba97d7f"},
+    {"custom-value", "25a849e95bb8e8b4bf"},
+  };
+  for (auto& v : vectors) {
+    std::string encoded;
+    hpack::huffman_encode(encoded, v.first);
+    EXPECT_EQ(encoded, unhex(v.second));
+    EXPECT_EQ(hpack::huffman_encoded_size(v.first), encoded.size());
+    EXPECT_EQ(hpack::huffman_decode(encoded.data(), encoded.size()), v.first);
+  }
+
+  std::string all;
+  for (int c = 0; c < 256; c++)
+    all.push_back(static_cast<char>(c));
+  std::string encoded;
+  hpack::huffman_encode(encoded, all);
+  EXPECT_EQ(hpack::huffman_decode(encoded.data(), encoded.size()), all);
+
+  // padding longer than 7 bits, or not made of ones
+  std::string bad = unhex("a8eb10649cbfff");
+  EXPECT_THROW(hpack::huffman_decode(bad.data(), bad.size()), std::runtime_error);
+  bad = unhex("a8eb10649cbe");
+  EXPECT_THROW(hpack::huffman_decode(bad.data(), bad.size()), std::runtime_error);
+}
+
+TEST(http2, decoderRequestsWithoutHuffman) {
+  // RFC 7541 C.3
+  hpack::decoder decoder;
+  hpack::header_list headers;
+  std::string block = unhex("828684410f7777772e6578616d706c652e636f6d");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 4u);
+  EXPECT_EQ(headers[0], std::make_pair(std::string(":method"), std::string("GET")));
+  EXPECT_EQ(headers[3], std::make_pair(std::string(":authority"), std::string("www.example.com")));
+  EXPECT_EQ(decoder.table().size(), 57u);
+
+  headers.clear();
+  block = unhex("828684be58086e6f2d6361636865");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 5u);
+  EXPECT_EQ(headers[3].second, "www.example.com");
+  EXPECT_EQ(headers[4], std::make_pair(std::string("cache-control"), std::string("no-cache")));
+  EXPECT_EQ(decoder.table().size(), 110u);
+
+  headers.clear();
+  block = unhex("828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 5u);
+  EXPECT_EQ(headers[1].second, "https");
+  EXPECT_EQ(headers[2].second, "/index.html");
+  EXPECT_EQ(headers[4], std::make_pair(std::string("custom-key"), std::string("custom-value")));
+  EXPECT_EQ(decoder.table().size(), 164u);
+  EXPECT_EQ(decoder.table().get(1).first, "custom-key");
+}
+
+TEST(http2, decoderRequestsWithHuffman) {
+  // RFC 7541 C.4
+  hpack::decoder decoder;
+  hpack::header_list headers;
+  std::string block = unhex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 4u);
+  EXPECT_EQ(headers[3].second, "www.example.com");
+
+  headers.clear();
+  block = unhex("828684be5886a8eb10649cbf");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 5u);
+  EXPECT_EQ(headers[4].second, "no-cache");
+
+  headers.clear();
+  block = unhex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+  decoder.decode(block.data(), block.size(), headers);
+  ASSERT_EQ(headers.size(), 5u);
+  EXPECT_EQ(headers[4], std::make_pair(std::string("custom-key"), std::string("custom-value")));
+  EXPECT_EQ(decoder.table().size(), 164u);
+}
+
+TEST(http2, decoderErrors) {
+  hpack::decoder decoder;
+  hpack::header_list headers;
+  std::string index_zero = unhex("80");
+  EXPECT_THROW(decoder.decode(index_zero.data(), index_zero.size(), headers), std::runtime_error);
+  std::string out_of_range = unhex("be");
+  EXPECT_THROW(decoder.decode(out_of_range.data(), out_of_range.size(), headers), std::runtime_error);
+  std::string truncated = unhex("410f7777");
+  EXPECT_THROW(decoder.decode(truncated.data(), truncated.size(), headers), std::runtime_error);
+  // table size update above the advertised limit
+  std::string too_large = unhex("3fe21f");
+  EXPECT_THROW(decoder.decode(too_large.data(), too_large.size(), headers), std::runtime_error);
+}
+
+TEST(http2, encoderRoundTrip) {
+  hpack::encoder encoder;
+  hpack::decoder decoder;
+  hpack::header_list headers = {
+    {":status", "200"},
+    {"content-type", "text/plain"},
+    {"server", "Crow/0.1"},
+    {"content-length", "12"},
+    {"set-cookie", "a=b"},
+  };
+  std::string first;
+  encoder.encode(headers, first);
+  hpack::header_list decoded;
+  decoder.decode(first.data(), first.size(), decoded);
+  EXPECT_EQ(decoded, headers);
+
+  // repeated fields are indexed the second time round
+  std::string second;
+  encoder.encode(headers, second);
+  EXPECT_LT(second.size(), first.size());
+  decoded.clear();
+  decoder.decode(second.data(), second.size(), decoded);
+  EXPECT_EQ(decoded, headers);
+  EXPECT_EQ(encoder.table().size(), decoder.table().size());
+
+  // a smaller table announced by the peer is signalled before the next block
+  encoder.set_max_table_size(0);
+  std::string third;
+  encoder.encode(headers, third);
+  EXPECT_EQ(third[0], '\x20');
+  decoded.clear();
+  decoder.decode(third.data(), third.size(), decoded);
+  EXPECT_EQ(decoded, headers);
+  EXPECT_EQ(decoder.table().size(), 0u);
+}
+
+TEST(http2, sessionRequestResponse) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+  std::vector<frame_header> frames = frames_of(s.output());
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].type, frame_type::settings);
+  s.output().clear();
+
+  hpack::encoder encoder;
+  std::string input = std::string(client_preface, client_preface_size);
+  input += frame(frame_type::settings, 0, 0, "");
+  input += frame(frame_type::headers, flags::end_headers | flags::end_stream, 1, request_headers(encoder, "GET", "/a?x=1"));
+  input += frame(frame_type::headers, flags::end_headers, 3, request_headers(encoder, "POST", "/b"));
+  input += frame(frame_type::data, 0, 3, "hello ");
+  input += frame(frame_type::data, flags::end_stream, 3, "world");
+
+  // fed a byte at a time, frames straddle every read boundary
+  for (auto c : input)
+    ASSERT_TRUE(s.feed(&c, 1));
+
+  ASSERT_EQ(handler.requests.size(), 2u);
+  EXPECT_EQ(handler.requests[0].first, 1u);
+  EXPECT_EQ(handler.requests[0].second.method, HTTPMethod::Get);
+  EXPECT_EQ(handler.requests[0].second.url, "/a");
+  EXPECT_EQ(handler.requests[0].second.url_params.get("x"), std::string("1"));
+  EXPECT_EQ(handler.requests[0].second.get_header_value("host"), "localhost");
+  EXPECT_EQ(handler.requests[1].first, 3u);
+  EXPECT_EQ(handler.requests[1].second.method, HTTPMethod::Post);
+  EXPECT_EQ(handler.requests[1].second.body, "hello world");
+  EXPECT_EQ(s.stream_count(), 2u);
+
+  // responses may complete out of order
+  s.submit_response(3, 201, {{"Content-Type", "text/plain"}, {"Connection", "Keep-Alive"}}, "created");
+  s.submit_response(1, 200, {}, "");
+  EXPECT_EQ(s.stream_count(), 0u);
+
+  std::vector<std::string> payloads;
+  frames = frames_of(s.output(), &payloads);
+  hpack::decoder decoder;
+  hpack::header_list headers;
+  bool got_data = false;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i].type == frame_type::headers && frames[i].stream_id == 3) {
+      decoder.decode(payloads[i].data(), payloads[i].size(), headers);
+      EXPECT_FALSE(frames[i].flags & flags::end_stream);
+    } else if (frames[i].type == frame_type::data && frames[i].stream_id == 3) {
+      EXPECT_EQ(payloads[i], "created");
+      EXPECT_TRUE(frames[i].flags & flags::end_stream);
+      got_data = true;
+    } else if (frames[i].type == frame_type::headers && frames[i].stream_id == 1) {
+      EXPECT_TRUE(frames[i].flags & flags::end_stream);
+    }
+  }
+  EXPECT_TRUE(got_data);
+  ASSERT_EQ(headers.size(), 2u);
+  EXPECT_EQ(headers[0], std::make_pair(std::string(":status"), std::string("201")));
+  EXPECT_EQ(headers[1], std::make_pair(std::string("content-type"), std::string("text/plain")));
+}
+
+TEST(http2, sessionFlowControl) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+
+  hpack::encoder encoder;
+  std::string settings;
+  append_setting(settings, settings_id::initial_window_size, 10);
+  std::string input = std::string(client_preface, client_preface_size);
+  input += frame(frame_type::settings, 0, 0, settings);
+  input += frame(frame_type::headers, flags::end_headers | flags::end_stream, 1, request_headers(encoder, "GET", "/"));
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  s.output().clear();
+
+  s.submit_response(1, 200, {}, std::string(25, 'x'));
+  std::vector<std::string> payloads;
+  auto frames = frames_of(s.output(), &payloads);
+  ASSERT_EQ(frames.size(), 2u);
+  EXPECT_EQ(frames[1].type, frame_type::data);
+  EXPECT_EQ(frames[1].length, 10u);
+  EXPECT_EQ(s.stream_count(), 1u);
+  s.output().clear();
+
+  std::string increment;
+  append_uint32(increment, 100);
+  input = frame(frame_type::window_update, 0, 1, increment);
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  frames = frames_of(s.output());
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].length, 15u);
+  EXPECT_TRUE(frames[0].flags & flags::end_stream);
+  EXPECT_EQ(s.stream_count(), 0u);
+}
+
+TEST(http2, sessionBodyLimit) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+
+  hpack::encoder encoder;
+  std::string input = std::string(client_preface, client_preface_size);
+  input += frame(frame_type::settings, 0, 0, "");
+  input += frame(frame_type::headers, flags::end_headers, 1, request_headers(encoder, "POST", "/upload"));
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  s.output().clear();
+
+  // the body is refused once it grows past the limit, whatever the windows allow
+  std::string chunk(16384, 'x');
+  std::string data = frame(frame_type::data, 0, 1, chunk);
+  size_t sent = 0;
+  for (; sent <= session<test_handler>::max_body_size; sent += chunk.size())
+    ASSERT_TRUE(s.feed(data.data(), data.size()));
+  EXPECT_TRUE(handler.requests.empty());
+  EXPECT_EQ(s.stream_count(), 0u);
+
+  std::vector<std::string> payloads;
+  auto frames = frames_of(s.output(), &payloads);
+  hpack::decoder decoder;
+  hpack::header_list headers;
+  bool reset = false;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i].type == frame_type::headers) {
+      decoder.decode(payloads[i].data(), payloads[i].size(), headers);
+      EXPECT_TRUE(frames[i].flags & flags::end_stream);
+    } else if (frames[i].type == frame_type::rst_stream) {
+      reset = true;
+    }
+  }
+  ASSERT_FALSE(headers.empty());
+  EXPECT_EQ(headers[0], std::make_pair(std::string(":status"), std::string("413")));
+  EXPECT_TRUE(reset);
+
+  // what is still in flight is dropped, and the connection stays usable
+  s.output().clear();
+  ASSERT_TRUE(s.feed(data.data(), data.size()));
+  input = frame(frame_type::headers, flags::end_headers | flags::end_stream, 3, request_headers(encoder, "GET", "/"));
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  ASSERT_EQ(handler.requests.size(), 1u);
+  EXPECT_EQ(handler.requests[0].first, 3u);
+}
+
+TEST(http2, sessionSlowConsumerStalls) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+
+  hpack::encoder encoder;
+  std::string input = std::string(client_preface, client_preface_size);
+  input += frame(frame_type::settings, 0, 0, "");
+  const uint32_t streams[] = {1, 3, 5, 7, 9};
+  for (uint32_t id : streams)
+    input += frame(frame_type::headers, flags::end_headers, id, request_headers(encoder, "POST", "/upload"));
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  s.output().clear();
+
+  // a client that keeps to its windows, uploading five bodies at once that none of them ends
+  std::map<uint32_t, int64_t> windows;
+  for (uint32_t id : streams)
+    windows[id] = 65535;
+  windows[0] = 65535;
+  auto read_updates = [&] {
+    std::vector<std::string> payloads;
+    auto frames = frames_of(s.output(), &payloads);
+    for (size_t i = 0; i < frames.size(); i++) {
+      if (frames[i].type == frame_type::window_update)
+        windows[frames[i].stream_id] += (uint8_t(payloads[i][0]) << 24) | (uint8_t(payloads[i][1]) << 16) |
+                                        (uint8_t(payloads[i][2]) << 8) | uint8_t(payloads[i][3]);
+    }
+    s.output().clear();
+  };
+  size_t sent = 0;
+  for (bool progress = true; progress;) {
+    progress = false;
+    for (uint32_t id : streams) {
+      int64_t n = std::min<int64_t>({16384, windows[0], windows[id]});
+      if (n <= 0)
+        continue;
+      std::string data = frame(frame_type::data, 0, id, std::string(static_cast<size_t>(n), 'x'));
+      ASSERT_TRUE(s.feed(data.data(), data.size()));
+      windows[0] -= n;
+      windows[id] -= n;
+      sent += static_cast<size_t>(n);
+      read_updates();
+      progress = true;
+    }
+  }
+  // stalled by the connection window, with every stream still below max_body_size
+  const size_t budget = session<test_handler>::max_buffered_body_size;
+  EXPECT_EQ(sent, budget);
+  EXPECT_EQ(windows[0], 0);
+  EXPECT_TRUE(handler.requests.empty());
+
+  // ending one of the bodies passes it on and reopens the window by as much
+  input = frame(frame_type::data, flags::end_stream, 1, "");
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+  ASSERT_EQ(handler.requests.size(), 1u);
+  read_updates();
+  EXPECT_EQ(static_cast<size_t>(windows[0]), handler.requests[0].second.body.size());
+
+  // sending past the window is a connection error
+  input = frame(frame_type::data, 0, 3, std::string(static_cast<size_t>(windows[0]) + 1, 'x'));
+  EXPECT_FALSE(s.feed(input.data(), input.size()));
+}
+
+TEST(http2, sessionPingResetAndErrors) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+
+  hpack::encoder encoder;
+  std::string input = std::string(client_preface, client_preface_size);
+  input += frame(frame_type::settings, 0, 0, "");
+  input += frame(frame_type::ping, 0, 0, "12345678");
+  input += frame(frame_type::headers, flags::end_headers | flags::end_stream, 1, request_headers(encoder, "GET", "/"));
+  std::string cancel;
+  append_uint32(cancel, static_cast<uint32_t>(error_code::cancel));
+  input += frame(frame_type::rst_stream, 0, 1, cancel);
+  ASSERT_TRUE(s.feed(input.data(), input.size()));
+
+  std::vector<std::string> payloads;
+  auto frames = frames_of(s.output(), &payloads);
+  bool got_pong = false;
+  for (size_t i = 0; i < frames.size(); i++)
+    if (frames[i].type == frame_type::ping && (frames[i].flags & flags::ack) && payloads[i] == "12345678")
+      got_pong = true;
+  EXPECT_TRUE(got_pong);
+  ASSERT_EQ(handler.resets.size(), 1u);
+  EXPECT_EQ(handler.resets[0], 1u);
+  EXPECT_EQ(s.stream_count(), 0u);
+
+  // a response to a reset stream is dropped
+  s.output().clear();
+  s.submit_response(1, 200, {}, "late");
+  EXPECT_TRUE(s.output().empty());
+
+  // streams ids must increase
+  input = frame(frame_type::headers, flags::end_headers | flags::end_stream, 1, request_headers(encoder, "GET", "/"));
+  EXPECT_FALSE(s.feed(input.data(), input.size()));
+  EXPECT_TRUE(s.is_finished());
+  frames = frames_of(s.output(), &payloads);
+  ASSERT_FALSE(frames.empty());
+  EXPECT_EQ(frames.back().type, frame_type::goaway);
+}
+
+TEST(http2, sessionRejectsBadPreface) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.start();
+  std::string input = "GET / HTTP/1.1\r\n\r\n";
+  EXPECT_FALSE(s.feed(input.data(), input.size()));
+}
+
+TEST(http2, sessionUpgrade) {
+  test_handler handler;
+  session<test_handler> s(&handler);
+  s.output() = "HTTP/1.1 101 Switching Protocols\r\n\r\n";
+  s.start();
+
+  std::string settings;
+  append_setting(settings, settings_id::max_frame_size, 32768);
+  EXPECT_FALSE(s.upgrade("!!"));
+  ASSERT_TRUE(s.upgrade(utility::base64encode_urlsafe(settings.data(), settings.size())));
+  EXPECT_EQ(s.stream_count(), 1u);
+
+  s.submit_response(1, 200, {}, std::string(20000, 'y'));
+  std::string out = s.output().substr(s.output().find("\r\n\r\n") + 4);
+  auto frames = frames_of(out);
+  ASSERT_EQ(frames.size(), 3u);
+  EXPECT_EQ(frames[2].type, frame_type::data);
+  EXPECT_EQ(frames[2].length, 20000u);
+}
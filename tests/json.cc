@@ -2,6 +2,10 @@
 #include "testutil.h"
 
 #include "crow/json.h"
+
+#include <cstdio>
+#include <limits>
+#include <random>
 using namespace crow;
 
 template <typename I, typename K>
@@ -53,6 +57,21 @@ TEST(json, load) {
   EXPECT_FLOAT_EQ(three.d(), 4.2);
 }
 
+TEST(json, loadInPlace) {
+  std::string body = "{\"name\": \"a\\tb\", \"list\": [1, \"padding the body past the small string buffer\"]}";
+  const char* data = body.data();
+  const auto val = json::load(std::move(body));
+  ASSERT_FALSE(val.error());
+  EXPECT_EQ(val["name"].s(), "a\tb");
+  // the strings point into the buffer that was handed over
+  EXPECT_EQ(val["list"][1].s().begin(), data + 30);
+  EXPECT_EQ(val["list"][0].i(), 1);
+  EXPECT_EQ(val.key().size(), 0);
+
+  EXPECT_TRUE(json::load(std::string("{\"unterminated\": ")).error());
+  EXPECT_EQ(json::load(std::string("\"short\"")).s(), "short");
+}
+
 TEST(json, keyNotFound) {
   const auto val = json::load("{}");
   ASSERT_FALSE(val.error());
@@ -201,3 +220,457 @@ TEST(json, nestedValues) {
   EXPECT_EQ(z.t(), json::type::Number);
   EXPECT_EQ(z.i(), 42);
 }
+
+TEST(json, tape) {
+  const char* text = "{\"a\": [1, -2, 3.5, true, false, null], \"b\": {\"c\": \"x\\ny\"}, \"d\": 18446744073709551615}";
+  const auto doc = json::load_tape(text);
+  ASSERT_TRUE(doc);
+  const auto root = doc.root();
+  const auto r = json::load(text);
+
+  EXPECT_EQ(root.t(), json::type::Object);
+  EXPECT_EQ(root.size(), 3);
+  const auto a = root["a"];
+  ASSERT_EQ(a.size(), r["a"].size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].t(), r["a"][i].t());
+    EXPECT_EQ(a[i].nt(), r["a"][i].nt());
+  }
+  EXPECT_EQ(a[0].i(), 1);
+  EXPECT_EQ(a[1].i(), -2);
+  EXPECT_EQ(a[2].d(), 3.5);
+  EXPECT_TRUE(a[3].b());
+  EXPECT_FALSE(a[4].b());
+  EXPECT_EQ(root["b"]["c"].s(), "x\ny");
+  EXPECT_EQ(root["d"].u(), 18446744073709551615ull);
+  EXPECT_TRUE(root.has("b"));
+  EXPECT_FALSE(root.has("e"));
+  EXPECT_THROW(root["e"], std::runtime_error);
+
+  std::vector<std::string> keys;
+  for (auto member : root)
+    keys.push_back(member.key());
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "b", "d"}));
+
+  std::ostringstream os;
+  os << root;
+  EXPECT_EQ(os.str(), "{\"a\":[1,-2,3.5,true,false,null],\"b\":{\"c\":\"x\\ny\"},\"d\":18446744073709551615}");
+}
+
+TEST(json, tapeNumbers) {
+  const char* text = "[1.50, -7, 42, 18446744073709551616, 3.14159265358979323846264, 123456789012345678901e-2, -9223372036854775809]";
+  const auto doc = json::load_tape(text);
+  ASSERT_TRUE(doc);
+  const auto root = doc.root();
+  const auto r = json::load(text);
+  ASSERT_EQ(root.size(), r.size());
+  for (size_t i = 0; i < root.size(); i++) {
+    EXPECT_EQ(root[i].nt(), r[i].nt());
+    EXPECT_EQ(root[i].d(), r[i].d());
+  }
+  EXPECT_EQ(root[0].d(), 1.5);
+  EXPECT_EQ(root[1].i(), -7);
+  EXPECT_EQ(root[1].d(), -7.0);
+  EXPECT_EQ(root[2].i(), 42);
+  EXPECT_EQ(root[2].u(), 42u);
+  EXPECT_THROW(root[3].u(), boost::bad_lexical_cast);
+  EXPECT_THROW(root[6].i(), boost::bad_lexical_cast);
+
+  // the text is kept as written
+  std::ostringstream os;
+  os << root;
+  EXPECT_EQ(os.str(), "[1.50,-7,42,18446744073709551616,3.14159265358979323846264,123456789012345678901e-2,-9223372036854775809]");
+}
+
+TEST(json, tapeErrors) {
+  for (const char* bad : {"", "[1,", "{\"a\" 1}", "[1 2]", "\"abc", "nul", "[1]x", "{\"a\":}"}) {
+    EXPECT_FALSE(json::load_tape(bad)) << bad;
+    EXPECT_TRUE(json::load(bad).error()) << bad;
+  }
+  EXPECT_THROW(json::load_tape("[").root().t(), std::runtime_error);
+  EXPECT_TRUE(json::load_tape(std::string("[[], {}]")));
+}
+
+// Long documents go through the string index; escapes and errors have to land the same
+// wherever they fall relative to its 64 byte blocks
+TEST(json, stringIndex) {
+  for (size_t pad = 0; pad < 140; pad++) {
+    std::string filler(pad, 'a');
+    std::string text = "{\"" + filler + "\": [\"x\\\\\", \"\\\"q\\\"\", \"\\\\\\\"\", \"" + filler +
+                       "\\u0041\"], \"k\": \"" + filler + "\"}";
+    const auto r = json::load(text);
+    ASSERT_FALSE(r.error()) << text;
+    const auto list = r[filler];
+    ASSERT_EQ(list.size(), 4);
+    EXPECT_EQ(list[0].s(), "x\\");
+    EXPECT_EQ(list[1].s(), "\"q\"");
+    EXPECT_EQ(list[2].s(), "\\\"");
+    EXPECT_EQ(list[3].s(), filler + "A");
+    EXPECT_EQ(r["k"].s(), filler);
+
+    const auto doc = json::load_tape(text);
+    ASSERT_TRUE(doc) << text;
+    EXPECT_EQ(doc.root()[filler][1].s(), "\"q\"");
+    EXPECT_EQ(doc.root()["k"].s(), filler);
+
+    for (const char* bad : {"\\x", "\\u00g0"}) {
+      std::string broken = "[\"" + filler + bad + "\", \"" + std::string(64, 'b') + "\"]";
+      EXPECT_TRUE(json::load(broken).error()) << broken;
+      EXPECT_FALSE(json::load_tape(broken)) << broken;
+    }
+    std::string unterminated = "[\"" + std::string(64, 'b') + "\", \"" + filler;
+    EXPECT_TRUE(json::load(unterminated).error());
+    EXPECT_FALSE(json::load_tape(unterminated));
+    std::string nul = "[\"" + std::string(64, 'b') + "\", \"" + filler + '\0' + "\"]";
+    EXPECT_TRUE(json::load(nul).error());
+    EXPECT_FALSE(json::load_tape(nul));
+  }
+}
+
+TEST(json, largeObjectLookup) {
+  std::string text = "{";
+  for (int i = 0; i < 100; i++)
+    text += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+  text += "\"key7\": -1, \"esc\\u0041ped\": \"a\\tb\"}";
+  const auto r = json::load(text);
+  ASSERT_FALSE(r.error());
+  ASSERT_EQ(r.size(), 102);
+
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(r["key" + std::to_string(i)].i(), i);
+  // the first of two equal keys wins
+  EXPECT_EQ(r["key7"].i(), 7);
+  EXPECT_EQ(r["escAped"].s(), "a\tb");
+  EXPECT_FALSE(r.has("key100"));
+  EXPECT_FALSE(r.has("key"));
+  EXPECT_JSON_KEY_NOT_FOUND(r, "missing");
+
+  // looking keys up leaves the members in document order
+  int i = 0;
+  for (auto& v : r) {
+    if (i < 100) {
+      EXPECT_EQ(v.key(), "key" + std::to_string(i));
+    }
+    i++;
+  }
+
+  const json::rvalue copy = r;
+  EXPECT_EQ(copy["key42"].i(), 42);
+  EXPECT_EQ(copy["escAped"].s(), "a\tb");
+}
+
+TEST(json, numberParsing) {
+  struct {
+    const char* text;
+    json::num_type nt;
+  } cases[] = {
+      {"0", json::num_type::Unsigned_integer},
+      {"-0", json::num_type::Signed_integer},
+      {"18446744073709551615", json::num_type::Unsigned_integer},
+      {"-9223372036854775808", json::num_type::Signed_integer},
+      {"9223372036854775807", json::num_type::Unsigned_integer},
+      {"0.1", json::num_type::Floating_point},
+      {"-0.0", json::num_type::Floating_point},
+      {"0.30000000000000004", json::num_type::Floating_point},
+      {"123.456e-7", json::num_type::Floating_point},
+      {"1e22", json::num_type::Floating_point},
+      {"1e23", json::num_type::Floating_point},
+      {"9007199254740993", json::num_type::Unsigned_integer},
+      {"9007199254740993.0", json::num_type::Floating_point},
+      {"1.7976931348623157e308", json::num_type::Floating_point},
+      {"4.9e-324", json::num_type::Floating_point},
+      {"1E+2", json::num_type::Floating_point},
+      {"12345678901234567890123", json::num_type::Unsigned_integer},
+      {"0.000000000000000000000000000001", json::num_type::Floating_point},
+  };
+  for (auto& c : cases) {
+    const auto r = json::load(c.text);
+    ASSERT_FALSE(r.error()) << c.text;
+    EXPECT_EQ(r.nt(), c.nt) << c.text;
+    EXPECT_EQ(r.d(), boost::lexical_cast<double>(c.text)) << c.text;
+    if (c.nt == json::num_type::Floating_point)
+      continue;
+    int64_t i = 0;
+    bool has_i = true;
+    try {
+      i = boost::lexical_cast<int64_t>(c.text);
+    } catch (boost::bad_lexical_cast&) {
+      has_i = false;
+    }
+    if (has_i) {
+      EXPECT_EQ(r.i(), i) << c.text;
+    } else {
+      EXPECT_THROW(r.i(), boost::bad_lexical_cast) << c.text;
+    }
+  }
+  EXPECT_EQ(json::load("18446744073709551615").u(), 18446744073709551615ull);
+  EXPECT_THROW(json::load("12345678901234567890123").u(), boost::bad_lexical_cast);
+  EXPECT_THROW(json::load("1.5").i(), boost::bad_lexical_cast);
+
+  // whatever the digits, the value is the correctly rounded one
+  std::mt19937_64 rng(46);
+  char buf[64];
+  for (int n = 0; n < 20000; n++) {
+    switch (n % 3) {
+      case 0: snprintf(buf, sizeof buf, "%.17g", std::uniform_real_distribution<double>(-1e6, 1e6)(rng)); break;
+      case 1: snprintf(buf, sizeof buf, "%.*f", int(rng() % 8), double(int64_t(rng() % 100000000) - 50000000) / 1000); break;
+      case 2: snprintf(buf, sizeof buf, "%llue%d", (unsigned long long)(rng() % 10000000), int(rng() % 60) - 30); break;
+    }
+    EXPECT_EQ(json::load(buf).d(), strtod(buf, nullptr)) << buf;
+  }
+}
+
+TEST(json, dumpNumbers) {
+  struct {
+    double value;
+    const char* text;
+  } cases[] = {
+      {0.0, "0"},           {3.0, "3"},
+      {-5.5, "-5.5"},       {0.1, "0.1"},
+      {1.0 / 3, "0.3333333333333333"},
+      {0.30000000000000004, "0.30000000000000004"},
+      {1234567.0, "1234567"}, {1e20, "100000000000000000000"},
+      {1e21, "1e+21"},      {1.5e300, "1.5e+300"},
+      {0.000001, "0.000001"}, {1.25e-7, "1.25e-7"},
+      {5e-324, "5e-324"},   {1.7976931348623157e308, "1.7976931348623157e+308"},
+  };
+  for (auto& c : cases) {
+    json::wvalue w;
+    w = c.value;
+    EXPECT_EQ(json::dump(w), c.text);
+  }
+  json::wvalue w;
+  w[0] = std::numeric_limits<int64_t>::min();
+  w[1] = uint64_t(18446744073709551615ull);
+  w[2] = 0;
+  w[3] = -7;
+  w[4] = 1234567890;
+  EXPECT_EQ(json::dump(w), "[-9223372036854775808,18446744073709551615,0,-7,1234567890]");
+
+  // the digits always read back to the same double
+  std::mt19937_64 rng(47);
+  int longer = 0;
+  for (int n = 0; n < 100000; n++) {
+    uint64_t bits = rng();
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    if (std::isnan(d) || std::isinf(d))
+      continue;
+    if (n % 2)
+      d = std::uniform_real_distribution<double>(-1e4, 1e4)(rng);
+    json::wvalue x;
+    x = d;
+    std::string text = json::dump(x);
+    ASSERT_EQ(strtod(text.c_str(), nullptr), d) << text;
+
+    // and are nearly always as few as printf manages; Grisu2 gives up on about one in a
+    // thousand and writes more
+    int precision = 1;
+    char buf[32];
+    for (; precision < 17; precision++) {
+      snprintf(buf, sizeof buf, "%.*g", precision, d);
+      if (strtod(buf, nullptr) == d)
+        break;
+    }
+    std::string digits;
+    for (char c : text.substr(0, text.find('e')))
+      if (c >= '0' && c <= '9')
+        digits += c;
+    digits.erase(0, digits.find_first_not_of('0'));
+    digits.erase(digits.find_last_not_of('0') + 1);
+    longer += digits.size() > size_t(precision);
+  }
+  EXPECT_LT(longer, 500);
+}
+
+TEST(json, wvalueObjects) {
+  json::wvalue w;
+  for (int i = 0; i < 40; i++)
+    w["k" + std::to_string(i)] = i;
+  // past the index threshold, keys are still found and kept in order
+  for (int i = 0; i < 40; i++)
+    w["k" + std::to_string(i)] = i * 2;
+  EXPECT_EQ(w.count("k39"), 1);
+  EXPECT_EQ(w.count("k40"), 0);
+  auto keys = w.keys();
+  ASSERT_EQ(keys.size(), 40u);
+  for (int i = 0; i < 40; i++)
+    EXPECT_EQ(keys[i], "k" + std::to_string(i));
+
+  json::wvalue small;
+  small["b"] = "x";
+  small["a"] = std::string(100, 'y');
+  small["b"] = 1.5;
+  small["c"]["d"][1] = true;
+  EXPECT_EQ(json::dump(small), "{\"b\":1.5,\"a\":\"" + std::string(100, 'y') + "\",\"c\":{\"d\":[null,true]}}");
+
+  // values change type in place, and moves leave null behind
+  json::wvalue v;
+  v = "text";
+  v = 3;
+  v[2] = "list";
+  v["key"] = false;
+  json::wvalue moved = std::move(v);
+  EXPECT_EQ(v.t(), json::type::Null);
+  EXPECT_EQ(json::dump(moved), "{\"key\":false}");
+
+  // the first of two equal keys wins, as when reading
+  json::wvalue r = json::load("{\"x\": 1, \"y\": [2, \"z\"], \"x\": 3}");
+  EXPECT_EQ(json::dump(r), "{\"x\":1,\"y\":[2,\"z\"]}");
+}
+
+TEST(json, wvalueMemberReferences) {
+  // references to members survive adding more of them
+  json::wvalue x;
+  auto& a = x["a"];
+  for (int i = 0; i < 40; i++)
+    x["k" + std::to_string(i)] = i;
+  a = "late";
+  EXPECT_EQ(json::dump(x["a"]), "\"late\"");
+
+  json::wvalue y;
+  y["d"] = 4;
+  y["c"] = std::move(y["d"]);
+  y["e"] = std::move(y["f"]);
+  EXPECT_EQ(json::dump(y["c"]), "4");
+  EXPECT_EQ(y.keys().size(), 4u);
+}
+
+TEST(json, writer) {
+  std::string out = "prefix ";
+  json::writer w(out);
+  w.begin_object();
+  w.key("id").value(42);
+  w.key(std::string("name")).value("a \"quoted\"\n name");
+  w.key("empty").begin_list().end_list();
+  w.key("list").begin_list();
+  for (int i = 0; i < 3; i++)
+    w.begin_object().key("i").value(i).key("even").value(i % 2 == 0).end_object();
+  w.value(nullptr).value(-7LL).value(18446744073709551615ULL).value(0.5).value(2.0f);
+  w.end_list();
+  json::wvalue piece;
+  piece["x"][0] = "y";
+  w.key("piece").value(piece);
+  w.key("nested").begin_object().key("o").begin_object().end_object().end_object();
+  w.end_object();
+  EXPECT_EQ(out,
+            "prefix {\"id\":42,\"name\":\"a \\\"quoted\\\"\\n name\",\"empty\":[],"
+            "\"list\":[{\"i\":0,\"even\":true},{\"i\":1,\"even\":false},{\"i\":2,\"even\":true},"
+            "null,-7,18446744073709551615,0.5,2],\"piece\":{\"x\":[\"y\"]},\"nested\":{\"o\":{}}}");
+
+  // the same document built as a tree dumps identically
+  json::rvalue r = json::load(out.substr(7));
+  ASSERT_TRUE(r);
+  EXPECT_EQ(json::dump(json::wvalue(r)), out.substr(7));
+
+  // escaping copies plain runs around the characters that need it
+  std::string s;
+  json::writer(s).value(std::string("ab\x01" "cd\\ef\tg\"", 11));
+  EXPECT_EQ(s, "\"ab\\u0001cd\\\\ef\\tg\\\"\"");
+}
+
+namespace {
+// Writes down the events of a stream_parser
+struct event_recorder {
+  std::vector<std::string> events;
+
+  void begin_object() { events.push_back("{"); }
+  void end_object() { events.push_back("}"); }
+  void begin_list() { events.push_back("["); }
+  void end_list() { events.push_back("]"); }
+  void key(const std::string& k) { events.push_back("key " + k); }
+  void value(std::nullptr_t) { events.push_back("null"); }
+  void value(bool b) { events.push_back(b ? "true" : "false"); }
+  void value(int64_t i) { events.push_back("int " + std::to_string(i)); }
+  void value(uint64_t u) { events.push_back("uint " + std::to_string(u)); }
+  void value(double d) { events.push_back("double " + std::to_string(d)); }
+  void value(const std::string& s) { events.push_back("string " + s); }
+};
+
+// Feeds `doc' through a stream_parser into a writer, `step' bytes at a time
+bool stream_rewrite(const std::string& doc, size_t step, std::string& out) {
+  out.clear();
+  json::writer w(out);
+  json::stream_parser<json::writer> p(&w);
+  for (size_t pos = 0; pos < doc.size(); pos += step) {
+    if (!p.feed(doc.data() + pos, std::min(step, doc.size() - pos)))
+      return false;
+  }
+  return p.finish();
+}
+}  // namespace
+
+TEST(json, streamParserEvents) {
+  event_recorder r;
+  json::stream_parser<event_recorder> p(&r);
+  std::string doc = " {\"a\": [1, -2, 2.5e1, true, false, null, \"s\\\"\\u00e9\"], \"b\": {}, \"c\": []} ";
+  ASSERT_TRUE(p.feed(doc.data(), doc.size()));
+  EXPECT_TRUE(p.done());
+  ASSERT_TRUE(p.finish());
+  std::vector<std::string> expected = {"{", "key a", "[", "uint 1", "int -2", "double 25.000000", "true", "false", "null",
+                                       "string s\"\xc3\xa9", "]", "key b", "{", "}", "key c", "[", "]", "}"};
+  EXPECT_EQ(r.events, expected);
+
+  // a number at the top level only ends with the input
+  event_recorder n;
+  json::stream_parser<event_recorder> q(&n);
+  ASSERT_TRUE(q.feed("12", 2));
+  EXPECT_TRUE(n.events.empty());
+  ASSERT_TRUE(q.feed("34", 2));
+  ASSERT_TRUE(q.finish());
+  EXPECT_EQ(n.events, std::vector<std::string>{"uint 1234"});
+  q.reset();
+  ASSERT_TRUE(q.feed("99999999999999999999999", 23));
+  ASSERT_TRUE(q.finish());
+  // too large for 64 bits
+  EXPECT_EQ(n.events.back(), "double " + std::to_string(1e23));
+}
+
+TEST(json, streamParserPieces) {
+  const char* docs[] = {
+      "[]",
+      "\"just a string\"",
+      "  -0.125e-2  ",
+      "{\"k\\n\\t\\\\\":\"\\u0041\\u03a9\\u20ac\\/\",\"nested\":[[[{\"x\":[1,{},[]]}]]],\"n\":[0,1e3,-9223372036854775808,18446744073709551615]}",
+      "[true , false,null\r\n,\n{ \"a\" : \"b\" , \"c\":{\"d\":[ ]} } ]",
+  };
+  for (const char* d : docs) {
+    std::string doc = d;
+    json::rvalue r = json::load(doc);
+    ASSERT_TRUE(r) << doc;
+    std::string expected = json::dump(json::wvalue(r));
+    for (size_t step = 1; step <= doc.size(); step++) {
+      std::string out;
+      ASSERT_TRUE(stream_rewrite(doc, step, out)) << doc << " in pieces of " << step;
+      EXPECT_EQ(out, expected) << doc << " in pieces of " << step;
+    }
+  }
+}
+
+TEST(json, streamParserErrors) {
+  const char* bad[] = {"",      "[1,]",  "{\"a\" 1}", "tru",    "01",       "[1 2]",   "{}x",     "[",
+                       "{\"a\"}", "[-]",   "1.",       "1e",     "\"\\x\"",  "\"\\u12g4\"", "{,}",  "[}",
+                       "{1:2}", "nul",   "[\"a\" \"b\"]", "-01", ".5", "\"open"};
+  for (const char* b : bad) {
+    std::string out;
+    EXPECT_FALSE(stream_rewrite(b, 1, out)) << b;
+    EXPECT_FALSE(stream_rewrite(b, 64, out)) << b;
+  }
+
+  // nothing more is taken after an error
+  event_recorder r;
+  json::stream_parser<event_recorder> p(&r);
+  EXPECT_FALSE(p.feed("[1,]", 4));
+  EXPECT_TRUE(p.failed());
+  EXPECT_FALSE(p.feed("[]", 2));
+  EXPECT_EQ(r.events, (std::vector<std::string>{"[", "uint 1"}));
+
+  // state stays bounded
+  event_recorder deep_events;
+  json::stream_parser<event_recorder> deep(&deep_events, 8, 16);
+  EXPECT_TRUE(deep.feed("[[[[[[[[", 8));
+  EXPECT_FALSE(deep.feed("[", 1));
+  json::stream_parser<event_recorder> long_token(&deep_events, 8, 16);
+  EXPECT_TRUE(long_token.feed("\"0123456789abcdef", 17));
+  EXPECT_FALSE(long_token.feed("g", 1));
+}
@@ -0,0 +1,222 @@
+#include "gtest/gtest.h"
+
+#include "crow/parser.h"
+using namespace crow;
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+// Writes down everything a connection could see of each message
+template <typename Backend>
+struct recorder {
+  HTTPParser<recorder, Backend> parser{this};
+  std::vector<std::string> events;
+
+  void handle_header() {
+    std::ostringstream os;
+    os << "head " << parser.content_length << ' ' << parser.is_upgrade() << ' ' << parser.is_h2c_upgrade();
+    events.push_back(os.str());
+  }
+
+  void handle() {
+    request req;
+    parser.to_request(req);
+    std::ostringstream os;
+    os << "message " << http_method_str(static_cast<http_method>(parser.method)) << " HTTP/" << parser.http_major << '.' << parser.http_minor
+       << ' ' << req.raw_url << " keep-alive " << http_should_keep_alive(&parser) << " upgrade " << parser.is_upgrade();
+    // header order matters too, so walk the views rather than the map
+    for (size_t i = 0;; i++) {
+      auto value = parser.get_header_value("x-order-" + std::to_string(i));
+      if (value.empty())
+        break;
+      os << " [" << value << ']';
+    }
+    std::vector<std::string> headers;
+    for (auto& kv : req.headers)
+      headers.push_back(kv.first + ": " + kv.second);
+    std::sort(headers.begin(), headers.end());
+    for (auto& h : headers)
+      os << '\n' << h;
+    os << "\nbody " << req.body;
+    events.push_back(os.str());
+  }
+
+  // Feeds `input' cut at `cuts', stopping at the first error like a connection would
+  void run(const std::string& input, const std::vector<size_t>& cuts) {
+    size_t pos = 0;
+    bool ok = true;
+    for (size_t cut : cuts) {
+      if (!(ok = parser.feed(input.data() + pos, static_cast<int>(cut - pos))))
+        break;
+      pos = cut;
+    }
+    if (ok && pos < input.size())
+      ok = parser.feed(input.data() + pos, static_cast<int>(input.size() - pos));
+    bool done = parser.done();
+    std::ostringstream os;
+    os << "end " << done << ' ' << http_errno_name(static_cast<http_errno>(parser.http_errno));
+    events.push_back(os.str());
+  }
+};
+
+std::vector<std::string> parse(const std::string& input, const std::vector<size_t>& cuts, bool simd) {
+  if (simd) {
+    recorder<simd_parser_backend> r;
+    r.run(input, cuts);
+    return r.events;
+  }
+  recorder<http_parser_backend> r;
+  r.run(input, cuts);
+  return r.events;
+}
+
+// Requests that are mostly well formed, with the odd corner http_parser accepts or rejects
+struct request_generator {
+  std::mt19937 rng;
+
+  explicit request_generator(unsigned seed) : rng(seed) {}
+
+  size_t below(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); }
+  bool one_in(size_t n) { return below(n) == 0; }
+
+  template <size_t N>
+  std::string pick(const char* const (&choices)[N]) { return choices[below(N)]; }
+
+  std::string random_chars(const std::string& alphabet, size_t max_size) {
+    std::string ret;
+    for (size_t n = below(max_size + 1); n; n--)
+      ret += alphabet[below(alphabet.size())];
+    return ret;
+  }
+
+  std::string eol() { return one_in(30) ? "\n" : "\r\n"; }
+
+  std::string message() {
+    static const char* const methods[] = {"GET", "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS", "PATCH",
+                                          "M-SEARCH", "PROPPATCH", "CONNECT", "get", "GETS", "FOO"};
+    static const char* const versions[] = {"HTTP/1.1", "HTTP/1.1", "HTTP/1.0", "HTTP/2.0", "HTTP/1.10", "HXTP/1.1", "HTTP/1."};
+    static const char* const names[] = {"Host", "Content-Length", "content-length", "Connection", "Proxy-Connection",
+                                        "Transfer-Encoding", "Upgrade", "Expect", "X-Custom", "Accept", "Bad Name",
+                                        "Conn", "Connectionx", "Cookie", "X-Order-0", "X-Order-1"};
+    static const char* const values[] = {"localhost", "keep-alive", "Keep-Alive  ", "close", "CLOSE\t", "upgrade",
+                                         "chunked", "h2c", "100-continue", "0", "5", "12", "1 2", "x5", "", " ",
+                                         "text/html, */*;q=0.8", "a=b; c=d", "\x01\x7f\xff"};
+    const std::string url_chars = "abcxyz019/-._~%?#&=+;:@!$'()*,[]";
+
+    std::string m = pick(methods);
+    m += one_in(20) ? "  " : " ";
+    if (one_in(20))
+      m += one_in(2) ? "*" : "http://example.com/x";
+    else
+      m += "/" + random_chars(url_chars + (one_in(10) ? std::string("\t \x80\x01") : ""), 24);
+    if (!one_in(30))
+      m += (one_in(20) ? "  " : " ") + pick(versions);
+    m += eol();
+
+    std::string body;
+    int content_length = -1;
+    bool chunked = false;
+    for (size_t n = below(8); n; n--) {
+      std::string name = pick(names);
+      std::string value = one_in(4) ? random_chars("abc XYZ,;=-\t", 12) : pick(values);
+      if (one_in(3) && (name == "Content-Length" || name == "content-length")) {
+        content_length = static_cast<int>(below(20));
+        value = std::to_string(content_length);
+      }
+      if (name == "Transfer-Encoding" && value == "chunked")
+        chunked = true;
+      m += name + (one_in(10) ? " :" : ":") + (one_in(5) ? "" : one_in(5) ? "  " : " ") + value + eol();
+      if (one_in(20))
+        m += " folded" + eol();
+    }
+    m += eol();
+
+    if (chunked) {
+      for (size_t n = below(3); n; n--) {
+        std::string chunk = random_chars("abcdef", 10);
+        std::ostringstream os;
+        os << std::hex << chunk.size() << "\r\n" << chunk << "\r\n";
+        body += os.str();
+      }
+      body += "0\r\n" + (one_in(4) ? std::string("Trailer: x\r\n") : "") + "\r\n";
+    } else if (content_length > 0) {
+      body = random_chars("abcdefgh\r\n", content_length);
+      body.resize(content_length, 'z');
+    }
+    return m + body;
+  }
+
+  std::string input() {
+    std::string ret = one_in(20) ? "\r\n" : "";
+    for (size_t n = 1 + below(3); n; n--)
+      ret += message();
+    // and sometimes a byte out of place
+    for (size_t n = one_in(3) ? 1 + below(3) : 0; n && !ret.empty(); n--) {
+      size_t at = below(ret.size());
+      switch (below(3)) {
+        case 0: ret[at] = static_cast<char>(below(256)); break;
+        case 1: ret.insert(ret.begin() + at, " \r\n:\t"[below(5)]); break;
+        case 2: ret.erase(at, 1); break;
+      }
+    }
+    return ret;
+  }
+
+  std::vector<size_t> cuts(size_t size) {
+    std::vector<size_t> ret;
+    if (one_in(4))
+      return ret;
+    for (size_t pos = 0;;) {
+      pos += 1 + below(one_in(2) ? 8 : 64);
+      if (pos >= size)
+        break;
+      ret.push_back(pos);
+    }
+    return ret;
+  }
+};
+}  // namespace
+
+TEST(parser, simpleRequest) {
+  std::string input = "GET /a/b?x=1 HTTP/1.1\r\nHost: localhost\r\nX-Order-0: first\r\n\r\n";
+  for (bool simd : {false, true}) {
+    auto events = parse(input, {}, simd);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0], "head 18446744073709551615 0 0");
+    EXPECT_EQ(events[1], "message GET HTTP/1.1 /a/b?x=1 keep-alive 1 upgrade 0 [first]\n"
+                         "Host: localhost\nX-Order-0: first\nbody ");
+    EXPECT_EQ(events[2], "end 1 HPE_OK");
+  }
+}
+
+TEST(parser, bodySpanningReads) {
+  std::string input = "POST /p HTTP/1.0\r\nConnection: Keep-Alive\r\nContent-Length: 11\r\n\r\nhello world";
+  for (bool simd : {false, true}) {
+    auto events = parse(input, {10, 50, 70}, simd);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[1], "message POST HTTP/1.0 /p keep-alive 1 upgrade 0\n"
+                         "Connection: Keep-Alive\nContent-Length: 11\nbody hello world");
+  }
+}
+
+TEST(parser, truncatedBody) {
+  std::string input = "POST /p HTTP/1.1\r\nContent-Length: 10\r\n\r\nhello";
+  EXPECT_EQ(parse(input, {}, false), parse(input, {}, true));
+  EXPECT_EQ(parse(input, {}, true).back(), "end 0 HPE_INVALID_EOF_STATE");
+}
+
+// The SIMD backend must not be told apart from http_parser, whatever the input and however it is cut
+TEST(parser, differentialFuzz) {
+  request_generator gen(20240601);
+  for (int i = 0; i < 20000; i++) {
+    std::string input = gen.input();
+    std::vector<size_t> cuts = gen.cuts(input.size());
+    auto expected = parse(input, cuts, false);
+    auto actual = parse(input, cuts, true);
+    ASSERT_EQ(expected, actual) << "input #" << i << ":\n" << input;
+  }
+}
@@ -4,6 +4,8 @@
 using namespace crow;
 
 #include <string>
+#include <thread>
+#include <vector>
 
 TEST(query_string, instantiate) {
   query_string qs;
@@ -76,3 +78,104 @@ TEST(query_string, assignmentOperatorMove) {
   ASSERT_EQ(qs.get("x"), std::string("1"));
   ASSERT_EQ(qs2.get("x"), nullptr);
 }
+
+TEST(query_string, copyAfterLookup) {
+  query_string qs("?x=a%20b");
+  ASSERT_EQ(qs.get("x"), std::string("a b"));
+
+  // values are decoded once, not again in the copy
+  query_string qs2(qs);
+  ASSERT_EQ(qs2.get("x"), std::string("a b"));
+
+  query_string qs3;
+  qs3 = qs;
+  ASSERT_EQ(qs3.get("x"), std::string("a b"));
+}
+
+TEST(query_string, moveCtor) {
+  query_string qs("?x=1&y=2");
+  ASSERT_EQ(qs.get("y"), std::string("2"));
+  query_string qs2(std::move(qs));
+  ASSERT_EQ(qs2.get("x"), std::string("1"));
+  ASSERT_EQ(qs2.get("y"), std::string("2"));
+  ASSERT_EQ(qs.get("x"), nullptr);
+}
+
+TEST(query_string, decoding) {
+  query_string qs("?a%20b=c+d&e=%41%42&bad=1%2&flag&empty=");
+  EXPECT_EQ(qs.get("a b"), std::string("c d"));
+  EXPECT_EQ(qs.get("a+b"), std::string("c d"));
+  EXPECT_EQ(qs.get("e"), std::string("AB"));
+  EXPECT_EQ(qs.get("bad"), std::string("1"));
+  EXPECT_EQ(qs.get("flag"), std::string(""));
+  EXPECT_EQ(qs.get("empty"), std::string(""));
+  EXPECT_EQ(qs.get("a"), nullptr);
+}
+
+TEST(query_string, fragment) {
+  query_string qs("?a=1#x&b=2");
+  EXPECT_EQ(qs.get("a"), std::string("1"));
+  EXPECT_EQ(qs.get("b"), nullptr);
+  EXPECT_EQ(qs.get("x"), nullptr);
+
+  query_string qs2("?a&b=2#c=3");
+  EXPECT_EQ(qs2.get("a"), std::string(""));
+  EXPECT_EQ(qs2.get("b"), std::string("2"));
+  EXPECT_EQ(qs2.get("c"), nullptr);
+}
+
+TEST(query_string, concurrentFirstLookup) {
+  std::string url = "?";
+  for (int i = 0; i < 200; ++i)
+    url += "k" + std::to_string(i) + "=" + std::to_string(i) + "&";
+  for (int round = 0; round < 20; ++round) {
+    query_string qs(url);
+    std::vector<int> wrong(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+      threads.emplace_back([&, t] {
+        for (int i = 0; i < 200; ++i)
+          wrong[t] += qs.get_int("k" + std::to_string(i), -1) != i;
+      });
+    for (auto& t : threads)
+      t.join();
+    for (int w : wrong)
+      EXPECT_EQ(w, 0);
+  }
+}
+
+TEST(query_string, repeatedKeys) {
+  query_string qs("?x=1&x=2&y[]=a&z=3&y[]=b");
+  EXPECT_EQ(qs.get("x"), std::string("1"));
+  const auto y = qs.get_list("y");
+  ASSERT_EQ(y.size(), 2);
+  EXPECT_EQ(y[0], std::string("a"));
+  EXPECT_EQ(y[1], std::string("b"));
+}
+
+TEST(query_string, manyKeys) {
+  std::string url = "?";
+  for (int i = 0; i < 100; ++i)
+    url += "k" + std::to_string(i) + "=" + std::to_string(i * 3) + "&";
+  query_string qs(url);
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(qs.get_int("k" + std::to_string(i)), i * 3);
+  EXPECT_EQ(qs.get("k100"), nullptr);
+}
+
+TEST(query_string, typedGetters) {
+  query_string qs("?i=-42&big=99999999999999999999&d=2.5&e=1e3&bad=12x&t=TRUE&f=off&on&u=maybe");
+  EXPECT_EQ(qs.get_int("i"), -42);
+  EXPECT_EQ(qs.get_int("big", 7), 7);
+  EXPECT_EQ(qs.get_int("bad", 7), 7);
+  EXPECT_EQ(qs.get_int("missing", 7), 7);
+  EXPECT_DOUBLE_EQ(qs.get_double("d"), 2.5);
+  EXPECT_DOUBLE_EQ(qs.get_double("e"), 1000.0);
+  EXPECT_DOUBLE_EQ(qs.get_double("bad", -1), -1);
+  EXPECT_TRUE(qs.get_bool("t"));
+  EXPECT_FALSE(qs.get_bool("f", true));
+  EXPECT_TRUE(qs.get_bool("on"));
+  EXPECT_TRUE(qs.get_bool("u", true));
+  EXPECT_FALSE(qs.get_bool("u"));
+  EXPECT_FALSE(qs.get_bool("missing"));
+}
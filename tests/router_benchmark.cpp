@@ -0,0 +1,77 @@
+// Route lookup benchmark: 10,000 routes mixing static and parametrized rules.
+// Not run by ctest; build the `router_benchmark' target and run it with an optimized build.
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "crow/routing.h"
+
+using namespace crow;
+
+int main(int argc, char** argv)
+{
+    const unsigned route_count = 10000;
+    const unsigned rounds = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    Trie trie;
+    std::vector<std::string> static_hits;
+    std::vector<std::string> param_hits;
+    std::vector<std::string> misses;
+
+    // rule indices 0 and 1 are reserved by the router
+    unsigned rule_index = 2;
+    for(unsigned i = 0; rule_index < route_count + 2; i ++)
+    {
+        std::string group = "/api/v" + std::to_string(i % 4) + "/group" + std::to_string(i / 40);
+        std::string resource = group + "/resource" + std::to_string(i);
+
+        trie.add(resource, rule_index++, HTTPMethod::Get);
+        trie.add(resource + "/<int>", rule_index, HTTPMethod::Get);
+        trie.add(resource + "/<int>", rule_index, HTTPMethod::Put);
+        trie.add(resource + "/<int>", rule_index++, HTTPMethod::Delete);
+        trie.add(resource + "/<int>/items/<string>", rule_index++, HTTPMethod::Get);
+        trie.add("/users" + std::to_string(i) + "/<string>/profile", rule_index++, HTTPMethod::Get);
+
+        static_hits.push_back(resource);
+        param_hits.push_back(resource + "/" + std::to_string(i * 7));
+        param_hits.push_back(resource + "/" + std::to_string(i) + "/items/name" + std::to_string(i));
+        param_hits.push_back("/users" + std::to_string(i) + "/someone/profile");
+        misses.push_back(resource + "/x");
+        misses.push_back("/users" + std::to_string(i) + "/someone/settings");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    trie.validate();
+    auto built = std::chrono::steady_clock::now();
+    std::cout << rule_index - 2 << " routes compiled in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(built - start).count() << " ms" << std::endl;
+
+    auto run = [&](const char* name, const std::vector<std::string>& urls, bool expect_match)
+    {
+        unsigned long long matched = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for(unsigned r = 0; r < rounds; r ++)
+        {
+            for(auto& url : urls)
+            {
+                routing_params params;
+                matched += trie.find(url, HTTPMethod::Get, params) != 0;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        unsigned long long lookups = (unsigned long long)urls.size() * rounds;
+        std::cout << name << ": " << lookups << " lookups, " << ns / lookups << " ns/lookup" << std::endl;
+        if (matched != (expect_match ? lookups : 0))
+        {
+            std::cerr << name << ": unexpected match count " << matched << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    bool ok = run("static hits", static_hits, true);
+    ok = run("parametrized hits", param_hits, true) && ok;
+    ok = run("misses", misses, false) && ok;
+    return ok ? 0 : 1;
+}
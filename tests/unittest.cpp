@@ -168,6 +168,17 @@ TEST(PathRouting)
     }
 }
 
+TEST(route_parameter_limit)
+{
+    // routes are refused when added, rather than overflowing routing_params while serving
+    Trie trie;
+    std::string url;
+    for(unsigned i = 0; i < routing_params::capacity; i ++)
+        url += "/<int>";
+    trie.add(url, 1, HTTPMethod::Get);
+    ASSERT_THROW(trie.add(url + "/<string>", 2, HTTPMethod::Get));
+}
+
 TEST(RoutingTest)
 {
     SimpleApp app;
@@ -275,18 +286,102 @@ TEST(RoutingTest)
     }
 }
 
+TEST(RoutingPriority)
+{
+    SimpleApp app;
+    string matched;
+
+    CROW_ROUTE(app, "/a/<int>")
+    ([&](int){ matched = "int"; return ""; });
+    CROW_ROUTE(app, "/a/<string>")
+    ([&](string){ matched = "string"; return ""; });
+    CROW_ROUTE(app, "/abc")
+    ([&]{ matched = "abc"; return ""; });
+    CROW_ROUTE(app, "/abd")
+    ([&]{ matched = "abd"; return ""; });
+    CROW_ROUTE(app, "/ab/<uint>")
+    ([&](uint32_t){ matched = "ab"; return ""; });
+    CROW_ROUTE(app, "/x/<path>")
+    ([&](string){ matched = "path"; return ""; });
+    CROW_ROUTE(app, "/x/y")
+    ([&]{ matched = "y"; return ""; });
+    CROW_ROUTE(app, "/x/y/<int>/z")
+    ([&](int){ matched = "z"; return ""; });
+
+    app.validate();
+
+    auto get = [&](const string& url)
+    {
+        request req;
+        response res;
+        req.url = url;
+        matched.clear();
+        app.handle(req, res);
+        return res.code == 200 ? matched : to_string(res.code);
+    };
+
+    // the rule registered first wins when several match
+    ASSERT_EQUAL("int", get("/a/5"));
+    ASSERT_EQUAL("string", get("/a/x"));
+    ASSERT_EQUAL("string", get("/a/5x"));
+    ASSERT_EQUAL("abc", get("/abc"));
+    ASSERT_EQUAL("abd", get("/abd"));
+    ASSERT_EQUAL("ab", get("/ab/7"));
+    ASSERT_EQUAL("404", get("/ab"));
+    ASSERT_EQUAL("404", get("/abe"));
+    ASSERT_EQUAL("path", get("/x/y"));
+    ASSERT_EQUAL("path", get("/x/y/1/z"));
+    ASSERT_EQUAL("404", get("/x/"));
+}
+
+TEST(StaticRouteTable)
+{
+    SimpleApp app;
+    string matched;
+
+    CROW_ROUTE(app, "/healthz")
+    ([&]{ matched = "healthz"; return ""; });
+    CROW_ROUTE(app, "/v1/<string>")
+    ([&](string s){ matched = "v1 " + s; return ""; });
+    CROW_ROUTE(app, "/v1/config")
+    ([&]{ matched = "config"; return ""; });
+    CROW_ROUTE(app, "/metrics/")
+    ([&]{ matched = "metrics"; return ""; });
+
+    app.validate();
+
+    auto get = [&](const string& url)
+    {
+        request req;
+        response res;
+        req.url = url;
+        matched.clear();
+        app.handle(req, res);
+        return res.code == 200 ? matched : to_string(res.code);
+    };
+
+    ASSERT_EQUAL("healthz", get("/healthz"));
+    ASSERT_EQUAL("404", get("/healthz/"));
+    ASSERT_EQUAL("404", get("/health"));
+    // an earlier parametrized rule still takes precedence over a static one
+    ASSERT_EQUAL("v1 config", get("/v1/config"));
+    ASSERT_EQUAL("metrics", get("/metrics/"));
+    ASSERT_EQUAL("301", get("/metrics"));
+}
+
 TEST(simple_response_routing_params)
 {
     ASSERT_EQUAL(100, response(100).code);
     ASSERT_EQUAL(200, response("Hello there").code);
     ASSERT_EQUAL(500, response(500, "Internal Error?").code);
 
+    std::string url = "1/5/2/3/hello";
     routing_params rp;
-    rp.int_params.push_back(1);
-    rp.int_params.push_back(5);
-    rp.uint_params.push_back(2);
-    rp.double_params.push_back(3);
-    rp.string_params.push_back("hello");
+    rp.push(ParamType::INT, url.data(), 1);
+    rp.push(ParamType::INT, url.data()+2, 1);
+    rp.push(ParamType::UINT, url.data()+4, 1);
+    rp.push(ParamType::DOUBLE, url.data()+6, 1);
+    rp.push(ParamType::STRING, url.data()+8, 5);
     ASSERT_EQUAL(1, rp.get<int64_t>(0));
     ASSERT_EQUAL(5, rp.get<int64_t>(1));
     ASSERT_EQUAL(2, rp.get<uint64_t>(0));
@@ -335,6 +430,16 @@ TEST(http_method)
     ([](const request& /*req*/){
         return "purge";
     });
+    CROW_ROUTE(app, "/m/<path>")
+        .methods("GET"_method)
+    ([](const request& /*req*/, string){
+        return "path";
+    });
+    CROW_ROUTE(app, "/m/y")
+        .methods("POST"_method)
+    ([](const request& /*req*/){
+        return "y";
+    });
 
     app.validate();
     app.debug_print();
@@ -406,6 +511,52 @@ TEST(http_method)
         app.handle(req, res);
 
         ASSERT_NOTEQUAL("get", res.body);
+        ASSERT_EQUAL(405, res.code);
+        ASSERT_EQUAL("GET", res.get_header_value("Allow"));
+    }
+
+    {
+        request req;
+        response res;
+
+        req.url = "/";
+        req.method = "PUT"_method;
+        app.handle(req, res);
+
+        ASSERT_EQUAL(405, res.code);
+        ASSERT_EQUAL("GET, POST", res.get_header_value("Allow"));
+    }
+
+    {
+        request req;
+        response res;
+
+        req.url = "/no_such_url";
+        req.method = "POST"_method;
+        app.handle(req, res);
+
+        ASSERT_EQUAL(404, res.code);
+    }
+
+    {
+        request req;
+        response res;
+
+        req.url = "/m/y";
+        req.method = "POST"_method;
+        app.handle(req, res);
+        ASSERT_EQUAL("y", res.body);
+
+        response res2;
+        req.method = "GET"_method;
+        app.handle(req, res2);
+        ASSERT_EQUAL("path", res2.body);
+
+        response res3;
+        req.method = "PUT"_method;
+        app.handle(req, res3);
+        ASSERT_EQUAL(405, res3.code);
+        ASSERT_EQUAL("GET, POST", res3.get_header_value("Allow"));
     }
 
 }
@@ -673,6 +824,40 @@ TEST(json_copy_r_to_w_to_r)
   ASSERT_EQUAL("other", x["obj"]["other"].key());
 }
 
+TEST(json_writer_response)
+{
+    static char buf[2048];
+
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/list")
+    ([](const request&, response& res){
+        auto w = res.write_json();
+        w.begin_list();
+        for(int i = 0; i < 3; i ++)
+            w.begin_object().key("n").value(i).end_object();
+        w.end_list();
+        res.end();
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    std::string sendmsg = "GET /list HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        std::string response(buf, received);
+        ASSERT_TRUE(response.find("Content-Type: application/json\r\n") != std::string::npos);
+        std::string body = R"([{"n":0},{"n":1},{"n":2}])";
+        ASSERT_EQUAL(body, response.substr(response.size() - body.size()));
+        c.close();
+    }
+    app.stop();
+}
+
 TEST(template_basic)
 {
     auto t = crow::mustache::compile(R"---(attack of {{name}})---");
@@ -970,6 +1155,60 @@ TEST(middleware_cookieparser)
     app.stop();
 }
 
+// adds headers after CookieParser has run, moving the ones already stored
+struct HeaderAddingMW
+{
+    struct context {};
+    void before_handle(request& req, response&, context&)
+    {
+        req.add_header("Accept", "*/*");
+        for(int i = 0; i < 40; i ++)
+            req.add_header("X-Extra-" + std::to_string(i), "overwritten?");
+    }
+
+    void after_handle(request&, response&, context&)
+    {
+    }
+};
+
+TEST(middleware_cookieparser_later_headers)
+{
+    static char buf[2048];
+
+    App<CookieParser, HeaderAddingMW> app;
+
+    std::string from_jar;
+    std::string from_get;
+    size_t jar_size = 0;
+
+    CROW_ROUTE(app, "/")([&](const request& req){
+        auto& ctx = app.get_context<CookieParser>(req);
+        jar_size = ctx.jar.size();
+        if (ctx.jar.count("key1"))
+            from_jar = ctx.jar.at("key1");
+        from_get = ctx.get_cookie("key2");
+        return "";
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    std::string sendmsg = "GET / HTTP/1.1\r\nHost: localhost\r\nAccept: text/html\r\nCookie: key1=value1; key2=value2\r\n\r\n";
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+        c.send(asio::buffer(sendmsg));
+
+        c.receive(asio::buffer(buf, 2048));
+        c.close();
+    }
+    ASSERT_EQUAL(2, jar_size);
+    ASSERT_EQUAL("value1", from_jar);
+    ASSERT_EQUAL("value2", from_get);
+    app.stop();
+}
+
 TEST(bug_quick_repeated_request)
 {
     static char buf[2048];
@@ -1010,6 +1249,488 @@ TEST(bug_quick_repeated_request)
     app.stop();
 }
 
+TEST(remote_ip_address)
+{
+    static char buf[2048];
+
+    SimpleApp app;
+
+    std::unique_ptr<request> saved;
+    CROW_ROUTE(app, "/ip")
+    ([&](const request& req){
+        // copies outlive the connection and still know the address
+        saved.reset(new request(req));
+        std::string ip = req.remoteIpAddress;
+        return ip;
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    std::string sendmsg = "GET /ip HTTP/1.0\r\n\r\n";
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        ASSERT_EQUAL("127.0.0.1", std::string(buf + received - 9, buf + received));
+        c.close();
+    }
+    app.stop();
+    ASSERT_TRUE(saved && saved->remoteIpAddress == "127.0.0.1");
+}
+
+struct RecordingParserHandler
+{
+    HTTPParser<RecordingParserHandler>* parser;
+    std::vector<request> requests;
+    int headers_seen{};
+
+    void handle_header()
+    {
+        headers_seen ++;
+    }
+
+    void handle()
+    {
+        requests.emplace_back();
+        parser->to_request(requests.back());
+    }
+};
+
+TEST(parser_views)
+{
+    std::string long_value(10000, 'x');
+    std::string input =
+        "POST /a/b?x=1 HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "X-Folded: one\r\n two\r\n"
+        "X-Empty:\r\n"
+        "X-Long: " + long_value + "\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"
+        "GET /second HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 3\r\n"
+        "\r\n"
+        "abc";
+
+    for(size_t step : {input.size(), size_t(1), size_t(7), size_t(100), size_t(4096)})
+    {
+        RecordingParserHandler handler;
+        HTTPParser<RecordingParserHandler> parser(&handler);
+        handler.parser = &parser;
+        for(size_t i = 0; i < input.size(); i += step)
+            ASSERT_TRUE(parser.feed(input.data() + i, std::min(step, input.size() - i)));
+
+        ASSERT_EQUAL(2, handler.headers_seen);
+        ASSERT_EQUAL(2u, handler.requests.size());
+        auto& first = handler.requests[0];
+        ASSERT_EQUAL("/a/b?x=1", first.raw_url);
+        ASSERT_EQUAL("/a/b", first.url);
+        ASSERT_EQUAL(std::string("1"), first.url_params.get("x"));
+        ASSERT_EQUAL("localhost", first.get_header_value("host"));
+        ASSERT_EQUAL("one two", first.get_header_value("x-folded"));
+        ASSERT_EQUAL(1u, first.headers.count("x-empty"));
+        ASSERT_EQUAL("", first.get_header_value("x-empty"));
+        ASSERT_EQUAL(long_value, first.get_header_value("x-long"));
+        ASSERT_EQUAL("hello world", first.body);
+        auto& second = handler.requests[1];
+        ASSERT_EQUAL("/second", second.url);
+        ASSERT_TRUE(second.url_params.get("x") == nullptr);
+        ASSERT_EQUAL("example.com", second.get_header_value("Host"));
+        ASSERT_EQUAL(2u, second.headers.size());
+        ASSERT_EQUAL("abc", second.body);
+    }
+}
+
+TEST(client_disconnect)
+{
+    SimpleApp app;
+
+    std::atomic<bool> disconnected(false);
+
+    CROW_ROUTE(app, "/slow")
+    ([&](const request&, response& res){
+        // never completes on its own; only the disconnect notification ends it
+        res.on_disconnect([&]{
+            disconnected = true;
+            res.end();
+        });
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    // kept alive, and closed after the response
+    for(std::string sendmsg : {"GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n", "GET /slow HTTP/1.0\r\n\r\n"})
+    {
+        disconnected = false;
+        asio::io_service is;
+        {
+            asio::ip::tcp::socket c(is);
+            c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+            c.send(asio::buffer(sendmsg));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            c.close();
+        }
+        for(int i = 0; i < 100 && !disconnected; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ASSERT_TRUE(disconnected);
+    }
+    app.stop();
+}
+
+TEST(async_handler_deadline)
+{
+    SimpleApp app;
+
+    std::atomic<bool> cancelled(false);
+
+    CROW_ROUTE(app, "/stuck")
+    ([&](const request&, response& res){
+        // never completes on its own; the connection deadline gives up on it
+        res.on_disconnect([&]{
+            cancelled = true;
+            res.end();
+        });
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    std::string sendmsg = "GET /stuck HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        // the client stays connected; the server closes the connection
+        char buf[64];
+        boost::system::error_code ec;
+        c.receive(asio::buffer(buf), 0, ec);
+        ASSERT_TRUE(ec == asio::error::eof || ec == asio::error::connection_reset);
+        c.close();
+    }
+    for(int i = 0; i < 100 && !cancelled; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(cancelled);
+    app.stop();
+}
+
+TEST(detached_response)
+{
+    static char buf[2048];
+
+    SimpleApp app;
+
+    std::vector<std::thread> workers;
+
+    CROW_ROUTE(app, "/detach")
+    ([&](const request&, response& res){
+        workers.emplace_back([](DetachHelper detached) {
+            detached.res().code = 201;
+            detached.res().write("from worker");
+            detached.end();
+        }, res.detach());
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    std::string sendmsg = "GET /detach HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        c.close();
+
+        std::string response(buf, received);
+        ASSERT_EQUAL("HTTP/1.1 201", response.substr(0, 12));
+        ASSERT_EQUAL("from worker", response.substr(response.size() - 11));
+    }
+    app.stop();
+    for(auto& worker : workers)
+        worker.join();
+}
+
+TEST(detached_response_late_end)
+{
+    static char buf[2048];
+
+    SimpleApp app;
+
+    std::mutex mutex;
+    std::vector<DetachHelper> helpers;
+
+    CROW_ROUTE(app, "/throw")
+    ([&](const request&, response& res){
+        std::lock_guard<std::mutex> lock(mutex);
+        helpers.push_back(res.detach());
+        throw std::runtime_error("thrown after detaching");
+    });
+    CROW_ROUTE(app, "/wait")
+    ([&](const request&, response& res){
+        std::lock_guard<std::mutex> lock(mutex);
+        helpers.push_back(res.detach());
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(std::string("GET /throw HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        ASSERT_EQUAL("HTTP/1.1 500", std::string(buf, 12));
+
+        c.send(asio::buffer(std::string("GET /wait HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ASSERT_EQUAL(2u, helpers.size());
+            // belongs to the exchange that already ended with the 500; writing to its own
+            // response leaves the current exchange alone
+            helpers[0].res().code = 201;
+            helpers[0].res().write("late");
+            helpers[0].end();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            helpers[1].end(response(202, "current"));
+            // a helper ends its response once
+            helpers[1].end(response(203, "twice"));
+        }
+        received = c.receive(asio::buffer(buf, 2048));
+        std::string response(buf, received);
+        ASSERT_EQUAL("HTTP/1.1 202", response.substr(0, 12));
+        ASSERT_EQUAL("current", response.substr(response.size() - 7));
+        c.close();
+    }
+    app.stop();
+}
+
+struct http2_test_response
+{
+    std::string status;
+    std::string body;
+};
+
+// Reads frames until `stream_count' streams have ended; `in' holds bytes already received.
+std::map<uint32_t, http2_test_response> read_http2_responses(asio::ip::tcp::socket& c, std::string in, size_t stream_count)
+{
+    std::map<uint32_t, http2_test_response> ret;
+    http2::hpack::decoder decoder;
+    size_t ended = 0;
+    char buf[4096];
+    while (ended < stream_count)
+    {
+        if (in.size() >= http2::frame_header_size)
+        {
+            auto h = http2::parse_frame_header(in.data());
+            if (in.size() >= http2::frame_header_size + h.length)
+            {
+                std::string payload = in.substr(http2::frame_header_size, h.length);
+                in.erase(0, http2::frame_header_size + h.length);
+                if (h.type == http2::frame_type::headers)
+                {
+                    http2::hpack::header_list headers;
+                    decoder.decode(payload.data(), payload.size(), headers);
+                    ret[h.stream_id].status = headers.at(0).second;
+                }
+                else if (h.type == http2::frame_type::data)
+                    ret[h.stream_id].body += payload;
+                else
+                    continue;
+                if (h.flags & http2::flags::end_stream)
+                    ended ++;
+                continue;
+            }
+        }
+        size_t received = c.receive(asio::buffer(buf, sizeof(buf)));
+        in.append(buf, received);
+    }
+    return ret;
+}
+
+std::string http2_request(http2::hpack::encoder& encoder, uint32_t stream_id, const std::string& method, const std::string& path, const std::string& body = "")
+{
+    std::string block;
+    encoder.encode({{":method", method}, {":scheme", "http"}, {":path", path}, {":authority", "localhost"}}, block);
+    std::string ret;
+    http2::append_frame_header(ret, block.size(), http2::frame_type::headers, http2::flags::end_headers | (body.empty() ? http2::flags::end_stream : 0), stream_id);
+    ret += block;
+    if (!body.empty())
+    {
+        http2::append_frame_header(ret, body.size(), http2::frame_type::data, http2::flags::end_stream, stream_id);
+        ret += body;
+    }
+    return ret;
+}
+
+TEST(http2_prior_knowledge)
+{
+    SimpleApp app;
+
+    std::vector<std::thread> workers;
+
+    CROW_ROUTE(app, "/double/<int>")
+    ([](int x){
+        return std::to_string(x*2);
+    });
+
+    CROW_ROUTE(app, "/echo").methods("POST"_method)
+    ([](const request& req){
+        return response(201, req.body);
+    });
+
+    // completes after the others, so responses go out of order
+    CROW_ROUTE(app, "/slow")
+    ([&](const request&, response& res){
+        workers.emplace_back([](DetachHelper detached) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            detached.end(response("slow"));
+        }, res.detach());
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+        http2::hpack::encoder encoder;
+        std::string sendmsg(http2::client_preface, http2::client_preface_size);
+        http2::append_frame_header(sendmsg, 0, http2::frame_type::settings, 0, 0);
+        sendmsg += http2_request(encoder, 1, "GET", "/slow");
+        sendmsg += http2_request(encoder, 3, "GET", "/double/21");
+        sendmsg += http2_request(encoder, 5, "POST", "/echo", "hello");
+        sendmsg += http2_request(encoder, 7, "GET", "/missing");
+        c.send(asio::buffer(sendmsg));
+
+        auto responses = read_http2_responses(c, "", 4);
+        c.close();
+
+        ASSERT_EQUAL("200", responses[1].status);
+        ASSERT_EQUAL("slow", responses[1].body);
+        ASSERT_EQUAL("200", responses[3].status);
+        ASSERT_EQUAL("42", responses[3].body);
+        ASSERT_EQUAL("201", responses[5].status);
+        ASSERT_EQUAL("hello", responses[5].body);
+        ASSERT_EQUAL("404", responses[7].status);
+    }
+    app.stop();
+    for(auto& worker : workers)
+        worker.join();
+}
+
+TEST(http2_upgrade)
+{
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/h2c")
+    ([](const request& req){
+        return req.url + " " + req.get_header_value("host");
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    asio::io_service is;
+    {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+        std::string sendmsg = "GET /h2c HTTP/1.1\r\nHost: localhost\r\nConnection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAoAAAAAIAAAAA\r\n\r\n";
+        c.send(asio::buffer(sendmsg));
+
+        std::string in;
+        char buf[2048];
+        while (in.find("\r\n\r\n") == std::string::npos)
+        {
+            size_t received = c.receive(asio::buffer(buf, sizeof(buf)));
+            in.append(buf, received);
+        }
+        ASSERT_EQUAL("HTTP/1.1 101", in.substr(0, 12));
+        in.erase(0, in.find("\r\n\r\n") + 4);
+
+        http2::hpack::encoder encoder;
+        sendmsg.assign(http2::client_preface, http2::client_preface_size);
+        http2::append_frame_header(sendmsg, 0, http2::frame_type::settings, 0, 0);
+        sendmsg += http2_request(encoder, 3, "GET", "/h2c");
+        c.send(asio::buffer(sendmsg));
+
+        auto responses = read_http2_responses(c, in, 2);
+        c.close();
+
+        ASSERT_EQUAL("200", responses[1].status);
+        ASSERT_EQUAL("/h2c localhost", responses[1].body);
+        ASSERT_EQUAL("/h2c localhost", responses[3].body);
+    }
+    app.stop();
+}
+
+#ifdef CROW_CAN_USE_COROUTINES
+crow::task<int> coroutine_add(int a, int b)
+{
+    co_return a + b;
+}
+
+TEST(coroutine_handler)
+{
+    static char buf[2048];
+
+    SimpleApp app;
+
+    asio::io_service pool;
+    auto work = std::make_shared<asio::io_service::work>(pool);
+    std::thread pool_thread([&]{ pool.run(); });
+
+    CROW_ROUTE(app, "/coro/<int>")
+    ([&](const request& req, int x) -> crow::task<crow::response> {
+        co_await crow::sleep_for(*req.io_service, std::chrono::milliseconds(10));
+        int sum = co_await coroutine_add(x, 1);
+        auto offloaded_on = co_await crow::offload(pool, *req.io_service, []{ return std::this_thread::get_id(); });
+        if (offloaded_on == std::this_thread::get_id())
+            throw std::runtime_error("offload should run on the pool");
+        co_return crow::response(std::to_string(sum));
+    });
+
+    CROW_ROUTE(app, "/coro_throw")
+    ([]() -> crow::task<crow::response> {
+        throw std::runtime_error("failure");
+        co_return crow::response("unreachable");
+    });
+
+    auto _ = async(launch::async, [&]{app.bindaddr(LOCALHOST_ADDRESS).port(45451).run();});
+    app.wait_for_server_start();
+    asio::io_service is;
+    {
+        std::string sendmsg = "GET /coro/41 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        c.close();
+        ASSERT_EQUAL("42", std::string(buf + received - 2, buf + received));
+    }
+    {
+        std::string sendmsg = "GET /coro_throw HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(sendmsg));
+        size_t received = c.receive(asio::buffer(buf, 2048));
+        c.close();
+        ASSERT_EQUAL("HTTP/1.1 500", std::string(buf, buf + std::min<size_t>(received, 12)));
+    }
+    app.stop();
+    work.reset();
+    pool_thread.join();
+}
+#endif
+
 TEST(simple_url_params)
 {
     static char buf[2048];
@@ -1192,6 +1913,18 @@ TEST(route_dynamic)
     {
     }
 
+    // nothing was published
+    {
+        request req;
+        response res;
+        req.url = "/";
+        app.handle(req, res);
+        ASSERT_EQUAL(404, res.code);
+        ASSERT_EQUAL(x, 1);
+    }
+
+    ASSERT_TRUE(app.remove_route("/invalid_test/<double>/<path>"));
+
     {
         request req;
         response res;
@@ -1222,6 +1955,133 @@ TEST(route_dynamic)
     }
 }
 
+TEST(route_runtime_changes)
+{
+    SimpleApp app;
+    app.route_dynamic("/a")
+    ([]{
+        return "a";
+    });
+    app.validate();
+
+    auto get = [&](const string& url)
+    {
+        request req;
+        response res;
+        req.url = url;
+        app.handle(req, res);
+        return res.code;
+    };
+
+    ASSERT_EQUAL(200, get("/a"));
+    ASSERT_EQUAL(404, get("/b"));
+
+    app.route_dynamic("/b")
+    ([]{
+        return "b";
+    });
+    // not served until published
+    ASSERT_EQUAL(404, get("/b"));
+    app.validate();
+    ASSERT_EQUAL(200, get("/b"));
+
+    ASSERT_TRUE(app.remove_route("/a"));
+    ASSERT_TRUE(!app.remove_route("/a"));
+    ASSERT_EQUAL(404, get("/a"));
+    ASSERT_EQUAL(200, get("/b"));
+
+    // a bad addition keeps the table that is already published
+    try
+    {
+        app.route_dynamic("/bad/<int>")
+        ([]{
+            return "";
+        });
+    }
+    catch(std::exception&)
+    {
+    }
+    ASSERT_THROW(app.validate());
+    ASSERT_EQUAL(200, get("/b"));
+    ASSERT_EQUAL(404, get("/bad/1"));
+    ASSERT_TRUE(app.remove_route("/bad/<int>"));
+
+    // a removed rule is freed, but not before the responses it left open have ended
+    {
+        std::weak_ptr<int> watched;
+        std::vector<DetachHelper> pending;
+        {
+            auto token = std::make_shared<int>(1);
+            watched = token;
+            app.route_dynamic("/sync")
+            ([token]{
+                return "";
+            });
+            app.route_dynamic("/later")
+            ([token, &pending](const request&, response& res){
+                pending.push_back(res.detach());
+            });
+        }
+        app.validate();
+        ASSERT_EQUAL(200, get("/sync"));
+        request req;
+        req.url = "/later";
+        response res;
+        app.handle(req, res);
+        ASSERT_TRUE(!res.is_completed());
+
+        ASSERT_TRUE(app.remove_route("/sync"));
+        ASSERT_TRUE(app.remove_route("/later"));
+        ASSERT_TRUE(!watched.expired());
+        pending[0].res().code = 202;
+        pending[0].end();
+        ASSERT_EQUAL(202, res.code);
+        ASSERT_TRUE(watched.expired());
+    }
+
+    // a handler can change the routes it is served from
+    app.route_dynamic("/once")
+    ([&]{
+        app.remove_route("/once");
+        return "once";
+    });
+    app.validate();
+    ASSERT_EQUAL(200, get("/once"));
+    ASSERT_EQUAL(404, get("/once"));
+
+    // lookups keep working while rules come and go
+    std::atomic<bool> done{false};
+    std::atomic<int> unexpected{0};
+    std::vector<std::thread> readers;
+    for(int i = 0; i < 4; i ++)
+    {
+        readers.emplace_back([&]{
+            while (!done)
+            {
+                if (get("/b") != 200)
+                    unexpected ++;
+                int code = get("/c/42");
+                if (code != 200 && code != 404)
+                    unexpected ++;
+            }
+        });
+    }
+    for(int i = 0; i < 200; i ++)
+    {
+        app.route_dynamic("/c/<int>")
+        ([](int x){
+            return std::to_string(x);
+        });
+        app.validate();
+        app.remove_route("/c/<int>");
+    }
+    done = true;
+    for(auto& t : readers)
+        t.join();
+    ASSERT_EQUAL(0, unexpected.load());
+    ASSERT_EQUAL(404, get("/c/42"));
+}
+
 int main()
 {
     return testmain();